@@ -139,9 +139,11 @@ struct active_service {
 	event_handle_t *ev_read;	/* it's read event handle */
 	event_handle_t *ev_write;	/* it's write event handle */
 	security_stream_t *netfd;	/* stream to amanda server */
+	int splice_fd;			/* netfd's socket, to splice into */
 	struct active_service *as;	/* pointer back to our enclosure */
     } data[DATA_FD_COUNT];
-    char databuf[NETWORK_BLOCK_BYTES];	/* buffer to relay netfd data in */
+    char *databuf;			/* buffer to relay netfd data in */
+    size_t databufsize;			/* length of databuf */
 };
 
 /*
@@ -1150,6 +1152,12 @@ s_ackwait(
 	    continue;
 	}
 
+#ifdef HAVE_SPLICE
+	/* if the stream is a plain socket, relay the data into it with
+	 * splice(2), so that it is never copied through amandad */
+	dh->splice_fd = security_stream_fd(dh->netfd);
+#endif
+
 	/* setup an event for reads from it.  As a special case, don't start
 	 * listening on as->data[0] until we read some data on another fd, if
 	 * the service is sendbackup.  This ensures that we send a MESG or 
@@ -1175,6 +1183,7 @@ s_ackwait(
 	if (security_stream_auth(dh->netfd) < 0) {
 	    security_stream_close(dh->netfd);
 	    dh->netfd = NULL;
+	    dh->splice_fd = -1;
 	    event_release(dh->ev_read);
 	    event_release(dh->ev_write);
 	    dh->ev_read = NULL;
@@ -1346,10 +1355,61 @@ process_readnetfd(
 
     nak.body = NULL;
 
+#ifdef HAVE_SPLICE
+    /* The MESG fd of sendbackup is scanned for "sendbackup info end"
+     * below, so it has to be read until that is seen. */
+    if (dh->splice_fd >= 0 &&
+	!(as->service == SERVICE_SENDBACKUP && !as->seen_info_end &&
+	  dh == &as->data[1])) {
+	do {
+	    n = splice(dh->fd_read, NULL, dh->splice_fd, NULL,
+		       as->databufsize, SPLICE_F_MOVE | SPLICE_F_MORE);
+	} while ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)));
+
+	if (n > 0)
+	    return;
+	if (n == 0)
+	    goto closed;
+
+	/* EINVAL means the kernel can't splice into this socket; anything
+	 * else means one end or the other is broken */
+	if (errno != EINVAL) {
+	    pkt_init(&nak, P_NAK,
+		_("ERROR relay from data descriptor %d to stream %d failed: %s\n"),
+		dh->fd_read, security_stream_id(dh->netfd), strerror(errno));
+	    goto sendnak;
+	}
+	dbprintf(_("can't splice into stream %d, copying instead: %s\n"),
+		 security_stream_id(dh->netfd), strerror(errno));
+	dh->splice_fd = -1;
+    }
+#endif
+
     do {
-	n = read(dh->fd_read, as->databuf, SIZEOF(as->databuf));
+	n = read(dh->fd_read, as->databuf, as->databufsize);
     } while ((n < 0) && ((errno == EINTR) || (errno == EAGAIN)));
 
+    /* A pipe gives us at most a pipe-buffer at a time; keep reading
+     * whatever is already there, so that it goes out as one large block
+     * instead of many small ones.  An error or EOF here shows up again on
+     * the next call. */
+    while (n > 0 && (size_t)n < as->databufsize) {
+	SELECT_ARG_TYPE readset;
+	struct timeval  tv;
+	ssize_t         n1;
+
+	memset(&tv, 0, SIZEOF(tv));
+	FD_ZERO(&readset);
+	FD_SET(dh->fd_read, &readset);
+	if (select(dh->fd_read+1, &readset, NULL, NULL, &tv) <= 0 ||
+	    !FD_ISSET(dh->fd_read, &readset))
+	    break;
+	n1 = read(dh->fd_read, as->databuf + n, as->databufsize - (size_t)n);
+	if (n1 <= 0)
+	    break;
+	n += n1;
+    }
+
     /*
      * Process has died.
      */
@@ -1363,6 +1423,9 @@ process_readnetfd(
      * If all pipes are closed, shut down this service.
      */
     if (n == 0) {
+#ifdef HAVE_SPLICE
+closed:
+#endif
 	event_release(dh->ev_read);
 	dh->ev_read = NULL;
 	if(dh->ev_write == NULL) {
@@ -1552,7 +1615,9 @@ service_new(
 	as->seen_info_end = FALSE;
 	/* fill in info_end_buf with non-null characters */
 	memset(as->info_end_buf, '-', sizeof(as->info_end_buf));
-	if(service == SERVICE_SENDSIZE) {
+	as->databufsize = NETWORK_BLOCK_BYTES;
+	if((service == SERVICE_SENDSIZE || service == SERVICE_SENDBACKUP) &&
+	   strncmp_const(as->arguments, "OPTIONS ") == 0) {
 	    g_option_t *g_options;
 	    char *option_str, *p;
 
@@ -1561,12 +1626,19 @@ service_new(
 	    if(p) *p = '\0';
 
 	    g_options = parse_g_options(option_str, 1);
-	    if(am_has_feature(g_options->features, fe_partial_estimate)) {
+	    if(service == SERVICE_SENDSIZE &&
+	       am_has_feature(g_options->features, fe_partial_estimate)) {
 		as->send_partial_reply = 1;
 	    }
+	    /* relay the dump in larger blocks if the server can take them */
+	    if(service == SERVICE_SENDBACKUP &&
+	       am_has_feature(g_options->features, fe_large_network_blocks)) {
+		as->databufsize = NETWORK_BLOCK_BYTES_LARGE;
+	    }
 	    free_g_options(g_options);
 	    amfree(option_str);
 	}
+	as->databuf = alloc(as->databufsize);
 
 	/* write to the request pipe */
 	aclose(data_read[0][0]);
@@ -1604,6 +1676,7 @@ service_new(
 	    as->data[i].ev_read = NULL;
 	    as->data[i].ev_write = NULL;
 	    as->data[i].netfd = NULL;
+	    as->data[i].splice_fd = -1;
 	    as->data[i].as = as;
 	}
 
@@ -1735,6 +1808,8 @@ service_delete(
     assert(as->arguments != NULL);
     amfree(as->arguments);
 
+    amfree(as->databuf);
+
     if (as->reqfd != -1)
 	aclose(as->reqfd);
     if (as->repfd != -1)
@@ -1004,6 +1004,160 @@ test_pipe(void)
     return 1;
 }
 
+/* write an archive with interleaved files to a seekable file, then read
+ * single files from it using the index */
+static int
+test_index(void)
+{
+    int fd;
+    amar_t *arch = NULL;
+    amar_file_t *af1 = NULL, *af2 = NULL, *af3 = NULL;
+    amar_attr_t *at = NULL;
+    GPtrArray *index = NULL;
+    amar_index_entry_t *entry;
+    GError *error = NULL;
+    gboolean ok;
+
+    fd = open_temp(1);
+    arch = amar_new(fd, O_WRONLY, &error);
+    check_gerror(arch, error, "amar_new");
+
+    af1 = amar_new_file(arch, "one", 0, NULL, &error);
+    check_gerror(af1, error, "amar_new_file");
+    af2 = amar_new_file(arch, "two", 0, NULL, &error);
+    check_gerror(af2, error, "amar_new_file");
+
+    at = amar_new_attr(af1, 20, &error);
+    check_gerror(at, error, "amar_new_attr");
+    ok = amar_attr_add_data_buffer(at, "uno", 3, 1, &error);
+    check_gerror(ok, error, "amar_attr_add_data_buffer");
+    at = amar_new_attr(af2, 20, &error);
+    check_gerror(at, error, "amar_new_attr");
+    ok = amar_attr_add_data_buffer(at, "dos", 3, 1, &error);
+    check_gerror(ok, error, "amar_attr_add_data_buffer");
+
+    ok = amar_file_close(af1, &error);
+    check_gerror(ok, error, "amar_file_close");
+
+    af3 = amar_new_file(arch, "three", 0, NULL, &error);
+    check_gerror(af3, error, "amar_new_file");
+    at = amar_new_attr(af3, 21, &error);
+    check_gerror(at, error, "amar_new_attr");
+    ok = amar_attr_add_data_buffer(at, "tres", 4, 1, &error);
+    check_gerror(ok, error, "amar_attr_add_data_buffer");
+
+    ok = amar_file_close(af2, &error);
+    check_gerror(ok, error, "amar_file_close");
+    ok = amar_file_close(af3, &error);
+    check_gerror(ok, error, "amar_file_close");
+
+    ok = amar_close(arch, &error);
+    check_gerror(ok, error, "amar_close");
+    close(fd);
+
+    /* a full read doesn't see the index */
+    {
+	amar_attr_handling_t handling[] = {
+	    { 0, 0, frag_cb, NULL },
+	};
+	expected_step_t steps[] = {
+	    EXPECT_START_FILE_STR(1, "one", 0),
+	    EXPECT_START_FILE_STR(2, "two", 0),
+	    EXPECT_ATTR_DATA_STR(1, 20, "uno", 1, 0),
+	    EXPECT_ATTR_DATA_STR(2, 20, "dos", 1, 0),
+	    EXPECT_FINISH_FILE(1, 0),
+	    EXPECT_START_FILE_STR(3, "three", 0),
+	    EXPECT_ATTR_DATA_STR(3, 21, "tres", 1, 0),
+	    EXPECT_FINISH_FILE(2, 0),
+	    EXPECT_FINISH_FILE(3, 0),
+	    EXPECT_END(),
+	};
+	try_reading(steps, handling);
+    }
+
+    fd = open_temp(0);
+    arch = amar_new(fd, O_RDONLY, &error);
+    check_gerror(arch, error, "amar_new");
+
+    ok = amar_read_index(arch, &index, &error);
+    check_gerror(ok, error, "amar_read_index");
+    if (!index || index->len != 3)
+	EXPECT_FAILURE("expected 3 index entries; got %d",
+		       index? (int)index->len : -1);
+    entry = g_ptr_array_index(index, 2);
+    if (entry->filenum != 3 || entry->filename_len != 5
+	    || memcmp(entry->filename_buf, "three", 5) != 0)
+	EXPECT_FAILURE("bad index entry for 'three': filenum %d",
+		       (int)entry->filenum);
+
+    /* read the second file alone, skipping the first one's records */
+    {
+	amar_attr_handling_t handling[] = {
+	    { 0, 0, frag_cb, NULL },
+	};
+	expected_step_t steps[] = {
+	    EXPECT_START_FILE_STR(2, "two", 0),
+	    EXPECT_ATTR_DATA_STR(2, 20, "dos", 1, 0),
+	    EXPECT_FINISH_FILE(2, 0),
+	    EXPECT_END(),
+	};
+	expected_state_t state = { steps, 0 };
+
+	ok = amar_read_file(arch, g_ptr_array_index(index, 1), &state,
+			    handling, file_start_cb, file_finish_cb, &error);
+	check_gerror(ok, error, "amar_read_file");
+	if (steps[state.curstep].kind != EXP_END)
+	    EXPECT_FAILURE("Stopped reading early at step %d", state.curstep);
+    }
+
+    /* and the third, which was started after the first one closed */
+    {
+	amar_attr_handling_t handling[] = {
+	    { 0, 0, frag_cb, NULL },
+	};
+	expected_step_t steps[] = {
+	    EXPECT_START_FILE_STR(3, "three", 0),
+	    EXPECT_ATTR_DATA_STR(3, 21, "tres", 1, 0),
+	    EXPECT_FINISH_FILE(3, 0),
+	    EXPECT_END(),
+	};
+	expected_state_t state = { steps, 0 };
+
+	ok = amar_read_file(arch, entry, &state,
+			    handling, file_start_cb, file_finish_cb, &error);
+	check_gerror(ok, error, "amar_read_file");
+	if (steps[state.curstep].kind != EXP_END)
+	    EXPECT_FAILURE("Stopped reading early at step %d", state.curstep);
+    }
+
+    amar_free_index(index);
+    ok = amar_close(arch, &error);
+    check_gerror(ok, error, "amar_close");
+    close(fd);
+
+    /* an archive written without an index has none */
+    fd = open_temp(1);
+    WRITE_HEADER(fd, 1);
+    WRITE_RECORD_STR(fd, 1, AMAR_ATTR_FILENAME, 1, "/first/filename");
+    WRITE_RECORD_STR(fd, 1, 18, 1, "eighteen");
+    WRITE_RECORD_STR(fd, 1, AMAR_ATTR_EOF, 1, "");
+    close(fd);
+
+    fd = open_temp(0);
+    arch = amar_new(fd, O_RDONLY, &error);
+    check_gerror(arch, error, "amar_new");
+    ok = amar_read_index(arch, &index, &error);
+    check_gerror(ok, error, "amar_read_index");
+    if (index)
+	EXPECT_FAILURE("found %d index entries in an archive without an index",
+		       (int)index->len);
+    ok = amar_close(arch, &error);
+    check_gerror(ok, error, "amar_close");
+    close(fd);
+
+    return 1;
+}
+
 /****
  * Invalid inputs - test error returns
  */
@@ -1107,6 +1261,7 @@ main(int argc, char **argv)
 	TU_TEST(test_writing_coverage, 90),
 	TU_TEST(test_big_attr, 90),
 	TU_TEST(test_pipe, 90),
+	TU_TEST(test_index, 90),
 	TU_TEST(test_no_header, 90),
 	TU_TEST(test_invalid_eof, 90),
 	TU_TEST(test_header_vers, 90),
@@ -32,6 +32,22 @@
 #define HEADER_VERSION 1
 #define EOA_BIT 0x80000000
 
+/* An archive written to a seekable file ends with an index of its files.
+ * The index is stored as records of filenum INDEX_FILENUM, which is never
+ * given to a file, with application-range attribute IDs, so that readers
+ * which do not know about it skip it like the records of any unknown file.
+ * Its data is a sequence of index entries: a 16-bit filenum, a 32-bit
+ * filename length, a 64-bit offset of the file's filename record (relative
+ * to the start of the archive), and the filename, all in network order.
+ * The last record of the archive is a locator, giving the offset of the
+ * first index record; it has a fixed size, so a reader can find it from the
+ * end of the file. */
+#define INDEX_FILENUM 0
+#define INDEX_ATTRID 0xfffe
+#define INDEX_LOCATOR_ATTRID 0xffff
+#define INDEX_ENTRY_SIZE (2 + 4 + 8)
+#define INDEX_LOCATOR_SIZE (RECORD_SIZE + 8)
+
 typedef struct header_s {
     /* magic is HEADER_MAGIC + ' ' + decimal version, NUL padded */
     char     magic[28];
@@ -83,6 +99,8 @@ struct amar_s {
     off_t     position;		/* current position in the archive	*/
     GHashTable *files;		/* List of all amar_file_t	*/
     gboolean  seekable;		/* does lseek() work on this fd? */
+    off_t     start;		/* fd offset of the start of the archive */
+    GByteArray *index;		/* index entries to write on close, or NULL */
 
     /* internal buffer; on writing, this is WRITE_BUFFER_SIZE bytes, and
      * always has at least RECORD_SIZE bytes free. */
@@ -133,6 +151,31 @@ flush_buffer(
     return TRUE;
 }
 
+/* store and fetch 64-bit values in network order */
+static void
+put_uint64(
+	gpointer ptr,
+	guint64 val)
+{
+    uint32_t half;
+
+    half = htonl((uint32_t)(val >> 32));
+    memcpy(ptr, &half, 4);
+    half = htonl((uint32_t)val);
+    memcpy(ptr + 4, &half, 4);
+}
+
+static guint64
+get_uint64(
+	gpointer ptr)
+{
+    uint32_t hi, lo;
+
+    memcpy(&hi, ptr, 4);
+    memcpy(&lo, ptr + 4, 4);
+    return ((guint64)ntohl(hi) << 32) | ntohl(lo);
+}
+
 static gboolean
 write_header(
 	amar_t *archive,
@@ -215,6 +258,13 @@ amar_new(
     archive->seekable = TRUE; /* assume seekable until lseek() fails */
     archive->files = g_hash_table_new(g_int_hash, g_int_equal);
     archive->buf = NULL;
+    archive->index = NULL;
+
+    archive->start = lseek(fd, 0, SEEK_CUR);
+    if (archive->start < 0) {
+	archive->seekable = FALSE;
+	archive->start = 0;
+    }
 
     if (mode == O_WRONLY) {
 	archive->buf = g_malloc(WRITE_BUFFER_SIZE);
@@ -233,11 +283,43 @@ amar_new(
 	    amar_close(archive, NULL); /* flushing buffer won't fail */
 	    return NULL;
 	}
+
+	/* only a seekable file can be read by index, so don't bother
+	 * collecting one for a pipe */
+	if (archive->seekable)
+	    archive->index = g_byte_array_new();
     }
 
     return archive;
 }
 
+/* write the index collected by amar_new_file, followed by its locator */
+static gboolean
+write_index(
+	amar_t *archive,
+	GError **error)
+{
+    guint8 *data = archive->index->data;
+    gsize size = archive->index->len;
+    off_t index_offset = archive->position;
+    char locator[8];
+
+    do {
+	gsize rec_data_size = MIN(size, MAX_RECORD_DATA_SIZE);
+
+	if (!write_record(archive, INDEX_FILENUM, INDEX_ATTRID,
+			  rec_data_size == size, data, rec_data_size, error))
+	    return FALSE;
+
+	data += rec_data_size;
+	size -= rec_data_size;
+    } while (size);
+
+    put_uint64(locator, index_offset);
+    return write_record(archive, INDEX_FILENUM, INDEX_LOCATOR_ATTRID,
+			1, locator, sizeof(locator), error);
+}
+
 gboolean
 amar_close(
     amar_t *archive,
@@ -248,7 +330,13 @@ amar_close(
     /* verify all files are done */
     g_assert(g_hash_table_size(archive->files) == 0);
 
-    if (!flush_buffer(archive, error))
+    if (archive->index) {
+	if (!write_index(archive, error))
+	    success = FALSE;
+	g_byte_array_free(archive->index, TRUE);
+    }
+
+    if (!flush_buffer(archive, success? error : NULL))
 	success = FALSE;
 
     g_hash_table_destroy(archive->files);
@@ -271,6 +359,7 @@ amar_new_file(
     GError **error)
 {
     amar_file_t *file = NULL;
+    off_t filename_offset;
 
     g_assert(archive->mode == O_WRONLY);
     g_assert(filename_buf != NULL);
@@ -288,19 +377,21 @@ amar_new_file(
 
     /* pick a new, unused filenum */
 
-    if (g_hash_table_size(archive->files) == 65535) {
+    if (g_hash_table_size(archive->files) == 65534) {
 	g_set_error(error, amar_error_quark(), ENOSPC,
 		    "No more file numbers available");
 	return NULL;
     }
 
-    do {
+    while (1) {
 	gint filenum;
 
 	archive->maxfilenum++;
 
-	/* MAGIC_FILENUM can't be used because it matches the header record text */
-	if (archive->maxfilenum == MAGIC_FILENUM) {
+	/* MAGIC_FILENUM can't be used because it matches the header record
+	 * text, and INDEX_FILENUM is kept for the index */
+	if (archive->maxfilenum == MAGIC_FILENUM ||
+	    archive->maxfilenum == INDEX_FILENUM) {
 	    continue;
 	}
 
@@ -309,7 +400,8 @@ amar_new_file(
 	if (g_hash_table_lookup(archive->files, &filenum))
 	    continue;
 
-    } while (0);
+	break;
+    }
 
     file = g_new0(amar_file_t, 1);
     file->archive = archive;
@@ -325,10 +417,24 @@ amar_new_file(
     }
 
     /* add a filename record */
+    filename_offset = archive->position;
     if (!write_record(archive, file->filenum, AMAR_ATTR_FILENAME,
 		      1, filename_buf, filename_len, error))
 	goto error_exit;
 
+    /* and an index entry pointing to it */
+    if (archive->index) {
+	guint8 entry[INDEX_ENTRY_SIZE];
+	uint16_t filenum = htons(file->filenum);
+	uint32_t len = htonl(filename_len);
+
+	memcpy(entry, &filenum, 2);
+	memcpy(entry + 2, &len, 4);
+	put_uint64(entry + 6, filename_offset);
+	g_byte_array_append(archive->index, entry, INDEX_ENTRY_SIZE);
+	g_byte_array_append(archive->index, (guint8 *)filename_buf, filename_len);
+    }
+
     return file;
 
 error_exit:
@@ -773,13 +879,18 @@ handle_hunk(
     return success;
 }
 
-gboolean
-amar_read(
+/* Read records from the current position of the archive.  If ONLY_FILENUM
+ * is not -1, the read starts at that file's filename record, skips the
+ * records of every other file, and stops after that file's EOF record. */
+static gboolean
+read_records(
 	amar_t *archive,
 	gpointer user_data,
 	amar_attr_handling_t *handling_array,
 	amar_file_start_callback_t file_start_cb,
 	amar_file_finish_callback_t file_finish_cb,
+	gint only_filenum,
+	gboolean just_lseeked,
 	GError **error)
 {
     file_state_t *fs = NULL;
@@ -805,11 +916,11 @@ amar_read(
     hp.buf_size = 1024; /* use a 1K buffer to start */
     hp.buf = g_malloc(hp.buf_size);
     hp.got_eof = FALSE;
-    hp.just_lseeked = FALSE;
+    hp.just_lseeked = just_lseeked;
 
     /* check that we are starting at a header record, but don't advance
      * the buffer past it */
-    if (buf_atleast(archive, &hp, RECORD_SIZE)) {
+    if (only_filenum == -1 && buf_atleast(archive, &hp, RECORD_SIZE)) {
 	GETRECORD(buf_ptr(&hp), filenum, attrid, datasize, eoa);
 	if (filenum != MAGIC_FILENUM) {
 	    g_set_error(error, amar_error_quark(), EINVAL,
@@ -858,6 +969,12 @@ amar_read(
 	    return FALSE;
 	}
 
+	/* when reading a single file, step over everything else */
+	if (only_filenum != -1 && filenum != only_filenum) {
+	    buf_skip(archive, &hp, datasize);
+	    continue;
+	}
+
 	/* find the file_state_t, if it exists */
 	if (!fs || fs->filenum != filenum) {
 	    fs = NULL;
@@ -885,6 +1002,8 @@ amar_read(
 		    if (!success)
 			break;
 		}
+		if (only_filenum != -1)
+		    break;
 		continue;
 	    } else if (attrid == AMAR_ATTR_FILENAME) {
 		/* for filenames, we need the whole filename in the buffer */
@@ -927,6 +1046,10 @@ amar_read(
 			break;
 		}
 
+		/* nothing else of interest if the only file is ignored */
+		if (only_filenum != -1 && fs->ignore)
+		    break;
+
 		buf_skip(archive, &hp, datasize);
 
 		continue;
@@ -1067,3 +1190,210 @@ amar_read(
 
     return success;
 }
+
+gboolean
+amar_read(
+	amar_t *archive,
+	gpointer user_data,
+	amar_attr_handling_t *handling_array,
+	amar_file_start_callback_t file_start_cb,
+	amar_file_finish_callback_t file_finish_cb,
+	GError **error)
+{
+    return read_records(archive, user_data, handling_array,
+			file_start_cb, file_finish_cb, -1, FALSE, error);
+}
+
+/*
+ * Reading by index
+ */
+
+/* read exactly SIZE bytes at OFFSET from the start of the archive; returns
+ * FALSE, with ERROR set, on a short read */
+static gboolean
+read_at(
+	amar_t *archive,
+	off_t offset,
+	gpointer buf,
+	gsize size,
+	GError **error)
+{
+    if (lseek(archive->fd, archive->start + offset, SEEK_SET) < 0) {
+	g_set_error(error, amar_error_quark(), errno,
+		    "Error seeking in amanda archive: %s", strerror(errno));
+	return FALSE;
+    }
+
+    errno = 0;
+    if (full_read(archive->fd, buf, size) < size) {
+	g_set_error(error, amar_error_quark(), errno? errno : EINVAL,
+		    "Error reading amanda archive index: %s",
+		    errno? strerror(errno) : "short read");
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+free_index_entries(
+	GPtrArray *index)
+{
+    guint i;
+
+    for (i = 0; i < index->len; i++) {
+	amar_index_entry_t *entry = g_ptr_array_index(index, i);
+	g_free(entry->filename_buf);
+	g_free(entry);
+    }
+    g_ptr_array_free(index, TRUE);
+}
+
+gboolean
+amar_read_index(
+	amar_t *archive,
+	GPtrArray **index,
+	GError **error)
+{
+    char locator[INDEX_LOCATOR_SIZE];
+    GByteArray *data = NULL;
+    off_t end, offset, orig_position;
+    uint16_t filenum, attrid;
+    uint32_t datasize;
+    gboolean eoa;
+    gsize pos;
+    gboolean success = FALSE;
+
+    g_assert(archive->mode == O_RDONLY);
+
+    *index = NULL;
+
+    if (!archive->seekable)
+	return TRUE;
+
+    orig_position = lseek(archive->fd, 0, SEEK_CUR);
+    end = lseek(archive->fd, 0, SEEK_END);
+    if (orig_position < 0 || end < 0) {
+	if (errno == ESPIPE) {
+	    archive->seekable = FALSE;
+	    return TRUE;
+	}
+	g_set_error(error, amar_error_quark(), errno,
+		    "Error seeking in amanda archive: %s", strerror(errno));
+	return FALSE;
+    }
+    end -= archive->start;
+
+    /* no room for an index, or no locator at the end: no index */
+    if (end < (off_t)(HEADER_SIZE + INDEX_LOCATOR_SIZE)) {
+	success = TRUE;
+	goto done;
+    }
+    if (!read_at(archive, end - INDEX_LOCATOR_SIZE, locator,
+		 INDEX_LOCATOR_SIZE, error))
+	goto done;
+    GETRECORD(locator, filenum, attrid, datasize, eoa);
+    if (filenum != INDEX_FILENUM || attrid != INDEX_LOCATOR_ATTRID
+	    || datasize != 8 || !eoa) {
+	success = TRUE;
+	goto done;
+    }
+    offset = get_uint64(locator + RECORD_SIZE);
+
+    /* gather the index records */
+    data = g_byte_array_new();
+    do {
+	char rec[RECORD_SIZE];
+
+	if (offset < (off_t)HEADER_SIZE
+		|| offset + (off_t)RECORD_SIZE > end - (off_t)INDEX_LOCATOR_SIZE
+		|| !read_at(archive, offset, rec, RECORD_SIZE, error))
+	    goto bad_index;
+	GETRECORD(rec, filenum, attrid, datasize, eoa);
+	if (filenum != INDEX_FILENUM || attrid != INDEX_ATTRID
+		|| datasize > MAX_RECORD_DATA_SIZE
+		|| offset + (off_t)(RECORD_SIZE + datasize) > end - (off_t)INDEX_LOCATOR_SIZE)
+	    goto bad_index;
+
+	g_byte_array_set_size(data, data->len + datasize);
+	if (datasize && full_read(archive->fd, data->data + data->len - datasize,
+				  datasize) < datasize)
+	    goto bad_index;
+	offset += RECORD_SIZE + datasize;
+    } while (!eoa);
+
+    /* and parse them */
+    *index = g_ptr_array_new();
+    for (pos = 0; pos < data->len; ) {
+	amar_index_entry_t *entry;
+	uint16_t entry_filenum;
+	uint32_t len;
+
+	if (data->len - pos < INDEX_ENTRY_SIZE)
+	    goto bad_index;
+	memcpy(&entry_filenum, data->data + pos, 2);
+	memcpy(&len, data->data + pos + 2, 4);
+	len = ntohl(len);
+	if (len == 0 || data->len - pos - INDEX_ENTRY_SIZE < len)
+	    goto bad_index;
+
+	entry = g_new0(amar_index_entry_t, 1);
+	entry->filenum = ntohs(entry_filenum);
+	entry->offset = get_uint64(data->data + pos + 6);
+	entry->filename_len = len;
+	entry->filename_buf = g_memdup(data->data + pos + INDEX_ENTRY_SIZE, len);
+	g_ptr_array_add(*index, entry);
+
+	pos += INDEX_ENTRY_SIZE + len;
+    }
+
+    success = TRUE;
+    goto done;
+
+bad_index:
+    if (!error || !*error)
+	g_set_error(error, amar_error_quark(), EINVAL,
+		    "Invalid amanda archive index");
+    if (*index) {
+	free_index_entries(*index);
+	*index = NULL;
+    }
+
+done:
+    if (data)
+	g_byte_array_free(data, TRUE);
+    lseek(archive->fd, orig_position, SEEK_SET);
+    return success;
+}
+
+void
+amar_free_index(
+	GPtrArray *index)
+{
+    if (index)
+	free_index_entries(index);
+}
+
+gboolean
+amar_read_file(
+	amar_t *archive,
+	amar_index_entry_t *entry,
+	gpointer user_data,
+	amar_attr_handling_t *handling_array,
+	amar_file_start_callback_t file_start_cb,
+	amar_file_finish_callback_t file_finish_cb,
+	GError **error)
+{
+    g_assert(archive->mode == O_RDONLY);
+    g_assert(archive->seekable);
+
+    if (lseek(archive->fd, archive->start + entry->offset, SEEK_SET) < 0) {
+	g_set_error(error, amar_error_quark(), errno,
+		    "Error seeking in amanda archive: %s", strerror(errno));
+	return FALSE;
+    }
+
+    return read_records(archive, user_data, handling_array,
+			file_start_cb, file_finish_cb, entry->filenum, TRUE,
+			error);
+}
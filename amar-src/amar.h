@@ -61,7 +61,8 @@ enum {
 amar_t *amar_new(int fd, mode_t mode, GError **error);
 
 /* Finish writing to this fd.  All buffers are flushed, but the file descriptor
- * is not closed -- the user must close it. */
+ * is not closed -- the user must close it.  If the fd is seekable, an index of
+ * the archive's files is written first; see amar_read_index. */
 gboolean amar_close(amar_t *archive, GError **error);
 
 /* create a new 'file' object on the archive.  The filename is treated as a
@@ -249,3 +250,48 @@ gboolean amar_read(
 	amar_file_start_callback_t file_start_cb,
 	amar_file_finish_callback_t file_finish_cb,
 	GError **error);
+
+/* An entry in the index written at the end of a seekable archive. */
+typedef struct amar_index_entry_s {
+    uint16_t filenum;		/* the file's number in the archive */
+    off_t offset;		/* offset of its filename record */
+    gpointer filename_buf;	/* its filename.. */
+    gsize filename_len;		/* ..and the filename's length */
+} amar_index_entry_t;
+
+/* Read the index at the end of an archive.  On success, *index is set to an
+ * array of amar_index_entry_t pointers, one for each file, in the order the
+ * files were started, or to NULL if the archive is not seekable or has no
+ * index.  The archive's position is not changed.
+ *
+ * @param archive: the archive, opened for reading
+ * @param index (output): the index; free it with amar_free_index
+ * @param error (output): the error result
+ * @returns: FALSE on error (including a corrupt index)
+ */
+gboolean amar_read_index(
+	amar_t *archive,
+	GPtrArray **index,
+	GError **error);
+
+/* Free an index returned from amar_read_index. */
+void amar_free_index(
+	GPtrArray *index);
+
+/* Read a single file, seeking straight to it with an entry from the archive's
+ * index.  The callbacks are called as for amar_read, but only for this file;
+ * the records of any other files are skipped, and the read ends after this
+ * file's last record (or as soon as file_start_cb ignores it).
+ *
+ * @param entry: the index entry for the file
+ * (other parameters as for amar_read)
+ * @returns: FALSE on error or an early exit, otherwise TRUE
+ */
+gboolean amar_read_file(
+	amar_t *archive,
+	amar_index_entry_t *entry,
+	gpointer user_data,
+	amar_attr_handling_t *handling_array,
+	amar_file_start_callback_t file_start_cb,
+	amar_file_finish_callback_t file_finish_cb,
+	GError **error);
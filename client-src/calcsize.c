@@ -183,6 +183,9 @@ main(
     dbopen(DBG_SUBDIR_CLIENT);
     dbprintf(_("version %s\n"), VERSION);
 
+    /* the directory tree is traversed by several threads */
+    glib_init();
+
     argc--, argv++;	/* skip program name */
 
     /* need at least program, amname, and directory name */
@@ -376,122 +379,252 @@ basename(
 void push_name(char *str);
 char *pop_name(void);
 
+/*
+ * The tree is walked by several threads at once, so that many directories
+ * are read and stat'ed in parallel; on NFS and on trees of many small files,
+ * the time goes into waiting for those calls, not into computing.  Each
+ * thread takes a directory from name_stack, stats its entries, and pushes
+ * back the subdirectories it finds.
+ */
+#if defined(G_THREADS_ENABLED) && !defined(G_THREADS_IMPL_NONE)
+#define TRAVERSE_THREADS 8
+#else
+#define TRAVERSE_THREADS 1
+#endif
+
+typedef struct traverse_s {
+    size_t parent_len;		/* length of the toplevel directory name */
+    dev_t parent_dev;		/* don't cross into other filesystems */
+    int has_exclude;		/* check names against exclude_sl */
+    int busy;			/* threads reading a directory */
+    GMutex *mutex;		/* protects name_stack, dumpstats and busy */
+    GCond *cond;		/* signalled when either of those changes */
+} traverse_t;
+
+static gpointer traverse_worker(gpointer data);
+static void traverse_dir(traverse_t *tr, char *dirname, char **newnamep,
+			 size_t *newname_sizep);
+
 void
 traverse_dirs(
     char *	parent_dir,
     char *	include)
 {
-    DIR *d;
-    struct dirent *f;
+    traverse_t tr;
     struct stat finfo;
-    char *dirname, *newname = NULL;
-    char *newbase = NULL;
-    dev_t parent_dev = (dev_t)0;
-    int i;
-    size_t l;
-    size_t parent_len;
-    int has_exclude;
     char *aparent;
+#if TRAVERSE_THREADS > 1
+    GThread *threads[TRAVERSE_THREADS - 1];
+    int nthreads = 0;
+#endif
+    int i;
 
     if(parent_dir == NULL || include == NULL)
 	return;
 
-    has_exclude = !is_empty_sl(exclude_sl) && (use_gtar_excl || use_star_excl);
+    tr.has_exclude = !is_empty_sl(exclude_sl) && (use_gtar_excl || use_star_excl);
     aparent = vstralloc(parent_dir, "/", include, NULL);
 
     /* We (may) need root privs for the *stat() calls here. */
     set_root_privs(1);
+    tr.parent_dev = (dev_t)0;
     if(stat(parent_dir, &finfo) != -1)
-	parent_dev = finfo.st_dev;
+	tr.parent_dev = finfo.st_dev;
 
-    parent_len = strlen(parent_dir);
+    tr.parent_len = strlen(parent_dir);
+    tr.busy = 0;
+    tr.mutex = g_mutex_new();
+    tr.cond = g_cond_new();
 
     push_name(aparent);
 
-    for(; (dirname = pop_name()) != NULL; free(dirname)) {
-	if(has_exclude && calc_check_exclude(dirname+parent_len+1)) {
-	    continue;
+#if TRAVERSE_THREADS > 1
+    for (i = 0; i < TRAVERSE_THREADS - 1; i++) {
+	GError *err = NULL;
+
+	threads[nthreads] = g_thread_create(traverse_worker, &tr, TRUE, &err);
+	if (threads[nthreads] == NULL) {
+	    dbprintf(_("could not start a traverse thread: %s\n"),
+		     err->message);
+	    g_error_free(err);
+	    break;
 	}
-	if((d = opendir(dirname)) == NULL) {
-	    perror(dirname);
+	nthreads++;
+    }
+#endif
+
+    /* this thread takes its share of the directories, too */
+    traverse_worker(&tr);
+
+#if TRAVERSE_THREADS > 1
+    for (i = 0; i < nthreads; i++)
+	g_thread_join(threads[i]);
+#else
+    (void)i;	/* Quiet unused variable warning */
+#endif
+
+    /* drop root privs -- we're done with the permission-sensitive calls */
+    set_root_privs(0);
+
+    g_cond_free(tr.cond);
+    g_mutex_free(tr.mutex);
+    amfree(aparent);
+}
+
+/*
+ * Read directories from name_stack until it is empty and no other thread
+ * is reading a directory (which could push more).
+ */
+static gpointer
+traverse_worker(
+    gpointer	data)
+{
+    traverse_t *tr = data;
+    char *dirname;
+    char *newname = NULL;
+    size_t newname_size = 0;
+
+    g_mutex_lock(tr->mutex);
+    for (;;) {
+	while ((dirname = pop_name()) == NULL && tr->busy > 0)
+	    g_cond_wait(tr->cond, tr->mutex);
+	if (dirname == NULL)
+	    break;
+
+	tr->busy++;
+	g_mutex_unlock(tr->mutex);
+
+	traverse_dir(tr, dirname, &newname, &newname_size);
+	amfree(dirname);
+
+	g_mutex_lock(tr->mutex);
+	tr->busy--;
+	if (tr->busy == 0)
+	    g_cond_broadcast(tr->cond);
+    }
+    g_mutex_unlock(tr->mutex);
+
+    amfree(newname);
+    return NULL;
+}
+
+/*
+ * Add up the entries of one directory.  *newnamep is a buffer of
+ * *newname_sizep bytes, reused for the entries' full names.
+ */
+static void
+traverse_dir(
+    traverse_t *tr,
+    char *	dirname,
+    char **	newnamep,
+    size_t *	newname_sizep)
+{
+    DIR *d;
+    struct dirent *f;
+    struct stat finfo;
+    size_t l, baselen, namelen;
+    int i;
+
+    if(tr->has_exclude && calc_check_exclude(dirname+tr->parent_len+1)) {
+	return;
+    }
+    if((d = opendir(dirname)) == NULL) {
+	perror(dirname);
+	return;
+    }
+
+    l = strlen(dirname);
+    if(l > 0 && dirname[l - 1] != '/') {
+	baselen = l + 1;
+    } else {
+	baselen = l;
+    }
+
+    while((f = readdir(d)) != NULL) {
+	int is_symlink = 0;
+	int is_dir;
+	int is_file;
+	int is_excluded = -1;
+	char *newname;
+
+	if(is_dot_or_dotdot(f->d_name)) {
 	    continue;
 	}
 
-	l = strlen(dirname);
-	if(l > 0 && dirname[l - 1] != '/') {
-	    newbase = newstralloc2(newbase, dirname, "/");
-	} else {
-	    newbase = newstralloc(newbase, dirname);
+	/* build "dirname/d_name" in the reusable buffer */
+	namelen = strlen(f->d_name);
+	if (baselen + namelen + 1 > *newname_sizep) {
+	    *newname_sizep = (baselen + namelen + 1) * 2;
+	    amfree(*newnamep);
+	    *newnamep = alloc(*newname_sizep);
+	}
+	newname = *newnamep;
+	memcpy(newname, dirname, l);
+	if (baselen > l)
+	    newname[l] = '/';
+	memcpy(newname + baselen, f->d_name, namelen + 1);
+
+#ifdef HAVE_FSTATAT
+	/* relative to the open directory, so the kernel need not walk the
+	 * whole path again for each entry */
+	if(fstatat(dirfd(d), f->d_name, &finfo, AT_SYMLINK_NOFOLLOW) == -1) {
+#else
+	if(lstat(newname, &finfo) == -1) {
+#endif
+	    g_fprintf(stderr, "%s/%s: %s\n",
+		    dirname, f->d_name, strerror(errno));
+	    continue;
 	}
 
-	while((f = readdir(d)) != NULL) {
-	    int is_symlink = 0;
-	    int is_dir;
-	    int is_file;
-	    if(is_dot_or_dotdot(f->d_name)) {
-		continue;
-	    }
-
-	    newname = newstralloc2(newname, newbase, f->d_name);
-	    if(lstat(newname, &finfo) == -1) {
-		g_fprintf(stderr, "%s/%s: %s\n",
-			dirname, f->d_name, strerror(errno));
-		continue;
-	    }
-
-	    if(finfo.st_dev != parent_dev)
-		continue;
+	if(finfo.st_dev != tr->parent_dev)
+	    continue;
 
 #ifdef S_IFLNK
-	    is_symlink = ((finfo.st_mode & S_IFMT) == S_IFLNK);
+	is_symlink = ((finfo.st_mode & S_IFMT) == S_IFLNK);
 #endif
-	    is_dir = ((finfo.st_mode & S_IFMT) == S_IFDIR);
-	    is_file = ((finfo.st_mode & S_IFMT) == S_IFREG);
+	is_dir = ((finfo.st_mode & S_IFMT) == S_IFDIR);
+	is_file = ((finfo.st_mode & S_IFMT) == S_IFREG);
 
-	    if (!(is_file || is_dir || is_symlink)) {
-		continue;
-	    }
+	if (!(is_file || is_dir || is_symlink)) {
+	    continue;
+	}
 
-	    {
-		int is_excluded = -1;
+	/* do the exclude matching before taking the lock */
+	if(tr->has_exclude) {
+	    if(is_file) {
 		for(i = 0; i < ndumps; i++) {
-		    add_file_name(i, newname);
-		    if(is_file && (time_t)finfo.st_ctime >= dumpdate[i]) {
-
-			if(has_exclude) {
-			    if(is_excluded == -1)
-				is_excluded =
-				       calc_check_exclude(newname+parent_len+1);
-			    if(is_excluded == 1) {
-				i = ndumps;
-				continue;
-			    }
-			}
-			add_file(i, &finfo);
+		    if((time_t)finfo.st_ctime >= dumpdate[i]) {
+			is_excluded = calc_check_exclude(newname+tr->parent_len+1);
+			break;
 		    }
 		}
-		if(is_dir) {
-		    if(has_exclude && calc_check_exclude(newname+parent_len+1))
-			continue;
-		    push_name(newname);
-		}
+	    } else if(is_dir) {
+		is_excluded = calc_check_exclude(newname+tr->parent_len+1);
 	    }
 	}
 
+	g_mutex_lock(tr->mutex);
+	for(i = 0; i < ndumps; i++) {
+	    add_file_name(i, newname);
+	    if(is_file && (time_t)finfo.st_ctime >= dumpdate[i]) {
+		if(is_excluded == 1)
+		    break;
+		add_file(i, &finfo);
+	    }
+	}
+	if(is_dir && is_excluded != 1) {
+	    push_name(newname);
+	    g_cond_signal(tr->cond);
+	}
+	g_mutex_unlock(tr->mutex);
+    }
+
 #ifdef CLOSEDIR_VOID
-	closedir(d);
+    closedir(d);
 #else
-	if(closedir(d) == -1)
-	    perror(dirname);
+    if(closedir(d) == -1)
+	perror(dirname);
 #endif
-    }
-
-    /* drop root privs -- we're done with the permission-sensitive calls */
-    set_root_privs(0);
-
-    amfree(newbase);
-    amfree(newname);
-    amfree(aparent);
 }
 
 void
@@ -139,7 +139,6 @@ start_backup(
     char tmppath[PATH_MAX];
     int dumpin, dumpout, compout;
     char *cmd = NULL;
-    char *indexcmd = NULL;
     char *dirname = NULL;
     int l;
     char dumptimestr[80] = "UNUSED";
@@ -349,19 +348,6 @@ start_backup(
     cur_dumptime = time(0);
     cur_level = level;
     cur_disk = stralloc(dle->disk);
-#ifdef GNUTAR
-#  define PROGRAM_GNUTAR GNUTAR
-#else
-#  define PROGRAM_GNUTAR "tar"
-#endif
-    indexcmd = vstralloc(
-			 PROGRAM_GNUTAR,
-			 " -tf", " -",
-			 " 2>/dev/null",
-			 " | sed", " -e",
-			 " \'s/^\\.//\'",
-			 NULL);
-
 #ifdef SAMBA_CLIENT							/* { */
     /* Use sambatar if the disk to back up is a PC disk */
     if (dle->device[0] == '/' && dle->device[1]=='/') {
@@ -453,7 +439,7 @@ start_backup(
 	cmd = stralloc(program->backup_name);
 	info_tapeheader(dle);
 
-	start_index(dle->create_index, dumpout, mesgf, indexf, indexcmd);
+	start_tar_index(dle->create_index, dumpout, mesgf, indexf);
 
 	if (pwtext_len > 0) {
 	    pw_fd_env = "PASSWD_FD";
@@ -523,7 +509,7 @@ start_backup(
 	cmd = vstralloc(amlibexecdir, "/", "runtar", NULL);
 	info_tapeheader(dle);
 
-	start_index(dle->create_index, dumpout, mesgf, indexf, indexcmd);
+	start_tar_index(dle->create_index, dumpout, mesgf, indexf);
 
 	g_ptr_array_add(argv_ptr, stralloc("runtar"));
 	if (g_options->config)
@@ -588,7 +574,6 @@ start_backup(
     amfree(qdisk);
     amfree(dirname);
     amfree(cmd);
-    amfree(indexcmd);
     amfree(error_pn);
 
     /* close the write ends of the pipes */
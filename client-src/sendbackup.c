@@ -39,6 +39,7 @@
 #include "getfsent.h"
 #include "conffile.h"
 #include "amandates.h"
+#include "tarindex.h"
 
 #define sendbackup_debug(i, ...) do {	\
 	if ((i) <= debug_sendbackup) {	\
@@ -1205,20 +1206,19 @@ save_fd(
     dbprintf(_("Dupped file descriptor %i to %i\n"), origfd, *fd);
 }
 
-void
-start_index(
-    int		createindex,
+/*
+ * Fork the index tee process.  In the parent, input is replaced by the
+ * write end of a pipe and FALSE is returned.  In the child, the pipe is
+ * on fd 0, the index on fd 1, the messages on fd 2 and the original
+ * input on fd 3, and TRUE is returned.
+ */
+static gboolean
+fork_index_tee(
     int		input,
     int		mesg,
-    int		index,
-    char *	cmd)
+    int		index)
 {
   int pipefd[2];
-  FILE *pipe_fp;
-  int exitcode;
-
-  if (!createindex)
-    return;
 
   if (pipe(pipefd) != 0) {
     error(_("creating index pipe: %s"), strerror(errno));
@@ -1237,7 +1237,7 @@ start_index(
       /*NOTREACHED*/
     }
     aclose(pipefd[1]);
-    return;
+    return FALSE;
 
   case 0:
     break;
@@ -1258,6 +1258,26 @@ start_index(
     }
   }
 
+  return TRUE;
+}
+
+void
+start_index(
+    int		createindex,
+    int		input,
+    int		mesg,
+    int		index,
+    char *	cmd)
+{
+  FILE *pipe_fp;
+  int exitcode;
+
+  if (!createindex)
+    return;
+
+  if (!fork_index_tee(input, mesg, index))
+    return;
+
   if ((pipe_fp = popen(cmd, "w")) == NULL) {
     error(_("couldn't start index creator [%s]"), strerror(errno));
     /*NOTREACHED*/
@@ -1313,8 +1333,6 @@ start_index(
     }
   }
 
-  aclose(pipefd[1]);
-
   /* finished */
   /* check the exit code of the pipe and moan if not 0 */
   if ((exitcode = pclose(pipe_fp)) != 0) {
@@ -1329,6 +1347,81 @@ start_index(
   exit(exitcode);
 }
 
+/*
+ * start_tar_index.  Like start_index, but for tar-format output: the tee
+ * process reads the tar headers itself as the data goes by (see
+ * tarindex.c) and writes the index, without a second tar and without
+ * copying the whole stream through another pipe.
+ */
+
+void
+start_tar_index(
+    int		createindex,
+    int		input,
+    int		mesg,
+    int		index)
+{
+  tar_index_t ti;
+  FILE *indexf;
+  char *buffer;
+  int exitcode = 0;
+
+  if (!createindex)
+    return;
+
+  if (!fork_index_tee(input, mesg, index))
+    return;
+
+  if ((indexf = fdopen(1, "w")) == NULL) {
+    error(_("index tee cannot open index [%s]"), strerror(errno));
+    /*NOTREACHED*/
+  }
+  tar_index_init(&ti, indexf);
+
+  dbprintf(_("Started built-in tar index creator\n"));
+  buffer = alloc(DISK_BLOCK_BYTES * 8);
+  while(1) {
+    ssize_t bytes_read;
+
+    do {
+	bytes_read = read(0, buffer, DISK_BLOCK_BYTES * 8);
+    } while ((bytes_read < 0) && ((errno == EINTR) || (errno == EAGAIN)));
+
+    if (bytes_read < 0) {
+      error(_("index tee cannot read [%s]"), strerror(errno));
+      /*NOTREACHED*/
+    }
+
+    if (bytes_read == 0)
+      break; /* finished */
+
+    /* pass the data on first, so the dump is never held up by the index */
+    if (full_write(3, buffer, (size_t)bytes_read) < (size_t)bytes_read) {
+      error(_("index tee cannot write [%s]"), strerror(errno));
+      /*NOTREACHED*/
+    }
+
+    tar_index_data(&ti, buffer, (size_t)bytes_read);
+  }
+  amfree(buffer);
+
+  if (!ti.done && !ti.failed) {
+    dbprintf(_("index tee: tar archive ended without an end marker\n"));
+  }
+  if (ti.failed)
+    exitcode = 1;
+  tar_index_cleanup(&ti);
+
+  if (fclose(indexf) != 0) {
+    dbprintf(_("index tee cannot write index [%s]\n"), strerror(errno));
+    exitcode = 1;
+  }
+
+  if (exitcode == 0)
+    dbprintf(_("Index created successfully\n"));
+  exit(exitcode);
+}
+
 extern backup_program_t dump_program, gnutar_program;
 
 backup_program_t *programs[] = {
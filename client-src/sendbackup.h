@@ -39,6 +39,7 @@
 void info_tapeheader(dle_t *dle);
 void start_index(int createindex, int input, int mesg, 
 		    int index, char *cmd);
+void start_tar_index(int createindex, int input, int mesg, int index);
 
 /*
  * Dump output lines are scanned for two types of regex matches.
@@ -88,6 +88,7 @@ typedef struct disk_estimates_s {
     char *dirname;
     char *qdirname;
     pid_t child;
+    int nchildren;	/* processes it counts for against maxdumps */
     int done;
     dle_t *dle;
     level_estimate_t est[DUMP_LEVELS];
@@ -111,6 +112,12 @@ void smbtar_calc_estimates(disk_estimates_t *);
 void gnutar_calc_estimates(disk_estimates_t *);
 void application_api_calc_estimate(disk_estimates_t *);
 void generic_calc_estimates(disk_estimates_t *);
+static int estimate_children(disk_estimates_t *est, int available);
+#ifdef GNUTAR
+static void calc_levels_in_parallel(disk_estimates_t *est,
+			void (*calc_level)(disk_estimates_t *, int));
+static int wait_level_child(pid_t *pids);
+#endif
 
 int
 main(
@@ -461,7 +468,7 @@ main(
 	    } else {
 		est->done = 1;
 		est->child = 0;
-		dumpsrunning--;
+		dumpsrunning -= est->nchildren;
 		run_client_scripts(EXECUTE_ON_POST_DLE_ESTIMATE, g_options,
 				   est->dle, stdout);
 	    }
@@ -516,6 +523,8 @@ main(
 	    run_client_scripts(EXECUTE_ON_PRE_DLE_ESTIMATE, g_options,
 			       est->dle, stdout);
 
+	    est->nchildren = estimate_children(est,
+					g_options->maxdumps - dumpsrunning);
 	    if((est->child = fork()) == 0) {
 		calc_estimates(est);		/* child does the estimate */
 		exit(0);
@@ -523,7 +532,7 @@ main(
 		error(_("calc_estimates fork failed: %s"), strerror(errno));
 		/*NOTREACHED*/
 	    }
-	    dumpsrunning++;			/* parent */
+	    dumpsrunning += est->nchildren;	/* parent */
 	}
     }
 
@@ -698,6 +707,54 @@ free_estimates(
     }
 }
 
+/*
+ * How many of the AVAILABLE maxdumps processes the estimate of EST may use.
+ * Only a gnutar client estimate runs its levels in parallel (see
+ * calc_levels_in_parallel), and only for a DLE on no spindle (-1): a
+ * spindle says its disk should be read by one process at a time, and each
+ * level is a full pass over it.  Everything else uses one process.
+ */
+static int
+estimate_children(
+    disk_estimates_t *	est,
+    int			available)
+{
+    int nchildren = 0;
+#ifdef GNUTAR
+    estimatelist_t el;
+    estimate_t estimate;
+    int level;
+
+    if (est->dle->spindle != -1 ||
+	est->dle->program_is_application_api == 1 ||
+	strcmp(est->dle->program, "GNUTAR") != 0 ||
+	(est->dle->device[0] == '/' && est->dle->device[1] == '/'))
+	return 1;
+
+    /* the first client-side method must be the gnutar estimate itself */
+    for (el = est->dle->estimatelist; el != NULL; el = el->next) {
+	estimate = (estimate_t)GPOINTER_TO_INT(el->data);
+	if (estimate == ES_CALCSIZE)
+	    return 1;
+	if (estimate == ES_CLIENT)
+	    break;
+    }
+    if (el == NULL)
+	return 1;
+
+    for (level = 0; level < DUMP_LEVELS; level++) {
+	if (est->est[level].needestimate)
+	    nchildren++;
+    }
+#endif
+
+    if (nchildren > available)
+	nchildren = available;
+    if (nchildren < 1)
+	nchildren = 1;
+    return nchildren;
+}
+
 /*
  * ------------------------------------------------------------------------
  *
@@ -967,6 +1024,116 @@ application_api_calc_estimate(
 }
 
 
+#ifdef GNUTAR
+/*
+ * Run CALC_LEVEL for each level of EST that needs an estimate, each in its
+ * own child process, and wait for them all.  Each level is a separate pass
+ * over the same files; run side by side, the passes after the first find
+ * the directories and inodes already cached, so the whole DLE takes about
+ * as long as its slowest level instead of the sum of them.  The children
+ * print their results under the "size" lock, as the estimate children do.
+ * At most est->nchildren levels run at once, so that the DLE stays within
+ * the maxdumps processes the main loop reserved for it; with one, the
+ * levels are estimated here one after the other.
+ */
+static void
+calc_levels_in_parallel(
+    disk_estimates_t *	est,
+    void		(*calc_level)(disk_estimates_t *, int))
+{
+    pid_t pids[DUMP_LEVELS];
+    int running = 0;
+    int level;
+
+    for (level = 0; level < DUMP_LEVELS; level++) {
+	pids[level] = 0;
+	if (!est->est[level].needestimate)
+	    continue;
+
+	if (est->nchildren <= 1) {
+	    calc_level(est, level);
+	    continue;
+	}
+
+	/* wait for a level to finish before starting another */
+	while (running >= est->nchildren) {
+	    if (wait_level_child(pids) == -1)
+		running = 0;
+	    else
+		running--;
+	}
+
+	fflush(stderr); fflush(stdout);
+	switch (pids[level] = fork()) {
+	case -1:
+	    dbprintf(_("fork for level %d failed, estimating it here: %s\n"),
+		     level, strerror(errno));
+	    pids[level] = 0;
+	    calc_level(est, level);
+	    break;
+
+	case 0:
+	    calc_level(est, level);
+	    exit(0);
+	    /*NOTREACHED*/
+
+	default:
+	    running++;
+	    break;
+	}
+    }
+
+    while (running > 0) {
+	if (wait_level_child(pids) == -1)
+	    break;
+	running--;
+    }
+}
+
+/*
+ * Wait for one of the level children in PIDS, and clear its entry.  Returns
+ * its level, or -1 if there is no child left to wait for.
+ */
+static int
+wait_level_child(
+    pid_t *	pids)
+{
+    pid_t child_pid;
+    amwait_t child_status;
+    int level;
+
+    for (;;) {
+	child_pid = wait(&child_status);
+	if (child_pid == -1) {
+	    if (errno == EINTR)
+		continue;
+	    dbprintf(_("wait for a level child failed: %s\n"), strerror(errno));
+	    return -1;
+	}
+
+	for (level = 0; level < DUMP_LEVELS; level++) {
+	    if (pids[level] == child_pid)
+		break;
+	}
+	if (level == DUMP_LEVELS) {
+	    dbprintf(_("unexpected child %ld\n"), (long)child_pid);
+	    continue;
+	}
+	pids[level] = 0;
+
+	if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0) {
+	    char *child_name = vstrallocf(_("level %d child %ld"), level,
+					  (long)child_pid);
+	    char *child_status_str = str_exit_status(child_name, child_status);
+	    dbprintf("%s\n", child_status_str);
+	    amfree(child_status_str);
+	    amfree(child_name);
+	}
+	return level;
+    }
+}
+#endif
+
 void
 generic_calc_estimates(
     disk_estimates_t *	est)
@@ -1212,42 +1379,45 @@ smbtar_calc_estimates(
 #endif
 
 #ifdef GNUTAR
-void
-gnutar_calc_estimates(
-    disk_estimates_t *	est)
+static void
+gnutar_calc_level(
+    disk_estimates_t *	est,
+    int			level)
 {
-    int level;
     off_t size;
     char *errmsg = NULL, *qerrmsg;
 
-    for(level = 0; level < DUMP_LEVELS; level++) {
-	if (est->est[level].needestimate) {
-	    dbprintf(_("getting size via gnutar for %s level %d\n"),
-		      est->qamname, level);
-	    size = getsize_gnutar(est->dle, level,
-				  est->est[level].dumpsince,
-				  &errmsg);
+    dbprintf(_("getting size via gnutar for %s level %d\n"),
+	      est->qamname, level);
+    size = getsize_gnutar(est->dle, level,
+			  est->est[level].dumpsince,
+			  &errmsg);
 
-	    amflock(1, "size");
+    amflock(1, "size");
 
-	    g_printf(_("%s %d SIZE %lld\n"),
-		   est->qamname, level, (long long)size);
-	    if (errmsg && errmsg[0] != '\0') {
-		if(am_has_feature(g_options->features,
-				  fe_rep_sendsize_quoted_error)) {
-		    qerrmsg = quote_string(errmsg);
-		    dbprintf(_("errmsg is %s\n"), errmsg);
-		    g_printf(_("%s %d ERROR %s\n"),
-			   est->qamname, level, qerrmsg);
-		    amfree(qerrmsg);
-		}
-	    }
-	    amfree(errmsg);
-	    fflush(stdout);
-
-	    amfunlock(1, "size");
+    g_printf(_("%s %d SIZE %lld\n"),
+	   est->qamname, level, (long long)size);
+    if (errmsg && errmsg[0] != '\0') {
+	if(am_has_feature(g_options->features,
+			  fe_rep_sendsize_quoted_error)) {
+	    qerrmsg = quote_string(errmsg);
+	    dbprintf(_("errmsg is %s\n"), errmsg);
+	    g_printf(_("%s %d ERROR %s\n"),
+		   est->qamname, level, qerrmsg);
+	    amfree(qerrmsg);
 	}
     }
+    amfree(errmsg);
+    fflush(stdout);
+
+    amfunlock(1, "size");
+}
+
+void
+gnutar_calc_estimates(
+    disk_estimates_t *	est)
+{
+    calc_levels_in_parallel(est, gnutar_calc_level);
 }
 #endif
 
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2008,2009 Zmanda, Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "testutils.h"
+#include "tarindex.h"
+
+#define TEST_DIR "tarindex-test.dir"
+#define TEST_TAR "tarindex-test.tar"
+
+/* too long for the name field of a tar header */
+#define LONG_NAME "a-name-that-does-not-fit-in-the-one-hundred-bytes-" \
+		  "of-a-tar-header-and-needs-a-record-of-its-own"
+
+/* more data extents than an old GNU sparse header holds, so that tar
+ * writes extension headers for them */
+#define SPARSE_EXTENTS 40
+
+#ifdef GNUTAR
+
+static gboolean
+write_file(
+    const char *filename,
+    int		extents)
+{
+    char block[TAR_BLOCK_SIZE];
+    int fd, i;
+
+    memset(block, 'x', SIZEOF(block));
+    if ((fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+	tu_dbg("cannot create %s: %s\n", filename, strerror(errno));
+	return FALSE;
+    }
+    /* EXTENTS blocks of data, with a 64k hole before each */
+    for (i = 0; i < extents; i++) {
+	if (lseek(fd, (off_t)65536, SEEK_CUR) < 0 ||
+	    full_write(fd, block, SIZEOF(block)) < SIZEOF(block)) {
+	    tu_dbg("cannot write %s: %s\n", filename, strerror(errno));
+	    close(fd);
+	    return FALSE;
+	}
+    }
+    close(fd);
+    return TRUE;
+}
+
+/* A directory, a file with a long name, a sparse file with many holes,
+ * and a file after it, whose header is only found if the sparse file was
+ * skipped correctly. */
+static gboolean
+make_tree(void)
+{
+    if (system("rm -rf " TEST_DIR) != 0 ||
+	mkdir(TEST_DIR, 0755) < 0 ||
+	mkdir(TEST_DIR "/dir", 0755) < 0) {
+	tu_dbg("cannot create " TEST_DIR ": %s\n", strerror(errno));
+	return FALSE;
+    }
+
+    return write_file(TEST_DIR "/dir/" LONG_NAME, 3) &&
+	   write_file(TEST_DIR "/sparse", SPARSE_EXTENTS) &&
+	   write_file(TEST_DIR "/zzz", 1);
+}
+
+/* Read a file or the output of a command into a string. */
+static char *
+read_all(
+    FILE *	f)
+{
+    GString *s = g_string_new("");
+    char buf[4096];
+    size_t n;
+
+    while ((n = fread(buf, 1, SIZEOF(buf), f)) > 0)
+	g_string_append_len(s, buf, n);
+    return g_string_free(s, FALSE);
+}
+
+/* The listing of TEST_TAR by GNU tar, less the leading '.' of each name,
+ * as sendbackup used to write the index. */
+static char *
+tar_listing(void)
+{
+    FILE *f;
+    char *listing, *line, *next;
+    GString *s = g_string_new("");
+
+    if ((f = popen(GNUTAR " --list --file " TEST_TAR, "r")) == NULL)
+	return NULL;
+    listing = read_all(f);
+    pclose(f);
+
+    for (line = listing; *line; line = next) {
+	next = strchr(line, '\n');
+	next = next ? next + 1 : line + strlen(line);
+	if (*line == '.')
+	    line++;
+	g_string_append_len(s, line, next - line);
+    }
+    amfree(listing);
+    return g_string_free(s, FALSE);
+}
+
+/* Make sure tar really wrote "./sparse" as an old GNU sparse member with
+ * extension headers, so that the test covers them. */
+static gboolean
+has_sparse_extensions(void)
+{
+    char h[TAR_BLOCK_SIZE];
+    gboolean found = FALSE;
+    int fd;
+
+    if ((fd = open(TEST_TAR, O_RDONLY)) < 0)
+	return FALSE;
+    while (full_read(fd, h, SIZEOF(h)) == SIZEOF(h)) {
+	if (strcmp(h, "./sparse") == 0 && h[156] == 'S' && h[482] != '\0') {
+	    found = TRUE;
+	    break;
+	}
+    }
+    close(fd);
+    return found;
+}
+
+/* Archive TEST_DIR with the given tar options, and check that the index
+ * of the archive matches GNU tar's own listing of it. */
+static gboolean
+check_index(
+    const char *tar_options,
+    gboolean	old_gnu_sparse)
+{
+    char *cmd, *expected, *got;
+    tar_index_t ti;
+    FILE *tarf, *indexf;
+    char buf[777];	/* not a multiple of the block size */
+    size_t n;
+    gboolean ok = TRUE;
+
+    if (!make_tree())
+	return FALSE;
+
+    cmd = vstralloc("cd " TEST_DIR " && " GNUTAR " --create --file ../" TEST_TAR,
+		    " ", tar_options, " .", NULL);
+    if (system(cmd) != 0) {
+	tu_dbg("'%s' failed\n", cmd);
+	amfree(cmd);
+	return FALSE;
+    }
+    amfree(cmd);
+
+    if (old_gnu_sparse && !has_sparse_extensions()) {
+	tu_dbg("tar did not write sparse extension headers\n");
+	ok = FALSE;
+    }
+
+    tarf = fopen(TEST_TAR, "r");
+    indexf = tmpfile();
+    if (!tarf || !indexf) {
+	tu_dbg("cannot open files: %s\n", strerror(errno));
+	return FALSE;
+    }
+    tar_index_init(&ti, indexf);
+    while ((n = fread(buf, 1, SIZEOF(buf), tarf)) > 0)
+	tar_index_data(&ti, buf, n);
+    fclose(tarf);
+
+    if (!ti.done || ti.failed) {
+	tu_dbg("index %s\n", ti.failed ? "failed" : "did not reach the end");
+	ok = FALSE;
+    }
+    tar_index_cleanup(&ti);
+
+    rewind(indexf);
+    got = read_all(indexf);
+    fclose(indexf);
+    expected = tar_listing();
+    if (!expected || strcmp(got, expected) != 0) {
+	tu_dbg("got index:\n%s\nexpected:\n%s\n", got,
+	       expected ? expected : "(tar --list failed)\n");
+	ok = FALSE;
+    }
+    amfree(got);
+    amfree(expected);
+
+    unlink(TEST_TAR);
+    (void)system("rm -rf " TEST_DIR);
+    return ok;
+}
+
+#endif /* GNUTAR */
+
+/****
+ * Old GNU format, as sendbackup-gnutar writes it: an 'L' member for the
+ * long name, and a sparse member with extension headers before its data
+ */
+static int
+test_gnu_format(void)
+{
+#ifdef GNUTAR
+    return check_index("--format=gnu --sparse", TRUE);
+#else
+    tu_dbg("no GNU tar; skipped\n");
+    return TRUE;
+#endif
+}
+
+/****
+ * pax format: the long name and the sparse map are in 'x' headers
+ */
+static int
+test_pax_format(void)
+{
+#ifdef GNUTAR
+    return check_index("--format=pax --sparse", FALSE);
+#else
+    tu_dbg("no GNU tar; skipped\n");
+    return TRUE;
+#endif
+}
+
+/****
+ * Driver
+ */
+
+int
+main(int argc, char **argv)
+{
+    static TestUtilsTest tests[] = {
+	TU_TEST(test_gnu_format, 90),
+	TU_TEST(test_pax_format, 90),
+	TU_END()
+    };
+
+    return testutils_run_tests(argc, argv, tests);
+}
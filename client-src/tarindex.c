@@ -0,0 +1,339 @@
+/*
+ * Amanda, The Advanced Maryland Automatic Network Disk Archiver
+ * Copyright (c) 2008,2009 Zmanda, Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "tarindex.h"
+
+#define TAR_MAX_EXTENDED (1024*1024)
+
+/* Parse a numeric header field, in octal or in GNU base-256. */
+static gboolean
+tar_number(
+    const char *field,
+    size_t	len,
+    off_t *	value)
+{
+    off_t v = 0;
+    size_t i = 0;
+
+    if ((guchar)field[0] & 0x80) {
+	if ((guchar)field[0] != 0x80)
+	    return FALSE;
+	for (i = 1; i < len; i++) {
+	    if (v > (G_MAXINT64 >> 8))
+		return FALSE;
+	    v = (v << 8) | (guchar)field[i];
+	}
+	*value = v;
+	return TRUE;
+    }
+
+    while (i < len && field[i] == ' ')
+	i++;
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+	if (v > (G_MAXINT64 >> 3))
+	    return FALSE;
+	v = (v << 3) | (field[i] - '0');
+    }
+    if (i < len && field[i] != ' ' && field[i] != '\0')
+	return FALSE;
+    *value = v;
+    return TRUE;
+}
+
+/* The length of a header string field, which need not be terminated. */
+static size_t
+tar_field_len(
+    const char *field,
+    size_t	len)
+{
+    const char *nul = memchr(field, '\0', len);
+
+    return nul ? (size_t)(nul - field) : len;
+}
+
+static gboolean
+tar_checksum_ok(
+    const char *header)
+{
+    off_t chksum;
+    long usum = 0, ssum = 0;
+    int i;
+
+    if (!tar_number(header + 148, 8, &chksum))
+	return FALSE;
+    for (i = 0; i < TAR_BLOCK_SIZE; i++) {
+	int c = (i >= 148 && i < 156) ? ' ' : header[i];
+	usum += (guchar)c;
+	ssum += (signed char)c;
+    }
+    return chksum == usum || chksum == ssum;
+}
+
+/* Write a name as GNU tar lists it, less a leading '.' */
+static void
+tar_index_name(
+    tar_index_t *ti,
+    const char *name,
+    size_t	len)
+{
+    size_t i;
+
+    if (len > 0 && name[0] == '.') {
+	name++;
+	len--;
+    }
+    for (i = 0; i < len; i++) {
+	guchar c = (guchar)name[i];
+
+	switch (c) {
+	case '\\': fputs("\\\\", ti->out); break;
+	case '\a': fputs("\\a", ti->out); break;
+	case '\b': fputs("\\b", ti->out); break;
+	case '\f': fputs("\\f", ti->out); break;
+	case '\n': fputs("\\n", ti->out); break;
+	case '\r': fputs("\\r", ti->out); break;
+	case '\t': fputs("\\t", ti->out); break;
+	case '\v': fputs("\\v", ti->out); break;
+	default:
+	    if (c >= 0x20 && c < 0x7f)
+		putc(c, ti->out);
+	    else
+		fprintf(ti->out, "\\%03o", c);
+	    break;
+	}
+    }
+    putc('\n', ti->out);
+}
+
+static void
+tar_index_fail(
+    tar_index_t *ti,
+    const char *msg)
+{
+    dbprintf(_("index tee: %s; the index is incomplete\n"), msg);
+    ti->failed = TRUE;
+    ti->done = TRUE;
+}
+
+/* Pick the path and size out of the records of a pax extended header. */
+static void
+tar_index_pax(
+    tar_index_t *ti)
+{
+    char *p = ti->ext;
+    char *end = ti->ext + ti->ext_len;
+
+    while (p < end) {
+	char *rec = p, *key, *value, *rec_end;
+	size_t reclen = 0;
+
+	while (p < end && g_ascii_isdigit(*p))
+	    reclen = reclen * 10 + (*p++ - '0');
+	if (p >= end || *p != ' ' || reclen == 0 ||
+	    reclen > (size_t)(end - rec) || rec[reclen-1] != '\n') {
+	    tar_index_fail(ti, _("bad pax extended header"));
+	    return;
+	}
+	key = p + 1;
+	rec_end = rec + reclen - 1;
+	p = rec + reclen;
+	for (value = key; value < rec_end && *value != '='; value++)
+	    continue;
+	if (value == rec_end)
+	    continue;
+	*value++ = '\0';
+
+	if (strcmp(key, "path") == 0 || strcmp(key, "GNU.sparse.name") == 0) {
+	    amfree(ti->long_name);
+	    ti->long_name = alloc((size_t)(rec_end - value) + 1);
+	    memcpy(ti->long_name, value, (size_t)(rec_end - value));
+	    ti->long_name[rec_end - value] = '\0';
+	} else if (strcmp(key, "size") == 0) {
+	    ti->pax_size = (off_t)g_ascii_strtoull(value, NULL, 10);
+	}
+    }
+}
+
+static void
+tar_index_header(
+    tar_index_t *ti)
+{
+    char *h = ti->header;
+    char type = h[156];
+    off_t size;
+    int i;
+
+    if (ti->sparse_headers) {
+	/* the member's data follows the last extension header */
+	if (h[504] == '\0') {
+	    ti->sparse_headers = FALSE;
+	    ti->skip = ti->sparse_skip;
+	    ti->sparse_skip = 0;
+	}
+	return;
+    }
+
+    for (i = 0; i < TAR_BLOCK_SIZE && h[i] == '\0'; i++)
+	continue;
+    if (i == TAR_BLOCK_SIZE) {
+	/* end of archive */
+	ti->done = TRUE;
+	return;
+    }
+
+    if (!tar_checksum_ok(h)) {
+	tar_index_fail(ti, _("bad tar header checksum"));
+	return;
+    }
+    if (!tar_number(h + 124, 12, &size) || size < 0) {
+	tar_index_fail(ti, _("bad tar header size"));
+	return;
+    }
+
+    switch (type) {
+    case 'L':
+    case 'x':
+	if (size > TAR_MAX_EXTENDED) {
+	    tar_index_fail(ti, _("tar extended header too large"));
+	    return;
+	}
+	ti->ext_type = type;
+	ti->ext_size = (size_t)size;
+	ti->ext_len = 0;
+	ti->ext = alloc(ti->ext_size + 1);
+	break;
+
+    case 'K':
+    case 'g':
+    case 'V':
+    case 'M':
+	break;
+
+    default:
+	if (ti->pax_size >= 0)
+	    size = ti->pax_size;
+	if (ti->long_name) {
+	    tar_index_name(ti, ti->long_name, strlen(ti->long_name));
+	} else {
+	    char name[257];
+	    size_t len = 0, name_len;
+
+	    /* POSIX ustar has a prefix; old GNU keeps times there */
+	    if (memcmp(h + 257, "ustar\0", 6) == 0 && h[345] != '\0') {
+		len = tar_field_len(h + 345, 155);
+		memcpy(name, h + 345, len);
+		name[len++] = '/';
+	    }
+	    name_len = tar_field_len(h, 100);
+	    memcpy(name + len, h, name_len);
+	    len += name_len;
+	    tar_index_name(ti, name, len);
+	}
+	amfree(ti->long_name);
+	ti->pax_size = -1;
+
+	/* hard links and directories have no data */
+	if (type == '1' || type == '5')
+	    size = 0;
+	if (type == 'S' && h[482] != '\0') {
+	    /* old GNU sparse extension headers come before the data */
+	    ti->sparse_headers = TRUE;
+	    ti->sparse_skip = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE
+			      * TAR_BLOCK_SIZE;
+	    return;
+	}
+	break;
+    }
+
+    ti->skip = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+    if (ti->ext && ti->skip == 0) {
+	/* an empty extended header */
+	amfree(ti->ext);
+	ti->ext_type = '\0';
+    }
+}
+
+void
+tar_index_data(
+    tar_index_t *ti,
+    const char *buf,
+    size_t	len)
+{
+    while (len > 0 && !ti->done) {
+	if (ti->skip > 0) {
+	    size_t n = len;
+
+	    if ((off_t)n > ti->skip)
+		n = (size_t)ti->skip;
+	    if (ti->ext && ti->ext_len < ti->ext_size) {
+		size_t want = MIN(n, ti->ext_size - ti->ext_len);
+		memcpy(ti->ext + ti->ext_len, buf, want);
+		ti->ext_len += want;
+	    }
+	    buf += n;
+	    len -= n;
+	    ti->skip -= n;
+
+	    if (ti->skip == 0 && ti->ext) {
+		ti->ext[ti->ext_len] = '\0';
+		if (ti->ext_type == 'L') {
+		    amfree(ti->long_name);
+		    ti->long_name = ti->ext;
+		    ti->ext = NULL;
+		} else {
+		    tar_index_pax(ti);
+		    amfree(ti->ext);
+		}
+		ti->ext_type = '\0';
+	    }
+	} else {
+	    size_t n = MIN(len, TAR_BLOCK_SIZE - ti->header_len);
+
+	    memcpy(ti->header + ti->header_len, buf, n);
+	    ti->header_len += n;
+	    buf += n;
+	    len -= n;
+	    if (ti->header_len == TAR_BLOCK_SIZE) {
+		ti->header_len = 0;
+		tar_index_header(ti);
+	    }
+	}
+    }
+}
+
+void
+tar_index_init(
+    tar_index_t *ti,
+    FILE *	out)
+{
+    memset(ti, 0, SIZEOF(*ti));
+    ti->out = out;
+    ti->pax_size = -1;
+}
+
+void
+tar_index_cleanup(
+    tar_index_t *ti)
+{
+    amfree(ti->ext);
+    amfree(ti->long_name);
+}
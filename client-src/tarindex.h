@@ -0,0 +1,61 @@
+/*
+ * Amanda, The Advanced Maryland Automatic Network Disk Archiver
+ * Copyright (c) 2008,2009 Zmanda, Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+/*
+ * An index of a tar stream, built from its headers as the data goes by.
+ * The index lists each member as "tar -tf - | sed -e 's/^\.//'" would,
+ * quoted the way GNU tar lists names in the C locale.
+ */
+
+#ifndef TARINDEX_H
+#define TARINDEX_H
+
+#include "amanda.h"
+
+#define TAR_BLOCK_SIZE 512
+
+typedef struct tar_index_s {
+    FILE *out;
+    char header[TAR_BLOCK_SIZE];
+    size_t header_len;
+    off_t skip;			/* member data and padding left to skip */
+    gboolean sparse_headers;	/* old GNU sparse extension headers follow */
+    off_t sparse_skip;		/* data to skip after those headers */
+    char ext_type;		/* 'L' or 'x' while gathering their data */
+    char *ext;
+    size_t ext_len, ext_size;
+    char *long_name;		/* from a GNU 'L' member or pax path */
+    off_t pax_size;		/* from a pax size, or -1 */
+    gboolean done;		/* the end of the archive was seen */
+    gboolean failed;		/* the stream could not be parsed */
+} tar_index_t;
+
+/* Start an index, written to OUT. */
+void tar_index_init(tar_index_t *ti, FILE *out);
+
+/* Index the next LEN bytes of the tar stream.  Once ti->done is set, the
+ * rest of the stream is ignored. */
+void tar_index_data(tar_index_t *ti, const char *buf, size_t len);
+
+/* Free everything but OUT, which the caller closes. */
+void tar_index_cleanup(tar_index_t *ti);
+
+#endif /* TARINDEX_H */
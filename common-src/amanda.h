@@ -1174,6 +1174,7 @@ extern ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
 #define BIND_CYCLE_RETRIES	120		/* Total of 30 minutes */
 
 #define MAX_DUMPERS 63
+#define MAX_TAPERS 16
 
 #ifndef NI_MAXHOST
 #define NI_MAXHOST 1025
@@ -158,6 +158,7 @@ am_init_feature_set(void)
 	am_add_feature(f, fe_xml_data_path);
 	am_add_feature(f, fe_xml_directtcp_list);
 	am_add_feature(f, fe_amidxtaped_datapath);
+	am_add_feature(f, fe_large_network_blocks);
     }
     return f;
 }
@@ -62,6 +62,7 @@ static void *	bsd_stream_client(void *, int);
 static void	bsd_stream_close(void *);
 static int	bsd_stream_auth(void *);
 static int	bsd_stream_id(void *);
+static int	bsd_stream_fd(void *);
 static void	bsd_stream_read(void *, void (*)(void *, void *, ssize_t), void *);
 static ssize_t	bsd_stream_read_sync(void *, void **);
 static void	bsd_stream_read_cancel(void *);
@@ -89,7 +90,8 @@ const security_driver_t bsd_security_driver = {
     bsd_stream_read_cancel,
     sec_close_connection_none,
     NULL,
-    NULL
+    NULL,
+    bsd_stream_fd
 };
 
 /*
@@ -401,7 +403,7 @@ bsd_stream_server(
     bs = alloc(SIZEOF(*bs));
     security_streaminit(&bs->secstr, &bsd_security_driver);
     bs->socket = stream_server(SU_GET_FAMILY(&bh->udp->peer), &bs->port,
-			       (size_t)STREAM_BUFSIZE, (size_t)STREAM_BUFSIZE,
+			       (size_t)STREAM_BUFSIZE_LARGE, (size_t)STREAM_BUFSIZE_LARGE,
 			       0);
     if (bs->socket < 0) {
 	security_seterror(&bh->sech,
@@ -428,7 +430,7 @@ bsd_stream_accept(
     assert(bs->socket != -1);
     assert(bs->fd < 0);
 
-    bs->fd = stream_accept(bs->socket, 30, STREAM_BUFSIZE, STREAM_BUFSIZE);
+    bs->fd = stream_accept(bs->socket, 30, STREAM_BUFSIZE_LARGE, STREAM_BUFSIZE_LARGE);
     if (bs->fd < 0) {
 	security_stream_seterror(&bs->secstr,
 	    _("can't accept new stream connection: %s"), strerror(errno));
@@ -456,7 +458,7 @@ bsd_stream_client(
     bs = alloc(SIZEOF(*bs));
     security_streaminit(&bs->secstr, &bsd_security_driver);
     bs->fd = stream_client(bh->hostname, (in_port_t)id,
-	STREAM_BUFSIZE, STREAM_BUFSIZE, &bs->port, 0);
+	STREAM_BUFSIZE_LARGE, STREAM_BUFSIZE_LARGE, &bs->port, 0);
     if (bs->fd < 0) {
 	security_seterror(&bh->sech,
 	    _("can't connect stream to %s port %d: %s"), bh->hostname,
@@ -517,6 +519,21 @@ bsd_stream_id(
     return ((int)bs->port);
 }
 
+/*
+ * Returns the connected socket for this stream.  bsd streams carry the
+ * data as-is, so it can be written straight to the socket.
+ */
+static int
+bsd_stream_fd(
+    void *	s)
+{
+    struct sec_stream *bs = s;
+
+    assert(bs != NULL);
+
+    return (bs->fd);
+}
+
 /*
  * Submit a request to read some data.  Calls back with the given function
  * and arg when completed.
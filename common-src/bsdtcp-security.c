@@ -82,6 +82,7 @@ const security_driver_t bsdtcp_security_driver = {
     tcpm_stream_read_cancel,
     tcpm_close_connection,
     NULL,
+    NULL,
     NULL
 };
 
@@ -264,8 +265,8 @@ runbsdtcp(
 
     server_socket = stream_client_privileged(rc->hostname,
 				     port,
-				     STREAM_BUFSIZE,
-				     STREAM_BUFSIZE,
+				     STREAM_BUFSIZE_LARGE,
+				     STREAM_BUFSIZE_LARGE,
 				     &my_port,
 				     0);
     set_root_privs(0);
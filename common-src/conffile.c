@@ -81,7 +81,7 @@ typedef enum {
     CONF_LARGEST,		CONF_LARGESTFIT,	CONF_SMALLEST,
     CONF_LAST,			CONF_DISPLAYUNIT,	CONF_RESERVED_UDP_PORT,
     CONF_RESERVED_TCP_PORT,	CONF_UNRESERVED_TCP_PORT,
-    CONF_TAPERFLUSH,
+    CONF_TAPERFLUSH,		CONF_TAPER_SPILL_DIR,	CONF_TAPER_PARALLEL_WRITE,
     CONF_FLUSH_THRESHOLD_DUMPED,
     CONF_FLUSH_THRESHOLD_SCHEDULED,
     CONF_DEVICE_PROPERTY,      CONF_PROPERTY,		CONF_PLUGIN,
@@ -107,7 +107,7 @@ typedef enum {
 
     /* holding disk */
     CONF_COMMENT,		CONF_DIRECTORY,		CONF_USE,
-    CONF_CHUNKSIZE,
+    CONF_CHUNKSIZE,		CONF_WRITE_BUFFER_SIZE,	CONF_DIRECT_IO,
 
     /* dump type */
     /*COMMENT,*/		CONF_PROGRAM,		CONF_DUMPCYCLE,
@@ -516,10 +516,12 @@ static void validate_runspercycle(conf_var_t *, val_t *);
 static void validate_bumppercent(conf_var_t *, val_t *);
 static void validate_bumpmult(conf_var_t *, val_t *);
 static void validate_inparallel(conf_var_t *, val_t *);
+static void validate_taper_parallel_write(conf_var_t *, val_t *);
 static void validate_displayunit(conf_var_t *, val_t *);
 static void validate_reserve(conf_var_t *, val_t *);
 static void validate_use(conf_var_t *, val_t *);
 static void validate_chunksize(conf_var_t *, val_t *);
+static void validate_write_buffer_size(conf_var_t *, val_t *);
 static void validate_blocksize(conf_var_t *, val_t *);
 static void validate_debug(conf_var_t *, val_t *);
 static void validate_port_range(val_t *, int, int);
@@ -837,6 +839,7 @@ keytab_t server_keytab[] = {
     { "DEVICE", CONF_DEVICE },
     { "DEVICE_PROPERTY", CONF_DEVICE_PROPERTY },
     { "DIRECTORY", CONF_DIRECTORY },
+    { "DIRECT_IO", CONF_DIRECT_IO },
     { "DIRECTTCP", CONF_DIRECTTCP },
     { "DISKFILE", CONF_DISKFILE },
     { "DISPLAYUNIT", CONF_DISPLAYUNIT },
@@ -960,12 +963,15 @@ keytab_t server_keytab[] = {
     { "FLUSH_THRESHOLD_DUMPED", CONF_FLUSH_THRESHOLD_DUMPED },
     { "FLUSH_THRESHOLD_SCHEDULED", CONF_FLUSH_THRESHOLD_SCHEDULED },
     { "TAPERFLUSH", CONF_TAPERFLUSH },
+    { "TAPER_SPILL_DIR", CONF_TAPER_SPILL_DIR },
+    { "TAPER_PARALLEL_WRITE", CONF_TAPER_PARALLEL_WRITE },
     { "TAPETYPE", CONF_TAPETYPE },
     { "TAPE_SPLITSIZE", CONF_TAPE_SPLITSIZE },
     { "TPCHANGER", CONF_TPCHANGER },
     { "UNRESERVED_TCP_PORT", CONF_UNRESERVED_TCP_PORT },
     { "USE", CONF_USE },
     { "USETIMESTAMPS", CONF_USETIMESTAMPS },
+    { "WRITE_BUFFER_SIZE", CONF_WRITE_BUFFER_SIZE },
     { NULL, CONF_IDENT },
     { NULL, CONF_UNKNOWN }
 };
@@ -1123,6 +1129,8 @@ conf_var_t server_var [] = {
    { CONF_FLUSH_THRESHOLD_DUMPED, CONFTYPE_INT     , read_int         , CNF_FLUSH_THRESHOLD_DUMPED, validate_nonnegative },
    { CONF_FLUSH_THRESHOLD_SCHEDULED, CONFTYPE_INT  , read_int         , CNF_FLUSH_THRESHOLD_SCHEDULED, validate_nonnegative },
    { CONF_TAPERFLUSH           , CONFTYPE_INT      , read_int         , CNF_TAPERFLUSH           , validate_nonnegative },
+   { CONF_TAPER_SPILL_DIR      , CONFTYPE_STR      , read_str         , CNF_TAPER_SPILL_DIR      , NULL },
+   { CONF_TAPER_PARALLEL_WRITE , CONFTYPE_INT      , read_int         , CNF_TAPER_PARALLEL_WRITE , validate_taper_parallel_write },
    { CONF_DISPLAYUNIT          , CONFTYPE_STR      , read_str         , CNF_DISPLAYUNIT          , validate_displayunit },
    { CONF_AUTOFLUSH            , CONFTYPE_BOOLEAN  , read_bool        , CNF_AUTOFLUSH            , NULL },
    { CONF_RESERVE              , CONFTYPE_INT      , read_int         , CNF_RESERVE              , validate_reserve },
@@ -1219,11 +1227,13 @@ conf_var_t dumptype_var [] = {
 };
 
 conf_var_t holding_var [] = {
-   { CONF_DIRECTORY, CONFTYPE_STR   , read_str   , HOLDING_DISKDIR  , NULL },
-   { CONF_COMMENT  , CONFTYPE_STR   , read_str   , HOLDING_COMMENT  , NULL },
-   { CONF_USE      , CONFTYPE_INT64 , read_int64 , HOLDING_DISKSIZE , validate_use },
-   { CONF_CHUNKSIZE, CONFTYPE_INT64 , read_int64 , HOLDING_CHUNKSIZE, validate_chunksize },
-   { CONF_UNKNOWN  , CONFTYPE_INT   , NULL       , HOLDING_HOLDING  , NULL }
+   { CONF_DIRECTORY        , CONFTYPE_STR    , read_str   , HOLDING_DISKDIR          , NULL },
+   { CONF_COMMENT          , CONFTYPE_STR    , read_str   , HOLDING_COMMENT          , NULL },
+   { CONF_USE              , CONFTYPE_INT64  , read_int64 , HOLDING_DISKSIZE         , validate_use },
+   { CONF_CHUNKSIZE        , CONFTYPE_INT64  , read_int64 , HOLDING_CHUNKSIZE        , validate_chunksize },
+   { CONF_WRITE_BUFFER_SIZE, CONFTYPE_INT64  , read_int64 , HOLDING_WRITE_BUFFER_SIZE, validate_write_buffer_size },
+   { CONF_DIRECT_IO        , CONFTYPE_BOOLEAN, read_bool  , HOLDING_DIRECT_IO        , NULL },
+   { CONF_UNKNOWN          , CONFTYPE_INT    , NULL       , HOLDING_HOLDING          , NULL }
 };
 
 conf_var_t interface_var [] = {
@@ -1972,6 +1982,8 @@ init_holdingdisk_defaults(
     conf_init_int64(&hdcur.value[HOLDING_DISKSIZE] , (gint64)0);
                     /* 1 Gb = 1M counted in 1Kb blocks */
     conf_init_int64(&hdcur.value[HOLDING_CHUNKSIZE], (gint64)1024*1024);
+    conf_init_int64(&hdcur.value[HOLDING_WRITE_BUFFER_SIZE], (gint64)1024);
+    conf_init_bool(&hdcur.value[HOLDING_DIRECT_IO], 0);
 }
 
 static void
@@ -3999,6 +4011,16 @@ validate_inparallel(
 		       MAX_DUMPERS);
 }
 
+static void
+validate_taper_parallel_write(
+    struct conf_var_s *np G_GNUC_UNUSED,
+    val_t        *val)
+{
+    if(val_t__int(val) < 1 || val_t__int(val) >MAX_TAPERS)
+	conf_parserror(_("taper-parallel-write must be between 1 and MAX_TAPERS (%d)"),
+		       MAX_TAPERS);
+}
+
 static void
 validate_bumpmult(
     struct conf_var_s *np G_GNUC_UNUSED,
@@ -4073,6 +4095,18 @@ validate_chunksize(
     }
 }
 
+static void
+validate_write_buffer_size(
+    struct conf_var_s *np G_GNUC_UNUSED,
+    val_t        *val)
+{
+    /* NOTE: this function modifies the target value (rounding) */
+    val_t__int64(val) = am_floor(val_t__int64(val), (gint64)DISK_BLOCK_KB);
+    if (val_t__int64(val) < DISK_BLOCK_KB) {
+	conf_parserror("write-buffer-size must be at least %dkb", DISK_BLOCK_KB);
+    }
+}
+
 static void
 validate_blocksize(
     struct conf_var_s *np G_GNUC_UNUSED,
@@ -4399,6 +4433,8 @@ init_defaults(
     conf_init_int      (&conf_data[CNF_FLUSH_THRESHOLD_DUMPED]   , 0);
     conf_init_int      (&conf_data[CNF_FLUSH_THRESHOLD_SCHEDULED], 0);
     conf_init_int      (&conf_data[CNF_TAPERFLUSH]               , 0);
+    conf_init_str   (&conf_data[CNF_TAPER_SPILL_DIR]      , "");
+    conf_init_int      (&conf_data[CNF_TAPER_PARALLEL_WRITE]     , 1);
     conf_init_str   (&conf_data[CNF_DISPLAYUNIT]          , "k");
     conf_init_str   (&conf_data[CNF_KRB5KEYTAB]           , "/.amanda-v5-keytab");
     conf_init_str   (&conf_data[CNF_KRB5PRINCIPAL]        , "service/amanda");
@@ -400,6 +400,8 @@ typedef enum {
     CNF_FLUSH_THRESHOLD_DUMPED,
     CNF_FLUSH_THRESHOLD_SCHEDULED,
     CNF_TAPERFLUSH,
+    CNF_TAPER_SPILL_DIR,
+    CNF_TAPER_PARALLEL_WRITE,
     CNF_DISPLAYUNIT,
     CNF_KRB5KEYTAB,
     CNF_KRB5PRINCIPAL,
@@ -791,6 +793,8 @@ typedef enum {
     HOLDING_DISKDIR,
     HOLDING_DISKSIZE,
     HOLDING_CHUNKSIZE,
+    HOLDING_WRITE_BUFFER_SIZE,
+    HOLDING_DIRECT_IO,
     HOLDING_HOLDING /* sentinel */
 } holdingdisk_key;
 
@@ -844,6 +848,8 @@ char *holdingdisk_name(holdingdisk_t *hdisk);
 #define holdingdisk_get_diskdir(hdisk)   (val_t_to_str(holdingdisk_getconf((hdisk), HOLDING_DISKDIR)))
 #define holdingdisk_get_disksize(hdisk)  (val_t_to_int64(holdingdisk_getconf((hdisk), HOLDING_DISKSIZE)))
 #define holdingdisk_get_chunksize(hdisk) (val_t_to_int64(holdingdisk_getconf((hdisk), HOLDING_CHUNKSIZE)))
+#define holdingdisk_get_write_buffer_size(hdisk) (val_t_to_int64(holdingdisk_getconf((hdisk), HOLDING_WRITE_BUFFER_SIZE)))
+#define holdingdisk_get_direct_io(hdisk) (val_t_to_boolean(holdingdisk_getconf((hdisk), HOLDING_DIRECT_IO)))
 
 /* A application-tool interface */
 typedef enum application_e  {
@@ -76,6 +76,7 @@ const security_driver_t local_security_driver = {
     tcpm_stream_read_cancel,
     tcpm_close_connection,
     NULL,
+    NULL,
     NULL
 };
 
@@ -71,60 +71,106 @@ clean_regex(
     return result;
 }
 
-int
-match(
+/*
+ * Compiled regexes are cached, since the same few expressions (from the
+ * dumpspecs, the exclude lists, ...) are usually matched against a great
+ * many strings.  Entries are never freed, so a pointer returned from the
+ * cache stays valid without holding the lock; once the cache is full, new
+ * expressions are compiled for the one call only.
+ */
+#define REGEX_CACHE_MAX 1000
+
+static GStaticMutex regex_cache_mutex = G_STATIC_MUTEX_INIT;
+static GHashTable *regex_cache = NULL;
+static GHashTable *regex_cache_newline = NULL;
+
+/* Match STR against REGEX, using the compiled-regex cache.  Returns 1 on a
+ * match, 0 if there is no match, and -1 on error, with the message in ERRMSG
+ * (which must be STR_SIZE bytes). */
+static int
+do_match(
     const char *	regex,
-    const char *	str)
+    const char *	str,
+    gboolean		match_newline,
+    char *		errmsg)
 {
-    regex_t regc;
+    GHashTable **cache;
+    regex_t *regc;
+    regex_t tmpregc;
     int result;
-    char errmsg[STR_SIZE];
+    int cflags = REG_EXTENDED|REG_NOSUB;
+
+    if (match_newline)
+	cflags |= REG_NEWLINE;
+    cache = match_newline? &regex_cache_newline : &regex_cache;
+
+    g_static_mutex_lock(&regex_cache_mutex);
+    if (!*cache)
+	*cache = g_hash_table_new(g_str_hash, g_str_equal);
+    regc = g_hash_table_lookup(*cache, regex);
+    if (!regc) {
+	if (g_hash_table_size(*cache) < REGEX_CACHE_MAX)
+	    regc = alloc(SIZEOF(regex_t));
+	else
+	    regc = &tmpregc;
+
+	if ((result = regcomp(regc, regex, cflags)) != 0) {
+	    regerror(result, regc, errmsg, STR_SIZE);
+	    if (regc != &tmpregc)
+		amfree(regc);
+	    g_static_mutex_unlock(&regex_cache_mutex);
+	    return -1;
+	}
 
-    if((result = regcomp(&regc, regex,
-			 REG_EXTENDED|REG_NOSUB|REG_NEWLINE)) != 0) {
-        regerror(result, &regc, errmsg, SIZEOF(errmsg));
-	error(_("regex \"%s\": %s"), regex, errmsg);
-	/*NOTREACHED*/
+	if (regc != &tmpregc)
+	    g_hash_table_insert(*cache, stralloc(regex), regc);
     }
+    g_static_mutex_unlock(&regex_cache_mutex);
 
-    if((result = regexec(&regc, str, 0, 0, 0)) != 0
-       && result != REG_NOMATCH) {
-        regerror(result, &regc, errmsg, SIZEOF(errmsg));
-	error(_("regex \"%s\": %s"), regex, errmsg);
-	/*NOTREACHED*/
+    if ((result = regexec(regc, str, 0, 0, 0)) != 0
+	&& result != REG_NOMATCH) {
+	regerror(result, regc, errmsg, STR_SIZE);
+	result = -1;
+    } else {
+	result = (result == 0);
     }
 
-    regfree(&regc);
+    if (regc == &tmpregc)
+	regfree(&tmpregc);
 
-    return result == 0;
+    return result;
 }
 
 int
-match_no_newline(
+match(
     const char *	regex,
     const char *	str)
 {
-    regex_t regc;
     int result;
     char errmsg[STR_SIZE];
 
-    if((result = regcomp(&regc, regex,
-			 REG_EXTENDED|REG_NOSUB)) != 0) {
-        regerror(result, &regc, errmsg, SIZEOF(errmsg));
+    if ((result = do_match(regex, str, TRUE, errmsg)) < 0) {
 	error(_("regex \"%s\": %s"), regex, errmsg);
 	/*NOTREACHED*/
     }
 
-    if((result = regexec(&regc, str, 0, 0, 0)) != 0
-       && result != REG_NOMATCH) {
-        regerror(result, &regc, errmsg, SIZEOF(errmsg));
+    return result;
+}
+
+int
+match_no_newline(
+    const char *	regex,
+    const char *	str)
+{
+    int result;
+    char errmsg[STR_SIZE];
+
+    if ((result = do_match(regex, str, FALSE, errmsg)) < 0) {
 	error(_("regex \"%s\": %s"), regex, errmsg);
 	/*NOTREACHED*/
     }
 
-    regfree(&regc);
-
-    return result == 0;
+    return result;
 }
 
 char *
@@ -156,29 +202,18 @@ match_glob(
     const char *	str)
 {
     char *regex;
-    regex_t regc;
     int result;
     char errmsg[STR_SIZE];
 
     regex = glob_to_regex(glob);
-    if((result = regcomp(&regc, regex,
-			 REG_EXTENDED|REG_NOSUB|REG_NEWLINE)) != 0) {
-        regerror(result, &regc, errmsg, SIZEOF(errmsg));
-	error(_("glob \"%s\" -> regex \"%s\": %s"), glob, regex, errmsg);
-	/*NOTREACHED*/
-    }
-
-    if((result = regexec(&regc, str, 0, 0, 0)) != 0
-       && result != REG_NOMATCH) {
-        regerror(result, &regc, errmsg, SIZEOF(errmsg));
+    if ((result = do_match(regex, str, TRUE, errmsg)) < 0) {
 	error(_("glob \"%s\" -> regex \"%s\": %s"), glob, regex, errmsg);
 	/*NOTREACHED*/
     }
 
-    regfree(&regc);
     amfree(regex);
 
-    return result == 0;
+    return result;
 }
 
 char *
@@ -264,29 +299,18 @@ match_tar(
     const char *	str)
 {
     char *regex;
-    regex_t regc;
     int result;
     char errmsg[STR_SIZE];
 
     regex = tar_to_regex(glob);
-    if((result = regcomp(&regc, regex,
-			 REG_EXTENDED|REG_NOSUB|REG_NEWLINE)) != 0) {
-        regerror(result, &regc, errmsg, SIZEOF(errmsg));
+    if ((result = do_match(regex, str, TRUE, errmsg)) < 0) {
 	error(_("glob \"%s\" -> regex \"%s\": %s"), glob, regex, errmsg);
 	/*NOTREACHED*/
     }
 
-    if((result = regexec(&regc, str, 0, 0, 0)) != 0
-       && result != REG_NOMATCH) {
-        regerror(result, &regc, errmsg, SIZEOF(errmsg));
-	error(_("glob \"%s\" -> regex \"%s\": %s"), glob, regex, errmsg);
-	/*NOTREACHED*/
-    }
-
-    regfree(&regc);
     amfree(regex);
 
-    return result == 0;
+    return result;
 }
 
 char *
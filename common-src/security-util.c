@@ -558,8 +558,18 @@ tcpm_recv_token(
 	*size = -1;
 	return -1;
     }
-    amfree(*buf);
-    *buf = alloc((size_t)*size);
+    if (buf == &rc->pkt) {
+	/* the connection's own buffer: the previous token has been handed
+	 * to its stream already, so reuse the buffer, growing it if need be */
+	if (rc->pktsize < (size_t)*size || rc->pkt == NULL) {
+	    amfree(rc->pkt);
+	    rc->pktsize = MAX((size_t)*size, NETWORK_BLOCK_BYTES);
+	    rc->pkt = alloc(rc->pktsize);
+	}
+    } else {
+	amfree(*buf);
+	*buf = alloc((size_t)*size);
+    }
 
     if(*size == 0) {
 	auth_debug(1, _("tcpm_recv_token: read EOF from %d\n"), *handle);
@@ -588,8 +598,16 @@ tcpm_recv_token(
 	ssize_t decsize;
 	rc->driver->data_decrypt(rc, *buf, *size, &decbuf, &decsize);
 	if (*buf != (char *)decbuf) {
-	    amfree(*buf);
-	    *buf = (char *)decbuf;
+	    if (buf == &rc->pkt && (size_t)decsize <= rc->pktsize) {
+		/* keep the connection's buffer */
+		memcpy(rc->pkt, decbuf, (size_t)decsize);
+		amfree(decbuf);
+	    } else {
+		amfree(*buf);
+		*buf = (char *)decbuf;
+		if (buf == &rc->pkt)
+		    rc->pktsize = (size_t)decsize;
+	    }
 	}
 	*size = decsize;
     }
@@ -764,7 +782,7 @@ tcp1_stream_server(
 	rh->rc->driver = rh->sech.driver;
 	rs->rc = rh->rc;
 	rs->socket = stream_server(SU_GET_FAMILY(&rh->udp->peer), &rs->port,
-				   STREAM_BUFSIZE, STREAM_BUFSIZE, 0);
+				   STREAM_BUFSIZE_LARGE, STREAM_BUFSIZE_LARGE, 0);
 	if (rs->socket < 0) {
 	    security_seterror(&rh->sech,
 			    _("can't create server stream: %s"), strerror(errno));
@@ -795,7 +813,7 @@ tcp1_stream_accept(
     assert(bs->fd < 0);
 
     if (bs->socket > 0) {
-	bs->fd = stream_accept(bs->socket, 30, STREAM_BUFSIZE, STREAM_BUFSIZE);
+	bs->fd = stream_accept(bs->socket, 30, STREAM_BUFSIZE_LARGE, STREAM_BUFSIZE_LARGE);
 	if (bs->fd < 0) {
 	    security_stream_seterror(&bs->secstr,
 				     _("can't accept new stream connection: %s"),
@@ -836,7 +854,7 @@ tcp1_stream_client(
 	rh->rc->driver = rh->sech.driver;
 	rs->rc = rh->rc;
 	rh->rc->read = stream_client(rh->hostname, (in_port_t)id,
-			STREAM_BUFSIZE, STREAM_BUFSIZE, &rs->port, 0);
+			STREAM_BUFSIZE_LARGE, STREAM_BUFSIZE_LARGE, &rs->port, 0);
 	if (rh->rc->read < 0) {
 	    security_seterror(&rh->sech,
 			      _("can't connect stream to %s port %d: %s"),
@@ -1466,6 +1484,7 @@ sec_tcp_conn_get(
     rc->refcnt = 1;
     rc->handle = -1;
     rc->pkt = NULL;
+    rc->pktsize = 0;
     rc->accept_fn = NULL;
     rc->recv_security_ok = NULL;
     rc->prefix_packet = NULL;
@@ -1508,6 +1527,7 @@ sec_tcp_conn_put(
 	amfree(rc->errmsg);
     connq = g_slist_remove(connq, rc);
     amfree(rc->pkt);
+    rc->pktsize = 0;
     if(!rc->donotclose) {
 	/* amfree(rc) */
 	/* a memory leak occurs, but freeing it lead to memory
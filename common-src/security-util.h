@@ -67,6 +67,9 @@ struct tcp_conn {
     pid_t		pid;			/* pid of sec process */
     char *		pkt;			/* last pkt read */
     ssize_t		pktlen;			/* len of above */
+    size_t		pktsize;		/* allocated size of pkt; the
+						 * buffer is reused for the
+						 * next token */
     event_handle_t *	ev_read;		/* read (EV_READFD) handle */
     int			ev_read_refcnt;		/* number of readers */
     char		hostname[MAX_HOSTNAME_LENGTH+1];
@@ -159,6 +159,13 @@ typedef struct security_driver {
 
     int (*data_encrypt)(void *, void *, ssize_t, void **, ssize_t *);
     int (*data_decrypt)(void *, void *, ssize_t, void **, ssize_t *);
+
+    /*
+     * Return the file descriptor of a stream whose data goes over it
+     * unframed and unencrypted, so that it can be written to directly.
+     * NULL if the driver's streams are never like that.
+     */
+    int (*stream_fd)(void *);
 } security_driver_t;
 
 /*
@@ -249,6 +256,11 @@ void security_stream_close(security_stream_t *);
 #define	security_stream_id(stream)		\
     (*(stream)->driver->stream_id)(stream)
 
+/* int security_stream_fd(security_stream_t *); */
+#define	security_stream_fd(stream)		\
+    ((stream)->driver->stream_fd ?		\
+	(*(stream)->driver->stream_fd)(stream) : -1)
+
 /* int security_stream_write(security_stream_t *, const void *, size_t); */
 #define	security_stream_write(stream, buf, size)	\
     (*(stream)->driver->stream_write)(stream, buf, size)
@@ -37,6 +37,12 @@
 #define NETWORK_BLOCK_BYTES	DISK_BLOCK_BYTES
 #define STREAM_BUFSIZE		(NETWORK_BLOCK_BYTES * 2)
 
+/* Data may be relayed in blocks this big to a peer that has
+ * fe_large_network_blocks; sockets carrying dump data ask for buffers
+ * of STREAM_BUFSIZE_LARGE. */
+#define NETWORK_BLOCK_BYTES_LARGE	(NETWORK_BLOCK_BYTES * 8)
+#define STREAM_BUFSIZE_LARGE		(NETWORK_BLOCK_BYTES_LARGE * 4)
+
 int stream_server(int family, in_port_t *port, size_t sendsize,
 		  size_t recvsize, int priv);
 int stream_accept(int sock, int timeout, size_t sendsize, size_t recvsize);
@@ -125,6 +125,28 @@ AC_DEFUN([AMANDA_CHECK_GLIB], [
     AMANDA_ADD_LIBS($GLIB_LIBS)
 ])
 
+# SYNOPSIS
+#
+#   AMANDA_CHECK_ZLIB
+#
+# OVERVIEW
+#
+#   Check for zlib, which lets Amanda compress data without running a
+#   separate gzip process.  If zlib.h and a deflateBound in -lz are found,
+#   HAVE_ZLIB is defined and -lz is added to the libraries.
+#
+AC_DEFUN([AMANDA_CHECK_ZLIB], [
+    HAVE_ZLIB=no
+    AC_CHECK_HEADERS([zlib.h], [
+	AC_CHECK_LIB([z], [deflateBound], [HAVE_ZLIB=yes])
+    ])
+    if test x"$HAVE_ZLIB" = x"yes"; then
+	AC_DEFINE(HAVE_ZLIB, 1,
+	    [Define if zlib is available for in-process compression. ])
+	AMANDA_ADD_LIBS([-lz])
+    fi
+])
+
 # LIBCURL_CHECK_CONFIG is from the libcurl
 # distribution and licensed under the BSD license:
 # Copyright (c) 1996 - 2007, Daniel Stenberg, <daniel@haxx.se>.
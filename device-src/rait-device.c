@@ -30,6 +30,10 @@
 #include "fileheader.h"
 #include "semaphore.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /* Just a note about the failure mode of different operations:
    - Recovers from a failure (enters degraded mode)
      open_device()
@@ -81,10 +85,19 @@ struct _RaitDeviceClass {
 
 typedef enum {
     RAIT_STATUS_COMPLETE, /* All subdevices OK. */
-    RAIT_STATUS_DEGRADED, /* One subdevice failed. */
-    RAIT_STATUS_FAILED    /* Two or more subdevices failed. */
+    RAIT_STATUS_DEGRADED, /* No more subdevices failed than there are parity
+			   * subdevices. */
+    RAIT_STATUS_FAILED    /* Too many subdevices failed. */
 } RaitStatus;
 
+/* The most parity children a RAIT set can have: P (plain XOR) and Q
+ * (Reed-Solomon over GF(2^8)) */
+#define RAIT_MAX_PARITY 2
+
+/* Number of child-sized blocks in the scratch area: read or computed P and Q,
+ * plus two working blocks */
+#define RAIT_SCRATCH_BLOCKS 4
+
 /* Older versions of glib have a deadlock in their thread pool implementations,
  * so we include a simple thread-pool implementation here to replace it.
  *
@@ -102,13 +115,22 @@ typedef struct RaitDevicePrivate_s {
     GPtrArray * children;
     /* These flags are only relevant for reading. */
     RaitStatus status;
-    /* If status == RAIT_STATUS_DEGRADED, this holds the index of the
-       failed node. It holds a negative number otherwise. */
-    int failed;
+    /* If status == RAIT_STATUS_DEGRADED, the first nfailed elements of
+       this array hold the indices of the failed nodes. */
+    int failed[RAIT_MAX_PARITY];
+    guint nfailed;
+
+    /* number of children holding parity (RAIT_PARITY) */
+    guint nparity;
 
     /* the child block size */
     gsize child_block_size;
 
+    /* scratch space for parity, kept between blocks; see get_scratch */
+    char *scratch;
+    gsize scratch_size;
+    char **chunks;
+
 #ifdef USE_INTERNAL_THREADPOOL
     /* array of ThreadInfo for performing parallel operations */
     GArray *threads;
@@ -211,6 +233,18 @@ static gboolean property_set_max_volume_usage_fn(Device *self,
     DevicePropertyBase *base, GValue *val,
     PropertySurety surety, PropertySource source);
 
+static gboolean property_get_rait_parity_fn(Device *self,
+    DevicePropertyBase *base, GValue *val,
+    PropertySurety *surety, PropertySource *source);
+
+static gboolean property_set_rait_parity_fn(Device *self,
+    DevicePropertyBase *base, GValue *val,
+    PropertySurety surety, PropertySource source);
+
+/* Number of children holding parity; 2 adds a Reed-Solomon Q block, so that
+ * the set survives the loss of any two children. */
+static DevicePropertyBase device_property_rait_parity;
+#define PROPERTY_RAIT_PARITY (device_property_rait_parity.ID)
 
 /* pointer to the class of our parent */
 static DeviceClass *parent_class = NULL;
@@ -292,6 +326,8 @@ rait_device_finalize(GObject *obj_self)
     if (PRIVATE(self)->threads_sem)
 	semaphore_free(PRIVATE(self)->threads_sem);
 #endif
+    amfree(self->private->scratch);
+    amfree(self->private->chunks);
     amfree(self->private);
 }
 
@@ -301,7 +337,12 @@ rait_device_init (RaitDevice * o G_GNUC_UNUSED)
     PRIVATE(o) = g_new(RaitDevicePrivate, 1);
     PRIVATE(o)->children = g_ptr_array_new();
     PRIVATE(o)->status = RAIT_STATUS_COMPLETE;
-    PRIVATE(o)->failed = -1;
+    PRIVATE(o)->nfailed = 0;
+    PRIVATE(o)->nparity = 1;
+    PRIVATE(o)->child_block_size = 0;
+    PRIVATE(o)->scratch = NULL;
+    PRIVATE(o)->scratch_size = 0;
+    PRIVATE(o)->chunks = NULL;
 #ifdef USE_INTERNAL_THREADPOOL
     PRIVATE(o)->threads = NULL;
     PRIVATE(o)->threads_sem = NULL;
@@ -395,6 +436,11 @@ rait_device_base_init (RaitDeviceClass * c)
 	    PROPERTY_ACCESS_GET_MASK,
 	    property_get_max_volume_usage_fn,
 	    property_set_max_volume_usage_fn);
+
+    device_class_register_property(device_class, PROPERTY_RAIT_PARITY,
+	    PROPERTY_ACCESS_GET_MASK | PROPERTY_ACCESS_SET_BEFORE_START,
+	    property_get_rait_parity_fn,
+	    property_set_rait_parity_fn);
 }
 
 /* This function does something a little clever and a little
@@ -512,6 +558,62 @@ static void do_rait_child_ops(RaitDevice *self, GFunc func, GPtrArray * ops) {
     }
 }
 
+/* Returns TRUE if the given child has been isolated. */
+static gboolean
+child_failed(RaitDevice * self, guint child_index) {
+    guint i;
+
+    for (i = 0; i < self->private->nfailed; i++) {
+	if (self->private->failed[i] == (int)child_index)
+	    return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* Isolates the given child, putting the device into DEGRADED mode if the
+ * parity children can still cover for it, and into FAILED mode otherwise.
+ * Returns FALSE in the latter case. */
+static gboolean
+isolate_child(RaitDevice * self, guint child_index) {
+    guint num_children, data_children;
+
+    if (child_failed(self, child_index))
+	return self->private->status != RAIT_STATUS_FAILED;
+
+    find_simple_params(self, &num_children, &data_children);
+    if (self->private->nfailed < num_children - data_children) {
+	self->private->failed[self->private->nfailed++] = child_index;
+	self->private->status = RAIT_STATUS_DEGRADED;
+	return TRUE;
+    }
+
+    self->private->status = RAIT_STATUS_FAILED;
+    return FALSE;
+}
+
+/* Children that could not be opened are accepted provisionally, because the
+ * number of parity children is not known until the device's properties are
+ * set.  This checks them against that number, putting the device into FAILED
+ * mode and setting its error status if there are too many. */
+static gboolean
+check_failed_children(RaitDevice * self) {
+    guint num_children, data_children;
+
+    find_simple_params(self, &num_children, &data_children);
+    if (self->private->nfailed > num_children - data_children) {
+	self->private->status = RAIT_STATUS_FAILED;
+	device_set_error((Device *)self,
+	    vstrallocf(_("%u child devices are missing, but the RAIT device "
+			 "has only %u parity children"),
+		       self->private->nfailed, num_children - data_children),
+	    DEVICE_STATUS_DEVICE_ERROR);
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
 static char *
 child_device_names_to_rait_name(RaitDevice * self) {
     GPtrArray *kids;
@@ -527,7 +629,7 @@ child_device_names_to_rait_name(RaitDevice * self) {
 
         bzero(&val, sizeof(val));
 
-        if ((signed)i != self->private->failed) {
+        if (!child_failed(self, i)) {
 	    if (device_property_get(child, PROPERTY_CANONICAL_NAME, &val)) {
 		child_name = g_value_get_string(&val);
 		got_prop = TRUE;
@@ -581,7 +683,7 @@ calculate_block_size_from_children(RaitDevice * self, gsize *rait_size)
 
         bzero(&property_result, sizeof(property_result));
 
-	if ((signed)i == self->private->failed)
+	if (child_failed(self, i))
 	    continue;
 
 	child = g_ptr_array_index(self->private->children, i);
@@ -671,7 +773,7 @@ set_block_size_on_children(RaitDevice *self, gsize child_block_size)
 
 	bzero(&property_result, sizeof(property_result));
 
-	if ((signed)i == self->private->failed)
+	if (child_failed(self, i))
 	    continue;
 
 	child = g_ptr_array_index(self->private->children, i);
@@ -716,6 +818,9 @@ fix_block_size(RaitDevice *self)
     Device *dself = (Device *)self;
     gsize my_block_size, child_block_size;
 
+    if (!check_failed_children(self))
+	return FALSE;
+
     if (dself->block_size_source == PROPERTY_SOURCE_DEFAULT) {
 	child_block_size = calculate_block_size_from_children(self, &my_block_size);
 	if (child_block_size == 0)
@@ -797,7 +902,7 @@ static GPtrArray * make_generic_boolean_op_array(RaitDevice* self) {
     for (i = 0; i < self->private->children->len; i ++) {
         GenericOp * op;
 
-        if ((signed)i == self->private->failed) {
+        if (child_failed(self, i)) {
             continue;
         }
 
@@ -817,21 +922,22 @@ static GPtrArray * make_generic_boolean_op_array(RaitDevice* self) {
 static gboolean g_ptr_array_union_robust(RaitDevice * self, GPtrArray * ops,
                                          BooleanExtractor extractor) {
     int nfailed = 0;
-    int lastfailed = 0;
+    gboolean success = TRUE;
     guint i;
 
     /* We found one or more failed elements.  See which elements failed, and
-     * isolate them*/
+     * isolate them; failures beyond what the parity children can cover
+     * leave us in FAILED mode. */
     for (i = 0; i < ops->len; i ++) {
 	GenericOp * op = g_ptr_array_index(ops, i);
 	if (!extractor(op)) {
-	    self->private->failed = op->child_index;
 	    g_warning("RAIT array %s isolated device %s: %s",
 		    DEVICE(self)->device_name,
 		    op->child->device_name,
 		    device_error(op->child));
 	    nfailed++;
-            lastfailed = i;
+	    if (!isolate_child(self, op->child_index))
+		success = FALSE;
 	}
     }
 
@@ -839,14 +945,10 @@ static gboolean g_ptr_array_union_robust(RaitDevice * self, GPtrArray * ops,
     if (nfailed == 0)
 	return TRUE;
 
-    /* a single failure in COMPLETE just puts us in DEGRADED mode */
-    if (self->private->status == RAIT_STATUS_COMPLETE && nfailed == 1) {
-	self->private->status = RAIT_STATUS_DEGRADED;
-        self->private->failed = lastfailed;
+    if (success) {
 	g_warning("RAIT array %s DEGRADED", DEVICE(self)->device_name);
 	return TRUE;
     } else {
-	self->private->status = RAIT_STATUS_FAILED;
 	g_warning("RAIT array %s FAILED", DEVICE(self)->device_name);
 	return FALSE;
     }
@@ -956,17 +1058,20 @@ open_child_devices (Device * dself, char * device_name,
             append_message(&failure_errmsgs,
                            strdup(this_failure_errmsg));
 	    failure_flags |= status;
-            if (self->private->status == RAIT_STATUS_COMPLETE) {
-                /* The first failure just puts us in degraded mode. */
+            if (self->private->nfailed < RAIT_MAX_PARITY &&
+		self->private->nfailed + 1 < device_open_ops->len) {
+                /* The first failures just put us in degraded mode; whether
+		 * the parity children can cover for them is checked by
+		 * check_failed_children once RAIT_PARITY is known. */
                 g_warning("%s: %s",
                           device_name, this_failure_errmsg);
 		g_warning("%s: %s failed, entering degraded mode.",
                           device_name, op->device_name);
                 g_ptr_array_add(self->private->children, op->result);
                 self->private->status = RAIT_STATUS_DEGRADED;
-                self->private->failed = i;
+                self->private->failed[self->private->nfailed++] = i;
             } else {
-                /* The second and further failures are fatal. */
+                /* Further failures are fatal. */
                 failure = TRUE;
             }
         }
@@ -1005,7 +1110,8 @@ rait_device_open_from_children (GSList *child_devices) {
     RaitDevice *self;
     GSList *iter;
     char *device_name;
-    int nfailures;
+    guint nfailures;
+    guint nchildren;
     int i;
 
     /* first, open a RAIT device using the DEFER_CHILDREN_SENTINEL */
@@ -1017,13 +1123,15 @@ rait_device_open_from_children (GSList *child_devices) {
     /* set its children */
     self = RAIT_DEVICE(dself);
     nfailures = 0;
+    nchildren = g_slist_length(child_devices);
     for (i=0, iter = child_devices; iter; i++, iter = iter->next) {
 	Device *kid = iter->data;
 
 	/* a NULL kid is OK -- it opens the device in degraded mode */
 	if (!kid) {
+	    if (nfailures < RAIT_MAX_PARITY)
+		self->private->failed[self->private->nfailed++] = i;
 	    nfailures++;
-	    self->private->failed = i;
 	} else {
 	    g_assert(IS_DEVICE(kid));
 	    g_object_ref((GObject *)kid);
@@ -1032,22 +1140,17 @@ rait_device_open_from_children (GSList *child_devices) {
 	g_ptr_array_add(self->private->children, kid);
     }
 
-    /* and set the status based on the children */
-    switch (nfailures) {
-	case 0:
-	    self->private->status = RAIT_STATUS_COMPLETE;
-	    break;
-
-	case 1:
-	    self->private->status = RAIT_STATUS_DEGRADED;
-	    break;
-
-	default:
-	    self->private->status = RAIT_STATUS_FAILED;
-	    device_set_error(dself,
-		    _("more than one child device is missing"),
-		    DEVICE_STATUS_DEVICE_ERROR);
-	    break;
+    /* and set the status based on the children; as in open_child_devices,
+     * missing children are checked against RAIT_PARITY later */
+    if (nfailures == 0) {
+	self->private->status = RAIT_STATUS_COMPLETE;
+    } else if (nfailures <= RAIT_MAX_PARITY && nfailures < nchildren) {
+	self->private->status = RAIT_STATUS_DEGRADED;
+    } else {
+	self->private->status = RAIT_STATUS_FAILED;
+	device_set_error(dself,
+		stralloc(_("too many child devices are missing")),
+		DEVICE_STATUS_DEVICE_ERROR);
     }
 
     /* create a name from the children's names and use it to chain up
@@ -1176,7 +1279,7 @@ rait_device_configure(Device * dself, gboolean use_global_config)
     for (i = 0; i < self->private->children->len; i ++) {
 	Device *child;
 
-	if ((signed)i == self->private->failed)
+	if (child_failed(self, i))
 	    continue;
 
 	child = g_ptr_array_index(self->private->children, i);
@@ -1232,7 +1335,7 @@ rait_device_start (Device * dself, DeviceAccessMode mode, char * label,
     for (i = 0; i < self->private->children->len; i ++) {
         StartOp * op;
 
-        if ((signed)i == self->private->failed) {
+        if (child_failed(self, i)) {
             continue;
         }
 
@@ -1411,8 +1514,8 @@ static void find_simple_params(RaitDevice * self,
     int num, data;
 
     num = self->private->children->len;
-    if (num > 1)
-        data = num - 1;
+    if (num > (int)self->private->nparity)
+        data = num - self->private->nparity;
     else
         data = num;
     if (num_children != NULL)
@@ -1425,7 +1528,6 @@ typedef struct {
     GenericOp base;
     guint size;           /* IN */
     gpointer data;        /* IN */
-    gboolean data_needs_free; /* bookkeeping */
 } WriteBlockOp;
 
 /* a GFunc. */
@@ -1437,62 +1539,180 @@ static void write_block_do_op(gpointer data,
         GINT_TO_POINTER(device_write_block(op->base.child, op->size, op->data));
 }
 
-/* Parity block generation. Performance of this function can be improved
-   considerably by using larger-sized integers or
-   assembly-coded vector instructions. Parameters are:
-   % data       - All data chunks in series (chunk_size * num_chunks bytes)
-   % parity     - Allocated space for parity block (chunk_size bytes)
- */
-static void make_parity_block(char * data, char * parity,
-                              guint chunk_size, guint num_chunks) {
-    guint i;
-    bzero(parity, chunk_size);
-    for (i = 0; i < num_chunks - 1; i ++) {
-        guint j;
-        for (j = 0; j < chunk_size; j ++) {
-            parity[j] ^= data[chunk_size*i + j];
-        }
+/* Parity arithmetic.  P is the XOR of the data chunks; Q is the Reed-Solomon
+ * syndrome sum(g^i * D_i) over GF(2^8), with generator g = 2 and the
+ * polynomial x^8+x^4+x^3+x^2+1 (0x11d).  Both are computed a machine word (or,
+ * with SSE2, sixteen bytes) at a time; a data chunk pointer of NULL stands
+ * for a chunk of zeroes, which is what reconstruction needs. */
+
+static guint8 gf_exp[510];
+static guint8 gf_log[256];
+
+static void
+init_gf_tables(void) {
+    guint i, x = 1;
+
+    for (i = 0; i < 255; i++) {
+	gf_exp[i] = gf_exp[i + 255] = (guint8)x;
+	gf_log[x] = (guint8)i;
+	x <<= 1;
+	if (x & 0x100)
+	    x ^= 0x11d;
+    }
+}
+
+static guint8
+gf_mul(guint8 a, guint8 b) {
+    if (a == 0 || b == 0)
+	return 0;
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static guint8
+gf_div(guint8 a, guint8 b) {
+    g_assert(b != 0);
+    if (a == 0)
+	return 0;
+    return gf_exp[gf_log[a] + 255 - gf_log[b]];
+}
+
+/* a gulong with each byte set to b */
+#define BYTES_OF(b) ((~(gulong)0 / 0xff) * (b))
+
+#define WORD_ALIGNED(p) (((gsize)(p)) % sizeof(gulong) == 0)
+
+/* dst ^= src */
+static void
+xor_block(char *dst, const char *src, gsize len) {
+    gsize i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+	__m128i d = _mm_loadu_si128((__m128i *)(dst + i));
+	__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+	_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, s));
+    }
+#endif
+
+    if (WORD_ALIGNED(dst + i) && WORD_ALIGNED(src + i)) {
+	for (; i + sizeof(gulong) <= len; i += sizeof(gulong))
+	    *(gulong *)(dst + i) ^= *(const gulong *)(src + i);
     }
+
+    for (; i < len; i++)
+	dst[i] ^= src[i];
 }
 
-/* Does the same thing as make_parity_block, but instead of using a
-   single memory chunk holding all chunks, it takes a GPtrArray of
-   chunks. */
-static void make_parity_block_extents(GPtrArray * data, char * parity,
-                                      guint chunk_size) {
+/* dst = g * dst ^ src, or just g * dst if src is NULL */
+static void
+gf_mul2_xor_block(char *dst, const char *src, gsize len) {
+    gsize i = 0;
+
+#ifdef __SSE2__
+    {
+	__m128i poly = _mm_set1_epi8(0x1d);
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16) {
+	    __m128i d = _mm_loadu_si128((__m128i *)(dst + i));
+	    /* bytes with the high bit set wrap around through the polynomial */
+	    __m128i carry = _mm_and_si128(_mm_cmpgt_epi8(zero, d), poly);
+	    d = _mm_xor_si128(_mm_add_epi8(d, d), carry);
+	    if (src)
+		d = _mm_xor_si128(d,
+			_mm_loadu_si128((const __m128i *)(src + i)));
+	    _mm_storeu_si128((__m128i *)(dst + i), d);
+	}
+    }
+#endif
+
+    if (WORD_ALIGNED(dst + i) && (!src || WORD_ALIGNED(src + i))) {
+	for (; i + sizeof(gulong) <= len; i += sizeof(gulong)) {
+	    gulong d = *(gulong *)(dst + i);
+	    gulong high = d & BYTES_OF(0x80);
+	    d = ((d << 1) & BYTES_OF(0xfe))
+	      ^ (((high << 1) - (high >> 7)) & BYTES_OF(0x1d));
+	    if (src)
+		d ^= *(const gulong *)(src + i);
+	    *(gulong *)(dst + i) = d;
+	}
+    }
+
+    for (; i < len; i++) {
+	guint8 d = (guint8)dst[i];
+	d = (guint8)((d << 1) ^ ((d & 0x80)? 0x1d : 0));
+	if (src)
+	    d ^= (guint8)src[i];
+	dst[i] = (char)d;
+    }
+}
+
+/* block *= c, in GF(2^8) */
+static void
+gf_mul_block(char *block, guint8 c, gsize len) {
+    guint8 table[256];
+    gsize i;
+
+    if (c == 1)
+	return;
+
+    for (i = 0; i < 256; i++)
+	table[i] = gf_mul(c, (guint8)i);
+    for (i = 0; i < len; i++)
+	block[i] = (char)table[(guint8)block[i]];
+}
+
+/* Compute the P parity of num_chunks data chunks of chunk_size bytes. */
+static void
+make_parity_block(char ** chunks, guint num_chunks, char * parity,
+                  gsize chunk_size) {
+    gboolean first = TRUE;
     guint i;
-    bzero(parity, chunk_size);
-    for (i = 0; i < data->len; i ++) {
-        guint j;
-        char * data_chunk;
-        data_chunk = g_ptr_array_index(data, i);
-        for (j = 0; j < chunk_size; j ++) {
-            parity[j] ^= data_chunk[j];
-        }
+
+    for (i = 0; i < num_chunks; i ++) {
+	if (!chunks[i])
+	    continue;
+	if (first)
+	    memcpy(parity, chunks[i], chunk_size);
+	else
+	    xor_block(parity, chunks[i], chunk_size);
+	first = FALSE;
     }
+
+    if (first)
+	bzero(parity, chunk_size);
 }
 
-/* Does the parity creation algorithm. Allocates and returns a single
-   device block from a larger RAIT block. chunks and chunk are 1-indexed. */
-static char * extract_data_block(char * data, guint size,
-                                 guint chunks, guint chunk) {
-    char * rval;
-    guint chunk_size;
+/* Compute the Q parity of num_chunks data chunks of chunk_size bytes, by
+ * Horner's rule, starting from the highest-numbered chunk. */
+static void
+make_q_parity_block(char ** chunks, guint num_chunks, char * parity,
+                    gsize chunk_size) {
+    guint i = num_chunks - 1;
 
-    g_assert(chunks > 0 && chunk > 0 && chunk <= chunks);
-    g_assert(data != NULL);
-    g_assert(size > 0 && size % (chunks - 1) == 0);
+    if (chunks[i])
+	memcpy(parity, chunks[i], chunk_size);
+    else
+	bzero(parity, chunk_size);
 
-    chunk_size = size / (chunks - 1);
-    rval = g_malloc(chunk_size);
-    if (chunks != chunk) {
-        /* data block. */
-        memcpy(rval, data + chunk_size * (chunk - 1), chunk_size);
-    } else {
-        make_parity_block(data, rval, chunk_size, chunks);
+    while (i-- > 0)
+	gf_mul2_xor_block(parity, chunks[i], chunk_size);
+}
+
+/* Returns the device's scratch area, RAIT_SCRATCH_BLOCKS child blocks long,
+ * along with an array of per-child chunk pointers in self->private->chunks.
+ * These are kept between blocks, so reading and writing need not allocate
+ * anything per block. */
+static char *
+get_scratch(RaitDevice * self, gsize child_blocksize) {
+    if (self->private->scratch_size != child_blocksize) {
+	amfree(self->private->scratch);
+	amfree(self->private->chunks);
+	self->private->scratch = g_malloc(child_blocksize * RAIT_SCRATCH_BLOCKS);
+	self->private->chunks = g_new(char *, self->private->children->len);
+	self->private->scratch_size = child_blocksize;
     }
 
-    return rval;
+    return self->private->scratch;
 }
 
 static gboolean
@@ -1502,8 +1722,11 @@ rait_device_write_block (Device * dself, guint size, gpointer data) {
     gboolean success;
     guint data_children, num_children;
     gsize blocksize = dself->block_size;
+    gsize child_blocksize;
     RaitDevice * self;
     gboolean last_block = (size < blocksize);
+    char *scratch, **chunks;
+    char *parity[RAIT_MAX_PARITY];
 
     self = RAIT_DEVICE(dself);
 
@@ -1511,11 +1734,6 @@ rait_device_write_block (Device * dself, guint size, gpointer data) {
     if (self->private->status != RAIT_STATUS_COMPLETE) return FALSE;
 
     find_simple_params(RAIT_DEVICE(self), &num_children, &data_children);
-    num_children = self->private->children->len;
-    if (num_children != 1)
-        data_children = num_children - 1;
-    else
-        data_children = num_children;
 
     g_assert(size % data_children == 0 || last_block);
 
@@ -1532,19 +1750,39 @@ rait_device_write_block (Device * dself, guint size, gpointer data) {
         size = blocksize;
     }
 
+    /* the data children write straight out of the caller's buffer; only the
+     * parity is computed, into the scratch area */
+    child_blocksize = size / data_children;
+    scratch = get_scratch(self, child_blocksize);
+    chunks = self->private->chunks;
+    for (i = 0; i < data_children; i ++)
+	chunks[i] = (char *)data + child_blocksize * i;
+
+    for (i = 0; i < num_children - data_children; i ++) {
+	if (data_children == 1) {
+	    /* parity of a single chunk is a copy of it */
+	    parity[i] = data;
+	} else {
+	    parity[i] = scratch + child_blocksize * i;
+	    if (i == 0)
+		make_parity_block(chunks, data_children, parity[i],
+				  child_blocksize);
+	    else
+		make_q_parity_block(chunks, data_children, parity[i],
+				    child_blocksize);
+	}
+    }
+
     ops = g_ptr_array_sized_new(num_children);
-    for (i = 0; i < self->private->children->len; i ++) {
+    for (i = 0; i < num_children; i ++) {
         WriteBlockOp * op;
         op = g_malloc(sizeof(*op));
         op->base.child = g_ptr_array_index(self->private->children, i);
-        op->size = size / data_children;
-        if (num_children <= 2) {
-            op->data = data;
-            op->data_needs_free = FALSE;
-        } else {
-            op->data_needs_free = TRUE;
-            op->data = extract_data_block(data, size, num_children, i + 1);
-        }
+        op->size = child_blocksize;
+	if (i < data_children)
+	    op->data = chunks[i];
+	else
+	    op->data = parity[i - data_children];
         g_ptr_array_add(ops, op);
     }
 
@@ -1552,12 +1790,6 @@ rait_device_write_block (Device * dself, guint size, gpointer data) {
 
     success = g_ptr_array_and(ops, extract_boolean_generic_op);
 
-    for (i = 0; i < self->private->children->len; i ++) {
-        WriteBlockOp * op = g_ptr_array_index(ops, i);
-        if (op->data_needs_free)
-            free(op->data);
-    }
-
     if (last_block) {
         amfree(data);
     }
@@ -1656,7 +1888,7 @@ rait_device_seek_file (Device * dself, guint file) {
     ops = g_ptr_array_sized_new(self->private->children->len);
     for (i = 0; i < self->private->children->len; i ++) {
         SeekFileOp * op;
-        if ((int)i == self->private->failed)
+        if (child_failed(self, i))
             continue; /* This device is broken. */
         op = g_new(SeekFileOp, 1);
         op->base.child = g_ptr_array_index(self->private->children, i);
@@ -1681,7 +1913,7 @@ rait_device_seek_file (Device * dself, guint file) {
 
         this_op = (SeekFileOp*)g_ptr_array_index(ops, i);
 
-        if ((signed)this_op->base.child_index == self->private->failed)
+        if (child_failed(self, this_op->base.child_index))
             continue;
 
         this_result = this_op->base.result;
@@ -1747,7 +1979,7 @@ rait_device_seek_block (Device * dself, guint64 block) {
     ops = g_ptr_array_sized_new(self->private->children->len);
     for (i = 0; i < self->private->children->len; i ++) {
         SeekBlockOp * op;
-        if ((int)i == self->private->failed)
+        if (child_failed(self, i))
             continue; /* This device is broken. */
         op = g_new(SeekBlockOp, 1);
         op->base.child = g_ptr_array_index(self->private->children, i);
@@ -1819,106 +2051,136 @@ static int g_ptr_array_count(GPtrArray * array, BooleanExtractor filter) {
     return rval;
 }
 
-static gboolean raid_block_reconstruction(RaitDevice * self, GPtrArray * ops,
+/* Check the parity of a block read from all children, or rebuild the data
+ * chunks of failed children from the surviving parity.  The data chunks are
+ * already in place in buf, and the parity blocks are at the beginning of the
+ * scratch area. */
+static gboolean raid_block_reconstruction(RaitDevice * self,
                                       gpointer buf, size_t bufsize) {
     guint num_children, data_children;
     gsize blocksize;
     gsize child_blocksize;
     guint i;
-    int parity_child;
-    gpointer parity_block = NULL;
-    gboolean success;
-
-    success = TRUE;
+    char *scratch, **chunks;
+    char *p_block, *q_block, *work;
+    guint lost[RAIT_MAX_PARITY];
+    guint nlost = 0;
+    gboolean p_lost = FALSE;
 
     blocksize = DEVICE(self)->block_size;
     find_simple_params(self, &num_children, &data_children);
 
-    if (num_children > 1)
-        parity_child = num_children - 1;
-    else
-        parity_child = -1;
-
     child_blocksize = blocksize / data_children;
+    g_assert(child_blocksize * data_children <= bufsize);
+
+    /* a single child has no parity to check */
+    if (num_children == data_children)
+	return self->private->status != RAIT_STATUS_FAILED;
+
+    scratch = get_scratch(self, child_blocksize);
+    p_block = scratch;
+    q_block = scratch + child_blocksize;
+    work = scratch + child_blocksize * 2;
+
+    chunks = self->private->chunks;
+    for (i = 0; i < data_children; i ++)
+	chunks[i] = (char *)buf + child_blocksize * i;
 
-    for (i = 0; i < ops->len; i ++) {
-        ReadBlockOp * op = g_ptr_array_index(ops, i);
-        if (!extract_boolean_read_block_op_data(op))
-            continue;
-        if ((int)(op->base.child_index) == parity_child) {
-            parity_block = op->buffer;
-        } else {
-	    g_assert(child_blocksize * (op->base.child_index+1) <= bufsize);
-            memcpy((char *)buf + child_blocksize * op->base.child_index, op->buffer,
-                   child_blocksize);
-        }
-    }
     if (self->private->status == RAIT_STATUS_COMPLETE) {
-	g_assert(parity_block != NULL); /* should have found parity_child */
-
-        if (num_children >= 2) {
-            /* Verify the parity block. This code is inefficient but
-               does the job for the 2-device case, too. */
-            gpointer constructed_parity;
-            GPtrArray * data_extents;
-
-            constructed_parity = g_malloc(child_blocksize);
-            data_extents = g_ptr_array_sized_new(data_children);
-            for (i = 0; i < data_children; i ++) {
-                ReadBlockOp * op = g_ptr_array_index(ops, i);
-                g_assert(extract_boolean_read_block_op_data(op));
-                if ((int)op->base.child_index == parity_child)
-                    continue;
-                g_ptr_array_add(data_extents, op->buffer);
-            }
-            make_parity_block_extents(data_extents, constructed_parity,
-                                      child_blocksize);
+	/* Verify the parity blocks. */
+	make_parity_block(chunks, data_children, work, child_blocksize);
+	if (0 != memcmp(p_block, work, child_blocksize)) {
+	    device_set_error(DEVICE(self),
+		stralloc(_("RAIT is inconsistent: Parity block did not match data blocks.")),
+		DEVICE_STATUS_DEVICE_ERROR);
+	    /* TODO: can't we just isolate the device in this case? */
+	    return FALSE;
+	}
 
-            if (0 != memcmp(parity_block, constructed_parity,
-                            child_blocksize)) {
-                device_set_error(DEVICE(self),
-		    stralloc(_("RAIT is inconsistent: Parity block did not match data blocks.")),
+	if (num_children - data_children > 1) {
+	    make_q_parity_block(chunks, data_children, work, child_blocksize);
+	    if (0 != memcmp(q_block, work, child_blocksize)) {
+		device_set_error(DEVICE(self),
+		    stralloc(_("RAIT is inconsistent: Q parity block did not match data blocks.")),
 		    DEVICE_STATUS_DEVICE_ERROR);
-		/* TODO: can't we just isolate the device in this case? */
-                success = FALSE;
-            }
-            g_ptr_array_free(data_extents, TRUE);
-            amfree(constructed_parity);
-        } else { /* do nothing. */ }
-    } else if (self->private->status == RAIT_STATUS_DEGRADED) {
-	g_assert(self->private->failed >= 0 && self->private->failed < (int)num_children);
-        /* We are in degraded mode. What's missing? */
-        if (self->private->failed == parity_child) {
-            /* do nothing. */
-        } else if (num_children >= 2) {
-            /* Reconstruct failed block from parity block. */
-            GPtrArray * data_extents = g_ptr_array_new();
-
-            for (i = 0; i < data_children; i ++) {
-                ReadBlockOp * op = g_ptr_array_index(ops, i);
-                if (!extract_boolean_read_block_op_data(op))
-                    continue;
-                g_ptr_array_add(data_extents, op->buffer);
-            }
+		return FALSE;
+	    }
+	}
 
-            /* Conveniently, the reconstruction is the same procedure
-               as the parity generation. This even works if there is
-               only one remaining device! */
-            make_parity_block_extents(data_extents,
-                                      (char *)buf + (child_blocksize *
-                                             self->private->failed),
-                                      child_blocksize);
+	return TRUE;
+    } else if (self->private->status != RAIT_STATUS_DEGRADED) {
+	/* device is already in FAILED state -- we shouldn't even be here */
+	return FALSE;
+    }
 
-            /* The array members belong to our ops argument. */
-            g_ptr_array_free(data_extents, TRUE);
-        } else {
-            g_assert_not_reached();
-        }
+    /* We are in degraded mode. What's missing? */
+    for (i = 0; i < self->private->nfailed; i ++) {
+	guint failed = self->private->failed[i];
+
+	g_assert(failed < num_children);
+	if (failed < data_children) {
+	    lost[nlost++] = failed;
+	    chunks[failed] = NULL;
+	} else if (failed == data_children) {
+	    p_lost = TRUE;
+	}
+    }
+
+    if (nlost == 0) {
+	/* only parity is missing; do nothing. */
+    } else if (nlost == 1 && !p_lost) {
+	/* Reconstruct the failed chunk from P.  Conveniently, this is the same
+	 * procedure as the parity generation, and even works if there is only
+	 * one remaining device! */
+	char *dest = (char *)buf + child_blocksize * lost[0];
+
+	make_parity_block(chunks, data_children, dest, child_blocksize);
+	xor_block(dest, p_block, child_blocksize);
+    } else if (nlost == 1) {
+	/* P is gone too, so use Q: D_x = (Q ^ Q') / g^x, where Q' is the Q
+	 * parity of the remaining chunks */
+	char *dest = (char *)buf + child_blocksize * lost[0];
+
+	make_q_parity_block(chunks, data_children, dest, child_blocksize);
+	xor_block(dest, q_block, child_blocksize);
+	gf_mul_block(dest, gf_exp[255 - lost[0]], child_blocksize);
     } else {
-	/* device is already in FAILED state -- we shouldn't even be here */
-        success = FALSE;
+	/* Two data chunks x < y are gone, and both P and Q survive.  With
+	 * Pxy = D_x ^ D_y and Qxy = g^x D_x ^ g^y D_y from the parity of the
+	 * remaining chunks, D_x = A * Pxy ^ B * Qxy and D_y = Pxy ^ D_x, where
+	 * A = g^(y-x) / (g^(y-x) ^ 1) and B = g^-x / (g^(y-x) ^ 1). */
+	guint x = MIN(lost[0], lost[1]), y = MAX(lost[0], lost[1]);
+	char *dest_x = (char *)buf + child_blocksize * x;
+	char *dest_y = (char *)buf + child_blocksize * y;
+	guint8 a_table[256], b_table[256];
+	guint8 gyx, denom, a, b;
+	gsize j;
+
+	g_assert(nlost == 2 && !p_lost);
+
+	make_parity_block(chunks, data_children, dest_y, child_blocksize);
+	xor_block(dest_y, p_block, child_blocksize);
+	make_q_parity_block(chunks, data_children, work, child_blocksize);
+	xor_block(work, q_block, child_blocksize);
+
+	gyx = gf_exp[y - x];
+	denom = gyx ^ 1;
+	a = gf_div(gyx, denom);
+	b = gf_div(gf_exp[255 - x], denom);
+	for (j = 0; j < 256; j ++) {
+	    a_table[j] = gf_mul(a, (guint8)j);
+	    b_table[j] = gf_mul(b, (guint8)j);
+	}
+
+	for (j = 0; j < child_blocksize; j ++) {
+	    guint8 pxy = (guint8)dest_y[j];
+	    guint8 dx = a_table[pxy] ^ b_table[(guint8)work[j]];
+	    dest_x[j] = (char)dx;
+	    dest_y[j] = (char)(pxy ^ dx);
+	}
     }
-    return success;
+
+    return TRUE;
 }
 
 static int
@@ -1929,6 +2191,7 @@ rait_device_read_block (Device * dself, gpointer buf, int * size) {
     guint num_children, data_children;
     gsize blocksize = dself->block_size;
     gsize child_blocksize;
+    char *scratch;
 
     RaitDevice * self = RAIT_DEVICE(dself);
 
@@ -1945,16 +2208,22 @@ rait_device_read_block (Device * dself, gpointer buf, int * size) {
 
     g_assert(blocksize % data_children == 0); /* see find_block_size */
     child_blocksize = blocksize / data_children;
+    scratch = get_scratch(self, child_blocksize);
 
+    /* data children read directly into their place in the caller's buffer,
+     * and parity children into the scratch area */
     ops = g_ptr_array_sized_new(num_children);
     for (i = 0; i < num_children; i ++) {
         ReadBlockOp * op;
-        if ((int)i == self->private->failed)
+        if (child_failed(self, i))
             continue; /* This device is broken. */
         op = g_new(ReadBlockOp, 1);
         op->base.child = g_ptr_array_index(self->private->children, i);
         op->base.child_index = i;
-        op->buffer = g_malloc(child_blocksize);
+	if (i < data_children)
+	    op->buffer = (char *)buf + child_blocksize * i;
+	else
+	    op->buffer = scratch + child_blocksize * (i - data_children);
         op->desired_read_size = op->read_size = child_blocksize;
         g_ptr_array_add(ops, op);
     }
@@ -1973,7 +2242,7 @@ rait_device_read_block (Device * dself, gpointer buf, int * size) {
 	} else {
 	    /* raid_block_reconstruction sets the error status if necessary */
 	    success = raid_block_reconstruction(RAIT_DEVICE(self),
-                                                ops, buf, (size_t)*size);
+                                                buf, (size_t)*size);
 	}
     } else {
         success = FALSE;
@@ -1992,10 +2261,6 @@ rait_device_read_block (Device * dself, gpointer buf, int * size) {
 	}
     }
 
-    for (i = 0; i < ops->len; i ++) {
-        ReadBlockOp * op = g_ptr_array_index(ops, i);
-        amfree(op->buffer);
-    }
     g_ptr_array_free_full(ops);
 
     if (success) {
@@ -2029,7 +2294,7 @@ static GPtrArray * make_property_op_array(RaitDevice * self,
     for (i = 0; i < self->private->children->len; i ++) {
         PropertyOp * op;
 
-        if ((signed)i == self->private->failed) {
+        if (child_failed(self, i)) {
             continue;
         }
 
@@ -2574,6 +2839,68 @@ property_set_max_volume_usage_fn(Device *dself,
     return success;
 }
 
+static gboolean
+property_get_rait_parity_fn(Device *dself,
+    DevicePropertyBase *base G_GNUC_UNUSED, GValue *val,
+    PropertySurety *surety, PropertySource *source)
+{
+    RaitDevice *self = RAIT_DEVICE(dself);
+
+    if (val) {
+	g_value_unset_init(val, G_TYPE_UINT);
+	g_value_set_uint(val, self->private->nparity);
+    }
+
+    if (surety)
+	*surety = PROPERTY_SURETY_GOOD;
+
+    if (source)
+	*source = PROPERTY_SOURCE_DETECTED;
+
+    return TRUE;
+}
+
+static gboolean
+property_set_rait_parity_fn(Device *dself,
+    DevicePropertyBase *base G_GNUC_UNUSED, GValue *val,
+    PropertySurety surety G_GNUC_UNUSED, PropertySource source G_GNUC_UNUSED)
+{
+    RaitDevice *self = RAIT_DEVICE(dself);
+    guint new_val = g_value_get_uint(val);
+    guint num_children = self->private->children->len;
+
+    if (new_val < 1 || new_val > RAIT_MAX_PARITY) {
+	device_set_error(dself,
+	    vstrallocf(_("RAIT_PARITY must be between 1 and %d"), RAIT_MAX_PARITY),
+	    DEVICE_STATUS_DEVICE_ERROR);
+	return FALSE;
+    }
+
+    /* Q parity works over GF(2^8), so at most 255 data chunks */
+    if (new_val > 1 &&
+	(num_children <= new_val || num_children - new_val > 255)) {
+	device_set_error(dself,
+	    vstrallocf(_("RAIT_PARITY %u needs between %u and %u child devices"),
+		       new_val, new_val + 1, new_val + 255),
+	    DEVICE_STATUS_DEVICE_ERROR);
+	return FALSE;
+    }
+
+    if (dself->block_size_source != PROPERTY_SOURCE_DEFAULT &&
+	num_children > new_val &&
+	(dself->block_size % (num_children - new_val)) != 0) {
+	device_set_error(dself,
+	    vstrallocf(_("Block size must be a multiple of %u"),
+		       num_children - new_val),
+	    DEVICE_STATUS_DEVICE_ERROR);
+	return FALSE;
+    }
+
+    self->private->nparity = new_val;
+
+    return TRUE;
+}
+
 typedef struct {
     GenericOp base;
     guint filenum;
@@ -2663,5 +2990,12 @@ rait_device_factory (char * device_name, char * device_type, char * device_node)
 void
 rait_device_register (void) {
     static const char * device_prefix_list[] = {"rait", NULL};
+
+    init_gf_tables();
+
+    device_property_fill_and_register(&device_property_rait_parity,
+                                      G_TYPE_UINT, "rait_parity",
+       "Number of RAIT child devices holding parity (1 or 2)");
+
     register_device(rait_device_factory, device_prefix_list);
 }
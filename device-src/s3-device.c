@@ -66,6 +66,43 @@ static GType	s3_device_get_type	(void);
  */
 typedef struct _S3MetadataFile S3MetadataFile;
 
+/* One of the parallel connections used for data transfers.  Each connection
+ * has its own S3Handle, and is used by at most one thread at a time; the
+ * fields below the handle are protected by the device's thread_idle_mutex. */
+typedef struct _S3Connection S3Connection;
+struct _S3Connection {
+    S3Handle *s3;
+
+    /* the block being transferred; the buffer (of buffer_size bytes) is
+     * reused between blocks */
+    CurlBuffer curl_buffer;
+    guint buffer_size;
+    int file;
+    guint64 block;
+    char *key;
+
+    /* for a part of a multipart upload, the upload ID (owned by the device);
+     * block is then the part number */
+    const char *upload_id;
+
+    /* for a read from a multipart object, the block size it was written
+     * with; the block is fetched with a range GET */
+    guint range_size;
+
+    /* TRUE if this connection is not currently in use */
+    gboolean idle;
+
+    /* for reads, TRUE once the block has been fetched (or found not to
+     * exist, in which case eof is also set); the data stays in curl_buffer
+     * until read_block consumes it */
+    gboolean done;
+    gboolean eof;
+
+    /* error from the last transfer on this connection, or NULL */
+    char *errmsg;
+    DeviceStatusFlags errflags;
+};
+
 typedef struct _S3Device S3Device;
 struct _S3Device {
     Device __parent__;
@@ -99,6 +136,34 @@ struct _S3Device {
 
     /* Use SSL? */
     gboolean use_ssl;
+
+    /* Number of concurrent transfers; when greater than one, write_block hands
+     * each block to a thread in thread_pool_write and returns immediately,
+     * and read_block keeps up to this many following blocks in flight in
+     * thread_pool_read. */
+    guint max_connections;
+    S3Connection *conns;
+    GThreadPool *thread_pool_write;
+    GThreadPool *thread_pool_read;
+    GMutex *thread_idle_mutex;
+    GCond *thread_idle_cond;
+
+    /* Multipart mode: when part_size is nonzero, each file's data is stored
+     * as a single object, written with a multipart upload in parts of
+     * part_size bytes.  part_buf accumulates the current part, and mp_etags
+     * (protected by thread_idle_mutex) collects the ETag of each part. */
+    guint part_size;
+    char *part_buf;
+    guint part_buf_size;
+    guint part_buf_len;
+    char *mp_key;
+    char *mp_upload_id;
+    GPtrArray *mp_etags;
+
+    /* When reading a file that was written in multipart mode, its key and
+     * the block size it was written with; NULL/0 otherwise */
+    char *mp_read_key;
+    guint mp_read_block_size;
 };
 
 /*
@@ -125,6 +190,10 @@ struct _S3DeviceClass {
 #define S3_DEVICE_MAX_BLOCK_SIZE (100*1024*1024)
 #define S3_DEVICE_DEFAULT_BLOCK_SIZE (10*1024*1024)
 
+/* S3 requires all but the last part of a multipart upload to be at least
+ * 5MB, and at most 5GB */
+#define S3_DEVICE_MIN_PART_SIZE (5*1024*1024)
+
 /* This goes in lieu of file number for metadata. */
 #define SPECIAL_INFIX "special-"
 
@@ -157,6 +226,15 @@ static DevicePropertyBase device_property_ssl_ca_info;
 static DevicePropertyBase device_property_s3_ssl;
 #define PROPERTY_S3_SSL (device_property_s3_ssl.ID)
 
+/* Number of simultaneous uploads to Amazon S3. */
+static DevicePropertyBase device_property_s3_max_connections;
+#define PROPERTY_S3_MAX_CONNECTIONS (device_property_s3_max_connections.ID)
+
+/* Size of each part of a multipart upload, or 0 to store one object per
+ * block. */
+static DevicePropertyBase device_property_s3_multipart_part_size;
+#define PROPERTY_S3_MULTIPART_PART_SIZE (device_property_s3_multipart_part_size.ID)
+
 
 /*
  * prototypes
@@ -191,6 +269,30 @@ static char *
 special_file_to_key(S3Device *self,
                     char *special_name,
                     int file);
+
+/* Given a file number and block size, return the S3 key for the single
+ * object holding that file's data in multipart mode.
+ *
+ * @param self: the S3Device object
+ * @param file: the file number
+ * @param block_size: the block size the file is written with
+ * @returns: a newly allocated string containing an S3 key.
+ */
+static char *
+multipart_file_to_key(S3Device *self,
+                      int file,
+                      guint block_size);
+
+/* Look for a multipart object for the given file, and set up
+ * self->mp_read_key and self->mp_read_block_size accordingly.
+ *
+ * @param self: the S3Device object
+ * @param file: the file number
+ * @returns: FALSE on error
+ */
+static gboolean
+find_multipart_file(S3Device *self,
+                    int file);
 /* Write an amanda header file to S3.
  *
  * @param self: the S3Device object
@@ -245,6 +347,48 @@ delete_all_files(S3Device *self);
 static gboolean
 setup_handle(S3Device * self);
 
+/* Set up the parallel connections in self->conns, if max_connections
+ * is greater than one.
+ *
+ * @param self: the S3Device object
+ * @returns: TRUE if the connections are set up
+ */
+static gboolean
+setup_connections(S3Device * self);
+
+/* Free the parallel connections, waiting for any in-flight transfers first.
+ *
+ * @param self: the S3Device object
+ */
+static void
+free_connections(S3Device * self);
+
+/* Wait until all queued uploads have completed, and set the device error
+ * if any of them failed.  The blocks of the current file are durable once
+ * this returns TRUE.
+ *
+ * @param self: the S3Device object
+ * @returns: FALSE if any upload failed
+ */
+static gboolean
+wait_for_uploads(S3Device * self);
+
+/* Wait for any prefetched reads to complete, and discard their data.
+ *
+ * @param self: the S3Device object
+ */
+static void
+reset_prefetch(S3Device * self);
+
+/* Forget the current multipart upload, if any.
+ *
+ * @param self: the S3Device object
+ * @param abort_upload: if TRUE, also abort the upload on S3
+ */
+static void
+end_multipart_upload(S3Device * self,
+                     gboolean abort_upload);
+
 /*
  * class mechanics */
 
@@ -291,6 +435,14 @@ static gboolean s3_device_set_ssl_fn(Device *self,
     DevicePropertyBase *base, GValue *val,
     PropertySurety surety, PropertySource source);
 
+static gboolean s3_device_set_max_connections_fn(Device *self,
+    DevicePropertyBase *base, GValue *val,
+    PropertySurety surety, PropertySource source);
+
+static gboolean s3_device_set_multipart_part_size_fn(Device *self,
+    DevicePropertyBase *base, GValue *val,
+    PropertySurety surety, PropertySource source);
+
 /*
  * virtual functions */
 
@@ -367,6 +519,56 @@ special_file_to_key(S3Device *self,
         return g_strdup_printf("%sf%08x-%s", self->prefix, file, special_name);
 }
 
+static char *
+multipart_file_to_key(S3Device *self,
+                      int file,
+                      guint block_size)
+{
+    char *s3_key = g_strdup_printf("%sf%08x-mp%08x.data",
+                                   self->prefix, file, block_size);
+    g_assert(strlen(s3_key) <= S3_MAX_KEY_LENGTH);
+    return s3_key;
+}
+
+static gboolean
+find_multipart_file(S3Device *self,
+                    int file)
+{
+    gboolean result;
+    GSList *keys;
+    char *my_prefix = g_strdup_printf("%sf%08x-mp", self->prefix, file);
+    guint my_prefix_len = strlen(my_prefix);
+
+    amfree(self->mp_read_key);
+    self->mp_read_block_size = 0;
+
+    result = s3_list_keys(self->s3, self->bucket, my_prefix, NULL, &keys);
+    g_free(my_prefix);
+    if (!result) {
+	device_set_error(DEVICE(self),
+	    vstrallocf(_("While listing S3 keys: %s"), s3_strerror(self->s3)),
+	    DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR);
+        return FALSE;
+    }
+
+    for (; keys; keys = g_slist_remove(keys, keys->data)) {
+	char *key = keys->data;
+	guint block_size;
+
+	/* the key ends with the block size, as "%08x.data" */
+	if (!self->mp_read_key
+	    && sscanf(key + my_prefix_len, "%8x.data", &block_size) == 1
+	    && block_size > 0) {
+	    self->mp_read_key = key;
+	    self->mp_read_block_size = block_size;
+	} else {
+	    g_free(key);
+	}
+    }
+
+    return TRUE;
+}
+
 static gboolean
 write_amanda_header(S3Device *self,
                     char *label,
@@ -609,6 +811,328 @@ delete_all_files(S3Device *self)
     return TRUE;
 }
 
+/* Thread-pool function to upload a single block on one of the parallel
+ * connections.  The connection's fields are filled in by write_block before
+ * it is pushed to the pool. */
+static void
+s3_thread_write_block(gpointer thread_data, gpointer data)
+{
+    S3Connection *conn = (S3Connection *)thread_data;
+    S3Device *self = S3_DEVICE(data);
+    gboolean result;
+    char *errmsg = NULL;
+    char *etag = NULL;
+
+    conn->curl_buffer.buffer_pos = 0;
+    if (conn->upload_id) {
+	result = s3_upload_part(conn->s3, self->bucket, conn->key,
+			conn->upload_id, (int)conn->block, &etag,
+			S3_BUFFER_READ_FUNCS, &conn->curl_buffer, NULL, NULL);
+	if (!result)
+	    errmsg = vstrallocf(_("While writing part %ju to S3: %s"),
+				(uintmax_t)conn->block, s3_strerror(conn->s3));
+    } else {
+	result = s3_upload(conn->s3, self->bucket, conn->key, S3_BUFFER_READ_FUNCS,
+			   &conn->curl_buffer, NULL, NULL);
+	if (!result)
+	    errmsg = vstrallocf(_("While writing data block %ju to S3: %s"),
+				(uintmax_t)conn->block, s3_strerror(conn->s3));
+    }
+
+    g_mutex_lock(self->thread_idle_mutex);
+    amfree(conn->key);
+    if (etag)
+	g_ptr_array_index(self->mp_etags, conn->block - 1) = etag;
+    conn->upload_id = NULL;
+    if (errmsg) {
+	g_free(conn->errmsg);
+	conn->errmsg = errmsg;
+	conn->errflags = DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR;
+    }
+    conn->idle = TRUE;
+    g_cond_broadcast(self->thread_idle_cond);
+    g_mutex_unlock(self->thread_idle_mutex);
+}
+
+/* Thread-pool function to fetch a single block on one of the parallel
+ * connections, for read-ahead. */
+static void
+s3_thread_read_block(gpointer thread_data, gpointer data)
+{
+    S3Connection *conn = (S3Connection *)thread_data;
+    S3Device *self = S3_DEVICE(data);
+    gboolean result;
+    gboolean eof = FALSE;
+    char *errmsg = NULL;
+
+    if (conn->range_size) {
+	guint64 begin = conn->block * conn->range_size;
+	result = s3_read_range(conn->s3, self->bucket, conn->key,
+			       begin, begin + conn->range_size - 1,
+			       S3_BUFFER_WRITE_FUNCS, &conn->curl_buffer, NULL, NULL);
+    } else {
+	result = s3_read(conn->s3, self->bucket, conn->key, S3_BUFFER_WRITE_FUNCS,
+			 &conn->curl_buffer, NULL, NULL);
+    }
+    conn->buffer_size = conn->curl_buffer.buffer_len;
+    if (!result) {
+	guint response_code;
+	s3_error_code_t s3_error_code;
+	s3_error(conn->s3, NULL, &response_code, &s3_error_code, NULL, NULL, NULL);
+
+	/* a missing key, or a range past the end of a multipart object, is
+	 * the end of the file, not an error */
+	if ((response_code == 404 && s3_error_code == S3_ERROR_NoSuchKey)
+	    || (conn->range_size && response_code == 416))
+	    eof = TRUE;
+	else
+	    errmsg = vstrallocf(_("While reading data block from S3: %s"),
+				s3_strerror(conn->s3));
+    }
+
+    g_mutex_lock(self->thread_idle_mutex);
+    amfree(conn->key);
+    conn->eof = eof;
+    if (errmsg) {
+	g_free(conn->errmsg);
+	conn->errmsg = errmsg;
+	conn->errflags = DEVICE_STATUS_VOLUME_ERROR;
+    }
+    conn->done = TRUE;
+    g_cond_broadcast(self->thread_idle_cond);
+    g_mutex_unlock(self->thread_idle_mutex);
+}
+
+/* Check each connection for an error from a previous transfer, and move the
+ * first one found to the device.  Call with thread_idle_mutex held.
+ * Returns FALSE if an error was found. */
+static gboolean
+check_connection_errors(S3Device *self)
+{
+    guint i;
+
+    for (i = 0; i < self->max_connections; i++) {
+	S3Connection *conn = &self->conns[i];
+	if (conn->errmsg) {
+	    device_set_error(DEVICE(self), conn->errmsg, conn->errflags);
+	    conn->errmsg = NULL;
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+static gboolean
+wait_for_uploads(S3Device *self)
+{
+    gboolean result;
+    guint i;
+
+    if (!self->conns)
+	return TRUE;
+
+    g_mutex_lock(self->thread_idle_mutex);
+    for (i = 0; i < self->max_connections; i++) {
+	while (!self->conns[i].idle)
+	    g_cond_wait(self->thread_idle_cond, self->thread_idle_mutex);
+    }
+    result = check_connection_errors(self);
+    g_mutex_unlock(self->thread_idle_mutex);
+
+    return result;
+}
+
+/* Mark a connection as available for another transfer, keeping its buffer.
+ * Call with thread_idle_mutex held. */
+static void
+release_connection(S3Device *self, S3Connection *conn)
+{
+    conn->idle = TRUE;
+    conn->done = FALSE;
+    conn->eof = FALSE;
+    g_cond_broadcast(self->thread_idle_cond);
+}
+
+static void
+reset_prefetch(S3Device *self)
+{
+    guint i;
+
+    if (!self->conns)
+	return;
+
+    g_mutex_lock(self->thread_idle_mutex);
+    for (i = 0; i < self->max_connections; i++) {
+	S3Connection *conn = &self->conns[i];
+	while (!conn->idle && !conn->done)
+	    g_cond_wait(self->thread_idle_cond, self->thread_idle_mutex);
+	if (conn->done) {
+	    amfree(conn->errmsg);
+	    release_connection(self, conn);
+	}
+    }
+    g_mutex_unlock(self->thread_idle_mutex);
+}
+
+/* Find the connection fetching (or holding) the given block, if any.  Call
+ * with thread_idle_mutex held. */
+static S3Connection *
+find_prefetch(S3Device *self, int file, guint64 block)
+{
+    guint i;
+
+    for (i = 0; i < self->max_connections; i++) {
+	S3Connection *conn = &self->conns[i];
+	if (!conn->idle && conn->file == file && conn->block == block)
+	    return conn;
+    }
+
+    return NULL;
+}
+
+/* Start fetching the given block on an idle connection.  Call with
+ * thread_idle_mutex held.  Returns NULL if every connection is busy. */
+static S3Connection *
+start_prefetch(S3Device *self, int file, guint64 block)
+{
+    S3Connection *conn = NULL;
+    guint i;
+
+    for (i = 0; i < self->max_connections; i++) {
+	if (self->conns[i].idle) {
+	    conn = &self->conns[i];
+	    break;
+	}
+    }
+    if (!conn)
+	return NULL;
+
+    conn->idle = FALSE;
+    conn->done = FALSE;
+    conn->eof = FALSE;
+    conn->file = file;
+    conn->block = block;
+    if (self->mp_read_key) {
+	conn->key = g_strdup(self->mp_read_key);
+	conn->range_size = self->mp_read_block_size;
+    } else {
+	conn->key = file_and_block_to_key(self, file, block);
+	conn->range_size = 0;
+    }
+    conn->curl_buffer.buffer_len = conn->buffer_size;
+    conn->curl_buffer.buffer_pos = 0;
+    conn->curl_buffer.max_buffer_size = S3_DEVICE_MAX_BLOCK_SIZE;
+
+    g_thread_pool_push(self->thread_pool_read, conn, NULL);
+
+    return conn;
+}
+
+/* Release completed fetches that read_block will not ask for: those for
+ * other files, and those outside the window starting at the current block.
+ * Call with thread_idle_mutex held. */
+static void
+discard_stale_prefetch(S3Device *self)
+{
+    Device *pself = DEVICE(self);
+    guint i;
+
+    for (i = 0; i < self->max_connections; i++) {
+	S3Connection *conn = &self->conns[i];
+	if (conn->idle || !conn->done)
+	    continue;
+	if (conn->file != pself->file
+	    || conn->block < pself->block
+	    || conn->block >= pself->block + self->max_connections) {
+	    amfree(conn->errmsg);
+	    release_connection(self, conn);
+	}
+    }
+}
+
+static gboolean
+setup_connections(S3Device *self)
+{
+    Device *d_self = DEVICE(self);
+    guint i;
+
+    if (self->conns || self->max_connections <= 1)
+	return TRUE;
+
+    self->conns = g_new0(S3Connection, self->max_connections);
+    for (i = 0; i < self->max_connections; i++) {
+	S3Connection *conn = &self->conns[i];
+
+	conn->idle = TRUE;
+	conn->s3 = s3_open(self->access_key, self->secret_key, self->user_token,
+	    self->bucket_location, self->ca_info);
+	if (conn->s3 == NULL) {
+	    device_set_error(d_self,
+		stralloc(_("Internal error creating S3 handle")),
+		DEVICE_STATUS_DEVICE_ERROR);
+	    free_connections(self);
+	    return FALSE;
+	}
+
+	s3_verbose(conn->s3, self->verbose);
+	if (!s3_use_ssl(conn->s3, self->use_ssl)) {
+	    device_set_error(d_self, g_strdup_printf(_(
+		    "Error setting S3 SSL/TLS use "
+		    "(tried to enable SSL/TLS for S3, but curl doesn't support it?)")),
+		DEVICE_STATUS_DEVICE_ERROR);
+	    free_connections(self);
+	    return FALSE;
+	}
+    }
+
+    self->thread_idle_mutex = g_mutex_new();
+    self->thread_idle_cond = g_cond_new();
+    self->thread_pool_write = g_thread_pool_new(s3_thread_write_block, self,
+	(gint)self->max_connections, FALSE, NULL);
+    self->thread_pool_read = g_thread_pool_new(s3_thread_read_block, self,
+	(gint)self->max_connections, FALSE, NULL);
+
+    return TRUE;
+}
+
+static void
+free_connections(S3Device *self)
+{
+    guint i;
+
+    if (!self->conns)
+	return;
+
+    /* wait for any in-flight transfers to finish */
+    if (self->thread_pool_write) {
+	g_thread_pool_free(self->thread_pool_write, FALSE, TRUE);
+	self->thread_pool_write = NULL;
+    }
+    if (self->thread_pool_read) {
+	g_thread_pool_free(self->thread_pool_read, FALSE, TRUE);
+	self->thread_pool_read = NULL;
+    }
+
+    for (i = 0; i < self->max_connections; i++) {
+	S3Connection *conn = &self->conns[i];
+	if (conn->s3) s3_free(conn->s3);
+	g_free(conn->curl_buffer.buffer);
+	g_free(conn->key);
+	g_free(conn->errmsg);
+    }
+    amfree(self->conns);
+
+    if (self->thread_idle_cond) {
+	g_cond_free(self->thread_idle_cond);
+	self->thread_idle_cond = NULL;
+    }
+    if (self->thread_idle_mutex) {
+	g_mutex_free(self->thread_idle_mutex);
+	self->thread_idle_mutex = NULL;
+    }
+}
+
 /*
  * Class mechanics
  */
@@ -638,7 +1162,12 @@ s3_device_register(void)
     device_property_fill_and_register(&device_property_s3_ssl,
                                       G_TYPE_BOOLEAN, "s3_ssl",
        "Whether to use SSL with Amazon S3");
-
+    device_property_fill_and_register(&device_property_s3_max_connections,
+                                      G_TYPE_UINT, "s3_max_connections",
+       "Number of simultaneous uploads to Amazon S3");
+    device_property_fill_and_register(&device_property_s3_multipart_part_size,
+                                      G_TYPE_UINT, "s3_multipart_part_size",
+       "Size of each part of a multipart upload to Amazon S3, or 0 to disable");
 
     /* register the device itself */
     register_device(s3_device_factory, device_prefix_list);
@@ -786,6 +1315,16 @@ s3_device_class_init(S3DeviceClass * c G_GNUC_UNUSED)
 	    device_simple_property_get_fn,
 	    s3_device_set_ssl_fn);
 
+    device_class_register_property(device_class, PROPERTY_S3_MAX_CONNECTIONS,
+	    PROPERTY_ACCESS_GET_MASK | PROPERTY_ACCESS_SET_BEFORE_START,
+	    device_simple_property_get_fn,
+	    s3_device_set_max_connections_fn);
+
+    device_class_register_property(device_class, PROPERTY_S3_MULTIPART_PART_SIZE,
+	    PROPERTY_ACCESS_GET_MASK | PROPERTY_ACCESS_SET_BEFORE_START,
+	    device_simple_property_get_fn,
+	    s3_device_set_multipart_part_size_fn);
+
     device_class_register_property(device_class, PROPERTY_COMPRESSION,
 	    PROPERTY_ACCESS_GET_MASK,
 	    device_simple_property_get_fn,
@@ -892,11 +1431,15 @@ s3_device_set_verbose_fn(Device *p_self, DevicePropertyBase *base,
 {
     S3Device *self = S3_DEVICE(p_self);
 
+    guint i;
+
     self->verbose = g_value_get_boolean(val);
     /* Our S3 handle may not yet have been instantiated; if so, it will
      * get the proper verbose setting when it is created */
     if (self->s3)
 	s3_verbose(self->s3, self->verbose);
+    for (i = 0; self->conns && i < self->max_connections; i++)
+	s3_verbose(self->conns[i].s3, self->verbose);
 
     return device_simple_property_set_fn(p_self, base, val, surety, source);
 }
@@ -920,6 +1463,52 @@ s3_device_set_ssl_fn(Device *p_self, DevicePropertyBase *base,
     }
     self->use_ssl = new_val;
 
+    /* the parallel connections will be re-created with the new setting */
+    free_connections(self);
+
+    return device_simple_property_set_fn(p_self, base, val, surety, source);
+}
+
+static gboolean
+s3_device_set_max_connections_fn(Device *p_self, DevicePropertyBase *base,
+    GValue *val, PropertySurety surety, PropertySource source)
+{
+    S3Device *self = S3_DEVICE(p_self);
+    guint new_val;
+
+    new_val = g_value_get_uint(val);
+    if (new_val < 1) {
+	device_set_error(p_self, stralloc(_(
+		"S3_MAX_CONNECTIONS must be at least 1")),
+	    DEVICE_STATUS_DEVICE_ERROR);
+	return FALSE;
+    }
+
+    /* the connections are set up again, with the new count, by
+     * setup_handle */
+    free_connections(self);
+    self->max_connections = new_val;
+
+    return device_simple_property_set_fn(p_self, base, val, surety, source);
+}
+
+static gboolean
+s3_device_set_multipart_part_size_fn(Device *p_self, DevicePropertyBase *base,
+    GValue *val, PropertySurety surety, PropertySource source)
+{
+    S3Device *self = S3_DEVICE(p_self);
+    guint new_val;
+
+    new_val = g_value_get_uint(val);
+    if (new_val != 0 && new_val < S3_DEVICE_MIN_PART_SIZE) {
+	device_set_error(p_self, g_strdup_printf(_(
+		"S3_MULTIPART_PART_SIZE must be 0 or at least %d bytes"),
+		S3_DEVICE_MIN_PART_SIZE),
+	    DEVICE_STATUS_DEVICE_ERROR);
+	return FALSE;
+    }
+    self->part_size = new_val;
+
     return device_simple_property_set_fn(p_self, base, val, surety, source);
 }
 
@@ -976,6 +1565,7 @@ s3_device_open_device(Device *pself, char *device_name,
 
     /* default values */
     self->verbose = FALSE;
+    self->max_connections = 1;
 
     /* use SSL if available */
     self->use_ssl = s3_curl_supports_ssl();
@@ -984,6 +1574,18 @@ s3_device_open_device(Device *pself, char *device_name,
     g_value_set_boolean(&tmp_value, self->use_ssl);
     device_set_simple_property(pself, device_property_s3_ssl.ID,
 	&tmp_value, PROPERTY_SURETY_GOOD, PROPERTY_SOURCE_DEFAULT);
+    g_value_unset(&tmp_value);
+
+    g_value_init(&tmp_value, G_TYPE_UINT);
+    g_value_set_uint(&tmp_value, self->max_connections);
+    device_set_simple_property(pself, device_property_s3_max_connections.ID,
+	&tmp_value, PROPERTY_SURETY_GOOD, PROPERTY_SOURCE_DEFAULT);
+    g_value_unset(&tmp_value);
+
+    g_value_init(&tmp_value, G_TYPE_UINT);
+    g_value_set_uint(&tmp_value, self->part_size);
+    device_set_simple_property(pself, device_property_s3_multipart_part_size.ID,
+	&tmp_value, PROPERTY_SURETY_GOOD, PROPERTY_SOURCE_DEFAULT);
 
     if (parent_class->open_device) {
         parent_class->open_device(pself, device_name, device_type, device_node);
@@ -996,7 +1598,11 @@ static void s3_device_finalize(GObject * obj_self) {
     if(G_OBJECT_CLASS(parent_class)->finalize)
         (* G_OBJECT_CLASS(parent_class)->finalize)(obj_self);
 
+    free_connections(self);
+    if(self->mp_upload_id) end_multipart_upload(self, TRUE);
     if(self->s3) s3_free(self->s3);
+    if(self->part_buf) g_free(self->part_buf);
+    if(self->mp_read_key) g_free(self->mp_read_key);
     if(self->bucket) g_free(self->bucket);
     if(self->prefix) g_free(self->prefix);
     if(self->access_key) g_free(self->access_key);
@@ -1044,6 +1650,11 @@ static gboolean setup_handle(S3Device * self) {
         return FALSE;
     }
 
+    if (!setup_connections(self)) {
+        /* setup_connections already set our error message */
+        return FALSE;
+    }
+
     return TRUE;
 }
 
@@ -1194,6 +1805,17 @@ s3_device_start (Device * pself, DeviceAccessMode mode,
 
 static gboolean
 s3_device_finish (Device * pself) {
+    S3Device *self = S3_DEVICE(pself);
+
+    reset_prefetch(self);
+    if (!wait_for_uploads(self)) {
+	end_multipart_upload(self, TRUE);
+	return FALSE;
+    }
+
+    /* a file that was never finished is discarded */
+    end_multipart_upload(self, TRUE);
+
     if (device_in_error(pself)) return FALSE;
 
     /* we're not in a file anymore */
@@ -1251,9 +1873,212 @@ s3_device_start_file (Device *pself, dumpfile_t *jobInfo) {
         return FALSE;
     }
 
+    /* in multipart mode, the file's data is a single object */
+    if (self->part_size) {
+	self->mp_key = multipart_file_to_key(self, pself->file, pself->block_size);
+	self->mp_upload_id = s3_initiate_multi_part_upload(self->s3,
+						self->bucket, self->mp_key);
+	if (!self->mp_upload_id) {
+	    device_set_error(pself,
+		vstrallocf(_("While starting multipart upload: %s"),
+			   s3_strerror(self->s3)),
+		DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR);
+	    amfree(self->mp_key);
+	    return FALSE;
+	}
+	self->mp_etags = g_ptr_array_new();
+	self->part_buf_len = 0;
+    }
+
+    return TRUE;
+}
+
+/* Wait for an idle connection and claim it for an upload.  Returns NULL,
+ * with the device error set, if an earlier upload failed. */
+static S3Connection *
+acquire_upload_connection(S3Device *self)
+{
+    S3Connection *conn = NULL;
+    guint i;
+
+    g_mutex_lock(self->thread_idle_mutex);
+    while (!conn) {
+	if (!check_connection_errors(self)) {
+	    g_mutex_unlock(self->thread_idle_mutex);
+	    return NULL;
+	}
+
+	for (i = 0; i < self->max_connections; i++) {
+	    if (self->conns[i].idle) {
+		conn = &self->conns[i];
+		break;
+	    }
+	}
+
+	if (!conn)
+	    g_cond_wait(self->thread_idle_cond, self->thread_idle_mutex);
+    }
+    conn->idle = FALSE;
+    g_mutex_unlock(self->thread_idle_mutex);
+
+    return conn;
+}
+
+/* Queue a block for upload on the first idle connection, waiting for one
+ * to become available if all are busy.  The data is copied, so the caller's
+ * buffer may be reused as soon as this returns. */
+static gboolean
+s3_device_write_block_threaded(S3Device *self, guint size, gpointer data)
+{
+    Device *pself = DEVICE(self);
+    S3Connection *conn;
+
+    conn = acquire_upload_connection(self);
+    if (!conn)
+	return FALSE;
+
+    /* the connection is now ours until the upload thread marks it idle */
+    if (conn->buffer_size < size) {
+	g_free(conn->curl_buffer.buffer);
+	conn->curl_buffer.buffer = g_malloc(size);
+	conn->buffer_size = size;
+    }
+    memcpy(conn->curl_buffer.buffer, data, size);
+    conn->curl_buffer.buffer_len = size;
+    conn->curl_buffer.buffer_pos = 0;
+    conn->curl_buffer.max_buffer_size = 0;
+    conn->block = pself->block;
+    conn->key = file_and_block_to_key(self, pself->file, pself->block);
+    conn->upload_id = NULL;
+
+    g_thread_pool_push(self->thread_pool_write, conn, NULL);
+
+    pself->block++;
+
+    return TRUE;
+}
+
+/* Upload the contents of part_buf as the next part of the current multipart
+ * upload.  With parallel connections, part_buf is handed to the upload
+ * thread and replaced with the connection's previous buffer, so the part is
+ * not copied. */
+static gboolean
+flush_part(S3Device *self)
+{
+    Device *pself = DEVICE(self);
+    guint part_number;
+
+    /* reserve a slot for this part's ETag */
+    if (self->conns)
+	g_mutex_lock(self->thread_idle_mutex);
+    g_ptr_array_add(self->mp_etags, NULL);
+    part_number = self->mp_etags->len;
+    if (self->conns)
+	g_mutex_unlock(self->thread_idle_mutex);
+
+    if (self->thread_pool_write) {
+	S3Connection *conn;
+	char *tmp_buf;
+	guint tmp_size;
+
+	conn = acquire_upload_connection(self);
+	if (!conn)
+	    return FALSE;
+
+	tmp_buf = conn->curl_buffer.buffer;
+	tmp_size = conn->buffer_size;
+	conn->curl_buffer.buffer = self->part_buf;
+	conn->buffer_size = self->part_buf_size;
+	conn->curl_buffer.buffer_len = self->part_buf_len;
+	conn->curl_buffer.buffer_pos = 0;
+	conn->curl_buffer.max_buffer_size = 0;
+	conn->block = part_number;
+	conn->key = g_strdup(self->mp_key);
+	conn->upload_id = self->mp_upload_id;
+
+	self->part_buf = tmp_buf;
+	self->part_buf_size = tmp_size;
+	self->part_buf_len = 0;
+
+	g_thread_pool_push(self->thread_pool_write, conn, NULL);
+    } else {
+	CurlBuffer to_write = {self->part_buf, self->part_buf_len, 0, 0};
+	char *etag = NULL;
+
+	if (!s3_upload_part(self->s3, self->bucket, self->mp_key,
+		self->mp_upload_id, (int)part_number, &etag,
+		S3_BUFFER_READ_FUNCS, &to_write, NULL, NULL)) {
+	    device_set_error(pself,
+		vstrallocf(_("While writing part %u to S3: %s"),
+			   part_number, s3_strerror(self->s3)),
+		DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR);
+	    return FALSE;
+	}
+	g_ptr_array_index(self->mp_etags, part_number - 1) = etag;
+	self->part_buf_len = 0;
+    }
+
     return TRUE;
 }
 
+/* Append a block to the current part, uploading the part when it is full.
+ * Parts need not fall on block boundaries, since blocks are located by
+ * offset when reading. */
+static gboolean
+s3_device_write_block_multipart(S3Device *self, guint size, gpointer data)
+{
+    Device *pself = DEVICE(self);
+    char *p = data;
+
+    while (size > 0) {
+	guint n;
+
+	if (self->part_buf_size < self->part_size) {
+	    self->part_buf = g_realloc(self->part_buf, self->part_size);
+	    self->part_buf_size = self->part_size;
+	}
+
+	n = MIN(size, self->part_size - self->part_buf_len);
+	memcpy(self->part_buf + self->part_buf_len, p, n);
+	self->part_buf_len += n;
+	p += n;
+	size -= n;
+
+	if (self->part_buf_len == self->part_size && !flush_part(self))
+	    return FALSE;
+    }
+
+    pself->block++;
+
+    return TRUE;
+}
+
+/* Free the state of the current multipart upload, aborting it on S3 if it
+ * has not been completed. */
+static void
+end_multipart_upload(S3Device *self, gboolean abort_upload)
+{
+    guint i;
+
+    if (!self->mp_upload_id)
+	return;
+
+    if (abort_upload &&
+	!s3_abort_multi_part_upload(self->s3, self->bucket, self->mp_key,
+				    self->mp_upload_id)) {
+	g_warning(_("While aborting multipart upload of %s: %s"),
+		  self->mp_key, s3_strerror(self->s3));
+    }
+
+    for (i = 0; i < self->mp_etags->len; i++)
+	g_free(g_ptr_array_index(self->mp_etags, i));
+    g_ptr_array_free(self->mp_etags, TRUE);
+    self->mp_etags = NULL;
+    amfree(self->mp_upload_id);
+    amfree(self->mp_key);
+    self->part_buf_len = 0;
+}
+
 static gboolean
 s3_device_write_block (Device * pself, guint size, gpointer data) {
     gboolean result;
@@ -1265,6 +2090,12 @@ s3_device_write_block (Device * pself, guint size, gpointer data) {
     g_assert (data != NULL);
     if (device_in_error(self)) return FALSE;
 
+    if (self->mp_upload_id)
+	return s3_device_write_block_multipart(self, size, data);
+
+    if (self->thread_pool_write)
+	return s3_device_write_block_threaded(self, size, data);
+
     filename = file_and_block_to_key(self, pself->file, pself->block);
 
     result = s3_upload(self->s3, self->bucket, filename, S3_BUFFER_READ_FUNCS,
@@ -1284,7 +2115,43 @@ s3_device_write_block (Device * pself, guint size, gpointer data) {
 
 static gboolean
 s3_device_finish_file (Device * pself) {
-    if (device_in_error(pself)) return FALSE;
+    S3Device *self = S3_DEVICE(pself);
+
+    if (device_in_error(pself)) {
+	wait_for_uploads(self);
+	end_multipart_upload(self, TRUE);
+	return FALSE;
+    }
+
+    /* upload the last part; a file with no data at all is left without a
+     * data object, which reads as an empty file */
+    if (self->mp_upload_id && self->part_buf_len > 0 && !flush_part(self)) {
+	wait_for_uploads(self);
+	end_multipart_upload(self, TRUE);
+	return FALSE;
+    }
+
+    /* the file is not complete until every block is stored */
+    if (!wait_for_uploads(self)) {
+	end_multipart_upload(self, TRUE);
+	return FALSE;
+    }
+
+    if (self->mp_upload_id) {
+	if (self->mp_etags->len == 0) {
+	    end_multipart_upload(self, TRUE);
+	} else if (!s3_complete_multi_part_upload(self->s3, self->bucket,
+			self->mp_key, self->mp_upload_id, self->mp_etags)) {
+	    device_set_error(pself,
+		vstrallocf(_("While completing multipart upload: %s"),
+			   s3_strerror(self->s3)),
+		DEVICE_STATUS_DEVICE_ERROR | DEVICE_STATUS_VOLUME_ERROR);
+	    end_multipart_upload(self, TRUE);
+	    return FALSE;
+	} else {
+	    end_multipart_upload(self, FALSE);
+	}
+    }
 
     /* we're not in a file anymore */
     pself->in_file = FALSE;
@@ -1429,6 +2296,13 @@ s3_device_seek_file(Device *pself, guint file) {
             return NULL;
     }
 
+    /* the file's data may be a single multipart object */
+    if (!find_multipart_file(self, pself->file)) {
+	/* find_multipart_file already set our error message */
+	g_free(amanda_header);
+	return NULL;
+    }
+
     pself->in_file = TRUE;
     return amanda_header;
 }
@@ -1481,6 +2355,134 @@ s3_read_block_write_func(void *ptr, size_t size, size_t nmemb, void *stream)
     return new_bytes;
 }
 
+/* Read the current block, using the parallel connections to keep the
+ * following blocks of the file in flight.  Each connection holds at most one
+ * block, so no more than max_connections blocks are ever buffered. */
+static int
+s3_device_read_block_threaded(S3Device *self, gpointer data, int *size_req)
+{
+    Device *pself = DEVICE(self);
+    S3Connection *conn;
+    guint64 block;
+    int size;
+
+    g_mutex_lock(self->thread_idle_mutex);
+
+    /* get (or start) the fetch for the current block.  If every connection
+     * is busy, at least one of them is outside the window and will be
+     * discarded once it completes. */
+    discard_stale_prefetch(self);
+    while (!(conn = find_prefetch(self, pself->file, pself->block))
+	&& !(conn = start_prefetch(self, pself->file, pself->block))) {
+	g_cond_wait(self->thread_idle_cond, self->thread_idle_mutex);
+	discard_stale_prefetch(self);
+    }
+
+    /* fill the rest of the window, stopping at a known end of file */
+    for (block = pself->block + 1;
+	 block < pself->block + self->max_connections;
+	 block++) {
+	S3Connection *next = find_prefetch(self, pself->file, block);
+	if (next) {
+	    if (next->done && next->eof)
+		break;
+	    continue;
+	}
+	if (!start_prefetch(self, pself->file, block))
+	    break;
+    }
+
+    while (!conn->done)
+	g_cond_wait(self->thread_idle_cond, self->thread_idle_mutex);
+
+    if (conn->errmsg) {
+	device_set_error(pself, conn->errmsg, conn->errflags);
+	conn->errmsg = NULL;
+	release_connection(self, conn);
+	g_mutex_unlock(self->thread_idle_mutex);
+	return -1;
+    }
+
+    if (conn->eof) {
+	release_connection(self, conn);
+	g_mutex_unlock(self->thread_idle_mutex);
+
+	pself->is_eof = TRUE;
+	pself->in_file = FALSE;
+	device_set_error(pself,
+	    stralloc(_("EOF")),
+	    DEVICE_STATUS_SUCCESS);
+	return -1;
+    }
+
+    size = (int)conn->curl_buffer.buffer_pos;
+    if (!data || *size_req < size) {
+	/* keep the block; the caller will ask again with a larger buffer */
+	g_mutex_unlock(self->thread_idle_mutex);
+	*size_req = size;
+	return 0;
+    }
+    g_mutex_unlock(self->thread_idle_mutex);
+
+    /* the connection is ours until it is released, so copy without the lock */
+    memcpy(data, conn->curl_buffer.buffer, size);
+
+    g_mutex_lock(self->thread_idle_mutex);
+    release_connection(self, conn);
+    g_mutex_unlock(self->thread_idle_mutex);
+
+    pself->block++;
+    *size_req = size;
+    return size;
+}
+
+/* Read the current block from a multipart object with a range GET.  A range
+ * past the end of the object is the end of the file. */
+static int
+s3_device_read_block_multipart(S3Device *self, gpointer data, int *size_req)
+{
+    Device *pself = DEVICE(self);
+    guint block_size = self->mp_read_block_size;
+    guint64 begin = pself->block * block_size;
+    CurlBuffer buf;
+
+    /* all blocks but the last are full-sized, so ask for a full block */
+    if (!data || *size_req < (int)block_size) {
+	*size_req = block_size;
+	return 0;
+    }
+
+    buf.buffer = data;
+    buf.buffer_len = *size_req;
+    buf.buffer_pos = 0;
+    buf.max_buffer_size = *size_req;
+
+    if (!s3_read_range(self->s3, self->bucket, self->mp_read_key,
+		       begin, begin + block_size - 1,
+		       S3_BUFFER_WRITE_FUNCS, &buf, NULL, NULL)) {
+	guint response_code;
+	s3_error(self->s3, NULL, &response_code, NULL, NULL, NULL, NULL);
+
+	if (response_code == 416) {
+	    pself->is_eof = TRUE;
+	    pself->in_file = FALSE;
+	    device_set_error(pself,
+		stralloc(_("EOF")),
+		DEVICE_STATUS_SUCCESS);
+	    return -1;
+	}
+
+	device_set_error(pself,
+	    vstrallocf(_("While reading data block from S3: %s"), s3_strerror(self->s3)),
+	    DEVICE_STATUS_VOLUME_ERROR);
+	return -1;
+    }
+
+    pself->block++;
+    *size_req = buf.buffer_pos;
+    return buf.buffer_pos;
+}
+
 static int
 s3_device_read_block (Device * pself, gpointer data, int *size_req) {
     S3Device * self = S3_DEVICE(pself);
@@ -1491,6 +2493,12 @@ s3_device_read_block (Device * pself, gpointer data, int *size_req) {
     g_assert (self != NULL);
     if (device_in_error(self)) return -1;
 
+    if (self->thread_pool_read)
+	return s3_device_read_block_threaded(self, data, size_req);
+
+    if (self->mp_read_key)
+	return s3_device_read_block_multipart(self, data, size_req);
+
     /* get the file*/
     key = file_and_block_to_key(self, pself->file, pself->block);
     g_assert(key != NULL);
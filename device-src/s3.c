@@ -149,6 +149,7 @@ struct S3Handle {
     guint last_num_retries;
     void *last_response_body;
     guint last_response_body_size;
+    char *last_etag;
 };
 
 typedef struct {
@@ -251,7 +252,7 @@ lookup_result(const result_handling_t *result_handling,
 /*
  * Precompiled regular expressions */
 static regex_t etag_regex, error_name_regex, message_regex, subdomain_regex,
-    location_con_regex;
+    location_con_regex, upload_id_regex;
 
 /*
  * Utility functions
@@ -350,6 +351,8 @@ interpret_response(S3Handle *hdl,
  * @param subresource: the "sub-resource" to request (e.g. "acl") or NULL for none
  * @param query: the query string to send (not including th initial '?'),
  * or NULL for none
+ * @param range: the value of the Range header (e.g. "bytes=0-99"), or NULL
+ * for none
  * @param read_func: the callback for reading data
  *   Will use s3_empty_read_func if NULL is passed in.
  * @param read_reset_func: the callback for to reset reading data
@@ -373,6 +376,7 @@ perform_request(S3Handle *hdl,
                 const char *key,
                 const char *subresource,
                 const char *query,
+                const char *range,
                 s3_read_func read_func,
                 s3_reset_func read_reset_func,
                 s3_size_func size_func,
@@ -1000,6 +1004,7 @@ perform_request(S3Handle *hdl,
                 const char *key,
                 const char *subresource,
                 const char *query,
+                const char *range,
                 s3_read_func read_func,
                 s3_reset_func read_reset_func,
                 s3_size_func size_func,
@@ -1096,6 +1101,18 @@ perform_request(S3Handle *hdl,
         headers = authenticate_request(hdl, verb, bucket, key, subresource,
             md5_hash_b64, is_non_empty_string(hdl->bucket_location));
 
+        /* the Range header is not part of the signature */
+        if (range) {
+            char *buf = g_strdup_printf("Range: %s", range);
+            headers = curl_slist_append(headers, buf);
+            g_free(buf);
+        }
+
+        /* keep curl from adding a Content-Type to POSTs, since we signed an
+         * empty one */
+        if (curlopt_post)
+            headers = curl_slist_append(headers, "Content-Type:");
+
         if (hdl->use_ssl && hdl->ca_info) {
             if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_CAINFO, hdl->ca_info)))
                 goto curl_error;
@@ -1156,7 +1173,18 @@ perform_request(S3Handle *hdl,
             goto curl_error;
 
 
-        if (curlopt_upload) {
+        if (curlopt_post) {
+            /* POST bodies come from the read function too */
+#ifdef CURLOPT_POSTFIELDSIZE_LARGE
+            if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)request_body_size)))
+                goto curl_error;
+#else
+            if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_POSTFIELDSIZE, (long)request_body_size)))
+                goto curl_error;
+#endif
+        }
+
+        if (curlopt_upload || curlopt_post) {
             if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_READFUNCTION, read_func)))
                 goto curl_error;
             if ((curl_code = curl_easy_setopt(hdl->curl, CURLOPT_READDATA, read_data)))
@@ -1221,6 +1249,7 @@ cleanup:
     hdl->last_response_body = int_writedata.resp_buf.buffer;
     hdl->last_response_body_size = int_writedata.resp_buf.buffer_pos;
     hdl->last_num_retries = retries;
+    hdl->last_etag = int_writedata.etag;
 
     return result;
 }
@@ -1260,6 +1289,7 @@ s3_internal_reset_func(void * stream)
     s3_buffer_reset_func(&data->resp_buf);
     data->headers_done = FALSE;
     data->int_write_done = FALSE;
+    g_free(data->etag);
     data->etag = NULL;
     if (data->reset_func) {
         data->reset_func(data->write_data);
@@ -1275,8 +1305,10 @@ s3_internal_header_func(void *ptr, size_t size, size_t nmemb, void * stream)
     S3InternalData *data = (S3InternalData *) stream;
 
     header = g_strndup((gchar *) ptr, (gsize) size*nmemb);
-    if (!s3_regexec_wrap(&etag_regex, header, 2, pmatch, 0))
+    if (!s3_regexec_wrap(&etag_regex, header, 2, pmatch, 0)) {
+            g_free(data->etag);
             data->etag = find_regex_substring(header, pmatch[1]);
+    }
     if (!strcmp(final_header, header))
         data->headers_done = TRUE;
 
@@ -1295,6 +1327,7 @@ compile_regexes(void)
         {"<Message>[[:space:]]*([^<]*)[[:space:]]*</Message>", REG_EXTENDED | REG_ICASE, &message_regex},
         {"^[a-z0-9](-*[a-z0-9]){2,62}$", REG_EXTENDED | REG_NOSUB, &subdomain_regex},
         {"(/>)|(>([^<]*)</LocationConstraint>)", REG_EXTENDED | REG_ICASE, &location_con_regex},
+        {"<UploadId>[[:space:]]*([^<]*)[[:space:]]*</UploadId>", REG_EXTENDED | REG_ICASE, &upload_id_regex},
         {NULL, 0, NULL}
     };
     char regmessage[1024];
@@ -1327,6 +1360,9 @@ compile_regexes(void)
         {"(/>)|(>([^<]*)</LocationConstraint>)",
          G_REGEX_CASELESS,
          &location_con_regex},
+        {"<UploadId>\\s*([^<]*)\\s*</UploadId>",
+         G_REGEX_OPTIMIZE | G_REGEX_CASELESS,
+         &upload_id_regex},
         {NULL, 0, NULL}
   };
   int i;
@@ -1456,6 +1492,11 @@ s3_reset(S3Handle *hdl)
         }
 
         hdl->last_response_body_size = 0;
+
+        if (hdl->last_etag) {
+            g_free(hdl->last_etag);
+            hdl->last_etag = NULL;
+        }
     }
 }
 
@@ -1565,7 +1606,7 @@ s3_upload(S3Handle *hdl,
 
     g_assert(hdl != NULL);
 
-    result = perform_request(hdl, "PUT", bucket, key, NULL, NULL,
+    result = perform_request(hdl, "PUT", bucket, key, NULL, NULL, NULL,
                  read_func, reset_func, size_func, md5_func, read_data,
                  NULL, NULL, NULL, progress_func, progress_data,
                  result_handling);
@@ -1706,7 +1747,7 @@ list_fetch(S3Handle *hdl,
     }
 
     /* and perform the request on that URI */
-    result = perform_request(hdl, "GET", bucket, NULL, NULL, query->str,
+    result = perform_request(hdl, "GET", bucket, NULL, NULL, query->str, NULL,
                              NULL, NULL, NULL, NULL, NULL,
                              S3_BUFFER_WRITE_FUNCS, buf, NULL, NULL,
                              result_handling);
@@ -1818,7 +1859,7 @@ s3_read(S3Handle *hdl,
     g_assert(hdl != NULL);
     g_assert(write_func != NULL);
 
-    result = perform_request(hdl, "GET", bucket, key, NULL, NULL,
+    result = perform_request(hdl, "GET", bucket, key, NULL, NULL, NULL,
         NULL, NULL, NULL, NULL, NULL, write_func, reset_func, write_data,
         progress_func, progress_data, result_handling);
 
@@ -1840,7 +1881,7 @@ s3_delete(S3Handle *hdl,
 
     g_assert(hdl != NULL);
 
-    result = perform_request(hdl, "DELETE", bucket, key, NULL, NULL,
+    result = perform_request(hdl, "DELETE", bucket, key, NULL, NULL, NULL,
                  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
                  result_handling);
 
@@ -1889,7 +1930,7 @@ s3_make_bucket(S3Handle *hdl,
         }
     }
 
-    result = perform_request(hdl, "PUT", bucket, NULL, NULL, NULL,
+    result = perform_request(hdl, "PUT", bucket, NULL, NULL, NULL, NULL,
                  read_func, reset_func, size_func, md5_func, ptr,
                  NULL, NULL, NULL, NULL, NULL, result_handling);
 
@@ -1899,7 +1940,7 @@ s3_make_bucket(S3Handle *hdl,
         /* verify the that the location constraint on the existing bucket matches
          * the one that's configured.
          */
-        result = perform_request(hdl, "GET", bucket, NULL, "location", NULL,
+        result = perform_request(hdl, "GET", bucket, NULL, "location", NULL, NULL,
                                  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
                                  NULL, NULL, result_handling);
 
@@ -1958,3 +1999,211 @@ s3_delete_bucket(S3Handle *hdl,
 {
     return s3_delete(hdl, bucket, NULL);
 }
+
+gboolean
+s3_read_range(S3Handle *hdl,
+              const char *bucket,
+              const char *key,
+              guint64 range_begin,
+              guint64 range_end,
+              s3_write_func write_func,
+              s3_reset_func reset_func,
+              gpointer write_data,
+              s3_progress_func progress_func,
+              gpointer progress_data)
+{
+    s3_result_t result = S3_RESULT_FAIL;
+    static result_handling_t result_handling[] = {
+        { 200, 0, 0, S3_RESULT_OK },
+        { 206, 0, 0, S3_RESULT_OK },
+        RESULT_HANDLING_ALWAYS_RETRY,
+        { 0,   0, 0, /* default: */ S3_RESULT_FAIL  }
+        };
+    char *range;
+
+    g_assert(hdl != NULL);
+    g_assert(write_func != NULL);
+    g_assert(range_begin <= range_end);
+
+    range = g_strdup_printf("bytes=%ju-%ju",
+        (uintmax_t)range_begin, (uintmax_t)range_end);
+    result = perform_request(hdl, "GET", bucket, key, NULL, NULL, range,
+        NULL, NULL, NULL, NULL, NULL, write_func, reset_func, write_data,
+        progress_func, progress_data, result_handling);
+    g_free(range);
+
+    return result == S3_RESULT_OK;
+}
+
+char *
+s3_initiate_multi_part_upload(S3Handle *hdl,
+                              const char *bucket,
+                              const char *key)
+{
+    s3_result_t result = S3_RESULT_FAIL;
+    static result_handling_t result_handling[] = {
+        { 200, 0, 0, S3_RESULT_OK },
+        RESULT_HANDLING_ALWAYS_RETRY,
+        { 0,   0, 0, /* default: */ S3_RESULT_FAIL  }
+        };
+    regmatch_t pmatch[2];
+    char *body;
+    char *upload_id = NULL;
+
+    g_assert(hdl != NULL);
+
+    result = perform_request(hdl, "POST", bucket, key, "uploads", NULL, NULL,
+                 NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                 result_handling);
+    if (result != S3_RESULT_OK)
+        return NULL;
+
+    /* use strndup to get a null-terminated string */
+    body = g_strndup(hdl->last_response_body, hdl->last_response_body_size);
+    if (!s3_regexec_wrap(&upload_id_regex, body, 2, pmatch, 0))
+        upload_id = find_regex_substring(body, pmatch[1]);
+    g_free(body);
+
+    if (!upload_id || !upload_id[0]) {
+        g_free(upload_id);
+        if (hdl->last_message) g_free(hdl->last_message);
+        hdl->last_message = g_strdup(_("No UploadId in response to multipart upload request"));
+        return NULL;
+    }
+
+    return upload_id;
+}
+
+gboolean
+s3_upload_part(S3Handle *hdl,
+               const char *bucket,
+               const char *key,
+               const char *upload_id,
+               int part_number,
+               char **etag,
+               s3_read_func read_func,
+               s3_reset_func reset_func,
+               s3_size_func size_func,
+               s3_md5_func md5_func,
+               gpointer read_data,
+               s3_progress_func progress_func,
+               gpointer progress_data)
+{
+    s3_result_t result = S3_RESULT_FAIL;
+    static result_handling_t result_handling[] = {
+        { 200,  0, 0, S3_RESULT_OK },
+        RESULT_HANDLING_ALWAYS_RETRY,
+        { 0,    0, 0, /* default: */ S3_RESULT_FAIL }
+        };
+    char *subresource;
+
+    g_assert(hdl != NULL);
+    g_assert(etag != NULL);
+
+    subresource = g_strdup_printf("partNumber=%d&uploadId=%s",
+                                  part_number, upload_id);
+    result = perform_request(hdl, "PUT", bucket, key, subresource, NULL, NULL,
+                 read_func, reset_func, size_func, md5_func, read_data,
+                 NULL, NULL, NULL, progress_func, progress_data,
+                 result_handling);
+    g_free(subresource);
+
+    if (result != S3_RESULT_OK)
+        return FALSE;
+
+    if (!hdl->last_etag) {
+        if (hdl->last_message) g_free(hdl->last_message);
+        hdl->last_message = g_strdup(_("No ETag in response to part upload"));
+        return FALSE;
+    }
+
+    *etag = g_strdup(hdl->last_etag);
+    return TRUE;
+}
+
+gboolean
+s3_complete_multi_part_upload(S3Handle *hdl,
+                              const char *bucket,
+                              const char *key,
+                              const char *upload_id,
+                              GPtrArray *etags)
+{
+    s3_result_t result = S3_RESULT_FAIL;
+    static result_handling_t result_handling[] = {
+        { 200,  0, 0, S3_RESULT_OK },
+        RESULT_HANDLING_ALWAYS_RETRY,
+        { 0,    0, 0, /* default: */ S3_RESULT_FAIL }
+        };
+    GString *body;
+    CurlBuffer buf = {NULL, 0, 0, 0};
+    char *subresource;
+    regmatch_t pmatch[2];
+    guint i;
+
+    g_assert(hdl != NULL);
+    g_assert(etags != NULL && etags->len > 0);
+
+    body = g_string_new("<CompleteMultipartUpload>\n");
+    for (i = 0; i < etags->len; i++) {
+        g_string_append_printf(body,
+            "  <Part><PartNumber>%u</PartNumber><ETag>\"%s\"</ETag></Part>\n",
+            i + 1, (char *)g_ptr_array_index(etags, i));
+    }
+    g_string_append(body, "</CompleteMultipartUpload>\n");
+
+    buf.buffer = body->str;
+    buf.buffer_len = (guint) body->len;
+    buf.max_buffer_size = buf.buffer_len;
+
+    subresource = g_strdup_printf("uploadId=%s", upload_id);
+    result = perform_request(hdl, "POST", bucket, key, subresource, NULL, NULL,
+                 S3_BUFFER_READ_FUNCS, &buf,
+                 NULL, NULL, NULL, NULL, NULL, result_handling);
+    g_free(subresource);
+    g_string_free(body, TRUE);
+
+    /* S3 may report an error in the body of a 200 response, since the
+     * response is sent before the parts are assembled */
+    if (result == S3_RESULT_OK && hdl->last_response_body) {
+        char *resp = g_strndup(hdl->last_response_body,
+                               hdl->last_response_body_size);
+        if (!s3_regexec_wrap(&error_name_regex, resp, 2, pmatch, 0)) {
+            char *error_name = find_regex_substring(resp, pmatch[1]);
+            hdl->last_s3_error_code = s3_error_code_from_name(error_name);
+            if (hdl->last_message) g_free(hdl->last_message);
+            hdl->last_message = g_strdup_printf(
+                _("Error completing multipart upload: %s"), error_name);
+            g_free(error_name);
+            result = S3_RESULT_FAIL;
+        }
+        g_free(resp);
+    }
+
+    return result == S3_RESULT_OK;
+}
+
+gboolean
+s3_abort_multi_part_upload(S3Handle *hdl,
+                           const char *bucket,
+                           const char *key,
+                           const char *upload_id)
+{
+    s3_result_t result = S3_RESULT_FAIL;
+    static result_handling_t result_handling[] = {
+        { 204,  0,                     0, S3_RESULT_OK },
+        { 404,  0,                     0, S3_RESULT_OK },
+        RESULT_HANDLING_ALWAYS_RETRY,
+        { 0,    0,                     0, /* default: */ S3_RESULT_FAIL  }
+        };
+    char *subresource;
+
+    g_assert(hdl != NULL);
+
+    subresource = g_strdup_printf("uploadId=%s", upload_id);
+    result = perform_request(hdl, "DELETE", bucket, key, subresource, NULL, NULL,
+                 NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                 result_handling);
+    g_free(subresource);
+
+    return result == S3_RESULT_OK;
+}
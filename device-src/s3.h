@@ -378,6 +378,109 @@ s3_read(S3Handle *hdl,
         s3_progress_func progress_func,
         gpointer progress_data);
 
+/* Read a byte range of a file, passing the contents to write_func buffer
+ * by buffer.
+ *
+ * @param hdl: the S3Handle object
+ * @param bucket: the bucket to read from
+ * @param key: the key to read from
+ * @param range_begin: offset of the first byte to read
+ * @param range_end: offset of the last byte to read (inclusive)
+ * @param write_func: the callback for writing data
+ * @param reset_func: the callback for to reset writing data
+ * @param write_data: pointer to pass to C{write_func}
+ * @param progress_func: the callback for progress information
+ * @param progress_data: pointer to pass to C{progress_func}
+ * @returns: FALSE if an error occurs
+ */
+gboolean
+s3_read_range(S3Handle *hdl,
+              const char *bucket,
+              const char *key,
+              guint64 range_begin,
+              guint64 range_end,
+              s3_write_func write_func,
+              s3_reset_func reset_func,
+              gpointer write_data,
+              s3_progress_func progress_func,
+              gpointer progress_data);
+
+/* Begin a multipart upload.  The parts are then uploaded with
+ * s3_upload_part, and the object is created by s3_complete_multi_part_upload.
+ *
+ * @param hdl: the S3Handle object
+ * @param bucket: the bucket to which the upload should be made
+ * @param key: the key to which the upload should be made
+ * @returns: the newly allocated upload ID, or NULL if an error occurs
+ */
+char *
+s3_initiate_multi_part_upload(S3Handle *hdl,
+                              const char *bucket,
+                              const char *key);
+
+/* Upload one part of a multipart upload.  Parts are numbered from 1, and
+ * all but the last must be at least 5MB.
+ *
+ * @param hdl: the S3Handle object
+ * @param bucket: the bucket to which the upload should be made
+ * @param key: the key to which the upload should be made
+ * @param upload_id: the upload ID from s3_initiate_multi_part_upload
+ * @param part_number: the number of this part
+ * @param etag: (output) the newly allocated ETag of the part
+ * @param read_func: the callback for reading data
+ * @param reset_func: the callback for to reset reading data
+ * @param size_func: the callback to get the number of bytes to upload
+ * @param md5_func: the callback to get the MD5 hash of the data to upload
+ * @param read_data: pointer to pass to the above functions
+ * @param progress_func: the callback for progress information
+ * @param progress_data: pointer to pass to C{progress_func}
+ * @returns: false if an error ocurred
+ */
+gboolean
+s3_upload_part(S3Handle *hdl,
+               const char *bucket,
+               const char *key,
+               const char *upload_id,
+               int part_number,
+               char **etag,
+               s3_read_func read_func,
+               s3_reset_func reset_func,
+               s3_size_func size_func,
+               s3_md5_func md5_func,
+               gpointer read_data,
+               s3_progress_func progress_func,
+               gpointer progress_data);
+
+/* Finish a multipart upload, assembling its parts into a single object.
+ *
+ * @param hdl: the S3Handle object
+ * @param bucket: the bucket to which the upload was made
+ * @param key: the key to which the upload was made
+ * @param upload_id: the upload ID from s3_initiate_multi_part_upload
+ * @param etags: the ETag of each part, in order (element 0 is part 1)
+ * @returns: false if an error ocurred
+ */
+gboolean
+s3_complete_multi_part_upload(S3Handle *hdl,
+                              const char *bucket,
+                              const char *key,
+                              const char *upload_id,
+                              GPtrArray *etags);
+
+/* Abandon a multipart upload, discarding any parts already uploaded.
+ *
+ * @param hdl: the S3Handle object
+ * @param bucket: the bucket to which the upload was made
+ * @param key: the key to which the upload was made
+ * @param upload_id: the upload ID from s3_initiate_multi_part_upload
+ * @returns: false if an error ocurred
+ */
+gboolean
+s3_abort_multi_part_upload(S3Handle *hdl,
+                           const char *bucket,
+                           const char *key,
+                           const char *upload_id);
+
 /* Delete a file.
  *
  * @param hdl: the S3Handle object
@@ -163,6 +163,16 @@ queueing_thread(
     return NULL;
 }
 
+static void
+setup_impl(
+    XferElement *elt)
+{
+    XferDestDevice *self = (XferDestDevice *)elt;
+
+    /* have upstream glue deliver data in device-sized buffers */
+    xfer_set_buffer_size(elt->xfer, self->device->block_size, 0);
+}
+
 static gboolean
 start_impl(
     XferElement *elt)
@@ -189,6 +199,7 @@ class_init(
 	{ XFER_MECH_NONE, XFER_MECH_NONE, 0, 0},
     };
 
+    klass->setup = setup_impl;
     klass->start = start_impl;
 
     klass->perl_class = "Amanda::Xfer::Dest::Device";
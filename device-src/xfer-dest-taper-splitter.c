@@ -25,12 +25,19 @@
 #include "arglist.h"
 #include "conffile.h"
 
+/* The disk cache can be mapped straight into the slabs if we can map files and
+ * reserve their space up front (a mapped write to a sparse file that hits
+ * ENOSPC is a SIGBUS, not an error return). */
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_POSIX_FALLOCATE)
+#  define USE_MMAP_DISK_CACHE
+#  include <sys/mman.h>
+#endif
+
 /* A transfer destination that writes and entire dumpfile to one or more files on one
  * or more devices.   This is designed to work in concert with Amanda::Taper::Scribe. */
 
 /* Future Plans:
  * - capture EOF early enough to avoid wasting a tape when the part size is an even multiple of the volume size - maybe reader thread can just go back and tag previous slab with EOF in that case?
- * - use mmap to make the disk-cacher thread unnecessary, if supported, by simply mapping slabs into the disk cache file
  * - can we find a way to fall back to mem_cache when the disk cache gets ENOSPC? Does it even make sense to try, since this would change the part size?
  * - distinguish some permanent device errors and do not retry the part? (this will be a change of behavior)
  */
@@ -63,6 +70,10 @@ typedef struct Slab {
 
     /* base of the slab_size buffer */
     gpointer base;
+
+    /* if nonzero, base is a mapping of this many bytes of the disk cache file,
+     * rather than allocated memory */
+    gsize map_length;
 } Slab;
 
 /*
@@ -115,6 +126,11 @@ typedef struct XferDestTaperSplitter {
     char *disk_cache_dirname;
     guint64 part_size; /* (bytes) */
 
+    /* if not NULL, data that arrives while the slab train is full is appended
+     * to a spill file in this directory, rather than making the upstream
+     * element wait, and is moved into the train as slabs become free. */
+    char *spill_dirname;
+
     /*
      * threads
      */
@@ -126,6 +142,15 @@ typedef struct XferDestTaperSplitter {
     /* The thread writing slabs to the disk cache, if any */
     GThread *disk_cache_thread;
 
+    /* If true, there is no disk_cache_thread: the reader's slabs are mapped
+     * directly onto the disk cache file, and retries map the file again.  The
+     * file holds two parts, so the reader can fill the next part while the
+     * current part may still be retried.  Serials at or after
+     * cache_first_serial + 2*slabs_per_part must wait until cache_first_serial
+     * advances; it is protected by slab_mutex. */
+    gboolean disk_cache_mmap;
+    guint64 cache_first_serial;
+
     /* slab train
      *
      * All in-memory data is contained in a linked list called the "slab
@@ -186,6 +211,14 @@ typedef struct XferDestTaperSplitter {
     /* the serial to be assigned to reader_slab */
     guint64 next_serial;
 
+    /* the reader's spill file, opened twice like the disk cache file; the
+     * bytes written to it that are not yet in the slab train; the total
+     * spilled; and whether spilling has stopped after an error */
+    int spill_write_fd, spill_read_fd;
+    guint64 spill_bytes;
+    guint64 spill_total;
+    gboolean spill_failed;
+
     /* bytes written to the device in this part */
     guint64 bytes_written;
 
@@ -330,6 +363,18 @@ send_xmsg_error_and_cancel(
  * Slab handling
  */
 
+/* called with the slab_mutex held, this returns true if the slab train holds
+ * max_slabs slabs and none can be reused, so that alloc_slab would block. */
+static inline gboolean
+train_full(
+    XferDestTaperSplitter *self)
+{
+    return self->oldest_slab &&
+	   self->newest_slab &&
+	   self->oldest_slab->refcount > 1 &&
+	   (self->newest_slab->serial - self->oldest_slab->serial + 1) >= self->max_slabs;
+}
+
 /* called with the slab_mutex held, this gets a new slab to write into, with
  * refcount 1.  It will block if max_memory slabs are already in use, and mem
  * caching is not in use, although allocation may be forced with the 'force'
@@ -355,12 +400,7 @@ alloc_slab(
     DBG(8, "alloc_slab(force=%d)", force);
     if (!force) {
 	/* throttle based on maximum number of extant slabs */
-	while (G_UNLIKELY(
-            !elt->cancelled &&
-	    self->oldest_slab &&
-	    self->newest_slab &&
-	    self->oldest_slab->refcount > 1 &&
-	    (self->newest_slab->serial - self->oldest_slab->serial + 1) >= self->max_slabs)) {
+	while (G_UNLIKELY(!elt->cancelled && train_full(self))) {
 	    DBG(9, "waiting for available slab");
 	    g_cond_wait(self->slab_free_cond, self->slab_mutex);
 	}
@@ -378,6 +418,11 @@ alloc_slab(
     } else {
 	rv = g_new0(Slab, 1);
 	rv->refcount = 1;
+
+	/* mapped slabs get their memory from map_slab */
+	if (self->disk_cache_mmap)
+	    goto done;
+
 	rv->base = g_try_malloc(self->slab_size);
 	if (!rv->base) {
 	    g_free(rv);
@@ -387,6 +432,7 @@ alloc_slab(
 	}
     }
 
+done:
     rv->next = NULL;
     rv->size = 0;
     return rv;
@@ -402,6 +448,11 @@ free_slab(
     Slab *slab)
 {
     if (slab) {
+#ifdef USE_MMAP_DISK_CACHE
+	if (slab->map_length)
+	    munmap(slab->base, slab->map_length);
+	else
+#endif
 	if (slab->base)
 	    g_free(slab->base);
 	g_free(slab);
@@ -611,6 +662,116 @@ disk_cache_thread(
     return NULL;
 }
 
+#ifdef USE_MMAP_DISK_CACHE
+/* Called from start_impl, this tries to set up a mapped disk cache, leaving
+ * disk_cache_mmap false (and the disk_cache_thread to do the work) if that is
+ * not possible. */
+static void
+open_mmap_disk_cache(
+    XferDestTaperSplitter *self)
+{
+    char *filename;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    int fd, err;
+
+    if (pagesize <= 0 || self->slab_size % pagesize != 0) {
+	DBG(1, "slab size %zu is not a multiple of the page size; not mapping the disk cache",
+	    self->slab_size);
+	return;
+    }
+
+    filename = g_strdup_printf("%s/amanda-split-buffer-XXXXXX",
+			       self->disk_cache_dirname);
+    fd = g_mkstemp(filename);
+    if (fd < 0) {
+	/* the disk_cache_thread will try again, and report the error */
+	g_free(filename);
+	return;
+    }
+
+    /* errors from unlink are not fatal */
+    if (unlink(filename) < 0) {
+	g_warning("While unlinking '%s': %s (ignored)", filename, strerror(errno));
+    }
+    g_free(filename);
+
+    /* reserve space for two parts */
+    err = posix_fallocate(fd, 0, (off_t)(2 * self->part_size));
+    if (err != 0) {
+	g_debug("Not mapping the disk cache in '%s': %s",
+		self->disk_cache_dirname, strerror(err));
+	close(fd);
+	return;
+    }
+
+    self->disk_cache_write_fd = fd;
+    self->disk_cache_mmap = TRUE;
+    DBG(1, "mapping slabs directly onto the disk cache file");
+}
+
+/* Map SLAB onto the disk cache file at the place reserved for SERIAL,
+ * replacing any previous mapping.  Called without the slab_mutex held, on a
+ * slab that only the caller can see.
+ *
+ * @param self: the xfer element
+ * @param slab: slab to map
+ * @param serial: serial number the slab will hold
+ * @param prot: protection for the mapping (PROT_READ and/or PROT_WRITE)
+ * @returns: FALSE on error, after sending an XMSG_ERROR
+ */
+static gboolean
+map_slab(
+    XferDestTaperSplitter *self,
+    Slab *slab,
+    guint64 serial,
+    int prot)
+{
+    off_t offset;
+
+    offset = (off_t)((serial / self->slabs_per_part) % 2) * self->part_size
+	   + (off_t)(serial % self->slabs_per_part) * self->slab_size;
+
+    if (slab->map_length)
+	munmap(slab->base, slab->map_length);
+    slab->map_length = 0;
+
+    slab->base = mmap(NULL, self->slab_size, prot, MAP_SHARED,
+		      self->disk_cache_write_fd, offset);
+    if (slab->base == MAP_FAILED) {
+	slab->base = NULL;
+	send_xmsg_error_and_cancel(self,
+	    _("Error mapping disk cache file in '%s': %s"), self->disk_cache_dirname,
+	    strerror(errno));
+	return FALSE;
+    }
+    slab->map_length = self->slab_size;
+
+    return TRUE;
+}
+
+/* Called with the slab_mutex held, this waits until the disk cache space for
+ * SERIAL no longer holds a part that may be retried.
+ *
+ * @returns: FALSE if the transfer was cancelled while waiting
+ */
+static gboolean
+wait_for_cache_space(
+    XferDestTaperSplitter *self,
+    guint64 serial)
+{
+    XferElement *elt = XFER_ELEMENT(self);
+
+    while (!elt->cancelled
+	   && serial >= self->cache_first_serial + 2 * self->slabs_per_part) {
+	DBG(9, "waiting for the disk cache to finish with a part");
+	g_cond_wait(self->slab_free_cond, self->slab_mutex);
+    }
+    DBG(9, "done waiting");
+
+    return !elt->cancelled;
+}
+#endif
+
 /*
  * Device Thread
  *
@@ -782,6 +943,19 @@ slab_source_get_from_disk(
 
     g_assert(state->next_serial == serial);
 
+#ifdef USE_MMAP_DISK_CACHE
+    /* a mapped cache is still in the page cache, so just map the slab again */
+    if (self->disk_cache_mmap) {
+	if (!map_slab(self, state->tmp_slab, serial, PROT_READ))
+	    goto fatal_error;
+
+	state->tmp_slab->serial = state->next_serial++;
+
+	g_mutex_lock(self->slab_mutex);
+	return state->tmp_slab;
+    }
+#endif
+
     while (bytes_needed > 0) {
 	gsize read_size, bytes_read;
 
@@ -1063,7 +1237,7 @@ release_part_cache(
 	g_mutex_unlock(self->slab_mutex);
     }
 
-    /* the disk_cache_thread takes care of freeing its cache */
+    /* the disk cache is simply overwritten by the next part */
     else if (self->disk_cache_dirname)
 	return;
 
@@ -1104,7 +1278,7 @@ device_thread(
 
     DBG(1, "(this is the device thread)");
 
-    if (self->disk_cache_dirname) {
+    if (self->disk_cache_dirname && !self->disk_cache_mmap) {
         GError *error = NULL;
 	self->disk_cache_thread = g_thread_create(disk_cache_thread, (gpointer)self, TRUE, &error);
         if (!self->disk_cache_thread) {
@@ -1188,7 +1362,7 @@ add_reader_slab_to_train(
     /* steal reader_slab's reference for newest_slab */
 
     /* if any of the other pointers are waiting for this slab, update them */
-    if (self->disk_cache_dirname && !self->disk_cacher_slab) {
+    if (self->disk_cache_dirname && !self->disk_cache_mmap && !self->disk_cacher_slab) {
 	self->disk_cacher_slab = slab;
 	slab->refcount++;
     }
@@ -1208,6 +1382,222 @@ add_reader_slab_to_train(
     g_cond_broadcast(self->slab_cond);
 }
 
+/*
+ * Reader
+ *
+ * The reader runs in push_buffer, in the upstream element's thread.  It copies
+ * data into reader_slab, adding each full slab to the train.  When the train
+ * is full and a spill directory was given, it appends data to the spill file
+ * instead of waiting, and moves it into the train when slabs come free.
+ */
+
+/* Called without the slab_mutex held, this adds a full reader_slab (if any)
+ * to the slab train and gets a fresh one.  If BLOCK is false and no slab is
+ * free, this returns 0 instead of waiting, leaving reader_slab NULL.
+ *
+ * @param self: the xfer element
+ * @param block: wait for a free slab
+ * @returns: 1 on success, 0 if no slab is free, or -1 if the xfer is
+ *           cancelled
+ */
+static int
+get_reader_slab(
+    XferDestTaperSplitter *self,
+    gboolean block)
+{
+    g_mutex_lock(self->slab_mutex);
+    if (self->reader_slab)
+	add_reader_slab_to_train(self);
+
+    if (!block) {
+	gboolean full = train_full(self);
+#ifdef USE_MMAP_DISK_CACHE
+	full = full || (self->disk_cache_mmap &&
+	    self->next_serial >= self->cache_first_serial + 2 * self->slabs_per_part);
+#endif
+	if (full) {
+	    g_mutex_unlock(self->slab_mutex);
+	    return 0;
+	}
+    }
+
+    self->reader_slab = alloc_slab(self, FALSE);
+    if (!self->reader_slab) {
+	/* we've been cancelled while waiting for a slab */
+	g_mutex_unlock(self->slab_mutex);
+	return -1;
+    }
+    self->reader_slab->serial = self->next_serial++;
+
+#ifdef USE_MMAP_DISK_CACHE
+    if (self->disk_cache_mmap) {
+	if (!wait_for_cache_space(self, self->reader_slab->serial)) {
+	    g_mutex_unlock(self->slab_mutex);
+	    return -1;
+	}
+	g_mutex_unlock(self->slab_mutex);
+
+	/* reader_slab is not in the train yet, so this needs no lock */
+	if (!map_slab(self, self->reader_slab, self->reader_slab->serial,
+		      PROT_READ | PROT_WRITE))
+	    return -1;
+	return 1;
+    }
+#endif
+
+    g_mutex_unlock(self->slab_mutex);
+    return 1;
+}
+
+/* Copy SIZE bytes at BUF into the slab train.  If BLOCK is false, this stops
+ * when no slab is free.
+ *
+ * @returns: the number of bytes copied, or -1 if the xfer is cancelled
+ */
+static gssize
+copy_to_reader_slab(
+    XferDestTaperSplitter *self,
+    gpointer buf,
+    gsize size,
+    gboolean block)
+{
+    gpointer p = buf;
+
+    while (1) {
+	gsize copy_size;
+
+	/* get a fresh slab, if needed */
+	if (G_UNLIKELY(!self->reader_slab) || self->reader_slab->size == self->slab_size) {
+	    int rv = get_reader_slab(self, block);
+	    if (rv < 0)
+		return -1;
+	    if (rv == 0)
+		break;
+	}
+
+	if (size == 0)
+	    break;
+
+	copy_size = MIN(self->slab_size - self->reader_slab->size, size);
+	memcpy(self->reader_slab->base+self->reader_slab->size, p, copy_size);
+
+	self->reader_slab->size += copy_size;
+	p += copy_size;
+	size -= copy_size;
+    }
+
+    return p - buf;
+}
+
+/* Append SIZE bytes at BUF to the spill file, opening it first if necessary.
+ * On error, this stops spilling, so the caller must wait for slabs instead.
+ *
+ * @returns: the number of bytes spilled
+ */
+static gsize
+spill_data(
+    XferDestTaperSplitter *self,
+    gpointer buf,
+    gsize size)
+{
+    gsize written;
+
+    if (self->spill_write_fd < 0) {
+	char *filename = g_strdup_printf("%s/amanda-spill-buffer-XXXXXX",
+					 self->spill_dirname);
+
+	self->spill_write_fd = g_mkstemp(filename);
+	if (self->spill_write_fd < 0) {
+	    g_warning("Error creating spill file in '%s': %s; not spilling",
+		      self->spill_dirname, strerror(errno));
+	    g_free(filename);
+	    self->spill_failed = TRUE;
+	    return 0;
+	}
+
+	/* open a separate copy of the file for reading */
+	self->spill_read_fd = open(filename, O_RDONLY);
+	if (self->spill_read_fd < 0) {
+	    g_warning("Error opening spill file in '%s': %s; not spilling",
+		      self->spill_dirname, strerror(errno));
+	    g_free(filename);
+	    self->spill_failed = TRUE;
+	    return 0;
+	}
+
+	/* errors from unlink are not fatal */
+	if (unlink(filename) < 0) {
+	    g_warning("While unlinking '%s': %s (ignored)", filename, strerror(errno));
+	}
+	g_free(filename);
+    }
+
+    if (self->spill_bytes == 0)
+	DBG(2, "slab train is full; spilling to '%s'", self->spill_dirname);
+
+    written = full_write(self->spill_write_fd, buf, size);
+    if (written < size) {
+	/* probably ENOSPC; what did get written is still good */
+	g_warning("Error writing spill file in '%s': %s; not spilling",
+		  self->spill_dirname, strerror(errno));
+	self->spill_failed = TRUE;
+    }
+
+    self->spill_bytes += written;
+    self->spill_total += written;
+    return written;
+}
+
+/* Move data from the spill file into the slab train.  If BLOCK is false, this
+ * stops when no slab is free.  Once the spill file is empty, it is truncated
+ * so that it does not grow without bound.
+ *
+ * @returns: 1 on success, or -1 if the xfer is cancelled or the spill file
+ *           cannot be read
+ */
+static int
+drain_spill(
+    XferDestTaperSplitter *self,
+    gboolean block)
+{
+    if (self->spill_bytes == 0)
+	return 1;
+
+    while (self->spill_bytes > 0) {
+	gsize read_size, bytes_read;
+
+	if (G_UNLIKELY(!self->reader_slab) || self->reader_slab->size == self->slab_size) {
+	    int rv = get_reader_slab(self, block);
+	    if (rv <= 0)
+		return rv;
+	}
+
+	read_size = MIN(self->spill_bytes, self->slab_size - self->reader_slab->size);
+	bytes_read = full_read(self->spill_read_fd,
+			       self->reader_slab->base + self->reader_slab->size,
+			       read_size);
+	if (bytes_read < read_size) {
+	    send_xmsg_error_and_cancel(self, _("Error reading spill file in '%s': %s"),
+		self->spill_dirname, errno? strerror(errno) : _("Unexpected EOF"));
+	    return -1;
+	}
+
+	self->reader_slab->size += bytes_read;
+	self->spill_bytes -= bytes_read;
+    }
+
+    DBG(2, "spill file drained");
+    if (ftruncate(self->spill_write_fd, 0) < 0
+	    || lseek(self->spill_write_fd, 0, SEEK_SET) < 0
+	    || lseek(self->spill_read_fd, 0, SEEK_SET) < 0) {
+	send_xmsg_error_and_cancel(self, _("Error truncating spill file in '%s': %s"),
+	    self->spill_dirname, strerror(errno));
+	return -1;
+    }
+
+    return 1;
+}
+
 static void
 push_buffer_impl(
     XferElement *elt,
@@ -1215,6 +1605,7 @@ push_buffer_impl(
     size_t size)
 {
     XferDestTaperSplitter *self = (XferDestTaperSplitter *)elt;
+    size_t buf_size = size;
     gpointer p;
 
     DBG(3, "push_buffer(%p, %ju)", buf, (uintmax_t)size);
@@ -1226,6 +1617,13 @@ push_buffer_impl(
 
     /* handle EOF */
     if (G_UNLIKELY(buf == NULL)) {
+	/* everything in the spill file goes ahead of the last slab */
+	if (drain_spill(self, TRUE) < 0)
+	    goto cancelled;
+	if (self->spill_total)
+	    g_debug("spilled %ju bytes to '%s' while the device was busy",
+		    (uintmax_t)self->spill_total, self->spill_dirname);
+
 	/* send off the last, probably partial slab */
 	g_mutex_lock(self->slab_mutex);
 
@@ -1235,12 +1633,7 @@ push_buffer_impl(
             if (!self->reader_slab) {
                 /* we've been cancelled while waiting for a slab */
                 g_mutex_unlock(self->slab_mutex);
-
-                /* wait for the xfer to cancel, so we don't get another buffer
-                 * pushed to us (and do so *without* the mutex held) */
-                wait_until_xfer_cancelled(XFER_ELEMENT(self)->xfer);
-
-                goto free_and_finish;
+		goto cancelled;
             }
 	    self->reader_slab->serial = self->next_serial++;
 	}
@@ -1252,49 +1645,66 @@ push_buffer_impl(
     }
 
     p = buf;
-    while (1) {
-	gsize copy_size;
+    if (self->spill_dirname) {
+	gssize copied;
+
+	/* data spilled earlier goes first; once spilling has failed, that
+	 * means waiting for the device */
+	if (drain_spill(self, self->spill_failed) < 0)
+	    goto cancelled;
+
+	if (!self->spill_failed) {
+	    if (self->spill_bytes == 0) {
+		copied = copy_to_reader_slab(self, p, size, FALSE);
+		if (copied < 0)
+		    goto cancelled;
+		p += copied;
+		size -= copied;
+	    }
 
-	/* get a fresh slab, if needed */
-	if (G_UNLIKELY(!self->reader_slab) || self->reader_slab->size == self->slab_size) {
-	    g_mutex_lock(self->slab_mutex);
-	    if (self->reader_slab)
-		add_reader_slab_to_train(self);
-	    self->reader_slab = alloc_slab(self, FALSE);
-            if (!self->reader_slab) {
-                /* we've been cancelled while waiting for a slab */
-                g_mutex_unlock(self->slab_mutex);
+	    if (size > 0) {
+		gsize spilled = spill_data(self, p, size);
+		p += spilled;
+		size -= spilled;
+	    }
 
-                /* wait for the xfer to cancel, so we don't get another buffer
-                 * pushed to us (and do so *without* the mutex held) */
-                wait_until_xfer_cancelled(XFER_ELEMENT(self)->xfer);
+	    if (size == 0)
+		goto free_and_finish;
 
-                goto free_and_finish;
-            }
-	    self->reader_slab->serial = self->next_serial++;
-	    g_mutex_unlock(self->slab_mutex);
+	    /* the spill file failed partway; wait for the device */
+	    if (drain_spill(self, TRUE) < 0)
+		goto cancelled;
 	}
+    }
 
-	if (size == 0)
-	    break;
+    if (copy_to_reader_slab(self, p, size, TRUE) < 0)
+	goto cancelled;
+    goto free_and_finish;
 
-	copy_size = MIN(self->slab_size - self->reader_slab->size, size);
-	memcpy(self->reader_slab->base+self->reader_slab->size, p, copy_size);
-
-	self->reader_slab->size += copy_size;
-	p += copy_size;
-	size -= copy_size;
-    }
+cancelled:
+    /* wait for the xfer to cancel, so we don't get another buffer
+     * pushed to us (and do so *without* the mutex held) */
+    wait_until_xfer_cancelled(XFER_ELEMENT(self)->xfer);
 
 free_and_finish:
-    if (buf)
-        g_free(buf);
+    /* hand the buffer back for the glue to fill again */
+    xfer_release_buffer(elt->xfer, buf, buf_size);
 }
 
 /*
  * Element mechanics
  */
 
+static void
+setup_impl(
+    XferElement *elt)
+{
+    XferDestTaperSplitter *self = (XferDestTaperSplitter *)elt;
+
+    /* have upstream glue deliver data in device-sized buffers */
+    xfer_set_buffer_size(elt->xfer, self->block_size, 0);
+}
+
 static gboolean
 start_impl(
     XferElement *elt)
@@ -1302,6 +1712,11 @@ start_impl(
     XferDestTaperSplitter *self = (XferDestTaperSplitter *)elt;
     GError *error = NULL;
 
+#ifdef USE_MMAP_DISK_CACHE
+    if (self->disk_cache_dirname)
+	open_mmap_disk_cache(self);
+#endif
+
     self->device_thread = g_thread_create(device_thread, (gpointer)self, FALSE, &error);
     if (!self->device_thread) {
         g_critical(_("Error creating new thread: %s (%s)"),
@@ -1399,6 +1814,15 @@ start_part_impl(
 	    /* set part_stop_serial to an effectively infinite value */
 	    self->part_stop_serial = G_MAXUINT64;
 	}
+
+	/* the previous part is safely on the volume, so its space in a mapped
+	 * disk cache can be reused */
+	if (self->disk_cache_mmap) {
+	    g_mutex_lock(self->slab_mutex);
+	    self->cache_first_serial = self->part_first_serial;
+	    g_cond_broadcast(self->slab_free_cond);
+	    g_mutex_unlock(self->slab_mutex);
+	}
     }
 
     DBG(1, "unpausing");
@@ -1473,6 +1897,8 @@ instance_init(
     self->part_stop_serial = 0;
     self->disk_cache_read_fd = -1;
     self->disk_cache_write_fd = -1;
+    self->spill_read_fd = -1;
+    self->spill_write_fd = -1;
 }
 
 static void
@@ -1485,6 +1911,8 @@ finalize_impl(
 
     if (self->disk_cache_dirname)
 	g_free(self->disk_cache_dirname);
+    if (self->spill_dirname)
+	g_free(self->spill_dirname);
 
     g_mutex_free(self->state_mutex);
     g_cond_free(self->state_cond);
@@ -1522,6 +1950,10 @@ finalize_impl(
 	close(self->disk_cache_read_fd); /* ignore error */
     if (self->disk_cache_write_fd != -1)
 	close(self->disk_cache_write_fd); /* ignore error */
+    if (self->spill_read_fd != -1)
+	close(self->spill_read_fd); /* ignore error */
+    if (self->spill_write_fd != -1)
+	close(self->spill_write_fd); /* ignore error */
 
     /* chain up */
     G_OBJECT_CLASS(parent_class)->finalize(obj_self);
@@ -1539,6 +1971,7 @@ class_init(
 	{ XFER_MECH_NONE, XFER_MECH_NONE, 0, 0},
     };
 
+    klass->setup = setup_impl;
     klass->start = start_impl;
     klass->cancel = cancel_impl;
     klass->push_buffer = push_buffer_impl;
@@ -1588,7 +2021,8 @@ xfer_dest_taper_splitter(
     size_t max_memory,
     guint64 part_size,
     gboolean use_mem_cache,
-    const char *disk_cache_dirname)
+    const char *disk_cache_dirname,
+    const char *spill_dirname)
 {
     XferDestTaperSplitter *self = (XferDestTaperSplitter *)g_object_new(XFER_DEST_TAPER_SPLITTER_TYPE, NULL);
 
@@ -1614,6 +2048,9 @@ xfer_dest_taper_splitter(
 	self->part_slices->length = 0; /* will be filled in in start_part */
     }
 
+    if (spill_dirname && *spill_dirname)
+	self->spill_dirname = g_strdup(spill_dirname);
+
     /* calculate the device-dependent parameters */
     self->block_size = first_device->block_size;
 
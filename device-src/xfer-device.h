@@ -131,6 +131,8 @@ guint64 xfer_dest_taper_get_part_bytes_written(
  * @param use_mem_cache: if true, use the memory cache
  * @param disk_cache_dirname: if not NULL, this is the directory in which the disk
  *		      cache should be created
+ * @param spill_dirname: if not NULL, data that arrives while all buffers are
+ *		      full is spilled to a file in this directory
  * @return: new element
  */
 XferElement *
@@ -139,7 +141,8 @@ xfer_dest_taper_splitter(
     size_t max_memory,
     guint64 part_size,
     gboolean use_mem_cache,
-    const char *disk_cache_dirname);
+    const char *disk_cache_dirname,
+    const char *spill_dirname);
 
 /*
  * XferSourceTaper
@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 173;
+use Test::More tests => 175;
 use strict;
 
 use lib "@amperldir@";
@@ -183,6 +183,8 @@ $testconf->add_holdingdisk('hd1', [
     'directory' => '"/mnt/hd1"',
     'use' => '100M',
     'chunksize' => '1024k',
+    'write-buffer-size' => '4m',
+    'direct-io' => 'yes',
 ]);
 $testconf->add_holdingdisk('hd2', [
     'comment' => '"empty"',
@@ -389,6 +391,10 @@ SKIP: { # holdingdisks
 	"holdingdisk disksize (use)");
     is(holdingdisk_getconf($hdisk, $HOLDING_CHUNKSIZE), 1024, 
 	"holdingdisk chunksize");
+    is(holdingdisk_getconf($hdisk, $HOLDING_WRITE_BUFFER_SIZE), 4096,
+	"holdingdisk write-buffer-size");
+    ok(holdingdisk_getconf($hdisk, $HOLDING_DIRECT_IO),
+	"holdingdisk direct-io");
 
     $hdisk = lookup_holdingdisk("hd2");
     ok($hdisk, "found hd2");
@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 363;
+use Test::More tests => 447;
 use File::Path qw( mkpath rmtree );
 use Sys::Hostname;
 use Carp;
@@ -460,6 +460,66 @@ ok(!($dev->start($ACCESS_WRITE, "TESTCONF29", undef)),
    "start a RAIT device in write mode fails, when created with 'undef'")
     or diag($dev->error_or_status());
 
+####
+## Test a RAIT device with two parity children
+
+my ($vtape3, $vtape4);
+($vtape1, $vtape2, $vtape3, $vtape4) = (mkvtape(1), mkvtape(2), mkvtape(3), mkvtape(4));
+$dev_name = "rait:file:{$vtape1,$vtape2,$vtape3,$vtape4}";
+
+$dev = Amanda::Device->new($dev_name);
+is($dev->status(), $DEVICE_STATUS_SUCCESS,
+   "$dev_name: create successful")
+    or diag($dev->error_or_status());
+
+ok($dev->property_set("rait_parity", 2),
+    "rait device accepts RAIT_PARITY 2")
+    or diag($dev->error_or_status());
+
+is($dev->property_get("block_size"), 32768*2,
+    "..and stripes data over the remaining two children");
+
+ok($dev->start($ACCESS_WRITE, "TESTCONF31", undef),
+   "start in write mode")
+    or diag($dev->error_or_status());
+
+write_file(0x2FACE, $dev->block_size()*10+17, 1);
+write_file(0xD0ED0E, $dev->block_size()*4, 2);
+
+ok($dev->finish(),
+   "finish device after write")
+    or diag($dev->error_or_status());
+
+# lose a data child and the P parity child, then both data children
+for my $missing ([ 0, 2 ], [ 0, 1 ]) {
+    my @kids = ("file:$vtape1", "file:$vtape2", "file:$vtape3", "file:$vtape4");
+    $kids[$_] = "MISSING" for @$missing;
+    $dev_name = "rait:{" . join(",", @kids) . "}";
+
+    $dev = Amanda::Device->new($dev_name);
+    ok($dev->property_set("rait_parity", 2),
+	"$dev_name: set RAIT_PARITY")
+	or diag($dev->error_or_status());
+
+    ok($dev->start($ACCESS_READ, undef, undef),
+       "start in read mode with two children MISSING")
+	or diag($dev->error_or_status());
+
+    verify_file(0x2FACE, $dev->block_size()*10+17, 1);
+    verify_file(0xD0ED0E, $dev->block_size()*4, 2);
+
+    ok($dev->finish(),
+       "finish device read with two children MISSING")
+	or diag($dev->error_or_status());
+}
+
+$dev = Amanda::Device->new("rait:{MISSING,MISSING,file:$vtape3,file:$vtape4}");
+ok(!($dev->start($ACCESS_READ, undef, undef)),
+   "start fails with two children MISSING and only one parity child")
+    or diag($dev->error_or_status());
+
+undef $dev;
+
 # Make two devices with different labels, should get a
 # message accordingly.
 ($vtape1, $vtape2) = (mkvtape(1), mkvtape(2));
@@ -573,10 +633,10 @@ my $base_name;
 
 SKIP: {
     skip "define \$INSTALLCHECK_S3_{SECRET,ACCESS}_KEY to run S3 tests",
-            67 +
-            1 * $verify_file_count +
-            4 * $write_file_count +
-            10 * $s3_make_device_count
+            77 +
+            3 * $verify_file_count +
+            6 * $write_file_count +
+            12 * $s3_make_device_count
 	unless $run_s3_tests;
 
     $dev_name = "s3:";
@@ -747,6 +807,58 @@ SKIP: {
        "erase device right after creation")
        or diag($dev->error_or_status());
 
+    # write and read back with several simultaneous uploads
+    $dev = s3_make_device($dev_name, "s3");
+    ok($dev->property_set('S3_MAX_CONNECTIONS', 4),
+       "set S3_MAX_CONNECTIONS to 4")
+        or diag($dev->error_or_status());
+
+    ok($dev->start($ACCESS_WRITE, "TESTCONF13", undef),
+       "start in write mode with parallel uploads")
+        or diag($dev->error_or_status());
+
+    write_file(0x2FACE, $dev->block_size()*10+17, 1);
+
+    ok($dev->finish(),
+       "finish device after parallel write")
+        or diag($dev->error_or_status());
+
+    ok($dev->start($ACCESS_READ, undef, undef),
+       "start in read mode")
+        or diag($dev->error_or_status());
+
+    verify_file(0x2FACE, $dev->block_size()*10+17, 1);
+
+    ok($dev->finish(),
+       "finish device after read")
+        or diag($dev->error_or_status());
+
+    # write and read back a file as a single multipart object
+    $dev = s3_make_device($dev_name, "s3");
+    ok($dev->property_set('S3_MULTIPART_PART_SIZE', 5*1024*1024),
+       "set S3_MULTIPART_PART_SIZE to 5MB")
+        or diag($dev->error_or_status());
+
+    ok($dev->start($ACCESS_WRITE, "TESTCONF13", undef),
+       "start in write mode with multipart uploads")
+        or diag($dev->error_or_status());
+
+    write_file(0xD0ED0E, $dev->block_size()*3+17, 1);
+
+    ok($dev->finish(),
+       "finish device after multipart write")
+        or diag($dev->error_or_status());
+
+    ok($dev->start($ACCESS_READ, undef, undef),
+       "start in read mode")
+        or diag($dev->error_or_status());
+
+    verify_file(0xD0ED0E, $dev->block_size()*3+17, 1);
+
+    ok($dev->finish(),
+       "finish device after multipart read")
+        or diag($dev->error_or_status());
+
     # try with empty user token
     $dev_name = lc("s3:$base_name-s3");
     $dev = s3_make_device($dev_name, "s3");
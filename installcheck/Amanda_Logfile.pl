@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 35;
+use Test::More tests => 37;
 use File::Path;
 use strict;
 
@@ -313,6 +313,20 @@ is_deeply(\@results_arr,
 	  [ '20071109010002', 'thatbox', '/u_win',          3, 'TESTCONF004', 2, 'OK',        4, 4 ],
 	], "results are correct");
 
+# the same results should come back from the catalog
+Amanda::Logfile::find_catalog_add_logfile("$logdir/log.20071109010002.0");
+ok(-f "$logdir/catalog", "find_catalog_add_logfile writes the catalog");
+
+@results = ();
+for my $label ("TESTCONF002", "TESTCONF003", "TESTCONF004") {
+    push @results, Amanda::Logfile::search_logfile($label, "20071109010002",
+					   "$logdir/log.20071109010002.0", 1);
+}
+@results = sort { $a->{'label'} cmp $b->{'label'} ||
+		  $a->{'filenum'} <=> $b->{'filenum'} } @results;
+is_deeply([ map { res2arr($_) } @results ], \@results_arr,
+	"search_logfile returns the same results from the catalog");
+
 my @filtered;
 my @filtered_arr;
 
@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 35;
+use Test::More tests => 38;
 use File::Path;
 use Data::Dumper;
 use strict;
@@ -138,3 +138,31 @@ ok(!$taperscan->is_reusable_volume(label => "TEST-2", new_label_ok => 0), " TEST
 ok(!$taperscan->is_reusable_volume(label => "TEST-3", new_label_ok => 0), " TEST-3 not reusable");
 ok(!$taperscan->is_reusable_volume(label => "TEST-4", new_label_ok => 0), " TEST-4 not reusable");
 
+# two scans sharing pending_labels do not invent the same label
+my $pending = {};
+my $scan1 = Amanda::Taper::Scan->new(
+    algorithm => "traditional",
+    changer => {}, # (not used)
+    tapelist_filename => $tapelist,
+    tapecycle => 1,
+    labelstr => "TEST-[0-9]",
+    label_new_tapes => "TEST-%",
+    pending_labels => $pending,
+    );
+my $scan2 = Amanda::Taper::Scan->new(
+    algorithm => "traditional",
+    changer => {}, # (not used)
+    tapelist_filename => $tapelist,
+    tapecycle => 1,
+    labelstr => "TEST-[0-9]",
+    label_new_tapes => "TEST-%",
+    pending_labels => $pending,
+    );
+$scan1->read_tapelist();
+$scan2->read_tapelist();
+is($scan1->make_new_tape_label(), "TEST-5",
+    "make_new_tape_label skips labels in the tapelist");
+is($scan2->make_new_tape_label(), "TEST-6",
+    "..and labels already handed out by another scan");
+is_deeply([ sort keys %$pending ], [ "TEST-5", "TEST-6" ],
+    "..and records them in pending_labels");
@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 17;
+use Test::More tests => 21;
 use File::Path;
 use Data::Dumper;
 use strict;
@@ -113,6 +113,7 @@ my $RANDOM_SEED = 0xFACADE;
 # extra params:
 #   cancel_after_partnum - after this partnum is completed, cancel the xfer
 #   do_not_retry - do not retry a failed part - cancel the xfer instead
+#   part_delay - wait this many milliseconds before starting each new part
 sub test_taper_dest {
     my ($src, $dest_sub, $expected_messages, $msg_prefix, %params) = @_;
     my $xfer;
@@ -184,7 +185,13 @@ sub test_taper_dest {
 	    die $msg->{'elt'} . " failed: " . $msg->{'message'};
 	} elsif ($msg->{'type'} == $XMSG_PART_DONE) {
 	    push @messages, "PART-" . $msg->{'partnum'} . '-' . ($msg->{'successful'}? "OK" : "FAILED");
-	    $start_new_part->($msg->{'successful'}, $msg->{'eof'}, $msg->{'partnum'});
+	    if ($params{'part_delay'} and !$msg->{'eof'}) {
+		# leave the device idle for a while, as if it were busy
+		Amanda::MainLoop::call_after($params{'part_delay'}, $start_new_part,
+		    $msg->{'successful'}, $msg->{'eof'}, $msg->{'partnum'});
+	    } else {
+		$start_new_part->($msg->{'successful'}, $msg->{'eof'}, $msg->{'partnum'});
+	    }
 	} elsif ($msg->{'type'} == $XMSG_DONE) {
 	    push @messages, "DONE";
 	} elsif ($msg->{'type'} == $XMSG_CANCEL) {
@@ -208,6 +215,19 @@ sub test_taper_dest {
     or diag(Dumper([@messages]));
 }
 
+# return what was added to the debug log after it was $size bytes long
+sub debug_log_since {
+    my ($size) = @_;
+    my $fh;
+
+    open($fh, "<", Amanda::Debug::dbfn()) or die("Could not open debug log: $!");
+    seek($fh, $size, 0);
+    my $log = do { local $/; <$fh> };
+    close($fh);
+
+    return $log;
+}
+
 sub test_taper_source {
     my ($src, $dest, $files, $expected_messages) = @_;
     my $device;
@@ -331,7 +351,7 @@ test_taper_dest(
     sub {
         my ($first_dev) = @_;
         Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024,
-                                                 1024*1024, 1, undef),
+                                                 1024*1024, 1, undef, undef),
     },
     [ "PART-1-OK", "PART-2-OK", "PART-3-FAILED",
       "PART-3-OK", "PART-4-OK", "PART-5-OK",
@@ -360,7 +380,7 @@ test_taper_dest(
     sub {
         my ($first_dev) = @_;
         Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024,
-                                          1024*1024, 0, $disk_cache_dir),
+                                          1024*1024, 0, $disk_cache_dir, undef),
     },
     [ "PART-1-OK", "PART-2-OK", "PART-3-FAILED",
       "PART-3-OK", "PART-4-OK", "PART-5-OK",
@@ -384,12 +404,51 @@ test_taper_source(
       'DONE'
     ]);
 
+# the device sits idle for half a second between parts, while the source
+# keeps going; that is far more than the 128k of slabs can hold, so the
+# splitter has to spill the rest until the next part starts
+my $debug_log_size = -s Amanda::Debug::dbfn();
+test_taper_dest(
+    Amanda::Xfer::Source::Random->new(1024*1024*4.1, $RANDOM_SEED),
+    sub {
+        my ($first_dev) = @_;
+        Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024,
+                                 1024*1024, 0, $disk_cache_dir, $disk_cache_dir),
+    },
+    [ "PART-1-OK", "PART-2-OK", "PART-3-FAILED",
+      "PART-3-OK", "PART-4-OK", "PART-5-OK",
+      "DONE" ],
+    "disk cache with spill file",
+    part_delay => 500);
+like(debug_log_since($debug_log_size),
+    qr/spilled [1-9]\d* bytes to '\Q$disk_cache_dir\E' while the device was busy/,
+    "disk cache with spill file: data was spilled while the device was idle");
+is_deeply([ glob("$disk_cache_dir/amanda-spill-buffer-*") ], [],
+    "disk cache with spill file: the spill file was removed");
+test_taper_source(
+    Amanda::Xfer::Source::Taper->new(),
+    Amanda::Xfer::Dest::Null->new($RANDOM_SEED),
+    [ 1 => [ 1, 2 ], 2 => [ 1, 2, 3 ], ],
+    [
+      'PART',
+      'KB-1024',
+      'PART',
+      'KB-1024',
+      'PART',
+      'KB-1024',
+      'PART',
+      'KB-1024',
+      'PART',
+      'KB-102',
+      'DONE'
+    ]);
+
 test_taper_dest(
     Amanda::Xfer::Source::Random->new(1024*1024*2, $RANDOM_SEED),
     sub {
         my ($first_dev) = @_;
         Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024,
-                                                1024*1024, 0, undef),
+                                                1024*1024, 0, undef, undef),
     },
     [ "PART-1-OK", "PART-2-OK", "PART-3-OK",
       "DONE" ],
@@ -412,7 +471,7 @@ test_taper_dest(
     Amanda::Xfer::Source::Random->new(1024*1024*2, $RANDOM_SEED),
     sub {
         my ($first_dev) = @_;
-        Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024, 0, 0, undef),
+        Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024, 0, 0, undef, undef),
     },
     [ "PART-1-OK", "DONE" ],
     "no splitting (fits on volume)");
@@ -430,7 +489,7 @@ test_taper_dest(
     Amanda::Xfer::Source::Random->new(1024*1024*4.1, $RANDOM_SEED),
     sub {
         my ($first_dev) = @_;
-        Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024, 0, 0, undef),
+        Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024, 0, 0, undef, undef),
     },
     [ "PART-1-FAILED", "NOT-RETRYING", "CANCELLED", "DONE" ],
     "no splitting (doesn't fit on volume -> fails)",
@@ -441,7 +500,7 @@ test_taper_dest(
     sub {
         my ($first_dev) = @_;
         Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024,
-                                        1024*1024, 0, $disk_cache_dir),
+                                        1024*1024, 0, $disk_cache_dir, undef),
     },
     [ "PART-1-OK", "PART-2-OK", "PART-3-FAILED",
       "PART-3-OK", "PART-4-OK", "CANCEL",
@@ -456,7 +515,7 @@ test_taper_dest(
     sub {
         my ($first_dev) = @_;
         Amanda::Xfer::Dest::Taper::Splitter->new($first_dev, 128*1024,
-                                        1024*1024, 0, undef),
+                                        1024*1024, 0, undef, undef),
     },
     [ "PART-1-OK", "PART-2-OK", "PART-3-FAILED",
       "PART-3-OK", "PART-4-OK", "PART-5-FAILED",
@@ -541,7 +600,7 @@ sub test_taper_dest_cache_inform {
     $device->property_set("MAX_VOLUME_USAGE", 1024*1024*2.5);
 
     my $dest = Amanda::Xfer::Dest::Taper::Splitter->new($device, 128*1024,
-                                                1024*1024, 0, undef);
+                                                1024*1024, 0, undef, undef);
     $xfer = Amanda::Xfer->new([
 	Amanda::Xfer::Source::Fd->new(fileno($fh)),
 	$dest,
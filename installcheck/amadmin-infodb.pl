@@ -0,0 +1,141 @@
+# Copyright (c) 2009 Zmanda, Inc.  All Rights Reserved.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License version 2 as published
+# by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+# or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+# for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+#
+# Contact information: Zmanda Inc, 465 S Mathilda Ave, Suite 300
+# Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
+
+use Test::More tests => 16;
+use strict;
+use warnings;
+
+use lib "@amperldir@";
+use Installcheck;
+use Installcheck::Config;
+use Installcheck::Run qw(run run_get);
+use Amanda::Paths;
+use Amanda::Debug;
+use Amanda::Constants;
+
+Amanda::Debug::dbopen("installcheck");
+Installcheck::log_test_output();
+
+my $dbfile = "$CONFIG_DIR/TESTCONF/curinfo.db";
+my $importfile = "$Installcheck::TMP/infodb-import";
+my $testconf;
+
+# write TESTCONF with the given infofile; this removes the old config,
+# including its infofile
+sub write_config {
+    my ($infofile) = @_;
+
+    $testconf = Installcheck::Run::setup();
+    if (defined $infofile) {
+	$testconf->remove_param('infofile');
+	$testconf->add_param('infofile', "\"$infofile\"");
+    }
+    for my $disk (qw(/share-a /share-b /share-c /share-d)) {
+	$testconf->add_dle("localhost $disk installcheck-test");
+    }
+    $testconf->write();
+}
+
+# feed records (without the header line) to "amadmin import"; returns
+# its stderr
+sub import_records {
+    my ($records) = @_;
+
+    open(my $fh, ">", $importfile) or die("Could not write '$importfile'");
+    print $fh "CURINFO Version $Amanda::Constants::VERSION CONF DailySet1\n";
+    print $fh $records;
+    close($fh);
+
+    my $err = `$sbindir/amadmin TESTCONF import <"$importfile" 2>&1 >/dev/null`;
+    unlink($importfile);
+    return $err;
+}
+
+# the records from "amadmin export", without the header and comments
+sub export_records {
+    my $out = run_get('amadmin', 'TESTCONF', 'export');
+    return join('', grep { !/^(#|CURINFO )/ } split(/^/, $out));
+}
+
+sub record {
+    my ($disk, $command, @levels) = @_;
+    my $rec = "host: localhost\ndisk: $disk\ncommand: $command\n"
+	    . "last_level: $levels[-1]\nconsecutive_runs: 1\n"
+	    . "full-rate: 100.000000 110.000000 120.000000\n"
+	    . "full-comp: 0.500000 0.600000 0.700000\n"
+	    . "incr-rate: 10.000000 11.000000 12.000000\n"
+	    . "incr-comp: 0.100000 0.200000 0.300000\n";
+    for my $l (@levels) {
+	$rec .= sprintf("stats: %d %d %d 30 %d %d TESTCONF-%02d\n",
+			$l, 1000 * ($l + 1), 500 * ($l + 1),
+			1250000000 + $l, $l + 1, $l);
+    }
+    for my $l (reverse @levels) {
+	$rec .= sprintf("history: %d %d %d %d\n",
+			$l, 1000 * ($l + 1), 500 * ($l + 1), 1250000000 + $l);
+    }
+    return $rec . "//\n";
+}
+
+my $records = record("/share-a", 0, 0, 1, 2)
+	    . record("/share-b", 1, 0, 1);
+
+# start from the text infofile, and convert it to a database
+write_config();
+is(import_records($records), '', "import into the text infofile");
+my $text_export = export_records();
+is($text_export, $records, "text infofile holds the imported records");
+
+write_config($dbfile);
+ok(! -e $dbfile, "database does not exist before the first write");
+is(import_records($text_export), '', "import into a new .db infofile");
+ok(-f $dbfile, "..creates the database as a regular file");
+is(export_records(), $records, "..and it holds the same records");
+
+# delete one record; its slot is reused for a new one
+my $dbsize = -s $dbfile;
+like(run_get('amadmin', 'TESTCONF', 'delete', 'localhost', '/share-a'),
+    qr{localhost:/share-a deleted from curinfo database},
+    "delete a record from the database");
+is(export_records(), record("/share-b", 1, 0, 1),
+    "..leaves the other record");
+is(import_records(record("/share-c", 0, 0)), '',
+    "import a record for another DLE");
+is(-s $dbfile, $dbsize, "..which reuses the deleted record's slot");
+
+# put_info with a command changes the record in place
+like(run_get('amadmin', 'TESTCONF', 'force', 'localhost', '/share-c'),
+    qr{localhost:/share-c is set to a forced level 0 at next run},
+    "force a DLE");
+is(export_records(), record("/share-b", 1, 0, 1) . record("/share-c", 1, 0),
+    "..updates its record");
+
+# a record holds at most 16 dump levels
+is(import_records(record("/share-d", 0, 0 .. 15)), '',
+    "a record with 16 levels can be written");
+like(import_records(record("/share-a", 0, 0 .. 16)),
+    qr{error writing record for localhost:/share-a},
+    "a record with 17 levels can not");
+
+# and back to the text infofile
+my $db_export = export_records();
+write_config();
+is(import_records($db_export), '', "import the database into a text infofile");
+is(export_records(), $db_export, "..which then holds the same records");
+
+Installcheck::Run::cleanup();
@@ -16,7 +16,7 @@
 # Contact information: Zmanda Inc, 465 S. Mathilda Ave., Suite 300
 # Sunnyvale, CA 94086, USA, or: http://www.zmanda.com
 
-use Test::More tests => 134;
+use Test::More tests => 145;
 
 use lib '@amperldir@';
 use Installcheck::Run;
@@ -71,6 +71,9 @@ sub run_taper {
 	$testconf->add_tapetype('TEST-TAPE', [
 	    'length' =>  "$length",
 	    ]);
+	if ($params{'parallel_write'}) {
+	    $testconf->add_param('taper_parallel_write', $params{'parallel_write'});
+	}
 	$testconf->write();
     }
 
@@ -250,13 +253,13 @@ sub write_to_port {
 $handle = "11-11111";
 $datestamp = "20070102030405";
 run_taper(4096, "single-part and multipart FILE-WRITE");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
 make_holding_file(1024*1024, "localhost", "/home");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /home 0 $datestamp 0");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /home 0 $datestamp 0");
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 1 1024 "\[sec [\d.]+ kb 1024 kps [\d.]+\]"$/,
@@ -270,7 +273,7 @@ like(taper_reply, qr/^DONE $handle INPUT-GOOD TAPE-GOOD "\[sec [\d.]+ kb 1024 kp
 
 $handle = '11-22222';
 make_holding_file(1024*1024, "localhost", "/usr");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /usr 0 $datestamp 524288");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /usr 0 $datestamp 524288");
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 2 512 "\[sec [\d.]+ kb 512 kps [\d.]+\]"$/,
 	"got PARTDONE for filenum 2") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 3 512 "\[sec [\d.]+ kb 512 kps [\d.]+\]"$/,
@@ -352,16 +355,16 @@ check_logs([
 $handle = "11-33333";
 $datestamp = "19780615010203";
 run_taper(4096, "multipart PORT-WRITE");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
-taper_cmd("PORT-WRITE $handle localhost /var 0 $datestamp 524288 NULL 393216 AMANDA");
+taper_cmd("PORT-WRITE 0 $handle localhost /var 0 $datestamp 524288 NULL 393216 AMANDA");
 like(taper_reply, qr/^PORT (\d+)$/,
 	"got PORT");
 ($port) = ($last_taper_reply =~ /^PORT (\d+)/);
 write_to_port($port, 63*32768, "localhost", "/var", 0);
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 1 384 "\[sec [\d.]+ kb 384 kps [\d.]+\]"$/,
@@ -403,13 +406,13 @@ check_logs([
 $handle = "11-44444";
 $datestamp = "19411207000000";
 run_taper(4096, "testing NO-NEW-TAPE from the driver on 1st request");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
 make_holding_file(1024*1024, "localhost", "/home");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /home 0 $datestamp 0");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /home 0 $datestamp 0");
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NO-NEW-TAPE sorry");
+taper_cmd("NO-NEW-TAPE $handle sorry");
 like(taper_reply, qr/^FAILED $handle INPUT-GOOD TAPE-ERROR "" "?sorry"?.*$/,
 	"got FAILED") or die;
 taper_cmd("QUIT");
@@ -427,23 +430,23 @@ check_logs([
 $handle = "11-55555";
 $datestamp = "19750711095836";
 run_taper(1024, "PORT-WRITE retry on EOT (mem cache)");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
-taper_cmd("PORT-WRITE $handle localhost /usr/local 0 $datestamp 786432 NULL 786432 AMANDA");
+taper_cmd("PORT-WRITE 0 $handle localhost /usr/local 0 $datestamp 786432 NULL 786432 AMANDA");
 like(taper_reply, qr/^PORT (\d+)$/,
 	"got PORT");
 ($port) = ($last_taper_reply =~ /^PORT (\d+)/);
 write_to_port($port, 1575936, "localhost", "/usr/local", 0);
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 1 768 "\[sec [\d.]+ kb 768 kps [\d.]+\]"$/,
 	"got PARTDONE for filenum 1") or die;
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF02$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF02 1 768 "\[sec [\d.]+ kb 768 kps [\d.]+\]"$/,
@@ -479,20 +482,20 @@ check_logs([
 $handle = "11-66666";
 $datestamp = "19470815000000";
 run_taper(1024, "FILE-WRITE retry on EOT");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
 make_holding_file(1575936, "localhost", "/usr");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /usr 0 $datestamp 786432");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /usr 0 $datestamp 786432");
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 1 768 "\[sec [\d.]+ kb 768 kps [\d.]+\]"$/,
 	"got PARTDONE for filenum 1") or die;
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF02$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF02 1 768 "\[sec [\d.]+ kb 768 kps [\d.]+\]"$/,
@@ -525,23 +528,23 @@ check_logs([
 $handle = "11-77777";
 $datestamp = "20090427212500";
 run_taper(1024, "PORT-WRITE retry on EOT (disk cache)");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
-taper_cmd("PORT-WRITE $handle localhost /usr/local 0 $datestamp 786432 \"$Installcheck::TMP\" 786432 AMANDA");
+taper_cmd("PORT-WRITE 0 $handle localhost /usr/local 0 $datestamp 786432 \"$Installcheck::TMP\" 786432 AMANDA");
 like(taper_reply, qr/^PORT (\d+)$/,
 	"got PORT");
 ($port) = ($last_taper_reply =~ /^PORT (\d+)/);
 write_to_port($port, 1575936, "localhost", "/usr/local", 0);
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 1 768 "\[sec [\d.]+ kb 768 kps [\d.]+\]"$/,
 	"got PARTDONE for filenum 1") or die;
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF02$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF02 1 768 "\[sec [\d.]+ kb 768 kps [\d.]+\]"$/,
@@ -577,16 +580,16 @@ check_logs([
 $handle = "11-88888";
 $datestamp = "20090424173000";
 run_taper(1024, "PORT-WRITE failure on EOT (no cache)");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
-taper_cmd("PORT-WRITE $handle localhost /var/log 0 $datestamp 0 NULL 0 AMANDA");
+taper_cmd("PORT-WRITE 0 $handle localhost /var/log 0 $datestamp 0 NULL 0 AMANDA");
 like(taper_reply, qr/^PORT (\d+)$/,
 	"got PORT");
 ($port) = ($last_taper_reply =~ /^PORT (\d+)/);
 write_to_port($port, 1575936, "localhost", "/var/log", 1);
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTIAL $handle INPUT-GOOD TAPE-ERROR "\[sec [\d.]+ kb 0 kps [\d.]+\]" "" "No space left on device"$/,
@@ -608,20 +611,20 @@ check_logs([
 $handle = "11-99999";
 $datestamp = "20100101000000";
 run_taper(512, "FILE-WRITE runs out of tapes");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
 make_holding_file(512*1024, "localhost", "/music");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /music 0 $datestamp 262144");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /music 0 $datestamp 262144");
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 1 256 "\[sec [\d.]+ kb 256 kps [\d.]+\]"$/,
 	"got PARTDONE for filenum 1 on first tape") or die;
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NO-NEW-TAPE \"that's enough\"");
+taper_cmd("NO-NEW-TAPE $handle \"that's enough\"");
 like(taper_reply, qr/^PARTIAL $handle INPUT-GOOD TAPE-ERROR "\[sec [\d.]+ kb 256 kps [\d.]+\]" "" "that's enough"$/,
 	"got PARTIAL") or die;
 taper_cmd("QUIT");
@@ -645,16 +648,16 @@ check_logs([
 $handle = "22-00000";
 $datestamp = "20200202222222";
 run_taper(4096, "multipart PORT-WRITE");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
-taper_cmd("PORT-WRITE $handle localhost /sbin 0 $datestamp 10 NULL 655360 AMANDA");
+taper_cmd("PORT-WRITE 0 $handle localhost /sbin 0 $datestamp 10 NULL 655360 AMANDA");
 like(taper_reply, qr/^PORT (\d+)$/,
 	"got PORT");
 ($port) = ($last_taper_reply =~ /^PORT (\d+)/);
 write_to_port($port, 63*32768, "localhost", "/sbin", 0);
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 1 640 "\[sec [\d.]+ kb 640 kps [\d.]+\]"$/,
@@ -690,13 +693,13 @@ check_logs([
 $handle = "33-11111";
 $datestamp = "20090101010000";
 run_taper(1024, "first in a sequence");
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
 make_holding_file(500000, "localhost", "/u01");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /u01 0 $datestamp 262144");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /u01 0 $datestamp 262144");
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 1 256 "\[sec [\d.]+ kb 256 kps [\d.]+\]"$/,
@@ -707,12 +710,12 @@ like(taper_reply, qr/^DONE $handle INPUT-GOOD TAPE-GOOD "\[sec [\d.]+ kb 488 kps
 	"got DONE") or die;
 $handle = "33-22222";
 make_holding_file(614400, "localhost", "/u02");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /u02 0 $datestamp 262144");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /u02 0 $datestamp 262144");
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 3 256 "\[sec [\d.]+ kb 256 kps [\d.]+\]"$/,
 	"got PARTDONE for filenum 3") or die;
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF02$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF02 1 256 "\[sec [\d.]+ kb 256 kps [\d.]+\]"$/,
@@ -746,13 +749,13 @@ cleanup_log();
 $handle = "33-33333";
 $datestamp = "20090202020000";
 run_taper(1024, "second in a sequence", keep_config => 1);
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
 make_holding_file(300000, "localhost", "/u01");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /u01 0 $datestamp 262144");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /u01 0 $datestamp 262144");
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF03$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF03 1 256 "\[sec [\d.]+ kb 256 kps [\d.]+\]"$/,
@@ -763,14 +766,14 @@ like(taper_reply, qr/^DONE $handle INPUT-GOOD TAPE-GOOD "\[sec [\d.]+ kb 292 kps
 	"got DONE") or die;
 $handle = "33-44444";
 make_holding_file(614400, "localhost", "/u02");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /u02 0 $datestamp 262144");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /u02 0 $datestamp 262144");
 like(taper_reply, qr/^PARTDONE $handle TESTCONF03 3 256 "\[sec [\d.]+ kb 256 kps [\d.]+\]"$/,
 	"got PARTDONE for filenum 3") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF03 4 256 "\[sec [\d.]+ kb 256 kps [\d.]+\]"$/,
 	"got PARTDONE for filenum 4") or die;
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 like(taper_reply, qr/^NEW-TAPE $handle TESTCONF01$/,
 	"got proper NEW-TAPE") or die;
 like(taper_reply, qr/^PARTDONE $handle TESTCONF01 1 88 "\[sec [\d.]+ kb 88 kps [\d.]+\]"$/,
@@ -805,23 +808,23 @@ cleanup_log();
 $handle = "33-55555";
 $datestamp = "20090303030000";
 run_taper(1024, "failure to overwrite a volume", keep_config => 1);
-like(taper_reply, qr/^TAPER-OK$/,
+like(taper_reply, qr/^TAPER-OK 1$/,
 	"got TAPER-OK") or die;
 make_holding_file(32768, "localhost", "/u03");
-taper_cmd("FILE-WRITE $handle \"$test_filename\" localhost /u03 0 $datestamp 262144");
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /u03 0 $datestamp 262144");
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
 # we've secretly replaced the tape in slot 1 with a read-only tape.. let's see
 # if anyone can tell the difference!
 chmod(0555, Installcheck::Run::vtape_dir(2));
-taper_cmd("NEW-TAPE");
+taper_cmd("NEW-TAPE $handle");
 # NO-NEW-TAPE indicates it did *not* overwrite the tape
 like(taper_reply, qr/^NO-NEW-TAPE $handle$/,
 	"got proper NO-NEW-TAPE"); # no "die" here, so we can restore perms
 chmod(0755, Installcheck::Run::vtape_dir(2));
 like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
 	"got REQUEST-NEW-TAPE") or die;
-taper_cmd("NO-NEW-TAPE \"sorry\"");
+taper_cmd("NO-NEW-TAPE $handle \"sorry\"");
 like(taper_reply, qr/^FAILED $handle INPUT-GOOD TAPE-ERROR "" "?sorry"?.*$/,
 	"got FAILED") or die;
 taper_cmd("QUIT");
@@ -833,6 +836,44 @@ wait_for_exit();
 # immediately REQUEST-NEW-TAPE.  I can't see a way to make the VFS device erase a
 # volume without start_device succeeding.
 
+##
+# Two workers, each writing to its own volume
+
+$datestamp = "20090404040000";
+run_taper(4096, "two workers", parallel_write => 2);
+like(taper_reply, qr/^TAPER-OK 2$/,
+	"got TAPER-OK with two workers") or die;
+make_holding_file(1024*1024, "localhost", "/home");
+$handle = "44-11111";
+taper_cmd("FILE-WRITE 0 $handle \"$test_filename\" localhost /home 0 $datestamp 0");
+like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
+	"got REQUEST-NEW-TAPE from worker 0") or die;
+taper_cmd("NEW-TAPE $handle");
+like(taper_reply, qr/^NEW-TAPE $handle TESTCONF0[12]$/,
+	"got proper NEW-TAPE") or die;
+my ($label0) = ($last_taper_reply =~ /(TESTCONF0[12])$/);
+like(taper_reply, qr/^PARTDONE $handle $label0 1 1024 "\[sec [\d.]+ kb 1024 kps [\d.]+\]"$/,
+	"got PARTDONE") or die;
+like(taper_reply, qr/^DONE $handle INPUT-GOOD TAPE-GOOD "\[sec [\d.]+ kb 1024 kps [\d.]+\]" "" ""$/,
+	"got DONE") or die;
+make_holding_file(1024*1024, "localhost", "/usr");
+$handle = "44-22222";
+taper_cmd("FILE-WRITE 1 $handle \"$test_filename\" localhost /usr 0 $datestamp 0");
+like(taper_reply, qr/^REQUEST-NEW-TAPE $handle$/,
+	"got REQUEST-NEW-TAPE from worker 1") or die;
+taper_cmd("NEW-TAPE $handle");
+like(taper_reply, qr/^NEW-TAPE $handle TESTCONF0[12]$/,
+	"got proper NEW-TAPE") or die;
+my ($label1) = ($last_taper_reply =~ /(TESTCONF0[12])$/);
+isnt($label1, $label0, "..on a different volume");
+like(taper_reply, qr/^PARTDONE $handle $label1 1 1024 "\[sec [\d.]+ kb 1024 kps [\d.]+\]"$/,
+	"got PARTDONE") or die;
+like(taper_reply, qr/^DONE $handle INPUT-GOOD TAPE-GOOD "\[sec [\d.]+ kb 1024 kps [\d.]+\]" "" ""$/,
+	"got DONE") or die;
+taper_cmd("QUIT");
+wait_for_exit();
+cleanup_log();
+
 ##
 # A run with a bogus tapedev/tpchanger
 $handle = "11-11111";
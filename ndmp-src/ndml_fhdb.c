@@ -37,6 +37,30 @@
 
 #include "ndmlib.h"
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#define NDMFHDB_USE_MMAP
+#include <sys/mman.h>
+#endif
+
+
+/*
+ * Directories remembered by ndmfhdb_lookup_batch() from one
+ * path to the next. Deeper components are looked up every time.
+ */
+#define NDMFHDB_MAX_LEVEL	64
+
+struct ndmfhdb_level {
+	char *			name;		/* points into the path */
+	int			name_len;
+	unsigned long long	node;
+};
+
+static int	ndmfhdb_first (struct ndmfhdb *fhcb, char *key,
+			char *buf, unsigned max_buf);
+static int	ndmfhdb_dirnode_lookup_cached (struct ndmfhdb *fhcb,
+			char *path, ndmp9_file_stat *fstat,
+			struct ndmfhdb_level *level, int *n_level_p);
+
 
 
 int
@@ -114,30 +138,67 @@ ndmfhdb_add_fh_info_to_nlist (FILE *fp, ndmp9_name *nlist, int n_nlist)
 {
 	struct ndmfhdb		_fhcb, *fhcb = &_fhcb;
 	int			i, rc, n_found;
-	ndmp9_file_stat		fstat;
+	char **			path;
+	ndmp9_file_stat *	fstat;
 
 	rc = ndmfhdb_open (fp, fhcb);
 	if (rc != 0) {
 		return -31;
 	}
 
-	n_found = 0;
+	path = NDMOS_MACRO_NEWN (char *, n_nlist);
+	fstat = NDMOS_MACRO_NEWN (ndmp9_file_stat, n_nlist);
 
 	for (i = 0; i < n_nlist; i++) {
-		char *		name = nlist[i].original_path;
+		path[i] = nlist[i].original_path;
+	}
 
-		rc = ndmfhdb_lookup (fhcb, name, &fstat);
-		if (rc > 0) {
-			nlist[i].fh_info = fstat.fh_info;
-			if (fstat.fh_info.valid) {
+	n_found = 0;
+
+	rc = ndmfhdb_lookup_batch (fhcb, path, n_nlist, fstat);
+	if (rc > 0) {
+		for (i = 0; i < n_nlist; i++) {
+			if (fstat[i].fh_info.valid) {
+				nlist[i].fh_info = fstat[i].fh_info;
 				n_found++;
 			}
 		}
 	}
 
+	NDMOS_API_FREE (fstat);
+	NDMOS_API_FREE (path);
+	ndmfhdb_close (fhcb);
+
 	return n_found;
 }
 
+/*
+ * The index is normally far bigger than the number of files being
+ * recovered, and each lookup is a binary search. When possible the
+ * index is mmap()ed so the searches are done in memory, rather than
+ * with a fseek() and a stdio buffer refill per probe.
+ */
+static void
+ndmfhdb_map (struct ndmfhdb *fhcb)
+{
+#ifdef NDMFHDB_USE_MMAP
+	struct stat	st;
+	void *		map;
+	int		fd = fileno (fhcb->fp);
+
+	if (fstat (fd, &st) != 0 || st.st_size <= 0
+	 || (off_t)(size_t) st.st_size != st.st_size)
+		return;
+
+	map = mmap (0, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return;		/* use stdio */
+
+	fhcb->map = map;
+	fhcb->map_len = st.st_size;
+#endif /* NDMFHDB_USE_MMAP */
+}
+
 int
 ndmfhdb_open (FILE *fp, struct ndmfhdb *fhcb)
 {
@@ -146,6 +207,7 @@ ndmfhdb_open (FILE *fp, struct ndmfhdb *fhcb)
 	NDMOS_MACRO_ZEROFILL (fhcb);
 
 	fhcb->fp = fp;
+	ndmfhdb_map (fhcb);
 
 	rc = ndmfhdb_dirnode_root (fhcb);
 	if (rc > 0) {
@@ -159,9 +221,25 @@ ndmfhdb_open (FILE *fp, struct ndmfhdb *fhcb)
 		return 0;
 	}
 
+	ndmfhdb_close (fhcb);
+
 	return -1;
 }
 
+int
+ndmfhdb_close (struct ndmfhdb *fhcb)
+{
+#ifdef NDMFHDB_USE_MMAP
+	if (fhcb->map) {
+		munmap (fhcb->map, (size_t) fhcb->map_len);
+	}
+#endif /* NDMFHDB_USE_MMAP */
+	fhcb->map = 0;
+	fhcb->map_len = 0;
+
+	return 0;
+}
+
 int
 ndmfhdb_lookup (struct ndmfhdb *fhcb, char *path, ndmp9_file_stat *fstat)
 {
@@ -172,6 +250,71 @@ ndmfhdb_lookup (struct ndmfhdb *fhcb, char *path, ndmp9_file_stat *fstat)
 	}
 }
 
+static int
+ndmfhdb_path_compare (const void *a, const void *b)
+{
+	return strcmp (**(char ***)a, **(char ***)b);
+}
+
+/*
+ * ndmfhdb_lookup_batch()
+ *
+ * Look up n_path paths in one go. fstat[i] receives the
+ * stat of path[i], or is zero-filled if path[i] is not
+ * in the index. The paths are resolved in sorted order,
+ * so that with a dir/node index the directories shared
+ * by consecutive paths are only looked up once.
+ *
+ * Returns:
+ *	<0	Error
+ *	>=0	Number of paths found
+ */
+
+int
+ndmfhdb_lookup_batch (struct ndmfhdb *fhcb, char **path, int n_path,
+  ndmp9_file_stat *fstat)
+{
+	struct ndmfhdb_level	level[NDMFHDB_MAX_LEVEL];
+	int			n_level = 0;
+	char ***		order;
+	int			i, ix, rc, n_found;
+
+	if (n_path <= 0)
+		return 0;
+
+	order = NDMOS_MACRO_NEWN (char **, n_path);
+	if (!order)
+		return -1;
+
+	for (i = 0; i < n_path; i++) {
+		order[i] = &path[i];
+	}
+	qsort (order, n_path, sizeof *order, ndmfhdb_path_compare);
+
+	n_found = 0;
+
+	for (i = 0; i < n_path; i++) {
+		ix = order[i] - path;
+
+		if (fhcb->use_dir_node) {
+			rc = ndmfhdb_dirnode_lookup_cached (fhcb, path[ix],
+					&fstat[ix], level, &n_level);
+		} else {
+			rc = ndmfhdb_file_lookup (fhcb, path[ix], &fstat[ix]);
+		}
+
+		if (rc > 0) {
+			n_found++;
+		} else {
+			NDMOS_MACRO_ZEROFILL (&fstat[ix]);
+		}
+	}
+
+	NDMOS_API_FREE (order);
+
+	return n_found;
+}
+
 int
 ndmfhdb_dirnode_root (struct ndmfhdb *fhcb)
 {
@@ -185,7 +328,7 @@ ndmfhdb_dirnode_root (struct ndmfhdb *fhcb)
 	p = NDMOS_API_STREND(key);
 	off = p - key;
 
-	rc = ndmbstf_first (fhcb->fp, key, linebuf, sizeof linebuf);
+	rc = ndmfhdb_first (fhcb, key, linebuf, sizeof linebuf);
 
 	if (rc <= 0) {
 		return rc;	/* error or not found */
@@ -204,15 +347,30 @@ int
 ndmfhdb_dirnode_lookup (struct ndmfhdb *fhcb, char *path,
   ndmp9_file_stat *fstat)
 {
-	int			rc;
+	int			n_level = 0;
+
+	return ndmfhdb_dirnode_lookup_cached (fhcb, path, fstat, 0, &n_level);
+}
+
+/*
+ * level[0..*n_level_p-1] are the directories resolved for the
+ * previous path. Leading components that match are taken from
+ * there, the rest are looked up and replace them. level may be
+ * 0 to look up every component.
+ */
+static int
+ndmfhdb_dirnode_lookup_cached (struct ndmfhdb *fhcb, char *path,
+  ndmp9_file_stat *fstat, struct ndmfhdb_level *level, int *n_level_p)
+{
+	int			rc, depth, len;
 	char *			p;
-	char *			q;
 	char			component[256+128];
 	unsigned long long	dir_node;
 	unsigned long long	node;
 
 	/* classic path name reduction */
 	node = dir_node = fhcb->root_node;
+	depth = 0;
 	p = path;
 	for (;;) {
 		if (*p == '/') {
@@ -222,16 +380,44 @@ ndmfhdb_dirnode_lookup (struct ndmfhdb *fhcb, char *path,
 		if (*p == 0) {
 			break;
 		}
-		q = component;
-		while (*p != 0 && *p != '/') {
-			*q++ = *p++;
+		len = 0;
+		while (p[len] != 0 && p[len] != '/') {
+			len++;
 		}
-		*q = 0;
+
+		if (depth < *n_level_p
+		 && level[depth].name_len == len
+		 && strncmp (level[depth].name, p, len) == 0) {
+			/* same directory as the previous path */
+			node = level[depth].node;
+			depth++;
+			p += len;
+			continue;
+		}
+
+		/* whatever was cached below here is for another directory */
+		if (*n_level_p > depth)
+			*n_level_p = depth;
+
+		if (len >= (int) sizeof component)
+			return 0;	/* too long to be in the index */
+		NDMOS_API_BCOPY (p, component, len);
+		component[len] = 0;
 
 		dir_node = node;
 		rc = ndmfhdb_dir_lookup (fhcb, dir_node, component, &node);
 		if (rc <= 0)
 			return rc;	/* error or not found */
+
+		if (level && depth == *n_level_p && depth < NDMFHDB_MAX_LEVEL) {
+			level[depth].name = p;
+			level[depth].name_len = len;
+			level[depth].node = node;
+			*n_level_p = depth + 1;
+		}
+
+		depth++;
+		p += len;
 	}
 
 	rc = ndmfhdb_node_lookup (fhcb, node, fstat);
@@ -258,7 +444,7 @@ ndmfhdb_dir_lookup (struct ndmfhdb *fhcb, unsigned long long dir_node,
 	p = NDMOS_API_STREND(key);
 	off = p - key;
 
-	rc = ndmbstf_first (fhcb->fp, key, linebuf, sizeof linebuf);
+	rc = ndmfhdb_first (fhcb, key, linebuf, sizeof linebuf);
 
 	if (rc <= 0) {
 		return rc;	/* error or not found */
@@ -288,7 +474,7 @@ ndmfhdb_node_lookup (struct ndmfhdb *fhcb, unsigned long long node,
 	off = p - key;
 
 
-	rc = ndmbstf_first (fhcb->fp, key, linebuf, sizeof linebuf);
+	rc = ndmfhdb_first (fhcb, key, linebuf, sizeof linebuf);
 
 	if (rc <= 0) {
 		return rc;	/* error or not found */
@@ -303,6 +489,97 @@ ndmfhdb_node_lookup (struct ndmfhdb *fhcb, unsigned long long node,
 	return 1;
 }
 
+/*
+ * Like ndmbstf_compare(), for a line of the mapped index
+ * which ends at a \n or at end rather than at a NUL.
+ */
+static int
+ndmfhdb_map_compare (char *key, char *line, char *end)
+{
+	char *		p = key;
+	char *		q = line;
+
+	while (*p != 0 && q < end && *q != '\n' && *p == *q) {
+		p++;
+		q++;
+	}
+
+	if (*p == 0)
+		return 0;	/* entire key matched */
+	else if (q >= end || *q == '\n')
+		return *p;	/* line is a prefix of key */
+	else
+		return *p - *q;
+}
+
+/*
+ * ndmfhdb_first()
+ *
+ * ndmbstf_first() on the index, with the same return values.
+ * When the index is mapped, this is a plain binary search over
+ * the line starts, done in memory.
+ */
+static int
+ndmfhdb_first (struct ndmfhdb *fhcb, char *key, char *buf, unsigned max_buf)
+{
+	char *		map = fhcb->map;
+	char *		map_end;
+	char *		p;
+	char *		p_end;
+	char *		q;
+	char *		q_end;
+	off_t		lower, upper, mid;
+
+	if (!map)
+		return ndmbstf_first (fhcb->fp, key, buf, max_buf);
+
+	map_end = map + fhcb->map_len;
+
+	/*
+	 * lower and upper are always at the start of a line (or at
+	 * the end of the index). Lines before lower are less than
+	 * the key, lines from upper on are greater than or equal.
+	 */
+	lower = 0;
+	upper = fhcb->map_len;
+	while (lower < upper) {
+		mid = lower + (upper - lower) / 2;
+		while (mid > lower && map[mid-1] != '\n')
+			mid--;
+
+		if (ndmfhdb_map_compare (key, map + mid, map_end) > 0) {
+			/* key>line. Objective somewhere after this line */
+			p = memchr (map + mid, '\n', map_end - (map + mid));
+			if (!p)
+				return -2;	/* malformed last line */
+			lower = p + 1 - map;
+		} else {
+			/* key<=line. This line or one before it */
+			upper = mid;
+		}
+	}
+
+	if (lower >= fhcb->map_len)
+		return EOF;
+
+	p = map + lower;
+	p_end = memchr (p, '\n', map_end - p);
+	if (!p_end)
+		return -2;	/* malformed line */
+
+	/* same truncation as ndmbstf_getline() */
+	q = buf;
+	q_end = buf + max_buf - 2;
+	while (p < p_end && q < q_end)
+		*q++ = *p++;
+	*q = 0;
+
+	if (ndmbstf_compare (key, buf) == 0)
+		return q - buf;		/* match */
+
+	return 0;	/* have line but it doesn't match */
+}
+
 int
 ndmfhdb_file_root (struct ndmfhdb *fhcb)
 {
@@ -337,7 +614,7 @@ ndmfhdb_file_lookup (struct ndmfhdb *fhcb, char *path,
 	p = NDMOS_API_STREND(key);
 	off = p - key;
 
-	rc = ndmbstf_first (fhcb->fp, key, linebuf, sizeof linebuf);
+	rc = ndmfhdb_first (fhcb, key, linebuf, sizeof linebuf);
 
 	if (rc <= 0) {
 		return rc;	/* error or not found */
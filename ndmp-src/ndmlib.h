@@ -759,15 +759,18 @@ extern int	ndmcfg_free (ndmp9_config_info *config_info);
  * writes the File History info to a text file as it arrives. Upon
  * completion of the backup the text file should be sorted (UNIX
  * sort(1) command). For recovery the file history index is searched
- * using binary search (see NDMBSTF above). The fh_info, a 64-bit
- * cookie used by DATA to identify the region of the backup image
- * containing the corresponding object, is retreived from the index.
+ * using binary search (see NDMBSTF above), in memory when the index
+ * can be mmap()ed. The fh_info, a 64-bit cookie used by DATA to
+ * identify the region of the backup image containing the
+ * corresponding object, is retreived from the index.
  */
 
 struct ndmfhdb {
 	FILE *			fp;
 	int			use_dir_node;
 	unsigned long long	root_node;
+	char *			map;		/* mmap()ed index, or 0 */
+	off_t			map_len;
 };
 
 extern int	ndmfhdb_add_file (struct ndmlog *ixlog, int tagc,
@@ -783,8 +786,12 @@ extern int	ndmfhdb_add_dirnode_root (struct ndmlog *ixlog, int tagc,
 extern int	ndmfhdb_add_fh_info_to_nlist (FILE *fp,
 			ndmp9_name *nlist, int n_nlist);
 extern int	ndmfhdb_open (FILE *fp, struct ndmfhdb *fhcb);
+extern int	ndmfhdb_close (struct ndmfhdb *fhcb);
 extern int	ndmfhdb_lookup (struct ndmfhdb *fhcb, char *path,
 			ndmp9_file_stat *fstat);
+extern int	ndmfhdb_lookup_batch (struct ndmfhdb *fhcb,
+			char **path, int n_path,
+			ndmp9_file_stat *fstat);
 extern int	ndmfhdb_dirnode_root (struct ndmfhdb *fhcb);
 extern int	ndmfhdb_dirnode_lookup (struct ndmfhdb *fhcb, char *path,
 			ndmp9_file_stat *fstat);
@@ -57,6 +57,7 @@ algorithm.  The constructor takes the following keyword arguments:
     tapecycle
     labelstr
     label_new_tapes
+    pending_labels
 
 The changer object must always be provided, but C<algorithm> may be omitted, in
 which case the class specified by the user in the Amanda configuration file is
@@ -64,6 +65,11 @@ instantiated.  The remaining options will be taken from the configuration file
 if not specified.  Default values for all of these options are applied before a
 subclass's constructor is called.
 
+C<pending_labels> is an optional hashref that may be shared between several
+taperscan objects scanning the same changer at the same time.  Labels invented
+by C<make_new_tape_label> are recorded there, so that two scans do not hand out
+the same new label before either volume appears in the tapelist.
+
 Subclasses must implement a single method: C<scan>.  It takes only one mandatory
 parameter, C<result_cb>:
 
@@ -149,6 +155,8 @@ sub new {
 	unless exists $params{'labelstr'};
     $params{'label_new_tapes'} = getconf($CNF_LABEL_NEW_TAPES)
 	unless exists $params{'label_new_tapes'};
+    $params{'pending_labels'} = {}
+	unless defined $params{'pending_labels'};
 
     # load the package
     my $pkgname = "Amanda::Taper::Scan::" . $params{'algorithm'};
@@ -174,6 +182,7 @@ sub new {
     $self->{'tapelist_filename'} = $params{'tapelist_filename'};
     $self->{'labelstr'} = $params{'labelstr'};
     $self->{'label_new_tapes'} = $params{'label_new_tapes'};
+    $self->{'pending_labels'} = $params{'pending_labels'};
 
     return $self;
 }
@@ -250,6 +259,7 @@ sub make_new_tape_label {
 
     my %existing_labels =
 	map { $_->{'label'} => 1 } @{$self->{'tapelist'}};
+    $existing_labels{$_} = 1 for keys %{$self->{'pending_labels'}};
 
     my ($i, $label);
     for ($i = 1; $i < $nlabels; $i++) {
@@ -266,6 +276,7 @@ sub make_new_tape_label {
         return undef;
     }
 
+    $self->{'pending_labels'}->{$label} = 1;
     return $label;
 }
 
@@ -162,6 +162,10 @@ sub stage_1 {
 	    if ($err->failed and $err->notfound) {
 		$self->_user_msg("oldest reusable volume not found");
 		return $self->stage_2();
+	    } elsif ($err->failed and $err->inuse) {
+		# another scribe is writing to it
+		$self->_user_msg("oldest reusable volume is in use");
+		return $self->stage_2();
 	    } else {
 		return $self->scan_result($err, $res);
 	    }
@@ -140,7 +140,10 @@ principle, there is no reason that transfer filters could not be
 included.
 
 The underlying C<Amanda::Xfer::Dest::Taper> handles device streaming
-properly.  It uses C<max_memory> bytes of memory for this purpose.
+properly.  It uses C<max_memory> bytes of memory for this purpose.  If the
+optional C<spill_dirname> is given, data that arrives while that memory is
+full is spilled to a temporary file in that directory rather than holding up
+the transfer source.
 
 The arguments to C<start_xfer> differ for the various split methods.
 For no splitting:
@@ -462,7 +465,7 @@ sub start_xfer {
     my $finish_starting_xfer = make_cb(finish_starting_xfer => sub  {
 	my $xdt = $self->{'xdt'} = Amanda::Xfer::Dest::Taper::Splitter->new(
             $self->{'device'}, $params{'max_memory'}, $part_size,
-	    $use_mem_cache, $disk_cache_dirname);
+	    $use_mem_cache, $disk_cache_dirname, $params{'spill_dirname'});
 
 	my $xfer_elements = $params{'xfer_elements'};
 	my $xfer = $self->{'xfer'} = Amanda::Xfer->new([ @$xfer_elements, $xdt ]);
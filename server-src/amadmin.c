@@ -1870,7 +1870,7 @@ import_one(void)
 	    }
 	}
 
-	if(level < 0 || level > 9) goto parse_err;
+	if(level < 0 || level >= DUMP_LEVELS) goto parse_err;
 
 	info.inf[level] = onestat;
     }
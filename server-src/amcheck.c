@@ -34,6 +34,7 @@
 #include "columnar.h"
 #include "fsusage.h"
 #include "diskfile.h"
+#include "infofile.h"
 #include "tapefile.h"
 #include "changer.h"
 #include "packet.h"
@@ -1106,7 +1107,11 @@ start_server_check(
 
 	quoted = quote_string(conf_infofile);
 	if(stat(conf_infofile, &statbuf) == -1) {
-	    if (errno == ENOENT) {
+	    if (errno == ENOENT && infofile_is_db(conf_infofile)) {
+		g_fprintf(outf, _("NOTE: info database %s does not exist\n"),
+			quoted);
+		g_fprintf(outf, _("NOTE: it will be created on the next run.\n"));
+	    } else if (errno == ENOENT) {
 		g_fprintf(outf, _("NOTE: conf info dir %s does not exist\n"),
 			quoted);
 		g_fprintf(outf, _("NOTE: it will be created on the next run.\n"));
@@ -1116,6 +1121,15 @@ start_server_check(
 		infobad = 1;
 	    }	
 	    amfree(conf_infofile);
+	} else if (infofile_is_db(conf_infofile)) {
+	    if (access(conf_infofile, R_OK|W_OK) == -1) {
+		g_fprintf(outf, _("ERROR: info database %s: not writable\n"),
+			quoted);
+		g_fprintf(outf, _("Check permissions\n"));
+		infobad = 1;
+	    }
+	    /* a single file: there are no host or disk info dirs to check */
+	    amfree(conf_infofile);
 	} else if (!S_ISDIR(statbuf.st_mode)) {
 	    g_fprintf(outf, _("ERROR: info dir %s: not a directory\n"), quoted);
 	    g_fprintf(outf, _("Remove the entry and create a new directory\n"));
@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2008,2009 Zmanda, Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+#include "amanda.h"
+#include "testutils.h"
+#include "amindex.h"
+
+/* the sorted index text, and a stand-in for the compressed index it came
+ * from; get_dirindex only looks at the latter's mtime */
+#define TEST_INDEX	"amindex-test.index"
+#define TEST_INDEX_GZ	"amindex-test.gz"
+#define TEST_DIRINDEX	"amindex-test.dirindex"
+
+/* entries whose names are prefixes of each other, or differ from a
+ * directory name only after it */
+static const char *edge_paths[] = {
+    "/",
+    "/a/",
+    "/a/b",
+    "/a/b.c",
+    "/a/b.c/",
+    "/a/b.c/x",
+    "/a/b/",
+    "/a/b/c",
+    "/a/b/c/",
+    "/a/b/c/d",
+    "/a/b/c/d/",
+    "/a/b/c/d/e",
+    "/a/b/c2",
+    "/a/b0",
+    "/a/ba/",
+    "/a/ba/x",
+    "/z",
+    NULL
+};
+
+/* many more entries than fit in dirindex's read buffer */
+#define BULK_DIRS 100
+#define BULK_FILES 30
+
+static int
+compare_paths(
+    gconstpointer a,
+    gconstpointer b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Write the sorted index text, with a duplicate line as sort -u would not
+ * remove for us if the dumper wrote it twice. */
+static gboolean
+write_index(void)
+{
+    GPtrArray *paths = g_ptr_array_new();
+    FILE *fp;
+    guint i;
+    int d, f;
+
+    for (i = 0; edge_paths[i] != NULL; i++)
+	g_ptr_array_add(paths, stralloc(edge_paths[i]));
+    g_ptr_array_add(paths, stralloc("/a/b/c"));
+    for (d = 0; d < BULK_DIRS; d++) {
+	g_ptr_array_add(paths, g_strdup_printf("/bulk/dir%03d/", d));
+	for (f = 0; f < BULK_FILES; f++)
+	    g_ptr_array_add(paths, g_strdup_printf(
+		"/bulk/dir%03d/a-file-with-a-longish-name-to-fill-the-buffer-%03d",
+		d, f));
+	g_ptr_array_add(paths, g_strdup_printf("/bulk/dir%03d/sub/", d));
+	g_ptr_array_add(paths, g_strdup_printf("/bulk/dir%03d/sub/file", d));
+    }
+    qsort(paths->pdata, paths->len, SIZEOF(gpointer), compare_paths);
+
+    if ((fp = fopen(TEST_INDEX, "w")) == NULL) {
+	tu_dbg("cannot create " TEST_INDEX ": %s\n", strerror(errno));
+	return FALSE;
+    }
+    for (i = 0; i < paths->len; i++) {
+	g_fprintf(fp, "%s\n", (char *)g_ptr_array_index(paths, i));
+	g_free(g_ptr_array_index(paths, i));
+    }
+    g_ptr_array_free(paths, TRUE);
+    afclose(fp);
+
+    /* and the compressed index, which is no newer than what is built */
+    if ((fp = fopen(TEST_INDEX_GZ, "w")) == NULL) {
+	tu_dbg("cannot create " TEST_INDEX_GZ ": %s\n", strerror(errno));
+	return FALSE;
+    }
+    afclose(fp);
+    return TRUE;
+}
+
+static void
+cleanup(void)
+{
+    unlink(TEST_INDEX);
+    unlink(TEST_INDEX_GZ);
+    unlink(TEST_DIRINDEX);
+}
+
+static void
+append_path(
+    const char *path,
+    gpointer	user_data)
+{
+    g_string_append((GString *)user_data, path);
+    g_string_append_c((GString *)user_data, '\n');
+}
+
+/* Check that listing dir_slash through the directory index gives what the
+ * scan of the text index gives, and, if expected is not NULL, that it is
+ * expected. */
+static gboolean
+check_ls(
+    dirindex_t *dirindex,
+    const char *dir_slash,
+    int		recursive,
+    const char *expected)
+{
+    GString *got = g_string_new(""), *scanned = g_string_new("");
+    gboolean ok = TRUE;
+
+    if (dirindex_ls(dirindex, dir_slash, recursive, append_path, got) != 0 ||
+	index_ls(TEST_INDEX, dir_slash, recursive, append_path, scanned) != 0) {
+	tu_dbg("listing '%s' failed\n", dir_slash);
+	ok = FALSE;
+    } else if (strcmp(got->str, scanned->str) != 0) {
+	tu_dbg("listing '%s'%s: directory index gives\n%sbut the scan gives\n%s",
+	       dir_slash, recursive ? " recursively" : "", got->str, scanned->str);
+	ok = FALSE;
+    } else if (expected && strcmp(got->str, expected) != 0) {
+	tu_dbg("listing '%s'%s gives\n%sbut expected\n%s", dir_slash,
+	       recursive ? " recursively" : "", got->str, expected);
+	ok = FALSE;
+    }
+
+    g_string_free(got, TRUE);
+    g_string_free(scanned, TRUE);
+    return ok;
+}
+
+static gboolean
+check_prefix(
+    dirindex_t *dirindex,
+    const char *prefix,
+    int		expected)
+{
+    int found = dirindex_has_prefix(dirindex, prefix);
+
+    if (found != expected) {
+	tu_dbg("dirindex_has_prefix('%s') gives %d, expected %d\n",
+	       prefix, found, expected);
+	return FALSE;
+    }
+    return TRUE;
+}
+
+/* Check every directory of the test index both ways. */
+static gboolean
+check_all(
+    dirindex_t *dirindex)
+{
+    gboolean ok = TRUE;
+    char *dir;
+    int d, recursive;
+
+    for (recursive = 0; recursive <= 1; recursive++) {
+	ok = check_ls(dirindex, "/", recursive, NULL) && ok;
+	ok = check_ls(dirindex, "/a/", recursive, NULL) && ok;
+	ok = check_ls(dirindex, "/a/b/", recursive, NULL) && ok;
+	ok = check_ls(dirindex, "/a/b.c/", recursive, NULL) && ok;
+	ok = check_ls(dirindex, "/a/b/c/", recursive, NULL) && ok;
+	ok = check_ls(dirindex, "/a/ba/", recursive, NULL) && ok;
+	ok = check_ls(dirindex, "/nothing/", recursive, "") && ok;
+	ok = check_ls(dirindex, "/bulk/", recursive, NULL) && ok;
+	for (d = 0; d < BULK_DIRS; d += 7) {
+	    dir = g_strdup_printf("/bulk/dir%03d/", d);
+	    ok = check_ls(dirindex, dir, recursive, NULL) && ok;
+	    g_free(dir);
+	}
+    }
+    return ok;
+}
+
+/****
+ * A directory index lists the same entries as the scan of the text index
+ */
+static int
+test_dirindex_ls(void)
+{
+    dirindex_t *dirindex;
+    gboolean ok = TRUE;
+
+    cleanup();
+    if (!write_index() || !write_dirindex(TEST_INDEX, TEST_DIRINDEX) ||
+	(dirindex = open_dirindex(TEST_DIRINDEX)) == NULL) {
+	tu_dbg("cannot write a directory index\n");
+	cleanup();
+	return FALSE;
+    }
+
+    ok = check_all(dirindex) && ok;
+
+    /* "/a/b" is not a prefix of "/a/b.c" or "/a/b0" as a directory */
+    ok = check_ls(dirindex, "/a/", 0,
+		  "/a/\n/a/b\n/a/b.c\n/a/b.c/\n/a/b/\n/a/b0\n/a/ba/\n") && ok;
+    ok = check_ls(dirindex, "/a/b/", 0,
+		  "/a/b/\n/a/b/c\n/a/b/c/\n/a/b/c2\n") && ok;
+    ok = check_ls(dirindex, "/a/b/", 1,
+		  "/a/b/\n/a/b/c\n/a/b/c/\n/a/b/c/d\n/a/b/c/d/\n"
+		  "/a/b/c/d/e\n/a/b/c2\n") && ok;
+    ok = check_ls(dirindex, "/a/b.c/", 0, "/a/b.c/\n/a/b.c/x\n") && ok;
+
+    ok = check_prefix(dirindex, "/a/b", 1) && ok;
+    ok = check_prefix(dirindex, "/a/b/c/d/", 1) && ok;
+    ok = check_prefix(dirindex, "/a/b/c/d/e/", 0) && ok;
+    ok = check_prefix(dirindex, "/a/bb", 0) && ok;
+    ok = check_prefix(dirindex, "/zz", 0) && ok;
+
+    close_dirindex(dirindex);
+    cleanup();
+    return ok;
+}
+
+/****
+ * A truncated or garbled directory index is not used, and get_dirindex
+ * builds a new one
+ */
+static int
+test_truncated(void)
+{
+    dirindex_t *dirindex;
+    struct stat st;
+    gboolean ok = TRUE;
+    int fd;
+
+    cleanup();
+    if (!write_index() || !write_dirindex(TEST_INDEX, TEST_DIRINDEX) ||
+	stat(TEST_DIRINDEX, &st) < 0) {
+	tu_dbg("cannot write a directory index\n");
+	cleanup();
+	return FALSE;
+    }
+
+    /* lose the end of the offset table */
+    if (truncate(TEST_DIRINDEX, st.st_size - 1) < 0) {
+	tu_dbg("cannot truncate " TEST_DIRINDEX ": %s\n", strerror(errno));
+	cleanup();
+	return FALSE;
+    }
+    if ((dirindex = open_dirindex(TEST_DIRINDEX)) != NULL) {
+	tu_dbg("a truncated directory index was opened\n");
+	close_dirindex(dirindex);
+	ok = FALSE;
+    }
+    if ((dirindex = get_dirindex(TEST_INDEX_GZ, NULL)) != NULL) {
+	tu_dbg("get_dirindex returned a truncated directory index\n");
+	close_dirindex(dirindex);
+	ok = FALSE;
+    }
+
+    /* with the text index, it is rebuilt */
+    if ((dirindex = get_dirindex(TEST_INDEX_GZ, TEST_INDEX)) == NULL) {
+	tu_dbg("get_dirindex did not rebuild a truncated directory index\n");
+	ok = FALSE;
+    } else {
+	ok = check_all(dirindex) && ok;
+	close_dirindex(dirindex);
+    }
+
+    /* not a directory index at all */
+    if ((fd = open(TEST_DIRINDEX, O_WRONLY|O_TRUNC)) < 0 ||
+	full_write(fd, "/a/\n/a/b\n", 9) != 9) {
+	tu_dbg("cannot write " TEST_DIRINDEX ": %s\n", strerror(errno));
+	ok = FALSE;
+    }
+    if (fd >= 0)
+	close(fd);
+    if ((dirindex = open_dirindex(TEST_DIRINDEX)) != NULL) {
+	tu_dbg("a text file was opened as a directory index\n");
+	close_dirindex(dirindex);
+	ok = FALSE;
+    }
+
+    cleanup();
+    return ok;
+}
+
+/****
+ * A directory index older than its index file is not used, and
+ * get_dirindex builds a new one
+ */
+static int
+test_stale(void)
+{
+    dirindex_t *dirindex;
+    struct stat st_gz, st;
+    struct utimbuf times;
+    gboolean ok = TRUE;
+
+    cleanup();
+    if (!write_index() || !write_dirindex(TEST_INDEX, TEST_DIRINDEX) ||
+	stat(TEST_INDEX_GZ, &st_gz) < 0) {
+	tu_dbg("cannot write a directory index\n");
+	cleanup();
+	return FALSE;
+    }
+
+    /* a fresh one is used as it is */
+    if ((dirindex = get_dirindex(TEST_INDEX_GZ, NULL)) == NULL) {
+	tu_dbg("get_dirindex did not use a fresh directory index\n");
+	ok = FALSE;
+    } else {
+	close_dirindex(dirindex);
+    }
+
+    /* the index was re-written since the directory index was built */
+    times.actime = times.modtime = st_gz.st_mtime - 100;
+    if (utime(TEST_DIRINDEX, &times) < 0) {
+	tu_dbg("cannot set the time of " TEST_DIRINDEX ": %s\n", strerror(errno));
+	cleanup();
+	return FALSE;
+    }
+    if ((dirindex = get_dirindex(TEST_INDEX_GZ, NULL)) != NULL) {
+	tu_dbg("get_dirindex returned a stale directory index\n");
+	close_dirindex(dirindex);
+	ok = FALSE;
+    }
+
+    if ((dirindex = get_dirindex(TEST_INDEX_GZ, TEST_INDEX)) == NULL) {
+	tu_dbg("get_dirindex did not rebuild a stale directory index\n");
+	ok = FALSE;
+    } else {
+	ok = check_all(dirindex) && ok;
+	close_dirindex(dirindex);
+	if (stat(TEST_DIRINDEX, &st) < 0 || st.st_mtime < st_gz.st_mtime) {
+	    tu_dbg("the rebuilt directory index is still older\n");
+	    ok = FALSE;
+	}
+    }
+
+    cleanup();
+    return ok;
+}
+
+/****
+ * An index that is not sorted gets no directory index, so the caller
+ * falls back to scanning it
+ */
+static int
+test_unsorted(void)
+{
+    FILE *fp;
+    gboolean ok = TRUE;
+
+    cleanup();
+    if ((fp = fopen(TEST_INDEX, "w")) == NULL) {
+	tu_dbg("cannot create " TEST_INDEX ": %s\n", strerror(errno));
+	return FALSE;
+    }
+    g_fprintf(fp, "/\n/b/\n/a/\n");
+    afclose(fp);
+
+    if (write_dirindex(TEST_INDEX, TEST_DIRINDEX)) {
+	tu_dbg("write_dirindex accepted an unsorted index\n");
+	ok = FALSE;
+    }
+    if (access(TEST_DIRINDEX, F_OK) == 0 ||
+	access(TEST_DIRINDEX ".tmp", F_OK) == 0) {
+	tu_dbg("write_dirindex left a file behind\n");
+	ok = FALSE;
+    }
+
+    if (index_ls("amindex-test.missing", "/", 0, append_path, NULL) != -1) {
+	tu_dbg("index_ls did not fail on a missing file\n");
+	ok = FALSE;
+    }
+
+    cleanup();
+    unlink(TEST_DIRINDEX ".tmp");
+    return ok;
+}
+
+/****
+ * Driver
+ */
+
+int
+main(int argc, char **argv)
+{
+    static TestUtilsTest tests[] = {
+	TU_TEST(test_dirindex_ls, 90),
+	TU_TEST(test_truncated, 90),
+	TU_TEST(test_stale, 90),
+	TU_TEST(test_unsorted, 90),
+	TU_END()
+    };
+
+    return testutils_run_tests(argc, argv, tests);
+}
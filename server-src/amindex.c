@@ -147,3 +147,464 @@ getoldindexfname(
 
   return buf;
 }
+
+/*
+ * Directory indexes
+ *
+ * A directory index holds the lines of a sorted, uncompressed backup index,
+ * each ending in a newline, with duplicates removed.  They are preceded by a
+ * header and followed by a table of the offsets of the lines, so the lines
+ * under a directory can be found with a binary search and then read
+ * contiguously.  All integers are big-endian.
+ *
+ *   magic	16 bytes, DIRINDEX_MAGIC
+ *   count	8 bytes, number of lines
+ *   table	8 bytes, offset of the offset table
+ *   lines
+ *   offsets	count * 8 bytes
+ */
+
+#define DIRINDEX_MAGIC "AMANDA DIRIDX 1\n"
+#define DIRINDEX_MAGIC_SIZE 16
+#define DIRINDEX_HEADER_SIZE 32
+
+/* big enough for several lines; a line is never longer than STR_SIZE */
+#define DIRINDEX_BUFFER_SIZE (STR_SIZE * 4)
+
+struct dirindex_s {
+  int fd;
+  guint64 count;
+  guint64 table_offset;
+
+  /* a window onto the lines, starting at file offset buf_offset */
+  char buf[DIRINDEX_BUFFER_SIZE];
+  guint64 buf_offset;
+  size_t buf_len;
+};
+
+static void
+put_be64(
+    guint8 *	buf,
+    guint64	val)
+{
+  int i;
+
+  for (i = 7; i >= 0; i--) {
+    buf[i] = (guint8)(val & 0xff);
+    val >>= 8;
+  }
+}
+
+static guint64
+get_be64(
+    const guint8 *buf)
+{
+  guint64 val = 0;
+  int i;
+
+  for (i = 0; i < 8; i++)
+    val = (val << 8) | buf[i];
+  return val;
+}
+
+gboolean
+write_dirindex(
+    const char *sorted_name,
+    const char *dirindex_name)
+{
+  FILE *in = NULL, *out = NULL, *table = NULL;
+  char *tmpname;
+  char line[STR_SIZE], prev[STR_SIZE];
+  guint8 header[DIRINDEX_HEADER_SIZE];
+  guint8 num[8];
+  guint64 count = 0;
+  guint64 offset = DIRINDEX_HEADER_SIZE;
+  size_t len;
+  gboolean success = FALSE;
+
+  tmpname = vstralloc(dirindex_name, ".tmp", NULL);
+
+  if ((in = fopen(sorted_name, "r")) == NULL) {
+    dbprintf(_("Can't open '%s': %s\n"), sorted_name, strerror(errno));
+    goto done;
+  }
+  if ((out = fopen(tmpname, "w")) == NULL) {
+    dbprintf(_("Can't open '%s' for writing: %s\n"), tmpname, strerror(errno));
+    goto done;
+  }
+  if ((table = tmpfile()) == NULL) {
+    dbprintf(_("Can't create a temporary file: %s\n"), strerror(errno));
+    goto done;
+  }
+
+  /* the header is filled in once the lines are counted */
+  bzero(header, SIZEOF(header));
+  if (fwrite(header, SIZEOF(header), 1, out) != 1)
+    goto write_error;
+
+  prev[0] = '\0';
+  while (fgets(line, SIZEOF(line), in) != NULL) {
+    len = strlen(line);
+    if (len > 0 && line[len-1] == '\n') {
+      line[--len] = '\0';
+    } else if (!feof(in)) {
+      dbprintf(_("'%s' has a line longer than %d bytes\n"), sorted_name, STR_SIZE);
+      goto done;
+    }
+    if (len == 0)
+      continue;
+
+    if (count > 0) {
+      int cmp = strcmp(prev, line);
+      if (cmp == 0)
+	continue;
+      if (cmp > 0) {
+	dbprintf(_("'%s' is not sorted\n"), sorted_name);
+	goto done;
+      }
+    }
+
+    put_be64(num, offset);
+    if (fwrite(num, SIZEOF(num), 1, table) != 1)
+      goto write_error;
+    if (fputs(line, out) == EOF || putc('\n', out) == EOF)
+      goto write_error;
+
+    offset += len + 1;
+    count++;
+    strcpy(prev, line);
+  }
+  if (ferror(in)) {
+    dbprintf(_("Error reading '%s': %s\n"), sorted_name, strerror(errno));
+    goto done;
+  }
+
+  /* append the offset table */
+  rewind(table);
+  while ((len = fread(line, 1, SIZEOF(line), table)) > 0) {
+    if (fwrite(line, 1, len, out) != len)
+      goto write_error;
+  }
+  if (ferror(table))
+    goto write_error;
+
+  memcpy(header, DIRINDEX_MAGIC, DIRINDEX_MAGIC_SIZE);
+  put_be64(header + DIRINDEX_MAGIC_SIZE, count);
+  put_be64(header + DIRINDEX_MAGIC_SIZE + 8, offset);
+  if (fseek(out, 0L, SEEK_SET) != 0 ||
+      fwrite(header, SIZEOF(header), 1, out) != 1)
+    goto write_error;
+
+  if (fclose(out) != 0) {
+    out = NULL;
+    goto write_error;
+  }
+  out = NULL;
+
+  if (rename(tmpname, dirindex_name) != 0) {
+    dbprintf(_("Can't rename '%s' to '%s': %s\n"),
+	     tmpname, dirindex_name, strerror(errno));
+    goto done;
+  }
+
+  success = TRUE;
+  goto done;
+
+write_error:
+  dbprintf(_("Error writing '%s': %s\n"), tmpname, strerror(errno));
+
+done:
+  if (in)
+    afclose(in);
+  if (out)
+    afclose(out);
+  if (table)
+    afclose(table);
+  if (!success)
+    unlink(tmpname);
+  amfree(tmpname);
+  return success;
+}
+
+dirindex_t *
+open_dirindex(
+    const char *dirindex_name)
+{
+  dirindex_t *dirindex;
+  guint8 header[DIRINDEX_HEADER_SIZE];
+  struct stat statbuf;
+  int fd;
+
+  if ((fd = open(dirindex_name, O_RDONLY)) == -1)
+    return NULL;
+
+  if (fstat(fd, &statbuf) == -1 ||
+      full_read(fd, header, SIZEOF(header)) != SIZEOF(header) ||
+      memcmp(header, DIRINDEX_MAGIC, DIRINDEX_MAGIC_SIZE) != 0) {
+    dbprintf(_("'%s' is not a directory index\n"), dirindex_name);
+    aclose(fd);
+    return NULL;
+  }
+
+  dirindex = alloc(SIZEOF(dirindex_t));
+  dirindex->fd = fd;
+  dirindex->count = get_be64(header + DIRINDEX_MAGIC_SIZE);
+  dirindex->table_offset = get_be64(header + DIRINDEX_MAGIC_SIZE + 8);
+  dirindex->buf_offset = 0;
+  dirindex->buf_len = 0;
+
+  /* a truncated index is no use */
+  if (dirindex->table_offset < DIRINDEX_HEADER_SIZE ||
+      dirindex->table_offset + dirindex->count * 8 != (guint64)statbuf.st_size) {
+    dbprintf(_("'%s' is truncated\n"), dirindex_name);
+    close_dirindex(dirindex);
+    return NULL;
+  }
+
+  return dirindex;
+}
+
+void
+close_dirindex(
+    dirindex_t *dirindex)
+{
+  aclose(dirindex->fd);
+  amfree(dirindex);
+}
+
+/* Returns the offset of line number n, or 0 on error. */
+static guint64
+dirindex_line_offset(
+    dirindex_t *dirindex,
+    guint64	n)
+{
+  guint8 num[8];
+  off_t offset = (off_t)(dirindex->table_offset + n * 8);
+
+  if (lseek(dirindex->fd, offset, SEEK_SET) != offset ||
+      full_read(dirindex->fd, num, SIZEOF(num)) != SIZEOF(num))
+    return 0;
+  return get_be64(num);
+}
+
+/* Read the line at the given offset into line, without its newline.  Returns
+ * the offset of the next line, or 0 on error. */
+static guint64
+dirindex_read_line(
+    dirindex_t *dirindex,
+    guint64	offset,
+    char *	line,
+    size_t	size)
+{
+  char *start, *nl = NULL;
+  size_t len;
+
+  if (offset >= dirindex->buf_offset &&
+      offset < dirindex->buf_offset + dirindex->buf_len) {
+    start = dirindex->buf + (offset - dirindex->buf_offset);
+    nl = memchr(start, '\n', dirindex->buf_len - (offset - dirindex->buf_offset));
+  }
+
+  if (!nl) {
+    if (lseek(dirindex->fd, (off_t)offset, SEEK_SET) != (off_t)offset)
+      return 0;
+    dirindex->buf_offset = offset;
+    dirindex->buf_len = full_read(dirindex->fd, dirindex->buf,
+				  SIZEOF(dirindex->buf));
+    start = dirindex->buf;
+    nl = memchr(start, '\n', dirindex->buf_len);
+    if (!nl)
+      return 0;
+  }
+
+  len = (size_t)(nl - start);
+  if (len >= size)
+    return 0;
+  memcpy(line, start, len);
+  line[len] = '\0';
+
+  return offset + len + 1;
+}
+
+/* Find the number of the first line not less than key. */
+static gboolean
+dirindex_lower_bound(
+    dirindex_t *dirindex,
+    const char *key,
+    guint64 *	result)
+{
+  guint64 lo = 0, hi = dirindex->count;
+  char line[STR_SIZE];
+
+  while (lo < hi) {
+    guint64 mid = lo + (hi - lo) / 2;
+    guint64 offset = dirindex_line_offset(dirindex, mid);
+
+    if (offset == 0 ||
+	dirindex_read_line(dirindex, offset, line, SIZEOF(line)) == 0)
+      return FALSE;
+
+    if (strcmp(line, key) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  *result = lo;
+  return TRUE;
+}
+
+int
+dirindex_ls(
+    dirindex_t *dirindex,
+    const char *dir_slash,
+    int		recursive,
+    void	(*func)(const char *path, gpointer user_data),
+    gpointer	user_data)
+{
+  size_t len_dir_slash = strlen(dir_slash);
+  char line[STR_SIZE];
+  guint64 n, offset = 0, next;
+
+  if (!dirindex_lower_bound(dirindex, dir_slash, &n))
+    return -1;
+  if (n < dirindex->count && (offset = dirindex_line_offset(dirindex, n)) == 0)
+    return -1;
+
+  while (n < dirindex->count) {
+    next = dirindex_read_line(dirindex, offset, line, SIZEOF(line));
+    if (next == 0)
+      return -1;
+    if (strncmp(line, dir_slash, len_dir_slash) != 0)
+      break;
+
+    if (!recursive) {
+      char *slash = strchr(line + len_dir_slash, '/');
+
+      if (slash != NULL) {
+	/* report the subdirectory, then skip everything under it: '0' is the
+	 * character after '/', so "sub0" sorts after all of "sub/..." */
+	slash[1] = '\0';
+	func(line, user_data);
+	slash[0] = '0';
+	if (!dirindex_lower_bound(dirindex, line, &n))
+	  return -1;
+	if (n < dirindex->count &&
+	    (offset = dirindex_line_offset(dirindex, n)) == 0)
+	  return -1;
+	continue;
+      }
+    }
+
+    func(line, user_data);
+    n++;
+    offset = next;
+  }
+
+  return 0;
+}
+
+int
+dirindex_has_prefix(
+    dirindex_t *dirindex,
+    const char *prefix)
+{
+  char line[STR_SIZE];
+  guint64 n, offset;
+
+  if (!dirindex_lower_bound(dirindex, prefix, &n))
+    return -1;
+  if (n >= dirindex->count)
+    return 0;
+  if ((offset = dirindex_line_offset(dirindex, n)) == 0 ||
+      dirindex_read_line(dirindex, offset, line, SIZEOF(line)) == 0)
+    return -1;
+
+  return strncmp(line, prefix, strlen(prefix)) == 0;
+}
+
+/*
+ * Return the directory index for an index file, or NULL if there is none.
+ * If filename, the uncompressed and sorted index, is given, the directory
+ * index is built from it when it is missing or older than the index file.
+ * The directory index is kept alongside the index file, so amtrmidx removes
+ * it along with the index.
+ */
+dirindex_t *
+get_dirindex(
+    const char *filename_gz,
+    const char *filename)
+{
+  char *dirindex_name;
+  size_t len;
+  struct stat stat_gz, stat_dirindex;
+  dirindex_t *dirindex = NULL;
+
+  dirindex_name = stralloc(filename_gz);
+  len = strlen(dirindex_name);
+  if (len > 3 && strcmp(&(dirindex_name[len-3]), ".gz") == 0) {
+    dirindex_name[len-3] = '\0';
+  } else if (len > 2 && strcmp(&(dirindex_name[len-2]), ".Z") == 0) {
+    dirindex_name[len-2] = '\0';
+  }
+  dirindex_name = newstralloc2(dirindex_name, dirindex_name, ".dirindex");
+
+  if (stat(filename_gz, &stat_gz) == 0 &&
+      stat(dirindex_name, &stat_dirindex) == 0 &&
+      stat_dirindex.st_mtime >= stat_gz.st_mtime) {
+    dirindex = open_dirindex(dirindex_name);
+  }
+
+  if (dirindex == NULL && filename != NULL) {
+    dbprintf(_("building directory index %s\n"), dirindex_name);
+    if (write_dirindex(filename, dirindex_name))
+      dirindex = open_dirindex(dirindex_name);
+  }
+
+  amfree(dirindex_name);
+  return dirindex;
+}
+
+int
+index_ls(
+    const char *filename,
+    const char *dir_slash,
+    int		recursive,
+    void	(*func)(const char *path, gpointer user_data),
+    gpointer	user_data)
+{
+  char line[STR_SIZE], old_line[STR_SIZE];
+  size_t len_dir_slash = strlen(dir_slash);
+  FILE *fp;
+  char *s;
+  int ch;
+
+  if ((fp = fopen(filename, "r")) == NULL)
+    return -1;
+
+  old_line[0] = '\0';
+  while (fgets(line, STR_SIZE, fp) != NULL) {
+    if (line[0] != '\0') {
+      if (line[strlen(line)-1] == '\n')
+	line[strlen(line)-1] = '\0';
+      if (strncmp(dir_slash, line, len_dir_slash) == 0) {
+	if (!recursive) {
+	  s = line + len_dir_slash;
+	  ch = *s++;
+	  while (ch && ch != '/')
+	    ch = *s++;		/* find end of the file name */
+	  if (ch == '/') {
+	    ch = *s++;
+	  }
+	  s[-1] = '\0';
+	}
+	if (strcmp(line, old_line) != 0) {
+	  func(line, user_data);
+	  strcpy(old_line, line);
+	}
+      }
+    }
+  }
+  afclose(fp);
+  return 0;
+}
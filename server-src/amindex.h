@@ -38,4 +38,42 @@
 char *getindexfname(char *host, char *disk, char *date, int level);
 char *getoldindexfname(char *host, char *disk, char *date, int level);
 
+/* A directory index is a seekable form of a sorted, uncompressed backup
+ * index, which allows the entries under one directory to be listed without
+ * reading the whole index. */
+typedef struct dirindex_s dirindex_t;
+
+/* Write a directory index from the sorted index text in sorted_name.  Returns
+ * FALSE, and leaves no file behind, if that cannot be done (including if the
+ * text is not sorted); the reason is logged to the debug file. */
+gboolean write_dirindex(const char *sorted_name, const char *dirindex_name);
+
+/* Open a directory index, returning NULL if it is missing or invalid. */
+dirindex_t *open_dirindex(const char *dirindex_name);
+void close_dirindex(dirindex_t *dirindex);
+
+/* Call func for each entry under dir_slash (a directory name ending in '/');
+ * if not recursive, entries below a subdirectory are collapsed into a single
+ * entry for the subdirectory, ending in '/'.  Returns -1 on a read error. */
+int dirindex_ls(dirindex_t *dirindex, const char *dir_slash, int recursive,
+		void (*func)(const char *path, gpointer user_data),
+		gpointer user_data);
+
+/* Returns 1 if any entry starts with prefix, 0 if not, and -1 on error. */
+int dirindex_has_prefix(dirindex_t *dirindex, const char *prefix);
+
+/* Return the directory index kept alongside the index file filename_gz, or
+ * NULL if there is none.  If filename, the uncompressed and sorted index, is
+ * given, the directory index is built from it when it is missing, invalid,
+ * or older than the index file. */
+dirindex_t *get_dirindex(const char *filename_gz, const char *filename);
+
+/* List the entries under dir_slash as dirindex_ls does, but by scanning the
+ * sorted index text in filename; this is the fallback when there is no
+ * directory index.  Returns -1, with errno set, if the file cannot be
+ * opened. */
+int index_ls(const char *filename, const char *dir_slash, int recursive,
+	     void (*func)(const char *path, gpointer user_data),
+	     gpointer user_data);
+
 #endif /* AMINDEX_H */
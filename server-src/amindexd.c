@@ -389,6 +389,15 @@ uncompress_file(
     return filename;
 }
 
+/* a callback for dirindex_ls */
+static void
+add_dir_list_item_fn(
+    const char *path,
+    gpointer	dump_item)
+{
+    add_dir_list_item((DUMP_ITEM *)dump_item, path);
+}
+
 /* find all matching entries in a dump listing */
 /* return -1 if error */
 static int
@@ -398,16 +407,11 @@ process_ls_dump(
     int		recursive,
     GPtrArray **emsg)
 {
-    char line[STR_SIZE], old_line[STR_SIZE];
     char *filename = NULL;
     char *filename_gz;
     char *dir_slash = NULL;
-    FILE *fp;
-    char *s;
-    int ch;
-    size_t len_dir_slash;
+    dirindex_t *dirindex;
 
-    old_line[0] = '\0';
     if (strcmp(dir, "/") == 0) {
 	dir_slash = stralloc(dir);
     } else {
@@ -421,46 +425,37 @@ process_ls_dump(
 	amfree(filename_gz);
 	return -1;
     }
-    filename = uncompress_file(filename_gz, emsg);
-    if(filename == NULL) {
-	amfree(filename_gz);
-	amfree(dir_slash);
-	return -1;
+    /* use the directory index if there is one, building it if not */
+    dirindex = get_dirindex(filename_gz, NULL);
+    if (dirindex == NULL) {
+	filename = uncompress_file(filename_gz, emsg);
+	if(filename == NULL) {
+	    amfree(filename_gz);
+	    amfree(dir_slash);
+	    return -1;
+	}
+	dirindex = get_dirindex(filename_gz, filename);
     }
     amfree(filename_gz);
 
-    if((fp = fopen(filename,"r"))==0) {
-	g_ptr_array_add(*emsg, vstrallocf("%s", strerror(errno)));
+    if (dirindex != NULL) {
+	int result = dirindex_ls(dirindex, dir_slash, recursive,
+				 add_dir_list_item_fn, dump_item);
+	close_dirindex(dirindex);
+	if (result == -1)
+	    g_ptr_array_add(*emsg, stralloc(_("error reading directory index")));
+	amfree(filename);
 	amfree(dir_slash);
-        amfree(filename);
-	return -1;
+	return result;
     }
 
-    len_dir_slash=strlen(dir_slash);
-
-    while (fgets(line, STR_SIZE, fp) != NULL) {
-	if (line[0] != '\0') {
-	    if(line[strlen(line)-1] == '\n')
-		line[strlen(line)-1] = '\0';
-	    if(strncmp(dir_slash, line, len_dir_slash) == 0) {
-		if(!recursive) {
-		    s = line + len_dir_slash;
-		    ch = *s++;
-		    while(ch && ch != '/')
-			ch = *s++;/* find end of the file name */
-		    if(ch == '/') {
-			ch = *s++;
-		    }
-		    s[-1] = '\0';
-		}
-		if(strcmp(line, old_line) != 0) {
-		    add_dir_list_item(dump_item, line);
-		    strcpy(old_line, line);
-		}
-	    }
-	}
+    if (index_ls(filename, dir_slash, recursive,
+		 add_dir_list_item_fn, dump_item) == -1) {
+	g_ptr_array_add(*emsg, vstrallocf("%s", strerror(errno)));
+	amfree(dir_slash);
+	amfree(filename);
+	return -1;
     }
-    afclose(fp);
     amfree(filename);
     amfree(dir_slash);
     return 0;
@@ -874,6 +869,7 @@ is_dir_valid_opaque(
     char *filename = NULL;
     size_t ldir_len;
     GPtrArray *emsg = NULL;
+    dirindex_t *dirindex;
 
     if (get_config_name() == NULL || dump_hostname == NULL || disk_name == NULL) {
 	reply(502, _("Must set config,host,disk before asking about directories"));
@@ -921,16 +917,36 @@ is_dir_valid_opaque(
 	    amfree(ldir);
 	    return -1;
 	}
-	emsg = g_ptr_array_new();
-	if((filename = uncompress_file(filename_gz, &emsg)) == NULL) {
-	    reply_ptr_array(599, emsg);
-	    amfree(filename_gz);
+	dirindex = get_dirindex(filename_gz, NULL);
+	if (dirindex == NULL) {
+	    emsg = g_ptr_array_new();
+	    if((filename = uncompress_file(filename_gz, &emsg)) == NULL) {
+		reply_ptr_array(599, emsg);
+		amfree(filename_gz);
+		g_ptr_array_free_full(emsg);
+		amfree(ldir);
+		return -1;
+	    }
 	    g_ptr_array_free_full(emsg);
-	    amfree(ldir);
-	    return -1;
+	    dirindex = get_dirindex(filename_gz, filename);
 	}
-	g_ptr_array_free_full(emsg);
 	amfree(filename_gz);
+	if (dirindex != NULL) {
+	    int found = dirindex_has_prefix(dirindex, ldir);
+	    close_dirindex(dirindex);
+	    if (found == -1) {
+		reply(599, _("System error: error reading directory index"));
+		amfree(filename);
+		amfree(ldir);
+		return -1;
+	    }
+	    if (found) {
+		amfree(filename);
+		amfree(ldir);
+		return 0;
+	    }
+	    goto next_level;
+	}
 	dbprintf("f %s\n", filename);
 	if ((fp = fopen(filename, "r")) == NULL) {
 	    reply(599, _("System error: %s"), strerror(errno));
@@ -953,6 +969,7 @@ is_dir_valid_opaque(
 	}
 	afclose(fp);
 
+next_level:
 	last_level = item->level;
 	do
 	{
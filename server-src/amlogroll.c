@@ -33,6 +33,7 @@
 #include "amanda.h"
 #include "conffile.h"
 #include "logfile.h"
+#include "find.h"
 
 char *datestamp;
 
@@ -114,7 +115,11 @@ main(
     }
     afclose(logfile);
  
-    log_rename(datestamp);
+    logfname = log_rename(datestamp);
+
+    /* add the closed log to the dump catalog */
+    find_catalog_add_logfile(logfname);
+    amfree(logfname);
 
     amfree(datestamp);
 
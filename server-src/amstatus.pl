@@ -436,7 +436,9 @@ while($lineX = <AMDUMP>) {
 					$status_taper = $error;
 				}
 				elsif($line[6] eq "FILE-WRITE") {
-					#7:handle 8:filename 9:host 10:disk 11:level 12:datestamp 13:splitsize
+					#7:worker 8:handle 9:filename 10:host 11:disk 12:level 13:datestamp 14:splitsize
+					# (older logs have no worker)
+					splice(@line, 7, 1) if $line[7] =~ /^\d+$/;
 					$serial=$line[7];
 					$host=$line[9];
 					$partition=$line[10];
@@ -458,7 +460,9 @@ while($lineX = <AMDUMP>) {
 					$ntchunk_size = 0;
 				}
 				elsif($line[6] eq "PORT-WRITE") {
-					#7:handle 8:host 9:disk 10:level 11:datestamp 12:splitsize 13:diskbuffer 14:fallback_splitsize
+					#7:worker 8:handle 9:host 10:disk 11:level 12:datestamp 13:splitsize 14:diskbuffer 15:fallback_splitsize
+					# (older logs have no worker)
+					splice(@line, 7, 1) if $line[7] =~ /^\d+$/;
 					$serial=$line[7];
 					$host=$line[8];
 					$partition=$line[9];
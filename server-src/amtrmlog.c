@@ -197,6 +197,10 @@ main(
 	}
     }
     closedir(dir);
+
+    /* forget the logfiles that are gone from the dump catalog */
+    find_catalog_compact();
+
     for (name = output_find_log; *name != NULL; name++) {
 	amfree(*name);
     }
@@ -62,6 +62,15 @@
 
 #define STARTUP_TIMEOUT 60
 
+/* alignment of the write buffers and of O_DIRECT writes */
+#define WRITE_ALIGN 4096
+
+/*
+ * Data is collected in one of two large buffers while the other one is
+ * written to the holding disk by a writer thread.  Everything else --
+ * splitting and the protocol with the driver -- stays in the main thread,
+ * which waits for the outstanding write before looking at dumpsize.
+ */
 struct databuf {
     int fd;			/* file to flush to */
     char *filename;		/* name of what fd points to */
@@ -69,10 +78,32 @@ struct databuf {
     off_t split_size;		/* when to chunk */
     off_t chunk_size;		/* size of each chunk */
     off_t use;			/* size to use on this disk */
-    char buf[DISK_BLOCK_BYTES];
+    size_t bufsize;		/* size of each buffer */
+    char *bufspace;		/* allocation holding both buffers */
+    char *buf[2];		/* the buffers, aligned to WRITE_ALIGN */
+    int cur;			/* index of the buffer being filled */
     char *datain;		/* data buffer markers */
     char *dataout;
     char *datalimit;
+    char *prevout;		/* unwritten data in the other buffer */
+    char *previn;
+    gboolean direct;		/* direct-io is set for this holding disk */
+    gboolean direct_file;	/* O_DIRECT may still be used on fd */
+    gboolean direct_on;		/* O_DIRECT is set on fd */
+    times_t write_time;		/* time spent writing data */
+
+    /* writer thread; the w* fields are protected by mutex */
+    GThread *writer;
+    GMutex *mutex;
+    GCond *cond;
+    gboolean busy;		/* (main thread) a write is outstanding */
+    gboolean wqueued;		/* the writer has a write to do */
+    gboolean wquit;		/* the writer should exit */
+    int wfd;
+    char *wdata;
+    size_t wsize;
+    size_t wwritten;
+    int werrno;
 };
 
 static char *handle = NULL;
@@ -100,6 +131,16 @@ static dumpfile_t file;
 int main(int, char **);
 static ssize_t write_tapeheader(int, dumpfile_t *);
 static void databuf_init(struct databuf *, int, char *, off_t, off_t);
+static void databuf_free(struct databuf *);
+static void databuf_holdingdisk(struct databuf *, size_t *);
+static gpointer databuf_writer(gpointer);
+static size_t databuf_write(struct databuf *, int, char *, size_t);
+static size_t databuf_wait(struct databuf *);
+static int databuf_written(struct databuf *, char **, size_t, size_t);
+static void databuf_direct(struct databuf *, char *, size_t);
+static void databuf_prealloc(struct databuf *, off_t);
+static void databuf_trim(int);
+static int databuf_pending(struct databuf *);
 static int databuf_flush(struct databuf *);
 
 static int startup_chunker(char *, off_t, off_t, struct databuf *);
@@ -139,6 +180,9 @@ main(
 
     dbopen(DBG_SUBDIR_SERVER);
 
+    /* holding disk writes are done by a thread */
+    glib_init();
+
     /* Don't die when child closes pipe */
     signal(SIGPIPE, SIG_IGN);
 
@@ -303,16 +347,21 @@ main(
 	    if(infd >= 0 && do_chunk(infd, &db)) {
 		char kb_str[NUM_STR_SIZE];
 		char kps_str[NUM_STR_SIZE];
-		double rt;
+		char wkps_str[NUM_STR_SIZE];
+		double rt, wt;
 
 		runtime = stopclock();
                 rt = g_timeval_to_double(runtime);
+		wt = g_timeval_to_double(db.write_time);
 		g_snprintf(kb_str, SIZEOF(kb_str), "%lld",
 			 (long long)(dumpsize - (off_t)headersize));
 		g_snprintf(kps_str, SIZEOF(kps_str), "%3.1lf",
 				isnormal(rt) ? (double)dumpsize / rt : 0.0);
-		errstr = newvstrallocf(errstr, "sec %s kb %s kps %s",
-				walltime_str(runtime), kb_str, kps_str);
+		/* the rate at which the holding disk took the data */
+		g_snprintf(wkps_str, SIZEOF(wkps_str), "%3.1lf",
+				isnormal(wt) ? (double)(dumpsize - (off_t)headersize) / wt : 0.0);
+		errstr = newvstrallocf(errstr, "sec %s kb %s kps %s wkps %s",
+				walltime_str(runtime), kb_str, kps_str, wkps_str);
 		m = vstrallocf("[%s]", errstr);
 		q = quote_string(m);
 		amfree(m);
@@ -367,6 +416,7 @@ main(
 			hostname, qdiskname, chunker_timestamp, level, errstr);
 		amfree(q);
 	    }
+	    databuf_free(&db);
 	    amfree(filename);
 	    amfree(db.filename);
 	    break;
@@ -431,7 +481,7 @@ startup_chunker(
 	return -1;
     }
     data_socket = stream_server(res->ai_family, &data_port, 0,
-				STREAM_BUFSIZE, 0);
+				STREAM_BUFSIZE_LARGE, 0);
     if (res) freeaddrinfo(res);
 
     if(data_socket < 0) {
@@ -441,7 +491,7 @@ startup_chunker(
 
     putresult(PORT, "%d\n", data_port);
 
-    infd = stream_accept(data_socket, CONNECT_TIMEOUT, 0, STREAM_BUFSIZE);
+    infd = stream_accept(data_socket, CONNECT_TIMEOUT, 0, STREAM_BUFSIZE_LARGE);
     aclose(data_socket);
     if(infd == -1) {
 	errstr = vstrallocf(_("error accepting stream: %s"), strerror(errno));
@@ -528,7 +578,7 @@ do_chunk(
      * We've written the file header.  Now, just write data until the
      * end.
      */
-    while ((nread = full_read(infd, db->buf,
+    while ((nread = full_read(infd, db->datain,
 			     (size_t)(db->datalimit - db->datain))) > 0) {
 	db->datain += nread;
 	while(db->dataout < db->datain) {
@@ -537,11 +587,12 @@ do_chunk(
 	    }
 	}
     }
-    while(db->dataout < db->datain) {
+    while(databuf_pending(db)) {
 	if(!databuf_flush(db)) {
 	    return 0;
 	}
     }
+    databuf_trim(db->fd);
     if(dumpbytes > (off_t)0) {
 	dumpsize += (off_t)1;			/* count partial final KByte */
 	filesize += (off_t)1;
@@ -560,14 +611,327 @@ databuf_init(
     off_t		use,
     off_t		chunk_size)
 {
+    GError *err = NULL;
+
     db->fd = fd;
     db->filename = stralloc(filename);
     db->filename_seq = (off_t)0;
     db->chunk_size = chunk_size;
     db->split_size = (db->chunk_size > use) ? use : db->chunk_size;
     db->use = (use > db->split_size) ? use - db->split_size : (off_t)0;
-    db->datain = db->dataout = db->buf;
-    db->datalimit = db->buf + SIZEOF(db->buf);
+
+    db->bufsize = DISK_BLOCK_BYTES;
+    databuf_holdingdisk(db, &db->bufsize);
+    db->direct_file = db->direct;
+    db->direct_on = FALSE;
+    db->bufspace = alloc(2 * db->bufsize + WRITE_ALIGN);
+    db->buf[0] = (char *)(((gsize)db->bufspace + WRITE_ALIGN - 1)
+			  & ~(gsize)(WRITE_ALIGN - 1));
+    db->buf[1] = db->buf[0] + db->bufsize;
+    db->cur = 0;
+    db->datain = db->dataout = db->buf[0];
+    db->datalimit = db->buf[0] + db->bufsize;
+    db->prevout = db->previn = db->buf[1];
+    db->write_time.tv_sec = db->write_time.tv_usec = 0;
+
+    db->mutex = g_mutex_new();
+    db->cond = g_cond_new();
+    db->busy = db->wqueued = db->wquit = FALSE;
+    db->writer = g_thread_create(databuf_writer, (gpointer)db, TRUE, &err);
+    if (!db->writer) {
+	error(_("could not start the holding disk writer: %s"),
+	      err? err->message : _("(unknown error)"));
+	/*NOTREACHED*/
+    }
+
+    databuf_prealloc(db, db->split_size);
+}
+
+/*
+ * Stop the writer thread, release the buffers and close the file.
+ */
+static void
+databuf_free(
+    struct databuf *	db)
+{
+    if (!db->writer)
+	return;
+
+    if (db->busy)
+	(void)databuf_wait(db);
+    g_mutex_lock(db->mutex);
+    db->wquit = TRUE;
+    g_cond_broadcast(db->cond);
+    g_mutex_unlock(db->mutex);
+    g_thread_join(db->writer);
+    db->writer = NULL;
+    g_mutex_free(db->mutex);
+    g_cond_free(db->cond);
+    amfree(db->bufspace);
+
+    if (db->fd >= 0)
+	aclose(db->fd);
+}
+
+/*
+ * Look up the holding disk that db->filename is on, and take its
+ * direct-io setting and, if bufsize is not NULL, its write-buffer-size.
+ */
+static void
+databuf_holdingdisk(
+    struct databuf *	db,
+    size_t *		bufsize)
+{
+    GSList *hl;
+
+    db->direct = FALSE;
+    for (hl = getconf_holdingdisks(); hl != NULL; hl = hl->next) {
+	holdingdisk_t *hdisk = hl->data;
+	char *diskdir = holdingdisk_get_diskdir(hdisk);
+	size_t len = strlen(diskdir);
+
+	if (len == 0 || strncmp(db->filename, diskdir, len) != 0 ||
+	    (db->filename[len] != '/' && diskdir[len-1] != '/'))
+	    continue;
+
+	db->direct = holdingdisk_get_direct_io(hdisk);
+	if (bufsize)
+	    *bufsize = (size_t)holdingdisk_get_write_buffer_size(hdisk) * 1024;
+	break;
+    }
+#ifndef O_DIRECT
+    db->direct = FALSE;
+#endif
+    chunker_debug(1, _("holding file %s: direct-io %s\n"),
+		  db->filename, db->direct? "yes" : "no");
+}
+
+
+/*
+ * The writer thread: write whatever the main thread hands it, one
+ * buffer at a time.
+ */
+static gpointer
+databuf_writer(
+    gpointer	data)
+{
+    struct databuf *db = (struct databuf *)data;
+    size_t written;
+    int save_errno;
+
+    g_mutex_lock(db->mutex);
+    while (1) {
+	while (!db->wqueued && !db->wquit)
+	    g_cond_wait(db->cond, db->mutex);
+	if (!db->wqueued)
+	    break;
+	g_mutex_unlock(db->mutex);
+
+	written = databuf_write(db, db->wfd, db->wdata, db->wsize);
+	save_errno = errno;
+
+	g_mutex_lock(db->mutex);
+	db->wwritten = written;
+	db->werrno = save_errno;
+	db->wqueued = FALSE;
+	g_cond_broadcast(db->cond);
+    }
+    g_mutex_unlock(db->mutex);
+
+    return NULL;
+}
+
+/*
+ * Write data to fd, adding the time it took to db->write_time.  Only one
+ * thread writes at a time, so write_time and the O_DIRECT state need no
+ * lock.
+ */
+static size_t
+databuf_write(
+    struct databuf *	db,
+    int			fd,
+    char *		data,
+    size_t		size)
+{
+    GTimeVal start, end;
+    size_t written;
+    int save_errno;
+
+    g_get_current_time(&start);
+    errno = 0;
+    written = full_write(fd, data, size);
+#ifdef O_DIRECT
+    if (written < size && errno == EINVAL && db->direct_on) {
+	/* the file system would not take it; go through the page cache */
+	db->direct = db->direct_file = FALSE;
+	databuf_direct(db, NULL, 0);
+	errno = 0;
+	written += full_write(fd, data + written, size - written);
+    }
+#endif
+    save_errno = errno;
+    g_get_current_time(&end);
+    db->write_time = timesadd(db->write_time, timessub(end, start));
+    errno = save_errno;
+
+    return written;
+}
+
+/*
+ * Wait for the writer thread to finish the outstanding write.  Returns
+ * the number of bytes written, with errno set as the write left it.
+ */
+static size_t
+databuf_wait(
+    struct databuf *	db)
+{
+    size_t written;
+    int save_errno;
+
+    g_mutex_lock(db->mutex);
+    while (db->wqueued)
+	g_cond_wait(db->cond, db->mutex);
+    written = db->wwritten;
+    save_errno = db->werrno;
+    g_mutex_unlock(db->mutex);
+    db->busy = FALSE;
+
+    errno = save_errno;
+    return written;
+}
+
+/*
+ * Account for a write of size_to_write bytes from *dataout, of which
+ * written made it to disk; errno is as the write left it.  A short write
+ * for lack of space is reported to the driver and the rest of the data
+ * is kept for the next holding disk.  Returns 0 on any other error.
+ */
+static int
+databuf_written(
+    struct databuf *	db,
+    char **		dataout,
+    size_t		size_to_write,
+    size_t		written)
+{
+    int save_errno = errno;
+
+    if (written > 0) {
+	*dataout += written;
+	dumpbytes += (off_t)written;
+    }
+    dumpsize += (dumpbytes / (off_t)1024);
+    filesize += (dumpbytes / (off_t)1024);
+    dumpbytes %= 1024;
+    if (written < size_to_write) {
+	if (save_errno != ENOSPC) {
+	    char *m = vstrallocf(_("data write: %s"), strerror(save_errno));
+	    errstr = quote_string(m);
+	    amfree(m);
+	    return 0;
+	}
+
+	/*
+	 * NO-ROOM is informational only.  Later, RQ_MORE_DISK will be
+	 * issued to use another holding disk.
+	 */
+	putresult(NO_ROOM, "%s %lld\n", handle,
+		  (long long)(db->use+db->split_size-dumpsize));
+	db->use = (off_t)0;				/* force RQ_MORE_DISK */
+	db->split_size = dumpsize;
+	db->direct_file = FALSE;	/* the file offset is no longer aligned */
+    }
+    return 1;
+}
+
+/*
+ * Set or clear O_DIRECT on db->fd for a write of size bytes from data.
+ * O_DIRECT needs aligned buffers, sizes and file offsets, so once an
+ * unaligned write goes to a file, the rest of that file is written
+ * through the page cache.
+ */
+static void
+databuf_direct(
+    struct databuf *	db,
+    char *		data,
+    size_t		size)
+{
+#ifdef O_DIRECT
+    gboolean want;
+    int flags;
+
+    if (((gsize)data % WRITE_ALIGN) != 0 || (size % WRITE_ALIGN) != 0)
+	db->direct_file = FALSE;
+    want = db->direct_file;
+    if (want == db->direct_on)
+	return;
+
+    flags = fcntl(db->fd, F_GETFL);
+    if (flags == -1 ||
+	fcntl(db->fd, F_SETFL, want? flags | O_DIRECT : flags & ~O_DIRECT) == -1) {
+	chunker_debug(1, _("could not %s O_DIRECT on %s: %s\n"),
+		      want? "set" : "clear", db->filename, strerror(errno));
+	if (want) {
+	    db->direct = db->direct_file = FALSE;
+	}
+	return;
+    }
+    db->direct_on = want;
+#else
+    (void)db;	/* Quiet unused parameter warning */
+    (void)data;	/* Quiet unused parameter warning */
+    (void)size;	/* Quiet unused parameter warning */
+#endif
+}
+
+/*
+ * Preallocate kbytes of space for the file just opened on db->fd, so a
+ * chunk is laid out contiguously on the holding disk.  The file size is
+ * left alone; this is only a hint, and failures are ignored.
+ */
+static void
+databuf_prealloc(
+    struct databuf *	db,
+    off_t		kbytes)
+{
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+    if (kbytes <= (off_t)0)
+	return;
+    if (fallocate(db->fd, FALLOC_FL_KEEP_SIZE, (off_t)0,
+		  kbytes * (off_t)1024) == -1) {
+	chunker_debug(1, _("fallocate %s: %s\n"), db->filename, strerror(errno));
+    }
+#else
+    (void)db;		/* Quiet unused parameter warning */
+    (void)kbytes;	/* Quiet unused parameter warning */
+#endif
+}
+
+/*
+ * Give back the space preallocated past the end of a finished file.
+ */
+static void
+databuf_trim(
+    int		fd)
+{
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE)
+    struct stat sbuf;
+
+    if (fstat(fd, &sbuf) == 0 && ftruncate(fd, sbuf.st_size) == -1) {
+	chunker_debug(1, _("ftruncate: %s\n"), strerror(errno));
+    }
+#else
+    (void)fd;	/* Quiet unused parameter warning */
+#endif
+}
+
+/*
+ * Is there data that has not yet been written out?
+ */
+static int
+databuf_pending(
+    struct databuf *	db)
+{
+    return db->busy || db->prevout < db->previn || db->dataout < db->datain;
 }
 
 
@@ -583,6 +947,9 @@ databuf_flush(
     size_t size_to_write;
     size_t written;
     off_t left_in_chunk;
+    off_t room;
+    char **dataout;
+    char *datain;
     char *arg_filename = NULL;
     char *new_filename = NULL;
     char *tmp_filename = NULL;
@@ -593,10 +960,34 @@ databuf_flush(
     int a;
     char *pc;
 
+    /*
+     * Collect the write the writer thread is doing; dumpsize has to be
+     * exact, and the file quiet, before we think about splitting.
+     */
+    if (db->busy) {
+	written = databuf_wait(db);
+	if (!databuf_written(db, &db->prevout,
+			     (size_t)(db->previn - db->prevout), written)) {
+	    rc = 0;
+	    goto common_exit;
+	}
+    }
+
+    /*
+     * Whatever a short write left in the other buffer goes first.
+     */
+    if (db->prevout < db->previn) {
+	dataout = &db->prevout;
+	datain = db->previn;
+    } else {
+	dataout = &db->dataout;
+	datain = db->datain;
+    }
+
     /*
      * If there's no data, do nothing.
      */
-    if (db->dataout >= db->datain) {
+    if (*dataout >= datain) {
 	goto common_exit;
     }
 
@@ -675,6 +1066,7 @@ databuf_flush(
 		     * Different disk, so use new file.
 		     */
 		    db->filename = newstralloc(db->filename, arg_filename);
+		    databuf_holdingdisk(db, NULL);
 		}
 	    } else if(cmdargs->cmd == ABORT) {
 		abort_pending = 1;
@@ -765,6 +1157,8 @@ databuf_flush(
 	 * Now, update the header of the current file to point
 	 * to the next chunk, and then close it.
 	 */
+	db->direct_file = FALSE;
+	databuf_direct(db, NULL, 0);
 	if (lseek(db->fd, (off_t)0, SEEK_SET) < (off_t)0) {
 	    char *m = vstrallocf(_("lseek holding file %s: %s"),
 			     db->filename,
@@ -795,9 +1189,12 @@ databuf_flush(
 	/*
 	 * Now shift the file descriptor.
 	 */
+	databuf_trim(db->fd);
 	aclose(db->fd);
 	db->fd = newfd;
 	newfd = -1;
+	db->direct_file = db->direct;
+	db->direct_on = FALSE;
 
 	/*
 	 * Update when we need to chunk again
@@ -816,7 +1213,7 @@ databuf_flush(
 	    db->split_size += db->chunk_size;
 	    db->use -= db->chunk_size;
 	}
-
+	databuf_prealloc(db, db->split_size - dumpsize);
 
 	amfree(tmp_filename);
 	amfree(new_filename);
@@ -827,41 +1224,56 @@ databuf_flush(
     }
 
     /*
-     * Write out the buffer
+     * Write out no more than fits before the next split.  With the
+     * buffer this large, overshooting would make the chunk noticeably
+     * bigger than chunksize; if we are already at the split point
+     * (CONTINUE gave us no more room), overshoot by a block as before.
      */
-    size_to_write = (size_t)(db->datain - db->dataout);
-    written = full_write(db->fd, db->dataout, size_to_write);
-    if (written > 0) {
-	db->dataout += written;
-	dumpbytes += (off_t)written;
+    size_to_write = (size_t)(datain - *dataout);
+    if (db->split_size > (off_t)0) {
+	room = (db->split_size - dumpsize) * (off_t)1024 - dumpbytes;
+	if (room <= (off_t)0)
+	    room = (off_t)DISK_BLOCK_BYTES;
+	if ((off_t)size_to_write > room)
+	    size_to_write = (size_t)room;
     }
-    dumpsize += (dumpbytes / (off_t)1024);
-    filesize += (dumpbytes / (off_t)1024);
-    dumpbytes %= 1024;
-    if (written < size_to_write) {
-	if (errno != ENOSPC) {
-	    char *m = vstrallocf(_("data write: %s"), strerror(errno));
-	    errstr = quote_string(m);
-	    amfree(m);
-	    rc = 0;
-	    goto common_exit;
-	}
+    databuf_direct(db, *dataout, size_to_write);
 
+    if (dataout == &db->dataout && *dataout + size_to_write == datain) {
 	/*
-	 * NO-ROOM is informational only.  Later, RQ_MORE_DISK will be
-	 * issued to use another holding disk.
+	 * Hand the rest of this buffer to the writer thread, and fill
+	 * the other one meanwhile.
 	 */
-	putresult(NO_ROOM, "%s %lld\n", handle,
-		  (long long)(db->use+db->split_size-dumpsize));
-	db->use = (off_t)0;				/* force RQ_MORE_DISK */
-	db->split_size = dumpsize;
+	db->prevout = db->dataout;
+	db->previn = db->datain;
+	g_mutex_lock(db->mutex);
+	db->wfd = db->fd;
+	db->wdata = db->prevout;
+	db->wsize = size_to_write;
+	db->wqueued = TRUE;
+	g_cond_broadcast(db->cond);
+	g_mutex_unlock(db->mutex);
+	db->busy = TRUE;
+
+	db->cur = 1 - db->cur;
+	db->datain = db->dataout = db->buf[db->cur];
+	db->datalimit = db->buf[db->cur] + db->bufsize;
+	goto common_exit;
+    }
+
+    /*
+     * A split point or a short write is near; write synchronously.
+     */
+    written = databuf_write(db, db->fd, *dataout, size_to_write);
+    if (!databuf_written(db, dataout, size_to_write, written)) {
+	rc = 0;
 	goto common_exit;
     }
     if (db->datain == db->dataout) {
 	/*
 	 * We flushed the whole buffer so reset to use it all.
 	 */
-	db->datain = db->dataout = db->buf;
+	db->datain = db->dataout = db->buf[db->cur];
     }
 
 common_exit:
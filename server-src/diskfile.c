@@ -39,8 +39,22 @@
 static am_host_t *hostlist;
 static netif_t *all_netifs;
 
+/* Indexes over hostlist and the hosts' disk lists, so that lookup_host and
+ * lookup_disk need not walk them.  host_index maps hostnames, without regard
+ * to case, to am_host_t; disk_index maps disk_key_t to disk_t. */
+static GHashTable *host_index;
+static GHashTable *disk_index;
+
+typedef struct disk_key_s {
+    am_host_t *host;
+    const char *name;
+} disk_key_t;
+
 /* local functions */
 static char *upcase(char *st);
+static void index_host(am_host_t *host);
+static void index_disk(disk_t *disk);
+static void free_indexes(void);
 static int parse_diskline(disklist_t *, const char *, FILE *, int *, char **);
 static void disk_parserror(const char *, int, const char *, ...)
 			    G_GNUC_PRINTF(3, 4);
@@ -57,6 +71,7 @@ read_diskfile(
 
     /* initialize */
     hostlist = NULL;
+    free_indexes();
     lst->head = lst->tail = NULL;
     line_num = 0;
 
@@ -88,16 +103,97 @@ end:
     return config_errors(NULL);
 }
 
+static guint
+host_hash(
+    gconstpointer key)
+{
+    const char *p;
+    guint h = 5381;
+
+    for (p = key; *p != '\0'; p++)
+	h = (h << 5) + h + (guint)g_ascii_tolower(*p);
+    return h;
+}
+
+static gboolean
+host_equal(
+    gconstpointer a,
+    gconstpointer b)
+{
+    return g_ascii_strcasecmp(a, b) == 0;
+}
+
+static guint
+disk_key_hash(
+    gconstpointer key)
+{
+    const disk_key_t *k = key;
+
+    return g_str_hash(k->name) ^ g_direct_hash(k->host);
+}
+
+static gboolean
+disk_key_equal(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const disk_key_t *ka = a, *kb = b;
+
+    return ka->host == kb->host && strcmp(ka->name, kb->name) == 0;
+}
+
+/* Add a newly-created host, already on hostlist, to host_index. */
+static void
+index_host(
+    am_host_t *host)
+{
+    if (!host_index)
+	host_index = g_hash_table_new(host_hash, host_equal);
+
+    g_hash_table_insert(host_index, host->hostname, host);
+}
+
+/* Add a disk, already linked onto its host's disk list, to disk_index. */
+static void
+index_disk(
+    disk_t *disk)
+{
+    disk_key_t *key;
+
+    if (!disk_index)
+	disk_index = g_hash_table_new_full(disk_key_hash, disk_key_equal,
+					   g_free, NULL);
+
+    key = g_new(disk_key_t, 1);
+    key->host = disk->host;
+    key->name = disk->name;
+
+    /* the host's disk list is kept newest-first, and lookup_disk always
+     * returned the first match on it */
+    g_hash_table_replace(disk_index, key, disk);
+}
+
+static void
+free_indexes(void)
+{
+    if (host_index) {
+	g_hash_table_destroy(host_index);
+	host_index = NULL;
+    }
+    if (disk_index) {
+	g_hash_table_destroy(disk_index);
+	disk_index = NULL;
+    }
+}
+
 am_host_t *
 lookup_host(
     const char *hostname)
 {
-    am_host_t *p;
+    if (!host_index)
+	return (NULL);
 
-    for (p = hostlist; p != NULL; p = p->next) {
-	if(strcasecmp(p->hostname, hostname) == 0) return p;
-    }
-    return (NULL);
+    return g_hash_table_lookup(host_index, hostname);
 }
 
 disk_t *
@@ -106,17 +202,15 @@ lookup_disk(
     const char *diskname)
 {
     am_host_t *host;
-    disk_t *disk;
+    disk_key_t key;
 
     host = lookup_host(hostname);
-    if (host == NULL)
+    if (host == NULL || !disk_index)
 	return (NULL);
 
-    for (disk = host->disks; disk != NULL; disk = disk->hostnext) {
-	if (strcmp(disk->name, diskname) == 0)
-	    return (disk);
-    }
-    return (NULL);
+    key.host = host;
+    key.name = diskname;
+    return g_hash_table_lookup(disk_index, &key);
 }
 
 
@@ -233,12 +327,14 @@ add_disk(
 	host->features = NULL;
 	host->pre_script = 0;
 	host->post_script = 0;
+	index_host(host);
     }
     enqueue_disk(list, disk);
 
     disk->host = host;
     disk->hostnext = host->disks;
     host->disks = disk;
+    index_disk(disk);
 
     return disk;
 }
@@ -350,6 +446,7 @@ free_disklist(
 	amfree(host);
     }
     hostlist=NULL;
+    free_indexes();
 
     for (netif = all_netifs; netif != NULL; netif = next_if) {
 	next_if = netif->next;
@@ -425,8 +522,10 @@ parse_diskline(
 	}
     }
 
+    /* a host already in the list was checked against the others when it was
+     * added */
     shost = sanitise_filename(hostname);
-    for (p = hostlist; p != NULL; p = p->next) {
+    for (p = host? NULL : hostlist; p != NULL; p = p->next) {
 	char *shostp = sanitise_filename(p->hostname);
 	if (strcmp(hostname, p->hostname) &&
 	    !strcmp(shost, shostp)) {
@@ -830,6 +929,7 @@ parse_diskline(
 	host->features = NULL;
 	host->pre_script = 0;
 	host->post_script = 0;
+	index_host(host);
     }
 
     host->netif = netif;
@@ -840,6 +940,7 @@ parse_diskline(
     disk->hostnext = host->disks;
     host->disks = disk;
     host->maxdumps = disk->maxdumps;
+    index_disk(disk);
 
     return (0);
 }
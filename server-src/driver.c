@@ -66,7 +66,6 @@ static disklist_t tapeq;	// dle on holding disk waiting to be written
 				//   to tape
 static disklist_t roomq;	// dle waiting for more space on holding disk
 static int pending_aborts;
-static disk_t *taper_disk;
 static int degraded_mode;
 static off_t reserved_space;
 static off_t total_disksize;
@@ -75,8 +74,10 @@ static char *chunker_program;
 static int  inparallel;
 static int nodump = 0;
 static off_t tape_length = (off_t)0;
-static off_t tape_left = (off_t)0;
 static int current_tape = 0;
+static int granted_tapes = 0;		// NEW-TAPE sent, but the taper has
+					//   not started the tape yet
+static int taper_parallel_write;
 static int conf_taperalgo;
 static int conf_runtapes;
 static time_t sleep_time;
@@ -122,6 +123,15 @@ static void handle_dumper_result(void *);
 static void handle_chunker_result(void *);
 static void handle_dumpers_time(void *);
 static void handle_taper_result(void *);
+static void process_taper_result(cmd_t cmd, int result_argc, char **result_argv);
+static void answer_tape_request(taper_t *taper_slot);
+static int retire_taper(taper_t *taper_slot);
+static taper_t *idle_taper(void);
+static taper_t *disk2taper(disk_t *dp);
+static int busy_tapers(void);
+static void taper_slot_free(taper_t *taper_slot);
+static void taper_slot_freed(void *cookie);
+static void directq_wakeup(void *cookie);
 
 static void holdingdisk_state(char *time_str);
 static dumper_t *idle_dumper(void);
@@ -143,7 +153,7 @@ typedef enum {
     TAPE_ACTION_START_A_FLUSH = (1 << 2)
 } TapeAction;
 
-static TapeAction tape_action(char **why_no_new_tape);
+static TapeAction tape_action(taper_t *taper_slot, char **why_no_new_tape);
 
 static const char *idle_strings[] = {
 #define NOT_IDLE		0
@@ -171,6 +181,8 @@ main(
     disk_t *diskp;
     int dsk;
     dumper_t *dumper;
+    taper_t *taper_slot;
+    event_handle_t *taper_slot_ev, *sleep_ev;
     char *newdir = NULL;
     struct fs_usage fsusage;
     holdingdisk_t *hdp;
@@ -317,6 +329,7 @@ main(
     /* set up any configuration-dependent variables */
 
     inparallel	= getconf_int(CNF_INPARALLEL);
+    taper_parallel_write = getconf_int(CNF_TAPER_PARALLEL_WRITE);
 
     reserve = (unsigned long)getconf_int(CNF_RESERVE);
 
@@ -428,7 +441,6 @@ main(
     directq.head = NULL;
     directq.tail = NULL;
     waitq = origq;
-    taper_state = TAPER_STATE_DEFAULT;
     tapeq = read_flush();
 
     roomq.head = roomq.tail = NULL;
@@ -449,16 +461,29 @@ main(
 	if (cmd != TAPER_OK) {
 	    /* no tape, go into degraded mode: dump to holding disk */
 	    need_degraded = 1;
+	} else if (result_argc >= 2) {
+	    /* TAPER-OK <workers>: the taper may have fewer workers ready than
+	     * taper-parallel-write asked for */
+	    taper_parallel_write = MIN(taper_parallel_write, atoi(result_argv[1]));
 	}
+	g_strfreev(result_argv);
     } else {
 	need_degraded = 1;
     }
+    if (taper_parallel_write < 1) taper_parallel_write = 1;
+    if (taper_parallel_write > MAX_TAPERS) taper_parallel_write = MAX_TAPERS;
 
-    tape_left = tape_length;
-    taper_busy = 0;
-    amfree(taper_input_error);
-    amfree(taper_tape_error);
-    taper_disk = NULL;
+    for (taper_slot = tapetable; taper_slot < tapetable + MAX_TAPERS;
+	 taper_slot++) {
+	taper_slot->busy = 0;
+	taper_slot->state = TAPER_STATE_DEFAULT;
+	taper_slot->left = tape_length;
+	taper_slot->disk = NULL;
+	taper_slot->dumper = NULL;
+	taper_slot->input_error = NULL;
+	taper_slot->tape_error = NULL;
+	taper_slot->first_label = NULL;
+    }
     taper_ev_read = NULL;
 
     schedule_done = nodump;
@@ -502,8 +527,13 @@ main(
 	    }
 	}
 	diskp = sleep_diskp;
-	if (sleep_time > 0)
-	    sleep(sleep_time);
+	if (sleep_time > 0) {
+	    /* let the dumps that are already running continue meanwhile */
+	    sleep_ev = event_register((event_id_t)sleep_time, EV_TIME,
+				      directq_wakeup, NULL);
+	    event_wait(sleep_ev);
+	    event_release(sleep_ev);
+	}
 	remove_disk(&directq, diskp);
 
 	if (diskp->to_holdingdisk == HOLD_REQUIRED) {
@@ -515,10 +545,25 @@ main(
 	    amfree(qname);
 	}
 	else if (!degraded_mode) {
-	    taper_state |= TAPER_STATE_DUMP_TO_TAPE;
-	    dump_to_tape(diskp);
-	    event_loop(0);
-	    taper_state &= ~TAPER_STATE_DUMP_TO_TAPE;
+	    /* wait for a taper slot and a dumper; the other slots keep
+	     * writing meanwhile */
+	    while (taper > 0 && busy_tapers() > 0 &&
+		   (!idle_taper() || !idle_dumper())) {
+		taper_slot_ev = event_register((event_id_t)tapetable, EV_WAIT,
+					       taper_slot_freed, &taper_slot_ev);
+		event_wait(taper_slot_ev);
+		if (taper_slot_ev) {
+		    event_release(taper_slot_ev);
+		    taper_slot_ev = NULL;
+		}
+	    }
+	    if (idle_taper()) {
+		dump_to_tape(diskp);
+	    } else {
+		/* every slot has been refused a tape; fail it below */
+		start_degraded_mode(&runq);
+		headqueue_disk(&directq, diskp);
+	    }
 	}
 	else {
 	    char *qname = quote_string(diskp->name);
@@ -722,23 +767,22 @@ startaflush(void)
     char *datestamp;
     int extra_tapes = 0;
     char *qname;
-    TapeAction result_tape_action;
+    taper_t *taper_slot;
     char *why_no_new_tape;
 
-    result_tape_action = tape_action(&why_no_new_tape);
-
-    if (result_tape_action & TAPE_ACTION_NEW_TAPE) {
-	taper_state &= ~TAPER_STATE_WAIT_FOR_TAPE;
-	taper_cmd(NEW_TAPE, NULL, NULL, 0, NULL);
-    } else if (result_tape_action & TAPE_ACTION_NO_NEW_TAPE) {
-	taper_state &= ~TAPER_STATE_WAIT_FOR_TAPE;
-	taper_cmd(NO_NEW_TAPE, why_no_new_tape, NULL, 0, NULL);
-	start_degraded_mode(&runq);
+    /* answer the taper slots waiting for permission to use a new tape */
+    for (taper_slot = tapetable; taper_slot < tapetable + taper_parallel_write;
+	 taper_slot++) {
+	if (taper_slot->state & TAPER_STATE_WAIT_FOR_TAPE)
+	    answer_tape_request(taper_slot);
     }
 
-    if (!degraded_mode && !taper_busy && !empty(tapeq) &&
-	(result_tape_action & TAPE_ACTION_START_A_FLUSH)) {
+    /* and give each idle slot a dumpfile from the holding disk */
+    while (!degraded_mode && !empty(tapeq) &&
+	   (taper_slot = idle_taper()) != NULL &&
+	   (tape_action(taper_slot, &why_no_new_tape) & TAPE_ACTION_START_A_FLUSH)) {
 	
+	dp = NULL;
 	datestamp = sched(tapeq.head)->datestamp;
 	switch(conf_taperalgo) {
 	case ALGO_FIRST:
@@ -749,7 +793,7 @@ startaflush(void)
 		while (fit != NULL) {
 		    extra_tapes = (fit->tape_splitsize > (off_t)0) ? 
 					conf_runtapes - current_tape : 0;
-		    if(sched(fit)->act_size <= (tape_left +
+		    if(sched(fit)->act_size <= (taper_slot->left +
 		             tape_length * (off_t)extra_tapes) &&
 			     strcmp(sched(fit)->datestamp, datestamp) <= 0) {
 			dp = fit;
@@ -778,7 +822,7 @@ startaflush(void)
 		    extra_tapes = (fit->tape_splitsize > (off_t)0) ? 
 					conf_runtapes - current_tape : 0;
 		    if(sched(fit)->act_size <=
-		       (tape_left + tape_length * (off_t)extra_tapes) &&
+		       (taper_slot->left + tape_length * (off_t)extra_tapes) &&
 		       (!dp || sched(fit)->act_size > sched(dp)->act_size) &&
 		       strcmp(sched(fit)->datestamp, datestamp) <= 0) {
 			dp = fit;
@@ -814,37 +858,178 @@ startaflush(void)
 					   handle_taper_result, NULL);
 	}
 	if (dp) {
-	    taper_disk = dp;
-	    taper_busy = 1;
-	    amfree(taper_input_error);
-	    amfree(taper_tape_error);
-	    taper_result = LAST_TOK;
-	    taper_sendresult = 0;
-	    taper_first_label = NULL;
-	    taper_written = 0;
-	    taper_state &= ~TAPER_STATE_DUMP_TO_TAPE;
-	    taper_dumper = NULL;
+	    taper_slot->disk = dp;
+	    taper_slot->busy = 1;
+	    amfree(taper_slot->input_error);
+	    amfree(taper_slot->tape_error);
+	    taper_slot->result = LAST_TOK;
+	    taper_slot->sendresult = 0;
+	    amfree(taper_slot->first_label);
+	    taper_slot->written = 0;
+	    taper_slot->state &= ~TAPER_STATE_DUMP_TO_TAPE;
+	    taper_slot->dumper = NULL;
 	    qname = quote_string(dp->name);
 	    taper_cmd(FILE_WRITE, dp, sched(dp)->destname, sched(dp)->level,
 		      sched(dp)->datestamp);
-	    g_fprintf(stderr,_("driver: startaflush: %s %s %s %lld %lld\n"),
-		    taperalgo2str(conf_taperalgo), dp->host->hostname, qname,
-		    (long long)sched(taper_disk)->act_size,
-		    (long long)tape_left);
-	    if(sched(dp)->act_size <= tape_left)
-		tape_left -= sched(dp)->act_size;
+	    g_fprintf(stderr,_("driver: startaflush: %s %s %s %s %lld %lld\n"),
+		    taper_slot->name, taperalgo2str(conf_taperalgo),
+		    dp->host->hostname, qname,
+		    (long long)sched(dp)->act_size,
+		    (long long)taper_slot->left);
+	    if(sched(dp)->act_size <= taper_slot->left)
+		taper_slot->left -= sched(dp)->act_size;
 	    else
-		tape_left = (off_t)0;
+		taper_slot->left = (off_t)0;
 	    amfree(qname);
 	} else {
 	    error(_("FATAL: Taper marked busy and no work found."));
 	    /*NOTREACHED*/
 	}
 	short_dump_state();
-    } else if(!taper_busy && taper_ev_read != NULL) {
+    }
+
+    if (!busy_tapers() && taper_ev_read != NULL) {
+	event_release(taper_ev_read);
+	taper_ev_read = NULL;
+    }
+}
+
+/* Give a taper slot that asked for a new tape (REQUEST-NEW-TAPE) its answer,
+ * if it can be decided yet; otherwise the slot keeps waiting, and
+ * startaflush tries again later.
+ */
+static void
+answer_tape_request(
+    taper_t *taper_slot)
+{
+    TapeAction result_tape_action;
+    char *why_no_new_tape = NULL;
+
+    taper_slot->state |= TAPER_STATE_WAIT_FOR_TAPE;
+
+    /* tapes already granted to other slots count against runtapes */
+    if (current_tape + granted_tapes >= conf_runtapes) {
+	char *usermsg = g_strdup_printf(_("%d tapes filled; runtapes=%d "
+	    "does not allow additional tapes"), current_tape, conf_runtapes);
+	taper_slot->state &= ~TAPER_STATE_WAIT_FOR_TAPE;
+	taper_cmd(NO_NEW_TAPE, taper_slot->disk, usermsg, 0, NULL);
+	g_free(usermsg);
+	if (retire_taper(taper_slot))
+	    log_add(L_WARNING,
+		    _("Out of tapes; going into degraded mode."));
+	return;
+    }
+
+    result_tape_action = tape_action(taper_slot, &why_no_new_tape);
+    if (result_tape_action & TAPE_ACTION_NEW_TAPE) {
+	taper_slot->state &= ~TAPER_STATE_WAIT_FOR_TAPE;
+	granted_tapes++;
+	taper_cmd(NEW_TAPE, taper_slot->disk, NULL, 0, NULL);
+    } else if (result_tape_action & TAPE_ACTION_NO_NEW_TAPE) {
+	taper_slot->state &= ~TAPER_STATE_WAIT_FOR_TAPE;
+	taper_cmd(NO_NEW_TAPE, taper_slot->disk, why_no_new_tape, 0, NULL);
+	retire_taper(taper_slot);
+    }
+}
+
+/* Stop giving dumpfiles to a taper slot that has no tape and cannot get one.
+ * Once every slot is retired, dump to holding disk only.
+ *
+ * @returns: 1 if this started degraded mode
+ */
+static int
+retire_taper(
+    taper_t *taper_slot)
+{
+    taper_t *t;
+
+    taper_slot->state |= TAPER_STATE_DONE;
+    for (t = tapetable; t < tapetable + taper_parallel_write; t++) {
+	if (!(t->state & TAPER_STATE_DONE))
+	    return 0;
+    }
+    start_degraded_mode(&runq);
+    return 1;
+}
+
+/* Return a taper slot that can take a new dumpfile, or NULL */
+static taper_t *
+idle_taper(void)
+{
+    taper_t *taper_slot;
+
+    for (taper_slot = tapetable; taper_slot < tapetable + taper_parallel_write;
+	 taper_slot++) {
+	if (!taper_slot->busy && !(taper_slot->state & TAPER_STATE_DONE))
+	    return taper_slot;
+    }
+    return NULL;
+}
+
+/* Return the taper slot writing dp */
+static taper_t *
+disk2taper(
+    disk_t *dp)
+{
+    taper_t *taper_slot;
+
+    for (taper_slot = tapetable; taper_slot < tapetable + taper_parallel_write;
+	 taper_slot++) {
+	if (taper_slot->busy && taper_slot->disk == dp)
+	    return taper_slot;
+    }
+    error(_("driver: no taper slot is writing %s:%s"),
+	  dp->host->hostname, dp->name);
+    /*NOTREACHED*/
+}
+
+static int
+busy_tapers(void)
+{
+    taper_t *taper_slot;
+    int n = 0;
+
+    for (taper_slot = tapetable; taper_slot < tapetable + taper_parallel_write;
+	 taper_slot++) {
+	if (taper_slot->busy)
+	    n++;
+    }
+    return n;
+}
+
+/* Mark a taper slot idle once its dumpfile is finished, and wake up anyone
+ * waiting for one in main() */
+static void
+taper_slot_free(
+    taper_t *taper_slot)
+{
+    taper_slot->busy = 0;
+    taper_slot->disk = NULL;
+    taper_slot->dumper = NULL;
+    taper_slot->state &= ~TAPER_STATE_DUMP_TO_TAPE;
+    amfree(taper_slot->input_error);
+    amfree(taper_slot->tape_error);
+    if (!busy_tapers() && taper_ev_read != NULL) {
 	event_release(taper_ev_read);
 	taper_ev_read = NULL;
     }
+    event_wakeup((event_id_t)tapetable);
+}
+
+static void
+taper_slot_freed(
+    void *cookie)
+{
+    event_handle_t **taper_slot_ev = cookie;
+
+    event_release(*taper_slot_ev);
+    *taper_slot_ev = NULL;
+}
+
+static void
+directq_wakeup(
+    void *cookie G_GNUC_UNUSED)
+{
 }
 
 static int
@@ -873,26 +1058,330 @@ client_constrained(
     return 0;
 }
 
+/*
+ * Every idle dumper could start the same disks; only which of them it
+ * prefers depends on its dumporder character.  So rather than have each
+ * dumper compare every disk on the run queue, and ask find_diskspace
+ * about each one, start_some_dumps sorts the queue once for each
+ * dumporder in use and each dumper takes the first disk in its order
+ * that can be started.
+ */
+typedef struct runq_entry_s {
+    disk_t *dp;
+    int pos;			/* position on the run queue */
+} runq_entry_t;
+
+#define MAX_DUMPORDERS	8
+typedef struct runq_index_s {
+    runq_entry_t *queue;	/* in run queue order */
+    int len;
+    char dumptype[MAX_DUMPORDERS];
+    runq_entry_t *order[MAX_DUMPORDERS];
+    int norders;
+} runq_index_t;
+
+/* time taken to decide what to start, in microseconds */
+static unsigned long sched_usec, sched_max_usec;
+
+#define DUMPORDER_CMP(a, b)	(((a) > (b)) - ((a) < (b)))
+
+static int
+dumporder_cmp(
+    gconstpointer	a,
+    gconstpointer	b,
+    gpointer		user_data)
+{
+    const runq_entry_t *ea = a, *eb = b;
+    sched_t *sa = sched(ea->dp), *sb = sched(eb->dp);
+    int r;
+
+    switch (GPOINTER_TO_INT(user_data)) {
+      case 'S': r = DUMPORDER_CMP(sb->est_size, sa->est_size);
+		break;
+      case 't': r = DUMPORDER_CMP(sa->est_time, sb->est_time);
+		break;
+      case 'T': r = DUMPORDER_CMP(sb->est_time, sa->est_time);
+		break;
+      case 'b': r = DUMPORDER_CMP(sa->est_kps, sb->est_kps);
+		break;
+      case 'B': r = DUMPORDER_CMP(sb->est_kps, sa->est_kps);
+		break;
+      default:  r = DUMPORDER_CMP(sa->est_size, sb->est_size);
+		break;
+    }
+
+    /* on a tie, the disk nearer the head of the queue goes first */
+    if (r == 0)
+	r = ea->pos - eb->pos;
+    return r;
+}
+
+static char
+dumper_dumptype(
+    dumper_t *	dumper)
+{
+    char *dumporder = getconf_str(CNF_DUMPORDER);
+    char dumptype;
+
+    if(strlen(dumporder) > (size_t)(dumper-dmptable)) {
+	dumptype = dumporder[dumper-dmptable];
+    }
+    else {
+	if(dumper-dmptable < 3)
+	    dumptype = 't';
+	else
+	    dumptype = 'T';
+    }
+
+    if (strchr("sStTbB", dumptype) == NULL) {
+	log_add(L_WARNING, _("Unknown dumporder character \'%c\', using 's'.\n"),
+		dumptype);
+	dumptype = 's';
+    }
+    return dumptype;
+}
+
+static void
+runq_index_build(
+    runq_index_t *	idx,
+    disklist_t *	rq)
+{
+    disk_t *dp;
+    int i;
+
+    idx->len = queue_length(*rq);
+    idx->queue = alloc(SIZEOF(runq_entry_t) * (idx->len + 1));
+    for (i = 0, dp = rq->head; dp != NULL; dp = dp->next, i++) {
+	idx->queue[i].dp = dp;
+	idx->queue[i].pos = i;
+    }
+    idx->norders = 0;
+}
+
+static void
+runq_index_free(
+    runq_index_t *	idx)
+{
+    int i;
+
+    for (i = 0; i < idx->norders; i++)
+	amfree(idx->order[i]);
+    idx->norders = 0;
+    amfree(idx->queue);
+    idx->len = 0;
+}
+
+/* The run queue sorted by dumptype, most preferred first. */
+static runq_entry_t *
+runq_index_order(
+    runq_index_t *	idx,
+    char		dumptype)
+{
+    runq_entry_t *order;
+    int i;
+
+    for (i = 0; i < idx->norders; i++) {
+	if (idx->dumptype[i] == dumptype)
+	    return idx->order[i];
+    }
+
+    order = alloc(SIZEOF(runq_entry_t) * (idx->len + 1));
+    memcpy(order, idx->queue, SIZEOF(runq_entry_t) * idx->len);
+    g_qsort_with_data(order, idx->len, SIZEOF(runq_entry_t),
+		      dumporder_cmp, GINT_TO_POINTER((int)dumptype));
+
+    /* only the six dumptypes can get here, so this never overflows */
+    assert(idx->norders < MAX_DUMPORDERS);
+    idx->dumptype[idx->norders] = dumptype;
+    idx->order[idx->norders++] = order;
+    return order;
+}
+
+/* The size find_diskspace will look for to hold a dump of this size. */
+static off_t
+holding_request(
+    off_t	size)
+{
+    if (size < 2*DISK_BLOCK_KB)
+	size = 2*DISK_BLOCK_KB;
+    return am_round(size, (off_t)DISK_BLOCK_KB);
+}
+
+/*
+ * The biggest dump find_diskspace can place now.  It spreads a dump
+ * over every holding disk with room for a block, so a dump fits if it
+ * is no bigger than their free data space together.
+ */
+static off_t
+holding_capacity(void)
+{
+    holdalloc_t *ha;
+    off_t hfree, dfree;
+    off_t total = (off_t)0;
+
+    for (ha = holdalloc; ha != NULL; ha = ha->next) {
+	if (ha->allocated_space > ha->disksize - (off_t)(2*DISK_BLOCK_KB))
+	    continue;
+	hfree = ha->disksize - ha->allocated_space;
+	dfree = hfree - (((hfree-(off_t)1)/holdingdisk_get_chunksize(ha->hdisk))+(off_t)1) * (off_t)DISK_BLOCK_KB;
+	if (dfree > (off_t)0)
+	    total += dfree;
+    }
+    return total;
+}
+
+/*
+ * Why a disk on the run queue cannot be started now, or NOT_IDLE if it
+ * can.  For a delayed disk, *start_t is set to when it may start.
+ */
+static int
+disk_idle_reason(
+    disk_t *	diskp,
+    time_t	now,
+    off_t	capacity,
+    time_t *	start_t)
+{
+    assert(diskp->host != NULL && sched(diskp) != NULL);
+
+    if (diskp->host->start_t > now) {
+	*start_t = diskp->host->start_t;
+	return IDLE_START_WAIT;
+    } else if (diskp->start_t > now) {
+	*start_t = diskp->start_t;
+	return IDLE_START_WAIT;
+    } else if (diskp->host->netif->curusage > 0 &&
+	       sched(diskp)->est_kps > free_kps(diskp->host->netif)) {
+	return IDLE_NO_BANDWIDTH;
+    } else if (sched(diskp)->no_space) {
+	return IDLE_NO_DISKSPACE;
+    } else if (diskp->to_holdingdisk == HOLD_NEVER) {
+	return IDLE_NO_HOLD;
+    } else if (holding_request(sched(diskp)->est_size) > capacity) {
+	return IDLE_NO_DISKSPACE;
+    } else if (client_constrained(diskp)) {
+	return IDLE_CLIENT_CONSTRAINED;
+    }
+    return NOT_IDLE;
+}
+
+/*
+ * Choose the disk a dumper should start, and find holding disk space
+ * for it.  Outside degraded mode that is the first disk in the dumper's
+ * order that can start; in degraded mode a disk must also have at least
+ * the priority of the one it displaces, which depends on queue order,
+ * so the whole queue is compared as before.
+ */
+static disk_t *
+choose_disk(
+    runq_index_t *	idx,
+    char		dumptype,
+    time_t		now,
+    int *		cur_idle,
+    disk_t **		delayed_diskp,
+    assignedhd_t ***	holdpp)
+{
+    runq_entry_t *entries, *best = NULL;
+    disk_t *diskp;
+    off_t capacity = holding_capacity();
+    time_t start_t;
+    int reason;
+    int i;
+
+    *holdpp = NULL;
+    entries = degraded_mode? idx->queue : runq_index_order(idx, dumptype);
+
+    for (i = 0; i < idx->len; i++) {
+	diskp = entries[i].dp;
+	if (diskp->inprogress)		/* started by an earlier dumper */
+	    continue;
+
+	reason = disk_idle_reason(diskp, now, capacity, &start_t);
+	if (reason == IDLE_START_WAIT &&
+	    (*delayed_diskp == NULL || sleep_time > start_t)) {
+	    *delayed_diskp = diskp;
+	    sleep_time = start_t;
+	}
+	if (reason != NOT_IDLE) {
+	    *cur_idle = max(*cur_idle, reason);
+	    continue;
+	}
+
+	/* disk fits, dump it */
+	if (!degraded_mode) {
+	    best = &entries[i];
+	    break;
+	}
+	if (!best ||
+	    (dumporder_cmp(&entries[i], best, GINT_TO_POINTER((int)dumptype)) < 0 &&
+	     diskp->priority >= best->dp->priority))
+	    best = &entries[i];
+    }
+
+    if (best == NULL)
+	return NULL;
+
+    *holdpp = find_diskspace(sched(best->dp)->est_size, cur_idle, NULL);
+    if (*holdpp == NULL) {
+	*cur_idle = max(*cur_idle, IDLE_NO_DISKSPACE);
+	return NULL;
+    }
+    return best->dp;
+}
+
+/*
+ * Work out why the run queue is waiting, as a dumper scanning all of it
+ * would, and send the disks that can never fit on the holding disks to
+ * be dumped directly to tape once nothing else is going on.
+ */
+static int
+survey_runq(
+    disklist_t *	rq,
+    time_t		now,
+    int			busy_dumpers)
+{
+    disk_t *diskp, *next;
+    off_t capacity = holding_capacity();
+    time_t start_t;
+    int cur_idle = NOT_IDLE;
+    int reason;
+
+    for (diskp = rq->head; diskp != NULL; diskp = next) {
+	next = diskp->next;
+	reason = disk_idle_reason(diskp, now, capacity, &start_t);
+	cur_idle = max(cur_idle, reason);
+	if (reason == IDLE_NO_DISKSPACE && !sched(diskp)->no_space &&
+	    empty(tapeq) && busy_dumpers == 0) {
+	    remove_disk(rq, diskp);
+	    enqueue_disk(&directq, diskp);
+	}
+    }
+    return cur_idle;
+}
+
 static void
 start_some_dumps(
     disklist_t *	rq)
 {
     int cur_idle;
-    disk_t *diskp, *delayed_diskp, *diskp_accept;
+    disk_t *diskp, *delayed_diskp;
     disk_t *dp;
-    assignedhd_t **holdp=NULL, **holdp_accept;
+    assignedhd_t **holdp=NULL;
     const time_t now = time(NULL);
     cmd_t cmd;
     int result_argc;
     char **result_argv;
     chunker_t *chunker;
     dumper_t *dumper;
-    char dumptype;
-    char *dumporder;
     int  busy_dumpers = 0;
+    runq_index_t idx;
+    gboolean surveyed = FALSE;
+    GTimeVal t0, t1;
 
     idle_reason = IDLE_NO_DUMPERS;
     sleep_time = 0;
+    sched_usec = 0;
+    idx.queue = NULL;
+    idx.len = idx.norders = 0;
 
     if(dumpers_ev_time != NULL) {
 	event_release(dumpers_ev_time);
@@ -935,100 +1424,28 @@ start_some_dumps(
 	 * beginning.
 	 */
 
-	diskp_accept = NULL;
-	holdp_accept = NULL;
-	delayed_diskp = NULL;
+	g_get_current_time(&t0);
 
+	delayed_diskp = NULL;
 	cur_idle = NOT_IDLE;
 
-	dumporder = getconf_str(CNF_DUMPORDER);
-	if(strlen(dumporder) > (size_t)(dumper-dmptable)) {
-	    dumptype = dumporder[dumper-dmptable];
-	}
-	else {
-	    if(dumper-dmptable < 3)
-		dumptype = 't';
-	    else
-		dumptype = 'T';
+	if (!surveyed) {
+	    cur_idle = survey_runq(rq, now, busy_dumpers);
+	    surveyed = TRUE;
 	}
+	if (idx.queue == NULL)
+	    runq_index_build(&idx, rq);
 
-	for(diskp = rq->head; diskp != NULL; diskp = diskp->next) {
-	    assert(diskp->host != NULL && sched(diskp) != NULL);
-
-	    if (diskp->host->start_t > now) {
-		cur_idle = max(cur_idle, IDLE_START_WAIT);
-		if (delayed_diskp == NULL || sleep_time > diskp->host->start_t) {
-		    delayed_diskp = diskp;
-		    sleep_time = diskp->host->start_t;
-		}
-	    } else if(diskp->start_t > now) {
-		cur_idle = max(cur_idle, IDLE_START_WAIT);
-		if (delayed_diskp == NULL || sleep_time > diskp->start_t) {
-		    delayed_diskp = diskp;
-		    sleep_time = diskp->start_t;
-		}
-	    } else if (diskp->host->netif->curusage > 0 &&
-		       sched(diskp)->est_kps > free_kps(diskp->host->netif)) {
-		cur_idle = max(cur_idle, IDLE_NO_BANDWIDTH);
-	    } else if(sched(diskp)->no_space) {
-		cur_idle = max(cur_idle, IDLE_NO_DISKSPACE);
-	    } else if (diskp->to_holdingdisk == HOLD_NEVER) {
-		cur_idle = max(cur_idle, IDLE_NO_HOLD);
-	    } else if ((holdp =
-		find_diskspace(sched(diskp)->est_size, &cur_idle, NULL)) == NULL) {
-		cur_idle = max(cur_idle, IDLE_NO_DISKSPACE);
-		if (empty(tapeq) && busy_dumpers == 0) {
-		    remove_disk(rq, diskp);
-		    enqueue_disk(&directq, diskp);
-		}
-	    } else if (client_constrained(diskp)) {
-		free_assignedhd(holdp);
-		cur_idle = max(cur_idle, IDLE_CLIENT_CONSTRAINED);
-	    } else {
-
-		/* disk fits, dump it */
-		int accept = !diskp_accept;
-		if(!accept) {
-		    switch(dumptype) {
-		      case 's': accept = (sched(diskp)->est_size < sched(diskp_accept)->est_size);
-				break;
-		      case 'S': accept = (sched(diskp)->est_size > sched(diskp_accept)->est_size);
-				break;
-		      case 't': accept = (sched(diskp)->est_time < sched(diskp_accept)->est_time);
-				break;
-		      case 'T': accept = (sched(diskp)->est_time > sched(diskp_accept)->est_time);
-				break;
-		      case 'b': accept = (sched(diskp)->est_kps < sched(diskp_accept)->est_kps);
-				break;
-		      case 'B': accept = (sched(diskp)->est_kps > sched(diskp_accept)->est_kps);
-				break;
-		      default:  log_add(L_WARNING, _("Unknown dumporder character \'%c\', using 's'.\n"),
-					dumptype);
-				accept = (sched(diskp)->est_size < sched(diskp_accept)->est_size);
-				break;
-		    }
-		}
-		if(accept) {
-		    if( !diskp_accept || !degraded_mode || diskp->priority >= diskp_accept->priority) {
-			if(holdp_accept) free_assignedhd(holdp_accept);
-			diskp_accept = diskp;
-			holdp_accept = holdp;
-		    }
-		    else {
-			free_assignedhd(holdp);
-		    }
-		}
-		else {
-		    free_assignedhd(holdp);
-		}
-	    }
-	}
-
-	diskp = diskp_accept;
-	holdp = holdp_accept;
+	diskp = choose_disk(&idx, dumper_dumptype(dumper), now,
+			    &cur_idle, &delayed_diskp, &holdp);
 
 	idle_reason = max(idle_reason, cur_idle);
 
+	g_get_current_time(&t1);
+	t1 = timessub(t1, t0);
+	sched_usec += (unsigned long)t1.tv_sec * 1000000 + t1.tv_usec;
+	sched_max_usec = max(sched_max_usec, sched_usec);
+
 	/*
 	 * If we have no disk at this point, and there are disks that
 	 * are delayed, then schedule a time event to call this dumper
@@ -1039,8 +1456,11 @@ start_some_dumps(
 	    sleep_time -= now;
 	    dumpers_ev_time = event_register((event_id_t)sleep_time, EV_TIME,
 		handle_dumpers_time, &runq);
-	    return;
-	} else if (diskp != NULL) {
+	    break;
+	} else if (diskp == NULL) {
+	    /* no other dumper could start one either */
+	    break;
+	} else {
 	    sched(diskp)->act_size = (off_t)0;
 	    allocate_bandwidth(diskp->host->netif, sched(diskp)->est_kps);
 	    sched(diskp)->activehd = assign_holdingdisk(holdp, diskp);
@@ -1094,6 +1514,7 @@ start_some_dumps(
 		free_serial_dp(diskp);
 		if(sched(diskp)->dump_attempted < 2)
 		    enqueue_disk(rq, diskp);
+		runq_index_free(&idx);	/* the run queue has changed */
 	    }
 	    else {
 		dumper->ev_read = event_register((event_id_t)dumper->fd, EV_READFD,
@@ -1121,6 +1542,8 @@ start_some_dumps(
 	    short_dump_state();
 	}
     }
+
+    runq_index_free(&idx);
 }
 
 /*
@@ -1270,7 +1693,7 @@ continue_port_dumps(void)
 	}
     }
     if((dp != NULL) && (active_dumpers == 0) && (busy_dumpers > 0) && 
-        ((!taper_busy && empty(tapeq)) || degraded_mode) &&
+        ((!busy_tapers() && empty(tapeq)) || degraded_mode) &&
 	pending_aborts == 0 ) { /* not case a */
 	if( busy_dumpers == 1 ) { /* case c */
 	    sched(dp)->no_space = 1;
@@ -1291,278 +1714,300 @@ static void
 handle_taper_result(
 	void *cookie G_GNUC_UNUSED)
 {
-    disk_t *dp;
     cmd_t cmd;
     int result_argc;
     char **result_argv;
-    char *qname, *q;
-    char *s;
 
     assert(cookie == NULL);
-    amfree(taper_input_error);
-    amfree(taper_tape_error);
-    
+
     do {
         
 	short_dump_state();
         
 	cmd = getresult(taper, 1, &result_argc, &result_argv);
-        
-	switch(cmd) {
+	process_taper_result(cmd, result_argc, result_argv);
+	g_strfreev(result_argv);
+
+    } while(taper >= 0 && areads_dataready(taper));
+}
+
+/* Handle one result line from the taper, for whichever taper slot it names
+ * by its handle. */
+static void
+process_taper_result(
+    cmd_t cmd,
+    int result_argc,
+    char **result_argv)
+{
+    disk_t *dp;
+    taper_t *taper_slot = NULL;
+    char *qname, *q;
+    char *s;
+
+    switch(cmd) {
             
-	case FAILED:	/* FAILED <handle> INPUT-* TAPE-* <input err mesg> <tape err mesg> */
-	    if(result_argc != 6) {
-		error(_("error: [taper FAILED result_argc != 6: %d"), result_argc);
-		/*NOTREACHED*/
-	    }
+    case FAILED:	/* FAILED <handle> INPUT-* TAPE-* <input err mesg> <tape err mesg> */
+	if(result_argc != 6) {
+	    error(_("error: [taper FAILED result_argc != 6: %d"), result_argc);
+	    /*NOTREACHED*/
+	}
             
-	    dp = serial2disk(result_argv[1]);
-	    assert(dp == taper_disk);
-	    if (!taper_dumper)
-		free_serial(result_argv[1]);
+	dp = serial2disk(result_argv[1]);
+	taper_slot = disk2taper(dp);
+	if (!taper_slot->dumper)
+	    free_serial(result_argv[1]);
             
-	    qname = quote_string(dp->name);
-	    g_printf(_("driver: finished-cmd time %s taper wrote %s:%s\n"),
-		   walltime_str(curclock()), dp->host->hostname, qname);
-	    fflush(stdout);
+	qname = quote_string(dp->name);
+	g_printf(_("driver: finished-cmd time %s %s wrote %s:%s\n"),
+	       walltime_str(curclock()), taper_slot->name,
+	       dp->host->hostname, qname);
+	fflush(stdout);
 
-	    if (strcmp(result_argv[2], "INPUT-ERROR") == 0) {
-		taper_input_error = newstralloc(taper_input_error, result_argv[4]);
-	    } else if (strcmp(result_argv[2], "INPUT-GOOD") != 0) {
-		taper_tape_error = newstralloc(taper_tape_error,
+	if (strcmp(result_argv[2], "INPUT-ERROR") == 0) {
+	    taper_slot->input_error = newstralloc(taper_slot->input_error,
+						  result_argv[4]);
+	} else if (strcmp(result_argv[2], "INPUT-GOOD") != 0) {
+	    taper_slot->tape_error = newstralloc(taper_slot->tape_error,
 					       _("Taper protocol error"));
-		taper_result = FAILED;
-		log_add(L_FAIL, _("%s %s %s %d [%s]"),
-		        dp->host->hostname, qname, sched(dp)->datestamp,
-		        sched(dp)->level, taper_tape_error);
-		amfree(qname);
-		break;
-	    }
-	    if (strcmp(result_argv[3], "TAPE-ERROR") == 0) {
-		taper_tape_error = newstralloc(taper_tape_error, result_argv[5]);
-	    } else if (strcmp(result_argv[3], "TAPE-GOOD") != 0) {
-		taper_tape_error = newstralloc(taper_tape_error,
+	    taper_slot->result = FAILED;
+	    log_add(L_FAIL, _("%s %s %s %d [%s]"),
+		    dp->host->hostname, qname, sched(dp)->datestamp,
+		    sched(dp)->level, taper_slot->tape_error);
+	    amfree(qname);
+	    break;
+	}
+	if (strcmp(result_argv[3], "TAPE-ERROR") == 0) {
+	    taper_slot->tape_error = newstralloc(taper_slot->tape_error,
+						 result_argv[5]);
+	} else if (strcmp(result_argv[3], "TAPE-GOOD") != 0) {
+	    taper_slot->tape_error = newstralloc(taper_slot->tape_error,
 					       _("Taper protocol error"));
-		taper_result = FAILED;
-		log_add(L_FAIL, _("%s %s %s %d [%s]"),
-		        dp->host->hostname, qname, sched(dp)->datestamp,
-		        sched(dp)->level, taper_tape_error);
-		amfree(qname);
-		break;
-	    }
-
+	    taper_slot->result = FAILED;
+	    log_add(L_FAIL, _("%s %s %s %d [%s]"),
+		    dp->host->hostname, qname, sched(dp)->datestamp,
+		    sched(dp)->level, taper_slot->tape_error);
 	    amfree(qname);
-	    taper_result = cmd;
-
 	    break;
+	}
+
+	amfree(qname);
+	taper_slot->result = cmd;
+
+	break;
             
-	case PARTIAL:	/* PARTIAL <handle> INPUT-* TAPE-* <stat mess> <input err mesg> <tape err mesg>*/
-	case DONE:	/* DONE <handle> INPUT-GOOD TAPE-GOOD <stat mess> <input err mesg> <tape err mesg> */
-	    if(result_argc != 7) {
-		error(_("error: [taper PARTIAL result_argc != 7: %d"), result_argc);
-		/*NOTREACHED*/
-	    }
+    case PARTIAL:	/* PARTIAL <handle> INPUT-* TAPE-* <stat mess> <input err mesg> <tape err mesg>*/
+    case DONE:	/* DONE <handle> INPUT-GOOD TAPE-GOOD <stat mess> <input err mesg> <tape err mesg> */
+	if(result_argc != 7) {
+	    error(_("error: [taper PARTIAL result_argc != 7: %d"), result_argc);
+	    /*NOTREACHED*/
+	}
             
-	    dp = serial2disk(result_argv[1]);
-	    assert(dp == taper_disk);
-            if (!taper_dumper)
-                free_serial(result_argv[1]);
+	dp = serial2disk(result_argv[1]);
+	taper_slot = disk2taper(dp);
+	if (!taper_slot->dumper)
+	    free_serial(result_argv[1]);
 
-	    qname = quote_string(dp->name);
-	    g_printf(_("driver: finished-cmd time %s taper wrote %s:%s\n"),
-		   walltime_str(curclock()), dp->host->hostname, qname);
-	    fflush(stdout);
+	qname = quote_string(dp->name);
+	g_printf(_("driver: finished-cmd time %s %s wrote %s:%s\n"),
+	       walltime_str(curclock()), taper_slot->name,
+	       dp->host->hostname, qname);
+	fflush(stdout);
 
-	    if (strcmp(result_argv[2], "INPUT-ERROR") == 0) {
-		taper_input_error = newstralloc(taper_input_error, result_argv[5]);
-	    } else if (strcmp(result_argv[2], "INPUT-GOOD") != 0) {
-		taper_tape_error = newstralloc(taper_tape_error,
+	if (strcmp(result_argv[2], "INPUT-ERROR") == 0) {
+	    taper_slot->input_error = newstralloc(taper_slot->input_error,
+						  result_argv[5]);
+	} else if (strcmp(result_argv[2], "INPUT-GOOD") != 0) {
+	    taper_slot->tape_error = newstralloc(taper_slot->tape_error,
 					       _("Taper protocol error"));
-		taper_result = FAILED;
-		log_add(L_FAIL, _("%s %s %s %d [%s]"),
-		        dp->host->hostname, qname, sched(dp)->datestamp,
-		        sched(dp)->level, taper_tape_error);
-		amfree(qname);
-		break;
-	    }
-	    if (strcmp(result_argv[3], "TAPE-ERROR") == 0) {
-		taper_tape_error = newstralloc(taper_tape_error, result_argv[6]);
-	    } else if (strcmp(result_argv[3], "TAPE-GOOD") != 0) {
-		taper_tape_error = newstralloc(taper_tape_error,
+	    taper_slot->result = FAILED;
+	    log_add(L_FAIL, _("%s %s %s %d [%s]"),
+		    dp->host->hostname, qname, sched(dp)->datestamp,
+		    sched(dp)->level, taper_slot->tape_error);
+	    amfree(qname);
+	    break;
+	}
+	if (strcmp(result_argv[3], "TAPE-ERROR") == 0) {
+	    taper_slot->tape_error = newstralloc(taper_slot->tape_error,
+						 result_argv[6]);
+	} else if (strcmp(result_argv[3], "TAPE-GOOD") != 0) {
+	    taper_slot->tape_error = newstralloc(taper_slot->tape_error,
 					       _("Taper protocol error"));
-		taper_result = FAILED;
-		log_add(L_FAIL, _("%s %s %s %d [%s]"),
-		        dp->host->hostname, qname, sched(dp)->datestamp,
-		        sched(dp)->level, taper_tape_error);
-		amfree(qname);
-		break;
-	    }
+	    taper_slot->result = FAILED;
+	    log_add(L_FAIL, _("%s %s %s %d [%s]"),
+		    dp->host->hostname, qname, sched(dp)->datestamp,
+		    sched(dp)->level, taper_slot->tape_error);
+	    amfree(qname);
+	    break;
+	}
 
-	    s = strstr(result_argv[4], " kb ");
-	    if (s) {
-		s += 4;
-		sched(dp)->dumpsize = atol(s);
-	    }
+	s = strstr(result_argv[4], " kb ");
+	if (s) {
+	    s += 4;
+	    sched(dp)->dumpsize = atol(s);
+	}
 
-	    taper_result = cmd;
-	    amfree(qname);
+	taper_slot->result = cmd;
+	amfree(qname);
 
-	    break;
+	break;
             
-        case PARTDONE:  /* PARTDONE <handle> <label> <fileno> <kbytes> <stat> */
-	    dp = serial2disk(result_argv[1]);
-	    assert(dp == taper_disk);
-            if (result_argc != 6) {
-                error(_("error [taper PARTDONE result_argc != 6: %d]"),
-                      result_argc);
-		/*NOTREACHED*/
-            }
-	    if (!taper_first_label) {
-		taper_first_label = stralloc(result_argv[2]);
-		taper_first_fileno = OFF_T_ATOI(result_argv[3]);
-	    }
-	    taper_written = OFF_T_ATOI(result_argv[4]);
-	    if (taper_written > sched(taper_disk)->act_size)
-		sched(taper_disk)->act_size = taper_written;
+    case PARTDONE:  /* PARTDONE <handle> <label> <fileno> <kbytes> <stat> */
+	if (result_argc != 6) {
+	    error(_("error [taper PARTDONE result_argc != 6: %d]"),
+		  result_argc);
+	    /*NOTREACHED*/
+	}
+	dp = serial2disk(result_argv[1]);
+	taper_slot = disk2taper(dp);
+	if (!taper_slot->first_label) {
+	    taper_slot->first_label = stralloc(result_argv[2]);
+	    taper_slot->first_fileno = OFF_T_ATOI(result_argv[3]);
+	}
+	taper_slot->written = OFF_T_ATOI(result_argv[4]);
+	if (taper_slot->written > sched(dp)->act_size)
+	    sched(dp)->act_size = taper_slot->written;
             
-            break;
+	break;
 
-        case REQUEST_NEW_TAPE:  /* REQUEST-NEW-TAPE <handle> */
-            if (result_argc != 2) {
-                error(_("error [taper REQUEST_NEW_TAPE result_argc != 2: %d]"),
-                      result_argc);
-		/*NOTREACHED*/
-            }
-	    taper_state &= ~TAPER_STATE_TAPE_STARTED;
+    case REQUEST_NEW_TAPE:  /* REQUEST-NEW-TAPE <handle> */
+	if (result_argc != 2) {
+	    error(_("error [taper REQUEST_NEW_TAPE result_argc != 2: %d]"),
+		  result_argc);
+	    /*NOTREACHED*/
+	}
+	dp = serial2disk(result_argv[1]);
+	taper_slot = disk2taper(dp);
+	taper_slot->state &= ~TAPER_STATE_TAPE_STARTED;
+	answer_tape_request(taper_slot);
+	break;
 
-	    if (current_tape >= conf_runtapes) {
-		char *usermsg = g_strdup_printf(_("%d tapes filled; runtapes=%d "
-		    "does not allow additional tapes"), current_tape, conf_runtapes);
-		taper_cmd(NO_NEW_TAPE, usermsg, NULL, 0, NULL);
-		g_free(usermsg);
-		log_add(L_WARNING,
-			_("Out of tapes; going into degraded mode."));
-		start_degraded_mode(&runq);
+    case NEW_TAPE: /* NEW-TAPE <handle> <label> */
+	if (result_argc != 3) {
+	    error(_("error [taper NEW_TAPE result_argc != 3: %d]"),
+		  result_argc);
+	    /*NOTREACHED*/
+	}
+	dp = serial2disk(result_argv[1]);
+	taper_slot = disk2taper(dp);
+
+	/* Update our tape counter and reset the slot's tape_left */
+	current_tape++;
+	if (granted_tapes > 0) granted_tapes--;
+	taper_slot->left = tape_length;
+	taper_slot->state |= TAPER_STATE_TAPE_STARTED;
+	taper_slot->state &= ~TAPER_STATE_DONE;
+	break;
+
+    case NO_NEW_TAPE:  /* NO-NEW-TAPE <handle> */
+	if (result_argc != 2) {
+	    error(_("error [taper NO_NEW_TAPE result_argc != 2: %d]"),
+		  result_argc);
+	    /*NOTREACHED*/
+	}
+	dp = serial2disk(result_argv[1]);
+	taper_slot = disk2taper(dp);
+	if (granted_tapes > 0) granted_tapes--;
+	retire_taper(taper_slot);
+	break;
+
+    case DUMPER_STATUS:  /* DUMPER-STATUS <handle> */
+	if (result_argc != 2) {
+	    error(_("error [taper DUMPER_STATUS result_argc != 2: %d]"),
+		  result_argc);
+	    /*NOTREACHED*/
+	}
+	dp = serial2disk(result_argv[1]);
+	taper_slot = disk2taper(dp);
+	if (taper_slot->dumper->result == LAST_TOK) {
+	    taper_slot->sendresult = 1;
+	} else {
+	    if( taper_slot->dumper->result == DONE) {
+		taper_cmd(DONE, dp, NULL, 0, NULL);
 	    } else {
-		TapeAction result_tape_action;
-		char *why_no_new_tape;
-
-		taper_state |= TAPER_STATE_WAIT_FOR_TAPE;
-		result_tape_action = tape_action(&why_no_new_tape);
-		if (result_tape_action & TAPE_ACTION_NEW_TAPE) {
-		    taper_cmd(NEW_TAPE, NULL, NULL, 0, NULL);
-		    taper_state &= ~TAPER_STATE_WAIT_FOR_TAPE;
-		} else if (result_tape_action & TAPE_ACTION_NO_NEW_TAPE) {
-		    taper_cmd(NO_NEW_TAPE, why_no_new_tape, NULL, 0, NULL);
-		    taper_state &= ~TAPER_STATE_WAIT_FOR_TAPE;
-		    start_degraded_mode(&runq);
-		}
+		taper_cmd(FAILED, dp, NULL, 0, NULL);
 	    }
-	    break;
-
-	case NEW_TAPE: /* NEW-TAPE <handle> <label> */
-            if (result_argc != 3) {
-                error(_("error [taper NEW_TAPE result_argc != 3: %d]"),
-                      result_argc);
-		/*NOTREACHED*/
-            }
-
-            /* Update our tape counter and reset tape_left */
-	    current_tape++;
-	    tape_left = tape_length;
-	    taper_state |= TAPER_STATE_TAPE_STARTED;
-	    break;
+	}
+	break;
 
-	case NO_NEW_TAPE:  /* NO-NEW-TAPE <handle> */
-            if (result_argc != 2) {
-                error(_("error [taper NO_NEW_TAPE result_argc != 2: %d]"),
-                      result_argc);
-		/*NOTREACHED*/
-            }
-	    start_degraded_mode(&runq);
-	    break;
+    case TAPE_ERROR: /* TAPE-ERROR <handle> <err mess> */
+	dp = serial2disk(result_argv[1]);
+	taper_slot = disk2taper(dp);
+	if (!taper_slot->dumper)
+	    free_serial(result_argv[1]);
+	qname = quote_string(dp->name);
+	g_printf(_("driver: finished-cmd time %s %s wrote %s:%s\n"),
+	       walltime_str(curclock()), taper_slot->name,
+	       dp->host->hostname, qname);
+	amfree(qname);
+	fflush(stdout);
+	q = quote_string(result_argv[2]);
+	log_add(L_WARNING, _("Taper error: %s"), q);
+	amfree(q);
+	taper_slot->tape_error = newstralloc(taper_slot->tape_error,
+					     result_argv[2]);
+	/*FALLTHROUGH*/
 
-	case DUMPER_STATUS:  /* DUMPER-STATUS <handle> */
-            if (result_argc != 2) {
-                error(_("error [taper NO_NEW_TAPE result_argc != 2: %d]"),
-                      result_argc);
-		/*NOTREACHED*/
-            }
-	    if (taper_dumper->result == LAST_TOK) {
-		taper_sendresult = 1;
-	    } else {
-		if( taper_dumper->result == DONE) {
-		    taper_cmd(DONE, NULL, NULL, 0, NULL);
+    case BOGUS:
+	if (cmd == BOGUS) {
+	    log_add(L_WARNING, _("Taper protocol error"));
+	}
+	/*
+	 * Since we received a taper error, we can't send anything more
+	 * to the taper.  Go into degraded mode to try to get everthing
+	 * onto disk.  Later, these dumps can be flushed to a new tape.
+	 * The tape queue is zapped so that it appears empty in future
+	 * checks. If there are dumps waiting for diskspace to be freed,
+	 * cancel one.
+	 */
+	if(!nodump) {
+	    log_add(L_WARNING,
+		    _("going into degraded mode because of taper component error."));
+	}
+	start_degraded_mode(&runq);
+	tapeq.head = tapeq.tail = NULL;
+	if(taper_ev_read != NULL) {
+	    event_release(taper_ev_read);
+	    taper_ev_read = NULL;
+	}
+	if(cmd != TAPE_ERROR) aclose(taper);
+
+	/* every slot's dumpfile is lost when the taper goes away */
+	if (cmd == BOGUS) {
+	    taper_t *t;
+	    for (t = tapetable; t < tapetable + taper_parallel_write; t++) {
+		if (!t->busy)
+		    continue;
+		t->tape_error = newstralloc(t->tape_error, "BOGUS");
+		t->result = cmd;
+		if (t->dumper) {
+		    if (t->dumper->result != LAST_TOK)
+			dumper_taper_result(t->disk);
 		} else {
-		    taper_cmd(FAILED, NULL, NULL, 0, NULL);
+		    file_taper_result(t->disk);
 		}
 	    }
-	    break;
-
-        case TAPE_ERROR: /* TAPE-ERROR <handle> <err mess> */
-            dp = serial2disk(result_argv[1]);
-	    if (!taper_dumper)
-		free_serial(result_argv[1]);
-	    qname = quote_string(dp->name);
-            g_printf(_("driver: finished-cmd time %s taper wrote %s:%s\n"),
-                   walltime_str(curclock()), dp->host->hostname, qname);
-	    amfree(qname);
-            fflush(stdout);
-	    q = quote_string(result_argv[2]);
-            log_add(L_WARNING, _("Taper error: %s"), q);
-	    amfree(q);
-	    taper_tape_error = newstralloc(taper_tape_error, result_argv[2]);
-            /*FALLTHROUGH*/
-
-        case BOGUS:
-            if (cmd == BOGUS) {
-        	log_add(L_WARNING, _("Taper protocol error"));
-		taper_tape_error = newstralloc(taper_tape_error, "BOGUS");
-            }
-            /*
-             * Since we received a taper error, we can't send anything more
-             * to the taper.  Go into degraded mode to try to get everthing
-             * onto disk.  Later, these dumps can be flushed to a new tape.
-             * The tape queue is zapped so that it appears empty in future
-             * checks. If there are dumps waiting for diskspace to be freed,
-             * cancel one.
-             */
-            if(!nodump) {
-                log_add(L_WARNING,
-                        _("going into degraded mode because of taper component error."));
-	    }
-	    start_degraded_mode(&runq);
-            tapeq.head = tapeq.tail = NULL;
-            taper_busy = 0;
-            if(taper_ev_read != NULL) {
-                event_release(taper_ev_read);
-                taper_ev_read = NULL;
-            }
-            if(cmd != TAPE_ERROR) aclose(taper);
-	    taper_result = cmd;
-
-            break;
-
-	default:
-            error(_("driver received unexpected token (%s) from taper"),
-                  cmdstr[cmd]);
-	    /*NOTREACHED*/
+	    return;
 	}
+	taper_slot->result = cmd;
 
-	g_strfreev(result_argv);
+	break;
 
-	if (taper_result != LAST_TOK) {
-	    if(taper_dumper) {
-		if (taper_dumper->result != LAST_TOK) {
-		    // Dumper already returned it's result
-		    dumper_taper_result(taper_disk);
-		}
-	    } else {
-		file_taper_result(taper_disk);
+    default:
+	error(_("driver received unexpected token (%s) from taper"),
+	      cmdstr[cmd]);
+	/*NOTREACHED*/
+    }
+
+    if (taper_slot && taper_slot->busy && taper_slot->result != LAST_TOK) {
+	if(taper_slot->dumper) {
+	    if (taper_slot->dumper->result != LAST_TOK) {
+		// Dumper already returned it's result
+		dumper_taper_result(taper_slot->disk);
 	    }
+	} else {
+	    file_taper_result(taper_slot->disk);
 	}
-        
-    } while(areads_dataready(taper));
+    }
 }
 
 
@@ -1570,23 +2015,24 @@ static void
 file_taper_result(
     disk_t *dp)
 {
+    taper_t *taper_slot = disk2taper(dp);
     char *qname = quote_string(dp->name);
 
-    if (taper_result == DONE) {
-	update_info_taper(dp, taper_first_label, taper_first_fileno,
+    if (taper_slot->result == DONE) {
+	update_info_taper(dp, taper_slot->first_label, taper_slot->first_fileno,
 			  sched(dp)->level);
     }
 
     sched(dp)->taper_attempted += 1;
 
-    if (taper_input_error) {
+    if (taper_slot->input_error) {
 	g_printf("driver: taper failed %s %s: %s\n",
-		   dp->host->hostname, qname, taper_input_error);
+		   dp->host->hostname, qname, taper_slot->input_error);
 	if (strcmp(sched(dp)->datestamp, driver_timestamp) == 0) {
 	    if(sched(dp)->taper_attempted >= 2) {
 		log_add(L_FAIL, _("%s %s %s %d [too many taper retries after holding disk error: %s]"),
 		    dp->host->hostname, qname, sched(dp)->datestamp,
-		    sched(dp)->level, taper_input_error);
+		    sched(dp)->level, taper_slot->input_error);
 		g_printf("driver: taper failed %s %s, too many taper retry after holding disk error\n",
 		   dp->host->hostname, qname);
 		amfree(sched(dp)->destname);
@@ -1598,7 +2044,7 @@ file_taper_result(
 	    } else {
 		log_add(L_INFO, _("%s %s %s %d [Will retry dump because of holding disk error: %s]"),
 			dp->host->hostname, qname, sched(dp)->datestamp,
-			sched(dp)->level, taper_input_error);
+			sched(dp)->level, taper_slot->input_error);
 		g_printf("driver: taper will retry %s %s because of holding disk error\n",
 			dp->host->hostname, qname);
 		if (dp->to_holdingdisk != HOLD_REQUIRED) {
@@ -1622,9 +2068,9 @@ file_taper_result(
 	    amfree(sched(dp)->datestamp);
 	    amfree(dp->up);
 	}
-    } else if (taper_tape_error) {
+    } else if (taper_slot->tape_error) {
 	g_printf("driver: taper failed %s %s with tape error: %s\n",
-		   dp->host->hostname, qname, taper_tape_error);
+		   dp->host->hostname, qname, taper_slot->tape_error);
 	if(sched(dp)->taper_attempted >= 2) {
 	    log_add(L_FAIL, _("%s %s %s %d [too many taper retries]"),
 		    dp->host->hostname, qname, sched(dp)->datestamp,
@@ -1643,7 +2089,7 @@ file_taper_result(
 	    /* Re-insert into taper queue. */
 	    headqueue_disk(&tapeq, dp);
 	}
-    } else if (taper_result != DONE) {
+    } else if (taper_slot->result != DONE) {
 	g_printf("driver: taper failed %s %s without error\n",
 		   dp->host->hostname, qname);
     } else {
@@ -1658,10 +2104,7 @@ file_taper_result(
 
     amfree(qname);
 
-    taper_busy = 0;
-    amfree(taper_input_error);
-    amfree(taper_tape_error);
-    taper_disk = NULL;
+    taper_slot_free(taper_slot);
             
     /* continue with those dumps waiting for diskspace */
     continue_port_dumps();
@@ -1674,17 +2117,18 @@ dumper_taper_result(
     disk_t *dp)
 {
     dumper_t *dumper;
+    taper_t *taper_slot = disk2taper(dp);
     int is_partial;
     char *qname;
 
     dumper = sched(dp)->dumper;
 
     free_serial_dp(dp);
-    if(dumper->result == DONE && taper_result == DONE) {
+    if(dumper->result == DONE && taper_slot->result == DONE) {
 	update_info_dumper(dp, sched(dp)->origsize,
 			   sched(dp)->dumpsize, sched(dp)->dumptime);
-	update_info_taper(dp, taper_first_label, taper_first_fileno,
-			  sched(dp)->level);
+	update_info_taper(dp, taper_slot->first_label,
+			  taper_slot->first_fileno, sched(dp)->level);
 	qname = quote_string(dp->name); /*quote to take care of spaces*/
 
 	log_add(L_STATS, _("estimate %s %s %s %d [sec %ld nkb %lld ckb %lld kps %lu]"),
@@ -1698,12 +2142,12 @@ dumper_taper_result(
 	update_failed_dump(dp);
     }
 
-    is_partial = dumper->result != DONE || taper_result != DONE;
+    is_partial = dumper->result != DONE || taper_slot->result != DONE;
 
     sched(dp)->dump_attempted += 1;
     sched(dp)->taper_attempted += 1;
 
-    if((dumper->result != DONE || taper_result != DONE) &&
+    if((dumper->result != DONE || taper_slot->result != DONE) &&
 	sched(dp)->dump_attempted <= 1 &&
 	sched(dp)->taper_attempted <= 1) {
 	enqueue_disk(&directq, dp);
@@ -1713,17 +2157,11 @@ dumper_taper_result(
 	event_release(dumper->ev_read);
 	dumper->ev_read = NULL;
     }
-    if(taper_ev_read != NULL) {
-	event_release(taper_ev_read);
-	taper_ev_read = NULL;
-    }
-    taper_busy = 0;
-    amfree(taper_input_error);
-    amfree(taper_tape_error);
     dumper->busy = 0;
     dp->host->inprogress -= 1;
     dp->inprogress = 0;
     deallocate_bandwidth(dp->host->netif, sched(dp)->est_kps);
+    taper_slot_free(taper_slot);
 }
 
 
@@ -1980,19 +2418,21 @@ handle_dumper_result(
 	 	dumper->chunker->result != LAST_TOK)
 		dumper_chunker_result(dp);
 	} else { /* send the dumper result to the taper */
-	    if (taper_sendresult) {
+	    taper_t *taper_slot = disk2taper(dp);
+
+	    if (taper_slot->sendresult) {
 		if (cmd == DONE) {
-		    taper_cmd(DONE, driver_timestamp, NULL, 0, NULL);
+		    taper_cmd(DONE, dp, NULL, 0, NULL);
 		} else {
-		    taper_cmd(FAILED, driver_timestamp, NULL, 0, NULL);
+		    taper_cmd(FAILED, dp, NULL, 0, NULL);
 		}
-		taper_sendresult = 0;
+		taper_slot->sendresult = 0;
+	    }
+	    if (taper_slot->result != LAST_TOK) {
+		dumper_taper_result(dp);
 	    }
 	}
-	if (taper_dumper && taper_result != LAST_TOK) {
-	    dumper_taper_result(dp);
-	}
-    } while(areads_dataready(dumper->fd));
+    } while(dumper->fd >= 0 && areads_dataready(dumper->fd));
 }
 
 
@@ -3133,6 +3573,7 @@ dump_to_tape(
     disk_t *	dp)
 {
     dumper_t *dumper;
+    taper_t *taper_slot;
     cmd_t cmd;
     int result_argc;
     char **result_argv;
@@ -3144,6 +3585,19 @@ dump_to_tape(
 	   dp->host->hostname, qname);
     fflush(stdout);
 
+    /* pick a taper slot and fail if they are all busy */
+
+    taper_slot = idle_taper();
+    if (!taper_slot) {
+	g_printf(_("driver: no idle taper for %s:%s.\n"),
+		dp->host->hostname, qname);
+	fflush(stdout);
+	log_add(L_WARNING, _("no idle taper for %s:%s.\n"),
+	        dp->host->hostname, qname);
+        amfree(qname);
+	return;	/* fatal problem */
+    }
+
     /* pick a dumper and fail if there are no idle dumpers */
 
     dumper = idle_dumper();
@@ -3159,23 +3613,41 @@ dump_to_tape(
 
     /* tell the taper to read from a port number of its choice */
 
+    taper_slot->busy = 1;
+    taper_slot->disk = dp;
+    taper_slot->dumper = NULL;
     taper_cmd(PORT_WRITE, dp, NULL, sched(dp)->level, sched(dp)->datestamp);
-    cmd = getresult(taper, 1, &result_argc, &result_argv);
-    if (dp->data_path == DATA_PATH_AMANDA && cmd != PORT) {
-	g_printf(_("driver: did not get PORT from taper for %s:%s\n"),
-		dp->host->hostname, qname);
-	fflush(stdout);
-	log_add(L_WARNING, _("driver: did not get PORT from taper for %s:%s.\n"),
-	        dp->host->hostname, qname);
-        amfree(qname);
-	return;	/* fatal problem */
+
+    /* the other taper slots keep writing while we wait for the port, so
+     * handle whatever they report before it */
+    for (;;) {
+	cmd = getresult(taper, 1, &result_argc, &result_argv);
+	if (cmd == PORT || cmd == DIRECTTCP_PORT)
+	    break;
+	if (cmd == BOGUS) {
+	    taper_slot->busy = 0;
+	    taper_slot->disk = NULL;
+	    process_taper_result(cmd, result_argc, result_argv);
+	    g_strfreev(result_argv);
+	    amfree(qname);
+	    return;	/* fatal problem */
+	}
+	if (result_argc >= 2 && serial2disk(result_argv[1]) == dp)
+	    break;
+	process_taper_result(cmd, result_argc, result_argv);
+	g_strfreev(result_argv);
     }
-    if (dp->data_path == DATA_PATH_DIRECTTCP && cmd != DIRECTTCP_PORT) {
-	g_printf(_("driver: did not get DIRECTTCP_PORT from taper for %s:%s\n"),
-		dp->host->hostname, qname);
+    if ((dp->data_path == DATA_PATH_AMANDA && cmd != PORT) ||
+	(dp->data_path == DATA_PATH_DIRECTTCP && cmd != DIRECTTCP_PORT)) {
+	char *port_cmd = dp->data_path == DATA_PATH_AMANDA ?
+			 "PORT" : "DIRECTTCP_PORT";
+	g_printf(_("driver: did not get %s from taper for %s:%s\n"),
+		port_cmd, dp->host->hostname, qname);
 	fflush(stdout);
-	log_add(L_WARNING, _("driver: did not get DIRECTTCP_PORT from taper for %s:%s.\n"),
-	        dp->host->hostname, qname);
+	log_add(L_WARNING, _("driver: did not get %s from taper for %s:%s.\n"),
+	        port_cmd, dp->host->hostname, qname);
+	taper_slot_free(taper_slot);
+	g_strfreev(result_argv);
         amfree(qname);
 	return;	/* fatal problem */
     }
@@ -3193,7 +3665,8 @@ dump_to_tape(
     dumper->dp = dp;
     dumper->chunker = NULL;
     dumper->result = LAST_TOK;
-    taper_result = LAST_TOK;
+    taper_slot->result = LAST_TOK;
+    taper_slot->sendresult = 0;
     sched(dp)->dumper = dumper;
 
     if (dp->host->pre_script == 0) {
@@ -3214,14 +3687,13 @@ dump_to_tape(
 
     /* update statistics & print state */
 
-    taper_busy = dumper->busy = 1;
-    taper_input_error = NULL;
-    taper_tape_error = NULL;
-    taper_dumper = dumper;
-    taper_disk = dp;
-    taper_first_label = NULL;
-    taper_written = 0;
-    taper_state |= TAPER_STATE_DUMP_TO_TAPE;
+    dumper->busy = 1;
+    amfree(taper_slot->input_error);
+    amfree(taper_slot->tape_error);
+    taper_slot->dumper = dumper;
+    amfree(taper_slot->first_label);
+    taper_slot->written = 0;
+    taper_slot->state |= TAPER_STATE_DUMP_TO_TAPE;
     sched(dp)->act_size = sched(dp)->est_size;
     dp->host->inprogress += 1;
     dp->inprogress = 1;
@@ -3233,8 +3705,10 @@ dump_to_tape(
 
     dumper->ev_read = event_register(dumper->fd, EV_READFD,
 				     handle_dumper_result, dumper);
-    taper_ev_read = event_register(taper, EV_READFD,
-				   handle_taper_result, NULL);
+    if (taper_ev_read == NULL) {
+	taper_ev_read = event_register(taper, EV_READFD,
+				       handle_taper_result, NULL);
+    }
 
     g_strfreev(result_argv);
 }
@@ -3263,8 +3737,9 @@ short_dump_state(void)
     g_printf(_("free kps: %lu space: %lld taper: "),
 	   free_kps(NULL),
 	   (long long)free_space());
+    /* amstatus reads this as a single word, whatever the number of slots */
     if(degraded_mode) g_printf(_("DOWN"));
-    else if(!taper_busy) g_printf(_("idle"));
+    else if(!busy_tapers()) g_printf(_("idle"));
     else g_printf(_("writing"));
     nidle = 0;
     for(i = 0; i < inparallel; i++) if(!dmptable[i].busy) nidle++;
@@ -3273,16 +3748,19 @@ short_dump_state(void)
     g_printf(_(" runq: %d"), queue_length(runq));
     g_printf(_(" roomq: %d"), queue_length(roomq));
     g_printf(_(" wakeup: %d"), (int)sleep_time);
-    g_printf(_(" driver-idle: %s\n"), _(idle_strings[idle_reason]));
+    g_printf(_(" driver-idle: %s"), _(idle_strings[idle_reason]));
+    g_printf(_(" sched-usec: %lu max-sched-usec: %lu\n"),
+	   sched_usec, sched_max_usec);
     interface_state(wall_time);
     holdingdisk_state(wall_time);
     fflush(stdout);
 }
 
-static TapeAction tape_action(char **why_no_new_tape)
+static TapeAction tape_action(taper_t *taper_slot, char **why_no_new_tape)
 {
     TapeAction result = TAPE_ACTION_NO_ACTION;
     dumper_t *dumper;
+    taper_t  *t;
     disk_t   *dp;
     off_t dumpers_size;
     off_t runq_size;
@@ -3315,8 +3793,9 @@ static TapeAction tape_action(char **why_no_new_tape)
     for(dp = tapeq.head; dp != NULL; dp = dp->next) {
 	tapeq_size += sched(dp)->act_size;
     }
-    if (taper_disk) {
-	tapeq_size += sched(taper_disk)->act_size - taper_written;
+    for (t = tapetable; t < tapetable + taper_parallel_write; t++) {
+	if (t->busy && t->disk)
+	    tapeq_size += sched(t->disk)->act_size - t->written;
     }
     driver_debug(1, _("tapeq_size: %lld\n"), (long long)tapeq_size);
 
@@ -3331,8 +3810,8 @@ static TapeAction tape_action(char **why_no_new_tape)
     // Changing conditionals can produce a driver hang, take care.
     // 
     // when to start writting to a new tape
-    if ((taper_state & TAPER_STATE_WAIT_FOR_TAPE) &&
-        ((taper_state & TAPER_STATE_DUMP_TO_TAPE) ||	// for dump to tape
+    if ((taper_slot->state & TAPER_STATE_WAIT_FOR_TAPE) &&
+        ((taper_slot->state & TAPER_STATE_DUMP_TO_TAPE) ||	// for dump to tape
 	 !empty(directq) ||				// if a dle is waiting for a dump to tape
          !empty(roomq) ||				// holding disk constraint
          idle_reason == IDLE_NO_DISKSPACE ||		// holding disk constraint
@@ -3344,7 +3823,7 @@ static TapeAction tape_action(char **why_no_new_tape)
 	)) {
 	result |= TAPE_ACTION_NEW_TAPE;
     // when to stop using new tape
-    } else if ((taper_state & TAPER_STATE_WAIT_FOR_TAPE) &&
+    } else if ((taper_slot->state & TAPER_STATE_WAIT_FOR_TAPE) &&
 	       (taperflush >= tapeq_size &&		// taperflush criteria not meet
 	        (force_flush == 1 ||			//  if force_flush
 		 dump_to_disk_terminated))		//  or all dump to disk terminated
@@ -3363,10 +3842,11 @@ static TapeAction tape_action(char **why_no_new_tape)
     // We don't start a flush if taper_tape_started == 1 && dump_to_disk_terminated && force_flush == 0,
     // it is a criteria need to exit the first event_loop without flushing everything to tape,
     // they will be flush in another event_loop.
-    if (!degraded_mode && !taper_busy && !empty(tapeq) &&
-	(!((taper_state & TAPER_STATE_TAPE_STARTED) &&
+    if (!degraded_mode && !taper_slot->busy &&
+	!(taper_slot->state & TAPER_STATE_DONE) && !empty(tapeq) &&
+	(!((taper_slot->state & TAPER_STATE_TAPE_STARTED) &&
 	    dump_to_disk_terminated && force_flush == 0) ||	// if tape already started and dump to disk not terminated
-         ((taper_state & TAPER_STATE_TAPE_STARTED) &&
+         ((taper_slot->state & TAPER_STATE_TAPE_STARTED) &&
 	  force_flush == 1) ||					// if tape already started and force_flush
          !empty(roomq) ||					// holding disk constraint
          idle_reason == IDLE_NO_DISKSPACE ||			// holding disk constraint
@@ -3392,12 +3872,16 @@ dump_state(
     g_printf(_("free kps: %lu, space: %lld\n"),
     	   free_kps(NULL),
     	   (long long)free_space());
-    if(degraded_mode) g_printf(_("taper: DOWN\n"));
-    else if(!taper_busy) g_printf(_("taper: idle\n"));
-    else g_printf(_("taper: writing %s:%s.%d est size %lld\n"),
-		taper_disk->host->hostname, taper_disk->name,
-		sched(taper_disk)->level,
-		(long long)sched(taper_disk)->est_size);
+    g_printf(_("scheduling time: %lu usec, max %lu usec\n"),
+	   sched_usec, sched_max_usec);
+    for(i = 0; i < taper_parallel_write; i++) {
+	dp = tapetable[i].disk;
+	if(degraded_mode) g_printf(_("%s: DOWN\n"), tapetable[i].name);
+	else if(!tapetable[i].busy) g_printf(_("%s: idle\n"), tapetable[i].name);
+	else g_printf(_("%s: writing %s:%s.%d est size %lld\n"),
+		tapetable[i].name, dp->host->hostname, dp->name,
+		sched(dp)->level, (long long)sched(dp)->est_size);
+    }
     for(i = 0; i < inparallel; i++) {
 	dp = dmptable[i].dp;
 	if(!dmptable[i].busy)
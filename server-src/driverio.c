@@ -44,17 +44,26 @@
 int nb_chunker = 0;
 
 static const char *childstr(int);
+static int disk2worker(disk_t *dp);
 
 void
 init_driverio(void)
 {
     dumper_t *dumper;
+    taper_t *taper_slot;
+    char number[NUM_STR_SIZE];
 
     taper = -1;
 
     for(dumper = dmptable; dumper < dmptable + MAX_DUMPERS; dumper++) {
 	dumper->fd = -1;
     }
+
+    for(taper_slot = tapetable; taper_slot < tapetable + MAX_TAPERS;
+	taper_slot++) {
+	g_snprintf(number, SIZEOF(number), "%d", (int)(taper_slot - tapetable));
+	taper_slot->name = stralloc2("taper", number);
+    }
 }
 
 
@@ -279,6 +288,22 @@ getresult(
     return BOGUS;
 }
 
+/* Return the index of the taper slot (and so the taper worker) that was
+ * given dp to write; the caller marks the slot before sending the command. */
+static int
+disk2worker(
+    disk_t *dp)
+{
+    taper_t *taper_slot;
+
+    for (taper_slot = tapetable; taper_slot < tapetable + MAX_TAPERS;
+	 taper_slot++) {
+	if (taper_slot->busy && taper_slot->disk == dp)
+	    return (int)(taper_slot - tapetable);
+    }
+    error(_("no taper slot was given %s:%s"), dp->host->hostname, dp->name);
+    /*NOTREACHED*/
+}
 
 int
 taper_cmd(
@@ -289,6 +314,7 @@ taper_cmd(
     char *datestamp)
 {
     char *cmdline = NULL;
+    char worker[NUM_STR_SIZE];
     char number[NUM_STR_SIZE];
     char splitsize[NUM_STR_SIZE];
     char fallback_splitsize[NUM_STR_SIZE];
@@ -306,10 +332,12 @@ taper_cmd(
 	dp = (disk_t *) ptr;
         qname = quote_string(dp->name);
 	qdest = quote_string(destname);
+	g_snprintf(worker, SIZEOF(worker), "%d", disk2worker(dp));
 	g_snprintf(number, SIZEOF(number), "%d", level);
 	g_snprintf(splitsize, SIZEOF(splitsize), "%lld",
 		 (long long)dp->tape_splitsize * 1024);
 	cmdline = vstralloc(cmdstr[cmd],
+			    " ", worker,
 			    " ", disk2serial(dp),
 			    " ", qdest,
 			    " ", dp->host->hostname,
@@ -324,6 +352,7 @@ taper_cmd(
     case PORT_WRITE:
 	dp = (disk_t *) ptr;
         qname = quote_string(dp->name);
+	g_snprintf(worker, SIZEOF(worker), "%d", disk2worker(dp));
 	g_snprintf(number, SIZEOF(number), "%d", level);
 
 	/*
@@ -341,6 +370,7 @@ taper_cmd(
 	g_snprintf(fallback_splitsize, SIZEOF(fallback_splitsize), "%lld",
 		 (long long)dp->fallback_splitsize * 1024);
 	cmdline = vstralloc(cmdstr[cmd],
+			    " ", worker,
 			    " ", disk2serial(dp),
 			    " ", dp->host->hostname,
 			    " ", qname,
@@ -360,14 +390,21 @@ taper_cmd(
 			    " ", disk2serial(dp),
 			    "\n", NULL);
 	break;
-    case NO_NEW_TAPE:
-	q = quote_string((char *)ptr);
+    case NO_NEW_TAPE: /* handle, reason (in destname) */
+	dp = (disk_t *) ptr;
+	q = quote_string(destname);
 	cmdline = vstralloc(cmdstr[cmd],
+			    " ", disk2serial(dp),
 			    " ", q,
 			    "\n", NULL);
 	amfree(q);
 	break;
-    case NEW_TAPE:
+    case NEW_TAPE: /* handle */
+	dp = (disk_t *) ptr;
+	cmdline = vstralloc(cmdstr[cmd],
+			    " ", disk2serial(dp),
+			    "\n", NULL);
+	break;
     case QUIT:
 	cmdline = stralloc2(cmdstr[cmd], "\n");
 	break;
@@ -668,7 +705,7 @@ chunker_cmd(
     return 1;
 }
 
-#define MAX_SERIAL MAX_DUMPERS+1	/* one for the taper */
+#define MAX_SERIAL (MAX_DUMPERS+MAX_TAPERS)	/* one for each taper slot */
 
 long generation = 1;
 
@@ -123,23 +123,36 @@ typedef enum {
    TAPER_STATE_DUMP_TO_TAPE  = (1 << 0), // if taper is doing a dump to tape
    TAPER_STATE_WAIT_FOR_TAPE = (1 << 1), // if taper wait for a tape, after a
 					 //   REQUEST-NEW-TAPE
-   TAPER_STATE_TAPE_STARTED  = (1 << 2)	 // taper already started to write to
+   TAPER_STATE_TAPE_STARTED  = (1 << 2),	 // taper already started to write to
 					 //   a tape.
+   TAPER_STATE_DONE          = (1 << 3)	 // worker refused a new tape; not
+					 //   used any more.
 } TaperState;
 
-GLOBAL int taper, taper_busy;
-GLOBAL int taper_sendresult;
-GLOBAL char *taper_input_error;
-GLOBAL char *taper_tape_error;
+/* One of these for each dumpfile the taper can write at the same time
+ * (taper-parallel-write).  Slot i is driven by the taper's i'th worker;
+ * FILE-WRITE and PORT-WRITE name the worker to use. */
+typedef struct taper_s {
+    char *name;			/* name for debugging */
+    int busy;			/* writing a dumpfile */
+    int sendresult;
+    char *input_error;
+    char *tape_error;
+    int result;
+    dumper_t *dumper;		/* dumper feeding a PORT-WRITE, or NULL */
+    disk_t *disk;
+    char *first_label;
+    off_t first_fileno;
+    TaperState state;
+    off_t left;			// Number of kb left on the current tape
+    off_t written;		// Number of kb already written to tape
+				//   for the DLE.
+} taper_t;
+
+GLOBAL taper_t tapetable[MAX_TAPERS];
+GLOBAL int taper;
 GLOBAL pid_t taper_pid;
-GLOBAL int taper_result;
-GLOBAL dumper_t *taper_dumper;
 GLOBAL event_handle_t *taper_ev_read;
-GLOBAL char *taper_first_label;
-GLOBAL off_t taper_first_fileno;
-GLOBAL TaperState taper_state;
-GLOBAL off_t taper_written;		// Number of kb already written to tape
-					//   for the DLE.
 
 void init_driverio(void);
 void startup_tape_process(char *taper_program);
@@ -44,6 +44,7 @@
 #include "util.h"
 #include "timestamp.h"
 #include "amxml.h"
+#include "amxfer.h"
 
 #define dumper_debug(i,x) do {		\
 	if ((i) <= debug_dumper) {	\
@@ -70,6 +71,9 @@ struct databuf {
     char *dataout;
     char *datalimit;
     pid_t compresspid;		/* valid if fd is pipe to compress */
+    Xfer *compress_xfer;	/* valid if fd is pipe to in-process compression */
+    gboolean compress_done;	/* set when compress_xfer has finished */
+    char *compress_error;	/* set if compress_xfer failed */
     pid_t encryptpid;		/* valid if fd is pipe to encrypt */
 };
 
@@ -155,6 +159,10 @@ static void	log_msgout(logtype_t);
 static char *	dumper_get_security_conf (char *, void *);
 
 static int	runcompress(int, pid_t *, comp_t);
+#ifdef HAVE_ZLIB
+static int	start_compress_xfer(struct databuf *, comp_t);
+static void	finish_compress_xfer(struct databuf *, gboolean);
+#endif
 static int	runencrypt(int, pid_t *,  encrypt_t);
 
 static void	sendbackup_response(void *, pkt_t *, security_handle_t *);
@@ -331,6 +339,9 @@ main(
 
     dbopen(DBG_SUBDIR_SERVER);
 
+    /* the compression xfer runs in threads */
+    glib_init();
+
     /* Don't die when child closes pipe */
     signal(SIGPIPE, SIG_IGN);
 
@@ -536,7 +547,7 @@ main(
 	    /* connect outf to chunker/taper port */
 
 	    outfd = stream_client("localhost", taper_port,
-				  STREAM_BUFSIZE, 0, NULL, 0);
+				  STREAM_BUFSIZE_LARGE, 0, NULL, 0);
 	    if (outfd == -1) {
 		
 		errstr = newvstrallocf(errstr, _("port open: %s"),
@@ -642,6 +653,8 @@ databuf_init(
     db->fd = fd;
     db->datain = db->dataout = db->datalimit = NULL;
     db->compresspid = -1;
+    db->compress_xfer = NULL;
+    db->compress_error = NULL;
     db->encryptpid = -1;
 }
 
@@ -1232,6 +1245,20 @@ do_dump(
 	if (!errstr) errstr = stralloc(_("got no data"));
     }
 
+#ifdef HAVE_ZLIB
+    /* the image is only complete once the compression has finished */
+    if (db->compress_xfer && dump_result <= 1) {
+	aclose(db->fd);
+	finish_compress_xfer(db, FALSE);
+	if (db->compress_error) {
+	    dump_result = 2;
+	    errstr = newvstrallocf(errstr, _("compression failed: %s"),
+				   db->compress_error);
+	    amfree(db->compress_error);
+	}
+    }
+#endif
+
     if (dump_result > 1)
 	goto failed;
 
@@ -1290,6 +1317,10 @@ do_dump(
 	waitpid(db->compresspid,NULL,0);
 	log_add(L_INFO, "pid-done %ld", (long)db->compresspid);
     }
+#ifdef HAVE_ZLIB
+    if (db->compress_xfer)
+	finish_compress_xfer(db, FALSE);
+#endif
     if(db->encryptpid != -1) {
 	waitpid(db->encryptpid,NULL,0);
 	log_add(L_INFO, "pid-done %ld", (long)db->encryptpid);
@@ -1324,6 +1355,11 @@ failed:
 	    log_add(L_INFO, "pid-done %ld", (long)db->compresspid);
 	}
     }
+#ifdef HAVE_ZLIB
+    if (db->compress_xfer)
+	finish_compress_xfer(db, TRUE);
+    amfree(db->compress_error);
+#endif
 
     if (db->encryptpid != -1) {
 	g_fprintf(stderr,_("%s: kill encrypt command\n"),get_pname());
@@ -1444,6 +1480,15 @@ read_mesgfd(
 	 * Now, setup the compress for the data output, and start
 	 * reading the datafd.
 	 */
+#ifdef HAVE_ZLIB
+	if (srvcompress == COMP_FAST || srvcompress == COMP_BEST) {
+	    if (start_compress_xfer(db, srvcompress) < 0) {
+		dump_result = 2;
+		stop_dump();
+		return;
+	    }
+	} else
+#endif
 	if ((srvcompress != COMP_NONE) && (srvcompress != COMP_CUST)) {
 	    if (runcompress(db->fd, &db->compresspid, srvcompress) < 0) {
 		dump_result = 2;
@@ -1718,6 +1763,125 @@ runcompress(
     return (-1);
 }
 
+#ifdef HAVE_ZLIB
+static void
+compress_xfer_callback(
+    gpointer	data,
+    XMsg *	msg,
+    Xfer *	xfer)
+{
+    struct databuf *db = data;
+
+    switch (msg->type) {
+    case XMSG_ERROR:
+	g_fprintf(stderr, _("%s: compression failed: %s\n"),
+		  get_pname(), msg->message);
+	if (!db->compress_error)
+	    db->compress_error = stralloc(msg->message);
+	break;
+
+    case XMSG_DONE:
+	if (xfer->status == XFER_DONE)
+	    db->compress_done = TRUE;
+	break;
+
+    default:
+	break;
+    }
+}
+
+/*
+ * The number of threads each dumper compresses with: the CPUs shared out
+ * among the inparallel dumpers, so that together they do not run more
+ * compression threads than there are CPUs, but at least one each.
+ */
+static int
+compress_threads(void)
+{
+    long ncpu = 1;
+    int inparallel = getconf_int(CNF_INPARALLEL);
+
+#ifdef _SC_NPROCESSORS_ONLN
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (ncpu < 1)
+	ncpu = 1;
+    if (inparallel < 1)
+	inparallel = 1;
+    return (int)max(ncpu / inparallel, 1);
+}
+
+/*
+ * Compresses in this process, with compress_threads() threads, instead
+ * of running COMPRESS_PATH.  As with runcompress, db->fd becomes a pipe,
+ * here to a transfer that compresses what it reads and writes it where
+ * db->fd used to go.  The transfer's messages are delivered by the event
+ * loop; do_dump waits for it to finish before reporting the dump done.
+ * Returns 0 on success or negative if error.
+ */
+static int
+start_compress_xfer(
+    struct databuf *	db,
+    comp_t		comptype)
+{
+    int outpipe[2];
+    XferElement *elements[3];
+    GSource *src;
+    int i;
+
+    if (pipe(outpipe) < 0) {
+	errstr = newvstrallocf(errstr, _("pipe: %s"), strerror(errno));
+	return (-1);
+    }
+
+    /* the source and destination work on copies of these descriptors */
+    elements[0] = xfer_source_fd(outpipe[0]);
+    elements[1] = xfer_filter_gzip(comptype == COMP_BEST ? 9 : 1,
+				   compress_threads());
+    elements[2] = xfer_dest_fd(db->fd);
+    aclose(outpipe[0]);
+
+    if (dup2(outpipe[1], db->fd) < 0) {
+	errstr = newvstrallocf(errstr, _("couldn't dup2: %s"), strerror(errno));
+	aclose(outpipe[1]);
+	for (i = 0; i < 3; i++)
+	    g_object_unref(elements[i]);
+	return (-1);
+    }
+    aclose(outpipe[1]);
+
+    db->compress_xfer = xfer_new(elements, 3);
+    for (i = 0; i < 3; i++)
+	g_object_unref(elements[i]);
+
+    db->compress_done = FALSE;
+    src = xfer_get_source(db->compress_xfer);
+    g_source_set_callback(src, (GSourceFunc)compress_xfer_callback, db, NULL);
+    g_source_attach(src, NULL);
+    xfer_start(db->compress_xfer);
+
+    return (0);
+}
+
+/*
+ * Waits for the compression transfer to finish, after db->fd has been
+ * closed, cancelling it first if the dump failed.
+ */
+static void
+finish_compress_xfer(
+    struct databuf *	db,
+    gboolean		cancel)
+{
+    if (cancel && !db->compress_done)
+	xfer_cancel(db->compress_xfer);
+    while (!db->compress_done)
+	g_main_context_iteration(NULL, TRUE);
+
+    xfer_unref(db->compress_xfer);
+    db->compress_xfer = NULL;
+}
+#endif
+
 /*
  * Runs encrypt with the first arg as its stdout.  Returns
  * 0 on success or negative if error, and it's pid via the second
@@ -45,9 +45,68 @@ static int find_compare(const void *, const void *);
 static int parse_taper_datestamp_log(char *logline, char **datestamp, char **level);
 static gboolean logfile_has_tape(char * label, char * datestamp,
                                  char * logfile);
+static GPtrArray *parse_logfile_tapes(const char *logfile);
+static find_result_t *parse_logfile(const char *label,
+				    const char *passed_datestamp,
+				    const char *logfile,
+				    gboolean *found_start,
+				    GPtrArray *disks);
 
 static char *find_sort_order = NULL;
 
+/*
+ * The dump catalog.  Reading every logfile for each "amadmin find" or
+ * Amanda::DB::Catalog query gets slow with years of logs, so the results
+ * of parsing a logfile are kept in the "catalog" file in the log
+ * directory.  The catalog is a sequence of blocks, each ending with an
+ * END line; new blocks are only ever appended, and a later block for
+ * the same key replaces an earlier one:
+ *
+ *   TAPES <logfile> <size> <mtime>
+ *   TAPE <datestamp> <label>
+ *   END
+ *   SEARCH <logfile> <size> <mtime> <label> <datestamp> <found_start>
+ *   DISK <hostname> <diskname>
+ *   DUMP <timestamp> <hostname> <diskname> <level> <label> <filenum>
+ *        <partnum> <totalparts> <sec> <kb> <status>
+ *   END
+ *
+ * A TAPES block lists the taper START lines of a logfile, and a SEARCH
+ * block holds what parse_logfile returned for a label and datestamp (""
+ * for NULL), before any disklist filtering.  An entry is only used if
+ * its logfile still has the same size and mtime; otherwise the logfile is
+ * parsed again and a new block appended.  amlogroll adds the blocks for
+ * each logfile as it is closed, amtrmlog drops the blocks of logfiles
+ * that have gone, and the catalog can simply be removed to rebuild it.
+ */
+
+#define CATALOG_NAME "catalog"
+
+typedef struct catalog_entry_s {
+    char *logfile;
+    char *label;		/* NULL for a TAPES entry */
+    char *datestamp;
+    off_t size;
+    time_t mtime;
+    gboolean transient;		/* not kept in the catalog table */
+    GPtrArray *tapes;		/* TAPES: datestamp, label, ... */
+    gboolean found_start;	/* SEARCH */
+    GPtrArray *disks;		/* SEARCH: hostname, diskname, ... */
+    find_result_t *results;	/* SEARCH, in order */
+} catalog_entry_t;
+
+static GHashTable *catalog = NULL;
+static char *catalog_filename = NULL;
+static off_t catalog_offset = 0;
+static ino_t catalog_ino = 0;
+
+static catalog_entry_t *catalog_tapes(const char *logfile, gboolean force);
+static catalog_entry_t *catalog_search(const char *label,
+				       const char *datestamp,
+				       const char *logfile,
+				       gboolean force);
+static void catalog_release(catalog_entry_t *entry);
+
 find_result_t * find_dump(disklist_t* diskqp) {
     char *conf_logdir, *logfile = NULL;
     int tape, maxtape, logs;
@@ -590,8 +649,33 @@ parse_taper_datestamp_log(
 /* Returns TRUE if the given logfile mentions the given tape. */
 static gboolean logfile_has_tape(char * label, char * datestamp,
                                  char * logfile) {
+    catalog_entry_t *entry;
+    gboolean found = FALSE;
+    guint i;
+
+    entry = catalog_tapes(logfile, FALSE);
+    for (i = 0; i < entry->tapes->len; i += 2) {
+	if (strcmp(g_ptr_array_index(entry->tapes, i), datestamp) == 0 &&
+	    strcmp(g_ptr_array_index(entry->tapes, i+1), label) == 0) {
+	    found = TRUE;
+	    break;
+	}
+    }
+    catalog_release(entry);
+
+    return found;
+}
+
+/* Return the datestamp and label of each taper START line in a logfile,
+ * as a flat array of datestamp, label pairs. */
+static GPtrArray *
+parse_logfile_tapes(
+    const char *logfile)
+{
     FILE * logf;
     char * ck_datestamp, *ck_label;
+    GPtrArray *tapes = g_ptr_array_new();
+
     if((logf = fopen(logfile, "r")) == NULL) {
 	error(_("could not open logfile %s: %s"), logfile, strerror(errno));
 	/*NOTREACHED*/
@@ -603,16 +687,15 @@ static gboolean logfile_has_tape(char * label, char * datestamp,
 					 &ck_datestamp, &ck_label) == 0) {
 		g_printf(_("strange log line \"start taper %s\" curstr='%s'\n"),
                          logfile, curstr);
-	    } else if(strcmp(ck_datestamp, datestamp) == 0
-		      && strcmp(ck_label, label) == 0) {
-                afclose(logf);
-                return TRUE;
+	    } else {
+		g_ptr_array_add(tapes, stralloc(ck_datestamp));
+		g_ptr_array_add(tapes, stralloc(ck_label));
 	    }
 	}
     }
 
     afclose(logf);
-    return FALSE;
+    return tapes;
 }
 
 /* Like (strcmp(label1, label2) == 0), except that NULL values force TRUE. */
@@ -620,17 +703,24 @@ static gboolean volume_matches(const char * label1, const char * label2) {
     return (label1 == NULL || label2 == NULL || strcmp(label1, label2) == 0);
 }
 
-/* WARNING: Function accesses globals find_diskqp, curlog, curlog, curstr,
- * dynamic_disklist */
-gboolean
-search_logfile(
-    find_result_t **output_find,
+/* Parse a logfile for search_logfile, without looking at the disklist:
+ * return every dump it would find, in order, and add the host and disk
+ * names of every dump line to disks.  found_start is set if the logfile
+ * has a taper START line for label and passed_datestamp.
+ *
+ * WARNING: Function accesses globals curlog, curprog, curstr */
+static find_result_t *
+parse_logfile(
     const char *label,
     const char *passed_datestamp,
     const char *logfile,
-    disklist_t * dynamic_disklist)
+    gboolean *found_start,
+    GPtrArray *disks)
 {
     FILE *logf;
+    find_result_t *output = NULL;
+    find_result_t **output_find = &output;
+    GHashTable *disks_seen;
     char *host, *host_undo;
     char *disk, *qdisk, *disk_undo;
     char *date, *date_undo;
@@ -647,21 +737,18 @@ search_logfile(
     char *ck_datestamp, *datestamp;
     char *s;
     int ch;
-    disk_t *dp;
     find_result_t *part_find = NULL;  /* List for all part of a DLE */
     find_result_t *a_part_find;
     gboolean right_label = FALSE;
-    gboolean found_something = FALSE;
     regex_t regex;
     int reg_result;
     regmatch_t pmatch[3];
     double sec;
     size_t kb;
 
-    g_return_val_if_fail(output_find != NULL, 0);
-    g_return_val_if_fail(logfile != NULL, 0);
-
+    *found_start = FALSE;
     datestamp = g_strdup(passed_datestamp);
+    disks_seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
     if((logf = fopen(logfile, "r")) == NULL) {
 	error(_("could not open logfile %s: %s"), logfile, strerror(errno));
@@ -687,7 +774,7 @@ search_logfile(
             
             right_label = volume_matches(label, ck_label);
 	    if (label && datestamp && right_label) {
-		found_something = TRUE;
+		*found_start = TRUE;
 	    }
             amfree(current_label);
             current_label = g_strdup(ck_label);
@@ -844,107 +931,105 @@ search_logfile(
 	    }
 	    regfree(&regex);
 
-	    dp = lookup_disk(host,disk);
-	    if ( dp == NULL ) {
-		if (dynamic_disklist == NULL) {
-		    continue;
+	    /* note the disk, for the disklist */
+	    {
+		char *key = vstralloc(host, "\t", disk, NULL);
+		if (g_hash_table_lookup(disks_seen, key) == NULL) {
+		    g_ptr_array_add(disks, stralloc(host));
+		    g_ptr_array_add(disks, stralloc(disk));
+		    g_hash_table_insert(disks_seen, key, key);
+		} else {
+		    amfree(key);
 		}
-		dp = add_disk(dynamic_disklist, host, disk);
-		enqueue_disk(dynamic_disklist, dp);
 	    }
-            if (find_match(host, disk)) {
-		if(curprog == P_TAPER) {
-		    find_result_t *new_output_find = g_new0(find_result_t, 1);
-		    new_output_find->timestamp = stralloc(date);
-		    new_output_find->hostname=stralloc(host);
-		    new_output_find->diskname=stralloc(disk);
-		    new_output_find->level=level;
-		    new_output_find->partnum = partnum;
-		    new_output_find->totalparts = totalparts;
-                    new_output_find->label=stralloc(current_label);
-		    new_output_find->status=NULL;
-		    new_output_find->filenum=filenum;
-		    new_output_find->sec=sec;
-		    new_output_find->kb=kb;
-		    new_output_find->next=NULL;
-		    if (curlog == L_SUCCESS) {
-			new_output_find->status = stralloc("OK");
-			new_output_find->next = *output_find;
-			*output_find = new_output_find;
-                        found_something = TRUE;
-		    } else if (curlog == L_CHUNKSUCCESS || curlog == L_DONE ||
-			       curlog == L_PARTIAL      || curlog == L_FAIL) {
-			/* result line */
-			if (curlog == L_PARTIAL || curlog == L_FAIL) {
-			    /* change status of each part */
-			    for (a_part_find = part_find; a_part_find;
-				 a_part_find = a_part_find->next) {
-				if (curlog == L_PARTIAL)
-				    a_part_find->status = stralloc("PARTIAL");
-				else
-				    a_part_find->status = stralloc(rest);
-			    }
+
+	    if(curprog == P_TAPER) {
+		find_result_t *new_output_find = g_new0(find_result_t, 1);
+		new_output_find->timestamp = stralloc(date);
+		new_output_find->hostname=stralloc(host);
+		new_output_find->diskname=stralloc(disk);
+		new_output_find->level=level;
+		new_output_find->partnum = partnum;
+		new_output_find->totalparts = totalparts;
+		new_output_find->label=stralloc(current_label);
+		new_output_find->status=NULL;
+		new_output_find->filenum=filenum;
+		new_output_find->sec=sec;
+		new_output_find->kb=kb;
+		new_output_find->next=NULL;
+		if (curlog == L_SUCCESS) {
+		    new_output_find->status = stralloc("OK");
+		    new_output_find->next = *output_find;
+		    *output_find = new_output_find;
+		} else if (curlog == L_CHUNKSUCCESS || curlog == L_DONE ||
+			   curlog == L_PARTIAL      || curlog == L_FAIL) {
+		    /* result line */
+		    if (curlog == L_PARTIAL || curlog == L_FAIL) {
+			/* change status of each part */
+			for (a_part_find = part_find; a_part_find;
+			     a_part_find = a_part_find->next) {
+			    if (curlog == L_PARTIAL)
+				a_part_find->status = stralloc("PARTIAL");
+			    else
+				a_part_find->status = stralloc(rest);
 			}
-			if (curlog == L_DONE) {
-			    for (a_part_find = part_find; a_part_find;
-			         a_part_find = a_part_find->next) {
-				if (a_part_find->totalparts == -1) {
-				    a_part_find->totalparts = maxparts;
-				}
+		    }
+		    if (curlog == L_DONE) {
+			for (a_part_find = part_find; a_part_find;
+			     a_part_find = a_part_find->next) {
+			    if (a_part_find->totalparts == -1) {
+				a_part_find->totalparts = maxparts;
 			    }
 			}
-			if (part_find) { /* find last element */
-			    for (a_part_find = part_find;
-				 a_part_find->next != NULL;
-				 a_part_find=a_part_find->next) {
-			    }
-			    /* merge part_find to *output_find */
-			    a_part_find->next = *output_find;
-			    *output_find = part_find;
-			    part_find = NULL;
-			    maxparts = -1;
-                            found_something = TRUE;
+		    }
+		    if (part_find) { /* find last element */
+			for (a_part_find = part_find;
+			     a_part_find->next != NULL;
+			     a_part_find=a_part_find->next) {
 			}
-			free_find_result(&new_output_find);
-		    } else { /* part line */
-			if (curlog == L_PART || curlog == L_CHUNK)
-			    new_output_find->status=stralloc("OK");
-			else /* PARTPARTIAL */
-			    new_output_find->status=stralloc("PARTIAL");
-			/* Add to part_find list */
-			new_output_find->next = part_find;
-			part_find = new_output_find;
-			found_something = TRUE;
+			/* merge part_find to *output_find */
+			a_part_find->next = *output_find;
+			*output_find = part_find;
+			part_find = NULL;
+			maxparts = -1;
 		    }
-		}
-		else if(curlog == L_FAIL) {
-		    /* print other failures too -- this is a hack to ensure that failures which
-		     * did not make it to tape are also listed in the output of 'amadmin x find';
-		     * users that do not want this information (e.g., Amanda::DB::Catalog) should
-		     * filter dumps with a NULL label. */
-		    find_result_t *new_output_find = g_new0(find_result_t, 1);
-		    new_output_find->next=*output_find;
-		    new_output_find->timestamp = stralloc(date);
-		    new_output_find->hostname=stralloc(host);
-		    new_output_find->diskname=stralloc(disk);
-		    new_output_find->level=level;
-		    new_output_find->label=NULL;
-		    new_output_find->partnum=partnum;
-		    new_output_find->totalparts=totalparts;
-		    new_output_find->filenum=0;
-		    new_output_find->sec=sec;
-		    new_output_find->kb=kb;
-		    new_output_find->status=vstralloc(
-			 "FAILED (",
-			 program_str[(int)curprog],
-			 ") ",
-			 rest,
-			 NULL);
-		    *output_find=new_output_find;
-                    found_something = TRUE;
-		    maxparts = -1;
+		    free_find_result(&new_output_find);
+		} else { /* part line */
+		    if (curlog == L_PART || curlog == L_CHUNK)
+			new_output_find->status=stralloc("OK");
+		    else /* PARTPARTIAL */
+			new_output_find->status=stralloc("PARTIAL");
+		    /* Add to part_find list */
+		    new_output_find->next = part_find;
+		    part_find = new_output_find;
 		}
 	    }
+	    else if(curlog == L_FAIL) {
+		/* print other failures too -- this is a hack to ensure that failures which
+		 * did not make it to tape are also listed in the output of 'amadmin x find';
+		 * users that do not want this information (e.g., Amanda::DB::Catalog) should
+		 * filter dumps with a NULL label. */
+		find_result_t *new_output_find = g_new0(find_result_t, 1);
+		new_output_find->next=*output_find;
+		new_output_find->timestamp = stralloc(date);
+		new_output_find->hostname=stralloc(host);
+		new_output_find->diskname=stralloc(disk);
+		new_output_find->level=level;
+		new_output_find->label=NULL;
+		new_output_find->partnum=partnum;
+		new_output_find->totalparts=totalparts;
+		new_output_find->filenum=0;
+		new_output_find->sec=sec;
+		new_output_find->kb=kb;
+		new_output_find->status=vstralloc(
+		     "FAILED (",
+		     program_str[(int)curprog],
+		     ") ",
+		     rest,
+		     NULL);
+		*output_find=new_output_find;
+		maxparts = -1;
+	    }
 	    amfree(disk);
 	}
     }
@@ -986,10 +1071,507 @@ search_logfile(
     afclose(logf);
     amfree(datestamp);
     amfree(current_label);
+    g_hash_table_destroy(disks_seen);
 
-    return found_something;
+    return output;
+}
+
+
+static void
+free_string_array(
+    GPtrArray *array)
+{
+    guint i;
+
+    if (array == NULL)
+	return;
+    for (i = 0; i < array->len; i++)
+	g_free(g_ptr_array_index(array, i));
+    g_ptr_array_free(array, TRUE);
+}
+
+static find_result_t *
+copy_find_result(
+    find_result_t *result)
+{
+    find_result_t *copy = g_new0(find_result_t, 1);
+
+    memcpy(copy, result, SIZEOF(find_result_t));
+    copy->timestamp = stralloc(result->timestamp);
+    copy->hostname = stralloc(result->hostname);
+    copy->diskname = stralloc(result->diskname);
+    copy->label = result->label? stralloc(result->label) : NULL;
+    copy->status = result->status? stralloc(result->status) : NULL;
+    copy->user_ptr = NULL;
+    copy->next = NULL;
+
+    return copy;
+}
+
+static void
+catalog_free_entry(
+    gpointer data)
+{
+    catalog_entry_t *entry = data;
+
+    amfree(entry->logfile);
+    amfree(entry->label);
+    amfree(entry->datestamp);
+    free_string_array(entry->tapes);
+    free_string_array(entry->disks);
+    free_find_result(&entry->results);
+    amfree(entry);
+}
+
+/* Give back an entry returned by catalog_tapes or catalog_search */
+static void
+catalog_release(
+    catalog_entry_t *entry)
+{
+    if (entry->transient)
+	catalog_free_entry(entry);
+}
+
+static char *
+catalog_key(
+    const char *logfile,
+    gboolean	search,
+    const char *label,
+    const char *datestamp)
+{
+    return vstralloc(search? "SEARCH" : "TAPES", "\n", logfile,
+		     "\n", label? label : "", "\n", datestamp? datestamp : "",
+		     NULL);
+}
+
+static void
+catalog_insert(
+    catalog_entry_t *entry)
+{
+    g_hash_table_replace(catalog,
+			 catalog_key(entry->logfile, entry->disks != NULL,
+				     entry->label, entry->datestamp),
+			 entry);
+}
+
+/* Read any blocks appended to the catalog since it was last read. */
+static void
+catalog_read(void)
+{
+    char *conf_logdir, *filename;
+    FILE *catf;
+    struct stat st;
+    char *line;
+    catalog_entry_t *entry = NULL;
+    find_result_t **tail = NULL;
+
+    conf_logdir = config_dir_relative(getconf_str(CNF_LOGDIR));
+    filename = vstralloc(conf_logdir, "/", CATALOG_NAME, NULL);
+    amfree(conf_logdir);
+
+    if (catalog == NULL || strcmp(filename, catalog_filename) != 0) {
+	if (catalog)
+	    g_hash_table_destroy(catalog);
+	catalog = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, catalog_free_entry);
+	amfree(catalog_filename);
+	catalog_filename = filename;
+	catalog_offset = 0;
+    } else {
+	amfree(filename);
+    }
+
+    if ((catf = fopen(catalog_filename, "r")) == NULL)
+	return;
+
+    /* start over if the catalog was rewritten or truncated */
+    if (fstat(fileno(catf), &st) != 0) {
+	afclose(catf);
+	return;
+    }
+    if (st.st_ino != catalog_ino || st.st_size < catalog_offset) {
+	g_hash_table_destroy(catalog);
+	catalog = g_hash_table_new_full(g_str_hash, g_str_equal,
+					g_free, catalog_free_entry);
+	catalog_ino = st.st_ino;
+	catalog_offset = 0;
+    }
+    if (st.st_size == catalog_offset ||
+	fseeko(catf, catalog_offset, SEEK_SET) != 0) {
+	afclose(catf);
+	return;
+    }
+
+    while ((line = agets(catf)) != NULL) {
+	char **tokens = split_quoted_strings(line);
+	guint ntokens = g_strv_length(tokens);
+
+	if (entry == NULL) {
+	    if ((ntokens == 4 && strcmp(tokens[0], "TAPES") == 0) ||
+		(ntokens == 7 && strcmp(tokens[0], "SEARCH") == 0)) {
+		entry = g_new0(catalog_entry_t, 1);
+		entry->logfile = stralloc(tokens[1]);
+		entry->size = (off_t)g_ascii_strtoull(tokens[2], NULL, 10);
+		entry->mtime = (time_t)g_ascii_strtoull(tokens[3], NULL, 10);
+		if (ntokens == 4) {
+		    entry->tapes = g_ptr_array_new();
+		} else {
+		    entry->label = *tokens[4]? stralloc(tokens[4]) : NULL;
+		    entry->datestamp = *tokens[5]? stralloc(tokens[5]) : NULL;
+		    entry->found_start = atoi(tokens[6]);
+		    entry->disks = g_ptr_array_new();
+		    tail = &entry->results;
+		}
+	    }
+	} else if (ntokens == 1 && strcmp(tokens[0], "END") == 0) {
+	    char *key = catalog_key(entry->logfile, entry->disks != NULL,
+				    entry->label, entry->datestamp);
+	    catalog_entry_t *old = g_hash_table_lookup(catalog, key);
+
+	    /* keep an identical entry, as a caller may be using it */
+	    if (old && old->size == entry->size && old->mtime == entry->mtime) {
+		catalog_free_entry(entry);
+		amfree(key);
+	    } else {
+		g_hash_table_replace(catalog, key, entry);
+	    }
+	    entry = NULL;
+	    catalog_offset = ftello(catf);
+	} else if (ntokens == 3 && strcmp(tokens[0], "TAPE") == 0 &&
+		   entry->tapes) {
+	    g_ptr_array_add(entry->tapes, stralloc(tokens[1]));
+	    g_ptr_array_add(entry->tapes, stralloc(tokens[2]));
+	} else if (ntokens == 3 && strcmp(tokens[0], "DISK") == 0 &&
+		   entry->disks) {
+	    g_ptr_array_add(entry->disks, stralloc(tokens[1]));
+	    g_ptr_array_add(entry->disks, stralloc(tokens[2]));
+	} else if (ntokens == 12 && strcmp(tokens[0], "DUMP") == 0 &&
+		   entry->disks) {
+	    find_result_t *result = g_new0(find_result_t, 1);
+
+	    result->timestamp = stralloc(tokens[1]);
+	    result->hostname = stralloc(tokens[2]);
+	    result->diskname = stralloc(tokens[3]);
+	    result->level = atoi(tokens[4]);
+	    result->label = *tokens[5]? stralloc(tokens[5]) : NULL;
+	    result->filenum = (off_t)g_ascii_strtoull(tokens[6], NULL, 10);
+	    result->partnum = atoi(tokens[7]);
+	    result->totalparts = atoi(tokens[8]);
+	    result->sec = g_ascii_strtod(tokens[9], NULL);
+	    result->kb = (size_t)g_ascii_strtoull(tokens[10], NULL, 10);
+	    result->status = *tokens[11]? stralloc(tokens[11]) : NULL;
+	    *tail = result;
+	    tail = &result->next;
+	} else {
+	    dbprintf(_("ignoring bad catalog line: %s\n"), line);
+	    catalog_free_entry(entry);
+	    entry = NULL;
+	}
+	g_strfreev(tokens);
+	amfree(line);
+    }
+
+    /* an incomplete block is being appended; read it next time */
+    if (entry)
+	catalog_free_entry(entry);
+    afclose(catf);
+}
+
+static void
+catalog_format_entry(
+    GString *str,
+    catalog_entry_t *entry)
+{
+    char *q1, *q2, *q3;
+    guint i;
+    find_result_t *r;
+
+    q1 = quote_string(entry->logfile);
+    if (entry->tapes) {
+	g_string_append_printf(str, "TAPES %s %lld %lld\n", q1,
+			       (long long)entry->size, (long long)entry->mtime);
+	for (i = 0; i < entry->tapes->len; i += 2) {
+	    q2 = quote_string(g_ptr_array_index(entry->tapes, i));
+	    q3 = quote_string(g_ptr_array_index(entry->tapes, i+1));
+	    g_string_append_printf(str, "TAPE %s %s\n", q2, q3);
+	    amfree(q2);
+	    amfree(q3);
+	}
+    } else {
+	q2 = quote_string(entry->label);
+	q3 = quote_string(entry->datestamp);
+	g_string_append_printf(str, "SEARCH %s %lld %lld %s %s %d\n", q1,
+			       (long long)entry->size, (long long)entry->mtime,
+			       q2, q3, entry->found_start? 1 : 0);
+	amfree(q2);
+	amfree(q3);
+	for (i = 0; i < entry->disks->len; i += 2) {
+	    q2 = quote_string(g_ptr_array_index(entry->disks, i));
+	    q3 = quote_string(g_ptr_array_index(entry->disks, i+1));
+	    g_string_append_printf(str, "DISK %s %s\n", q2, q3);
+	    amfree(q2);
+	    amfree(q3);
+	}
+	for (r = entry->results; r != NULL; r = r->next) {
+	    char *qhost = quote_string(r->hostname);
+	    char *qdisk = quote_string(r->diskname);
+	    char *qlabel = quote_string(r->label);
+	    char *qstatus = quote_string(r->status);
+	    char sec_str[G_ASCII_DTOSTR_BUF_SIZE];
+
+	    q2 = quote_string(r->timestamp);
+	    g_string_append_printf(str,
+		"DUMP %s %s %s %d %s %lld %d %d %s %llu %s\n",
+		q2, qhost, qdisk, r->level, qlabel, (long long)r->filenum,
+		r->partnum, r->totalparts,
+		g_ascii_dtostr(sec_str, SIZEOF(sec_str), r->sec),
+		(unsigned long long)r->kb, qstatus);
+	    amfree(q2);
+	    amfree(qhost);
+	    amfree(qdisk);
+	    amfree(qlabel);
+	    amfree(qstatus);
+	}
+    }
+    g_string_append(str, "END\n");
+    amfree(q1);
+}
+
+/* Append an entry to the catalog file.  The catalog is only a cache, so
+ * failing to write it (for instance, as a user who can only read the
+ * log directory) is not an error. */
+static void
+catalog_write_entry(
+    catalog_entry_t *entry)
+{
+    GString *str = g_string_new("");
+    int fd;
+
+    catalog_format_entry(str, entry);
+    if ((fd = open(catalog_filename, O_WRONLY | O_APPEND | O_CREAT, 0600)) < 0) {
+	dbprintf(_("could not open catalog %s: %s\n"),
+		 catalog_filename, strerror(errno));
+    } else {
+	if (full_write(fd, str->str, str->len) < str->len) {
+	    dbprintf(_("could not write catalog %s: %s\n"),
+		     catalog_filename, strerror(errno));
+	}
+	aclose(fd);
+    }
+    g_string_free(str, TRUE);
+}
+
+/* Add a freshly parsed entry to the catalog, or mark it transient.  A
+ * logfile modified within the last second may still change without
+ * changing its size or mtime, so it is not cached unless force is set. */
+static void
+catalog_store(
+    catalog_entry_t *entry,
+    gboolean	force)
+{
+    if (force || entry->mtime + 1 < time(NULL)) {
+	catalog_write_entry(entry);
+	catalog_insert(entry);
+    } else {
+	entry->transient = TRUE;
+    }
 }
 
+/* Return the catalog entry for a logfile's START taper lines, parsing
+ * the logfile if the entry is missing or stale. */
+static catalog_entry_t *
+catalog_tapes(
+    const char *logfile,
+    gboolean	force)
+{
+    struct stat st;
+    catalog_entry_t *entry;
+    char *key;
+
+    catalog_read();
+    if (stat(logfile, &st) == 0) {
+	key = catalog_key(logfile, FALSE, NULL, NULL);
+	entry = g_hash_table_lookup(catalog, key);
+	amfree(key);
+	if (entry && entry->size == st.st_size && entry->mtime == st.st_mtime)
+	    return entry;
+    } else {
+	memset(&st, 0, SIZEOF(st));
+	force = FALSE;
+    }
+
+    entry = g_new0(catalog_entry_t, 1);
+    entry->logfile = stralloc(logfile);
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    entry->tapes = parse_logfile_tapes(logfile);
+    catalog_store(entry, force);
+
+    return entry;
+}
+
+/* Return the catalog entry for parse_logfile's results, parsing the
+ * logfile if the entry is missing or stale. */
+static catalog_entry_t *
+catalog_search(
+    const char *label,
+    const char *datestamp,
+    const char *logfile,
+    gboolean	force)
+{
+    struct stat st;
+    catalog_entry_t *entry;
+    char *key;
+
+    catalog_read();
+    if (stat(logfile, &st) == 0) {
+	key = catalog_key(logfile, TRUE, label, datestamp);
+	entry = g_hash_table_lookup(catalog, key);
+	amfree(key);
+	if (entry && entry->size == st.st_size && entry->mtime == st.st_mtime)
+	    return entry;
+    } else {
+	memset(&st, 0, SIZEOF(st));
+	force = FALSE;
+    }
+
+    entry = g_new0(catalog_entry_t, 1);
+    entry->logfile = stralloc(logfile);
+    entry->label = label? stralloc(label) : NULL;
+    entry->datestamp = datestamp? stralloc(datestamp) : NULL;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    entry->disks = g_ptr_array_new();
+    entry->results = parse_logfile(label, datestamp, logfile,
+				   &entry->found_start, entry->disks);
+    catalog_store(entry, force);
+
+    return entry;
+}
+
+void
+find_catalog_add_logfile(
+    const char *logfile)
+{
+    catalog_entry_t *entry;
+    GPtrArray *tapes = g_ptr_array_new();
+    guint i;
+
+    entry = catalog_tapes(logfile, TRUE);
+    for (i = 0; i < entry->tapes->len; i++)
+	g_ptr_array_add(tapes, stralloc(g_ptr_array_index(entry->tapes, i)));
+    catalog_release(entry);
+
+    catalog_release(catalog_search(NULL, NULL, logfile, TRUE));
+    for (i = 0; i < tapes->len; i += 2) {
+	catalog_release(catalog_search(g_ptr_array_index(tapes, i+1),
+				       g_ptr_array_index(tapes, i),
+				       logfile, TRUE));
+    }
+    free_string_array(tapes);
+}
+
+/* g_hash_table_foreach_remove callback for find_catalog_compact: drop
+ * the entries of logfiles that have gone or changed, and format the
+ * rest into the GString */
+static gboolean
+catalog_compact_entry(
+    gpointer key G_GNUC_UNUSED,
+    gpointer value,
+    gpointer user_data)
+{
+    catalog_entry_t *entry = value;
+    struct stat st;
+
+    if (stat(entry->logfile, &st) != 0 ||
+	st.st_size != entry->size || st.st_mtime != entry->mtime)
+	return TRUE;
+
+    catalog_format_entry((GString *)user_data, entry);
+    return FALSE;
+}
+
+void
+find_catalog_compact(void)
+{
+    GString *str = g_string_new("");
+    char *tmpname;
+    int fd;
+
+    catalog_read();
+    g_hash_table_foreach_remove(catalog, catalog_compact_entry, str);
+
+    tmpname = vstralloc(catalog_filename, ".tmp", NULL);
+    if ((fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0) {
+	dbprintf(_("could not open %s: %s\n"), tmpname, strerror(errno));
+    } else if (full_write(fd, str->str, str->len) < str->len) {
+	dbprintf(_("could not write %s: %s\n"), tmpname, strerror(errno));
+	aclose(fd);
+	unlink(tmpname);
+    } else {
+	aclose(fd);
+	if (rename(tmpname, catalog_filename) != 0) {
+	    dbprintf(_("could not rename %s to %s: %s\n"),
+		     tmpname, catalog_filename, strerror(errno));
+	    unlink(tmpname);
+	}
+    }
+    amfree(tmpname);
+    g_string_free(str, TRUE);
+
+    /* the next lookup reads the new catalog from the start */
+    g_hash_table_destroy(catalog);
+    catalog = NULL;
+}
+
+gboolean
+search_logfile(
+    find_result_t **output_find,
+    const char *label,
+    const char *passed_datestamp,
+    const char *logfile,
+    disklist_t * dynamic_disklist)
+{
+    catalog_entry_t *entry;
+    find_result_t *found = NULL;
+    find_result_t **tail = &found;
+    find_result_t *result;
+    gboolean found_something;
+    disk_t *dp;
+    guint i;
+
+    g_return_val_if_fail(output_find != NULL, 0);
+    g_return_val_if_fail(logfile != NULL, 0);
+
+    entry = catalog_search(label, passed_datestamp, logfile, FALSE);
+    found_something = entry->found_start;
+
+    if (dynamic_disklist) {
+	for (i = 0; i < entry->disks->len; i += 2) {
+	    char *host = g_ptr_array_index(entry->disks, i);
+	    char *disk = g_ptr_array_index(entry->disks, i+1);
+
+	    if (lookup_disk(host, disk) == NULL) {
+		dp = add_disk(dynamic_disklist, host, disk);
+		enqueue_disk(dynamic_disklist, dp);
+	    }
+	}
+    }
+
+    for (result = entry->results; result != NULL; result = result->next) {
+	if (!find_match(result->hostname, result->diskname))
+	    continue;
+	*tail = copy_find_result(result);
+	tail = &(*tail)->next;
+	found_something = TRUE;
+    }
+    *tail = *output_find;
+    *output_find = found;
+
+    catalog_release(entry);
+
+    return found_something;
+}
 
 /*
  * Return the set of dumps that match *all* of the given patterns (we consider
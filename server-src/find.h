@@ -63,4 +63,15 @@ find_result_t *dumps_match_dumpspecs(find_result_t *output_find,
 gboolean search_logfile(find_result_t **output_find, const char *volume_label,
                         const char *log_datestamp, const char *logfile,
                         disklist_t * dynamic_disklist);
+
+/* search_logfile and find_log keep what they learn from each logfile in a
+ * catalog in the log directory, and only read a logfile again if it has
+ * changed.  find_catalog_add_logfile adds a newly closed logfile to the
+ * catalog, and find_catalog_compact removes the entries of logfiles that
+ * no longer exist.
+ *
+ * @param logfile: full path of the logfile
+ */
+void find_catalog_add_logfile(const char *logfile);
+void find_catalog_compact(void);
 #endif	/* !FIND_H */
@@ -497,6 +497,779 @@ delete_txinfofile(
     return rc;
 }
 
+/*
+ * The binary info database.  It is used instead of the directory of text
+ * files when the infofile is a regular file, or does not exist yet and
+ * its name ends in ".db".  Records are fixed-size slots holding one
+ * host/disk each, so get_info is a hash lookup and a copy rather than a
+ * directory walk and a parse, and readers map the file rather than
+ * reading it.  Convert between the two with "amadmin export" and
+ * "amadmin import".
+ *
+ * The file is a header, a journal slot, and the record slots.  put_info
+ * and del_info write the new record to the journal slot before writing
+ * it in place, so a reader (which does not lock) that finds a record
+ * half-written can use the journal copy instead; each copy carries a
+ * checksum.  Writers lock the file, and bump the header's generation
+ * whenever a slot changes hands, which tells other processes to rebuild
+ * their host/disk index.  The header also counts the deleted slots, so
+ * that a new record is appended without a search when there are none.
+ */
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#  define USE_MMAP_INFODB
+#  include <sys/mman.h>
+#endif
+
+#define INFODB_MAGIC		"AMANDA INFODB 1\n"
+#define INFODB_BYTE_ORDER	0x01020304
+#define INFODB_HEADER_SIZE	4096
+#define INFODB_NAME_SIZE	1024
+#define INFODB_LEVELS		16	/* dump levels a record can hold */
+#define INFODB_READ_TRIES	10
+
+typedef struct infodb_header_s {
+    char magic[16];
+    guint32 byte_order;
+    guint32 record_size;
+    guint32 generation;
+    guint32 free_slots;			/* deleted slots, to reuse */
+    guint32 first_free;			/* no deleted slot is before this */
+} infodb_header_t;
+
+typedef struct infodb_stats_s {
+    gint32 level;			/* -1 if unused */
+    gint32 pad;
+    gint64 size, csize, secs, date, filenum;
+    char label[MAX_LABEL];
+} infodb_stats_t;
+
+typedef struct infodb_history_s {
+    gint32 level;
+    gint32 pad;
+    gint64 size, csize, date, secs;
+} infodb_history_t;
+
+typedef struct infodb_record_s {
+    guint32 checksum;			/* of everything after it */
+    guint32 slot;			/* where this record belongs */
+    guint32 in_use;
+    guint32 command;
+    char name[INFODB_NAME_SIZE];	/* hostname, NUL, diskname, NUL */
+    gint32 last_level, consecutive_runs;
+    double full_rate[AVG_COUNT], full_comp[AVG_COUNT];
+    double incr_rate[AVG_COUNT], incr_comp[AVG_COUNT];
+    infodb_stats_t stats[INFODB_LEVELS];
+    infodb_history_t history[NB_HISTORY+1];
+} infodb_record_t;
+
+#define INFODB_JOURNAL_OFFSET	((off_t)INFODB_HEADER_SIZE)
+#define INFODB_SLOT_OFFSET(i) \
+    ((off_t)INFODB_HEADER_SIZE + ((off_t)(i) + 1) * (off_t)SIZEOF(infodb_record_t))
+
+  static int infodb_fd = -1;
+  static gboolean infodb_writable;
+  static char *infodb_map = NULL;
+  static size_t infodb_map_size = 0;
+  static guint infodb_nslots = 0;
+  static GHashTable *infodb_index = NULL;	/* "host\ndisk" -> slot + 1 */
+  static guint32 infodb_index_generation;
+
+/* Does filename name a binary info database rather than a directory? */
+gboolean
+infofile_is_db(
+    const char *filename)
+{
+    struct stat st;
+    size_t len;
+
+    if (stat(filename, &st) == 0)
+	return S_ISREG(st.st_mode);
+
+    len = strlen(filename);
+    return len > 3 && strcmp(filename + len - 3, ".db") == 0;
+}
+
+static guint32
+infodb_checksum(
+    infodb_record_t *rec)
+{
+    /* FNV-1a */
+    guint32 h = 2166136261U;
+    guchar *p = (guchar *)rec + SIZEOF(rec->checksum);
+    guchar *end = (guchar *)rec + SIZEOF(*rec);
+
+    while (p < end) {
+	h ^= *p++;
+	h *= 16777619U;
+    }
+    return h;
+}
+
+static char *
+infodb_key(
+    const char *hostname,
+    const char *diskname)
+{
+    return vstralloc(hostname, "\n", diskname, NULL);
+}
+
+/* Copy len bytes at offset from the file, through the map if it covers
+ * them.  Returns FALSE on a short read. */
+static gboolean
+infodb_read(
+    off_t	offset,
+    void *	buf,
+    size_t	len)
+{
+    if (infodb_map && offset + (off_t)len <= (off_t)infodb_map_size) {
+	memcpy(buf, infodb_map + offset, len);
+	return TRUE;
+    }
+    return pread(infodb_fd, buf, len, offset) == (ssize_t)len;
+}
+
+static gboolean
+infodb_write(
+    off_t	offset,
+    void *	buf,
+    size_t	len)
+{
+    return pwrite(infodb_fd, buf, len, offset) == (ssize_t)len;
+}
+
+static guint32
+infodb_generation(void)
+{
+    infodb_header_t hdr;
+
+    if (!infodb_read(0, &hdr, SIZEOF(hdr)))
+	return 0;
+    return hdr.generation;
+}
+
+/* Map the file as it is now, and count its slots.  A new, empty file
+ * gets a header first. */
+static int
+infodb_remap(void)
+{
+    struct stat st;
+    infodb_header_t hdr;
+
+#ifdef USE_MMAP_INFODB
+    if (infodb_map) {
+	munmap(infodb_map, infodb_map_size);
+	infodb_map = NULL;
+	infodb_map_size = 0;
+    }
+#endif
+
+    if (fstat(infodb_fd, &st) != 0) {
+	dbprintf(_("cannot stat info database %s: %s\n"),
+		 infodir, strerror(errno));
+	return -1;
+    }
+
+    if (st.st_size == 0 && infodb_writable) {
+	char *buf = alloc(INFODB_HEADER_SIZE);
+
+	memset(buf, 0, INFODB_HEADER_SIZE);
+	memset(&hdr, 0, SIZEOF(hdr));
+	memcpy(hdr.magic, INFODB_MAGIC, SIZEOF(hdr.magic));
+	hdr.byte_order = INFODB_BYTE_ORDER;
+	hdr.record_size = SIZEOF(infodb_record_t);
+	memcpy(buf, &hdr, SIZEOF(hdr));
+	if (!infodb_write(0, buf, INFODB_HEADER_SIZE)) {
+	    dbprintf(_("cannot write info database %s: %s\n"),
+		     infodir, strerror(errno));
+	    amfree(buf);
+	    return -1;
+	}
+	amfree(buf);
+	st.st_size = INFODB_HEADER_SIZE;
+    }
+
+    if (st.st_size < INFODB_HEADER_SIZE ||
+	!infodb_read(0, &hdr, SIZEOF(hdr)) ||
+	memcmp(hdr.magic, INFODB_MAGIC, SIZEOF(hdr.magic)) != 0 ||
+	hdr.byte_order != INFODB_BYTE_ORDER ||
+	hdr.record_size != SIZEOF(infodb_record_t)) {
+	dbprintf(_("%s is not an info database for this system\n"), infodir);
+	return -1;
+    }
+
+    /* a partial slot at the end is an append that was interrupted */
+    if (st.st_size < INFODB_SLOT_OFFSET(0))
+	infodb_nslots = 0;
+    else
+	infodb_nslots = (guint)((st.st_size - INFODB_SLOT_OFFSET(0)) /
+				SIZEOF(infodb_record_t));
+
+#ifdef USE_MMAP_INFODB
+    infodb_map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+		      infodb_fd, 0);
+    if (infodb_map == MAP_FAILED) {
+	/* not fatal; infodb_read falls back to pread */
+	infodb_map = NULL;
+    } else {
+	infodb_map_size = (size_t)st.st_size;
+    }
+#endif
+
+    return 0;
+}
+
+/* Read the current version of a slot into rec: the journal copy if the
+ * journal holds this slot, the slot itself otherwise.  Returns FALSE if
+ * no valid copy could be read. */
+static gboolean
+infodb_get_record(
+    guint		slot,
+    infodb_record_t *	rec)
+{
+    int tries;
+
+    for (tries = 0; tries < INFODB_READ_TRIES; tries++) {
+	if (infodb_read(INFODB_JOURNAL_OFFSET, rec, SIZEOF(*rec)) &&
+	    rec->slot == slot && rec->checksum == infodb_checksum(rec))
+	    return TRUE;
+	if (infodb_read(INFODB_SLOT_OFFSET(slot), rec, SIZEOF(*rec)) &&
+	    rec->slot == slot && rec->checksum == infodb_checksum(rec))
+	    return TRUE;
+	/* a writer is probably part way through; try again */
+    }
+    return FALSE;
+}
+
+/* Does a slot hold this host and disk?  Only the name is looked at, so
+ * the caller must still read the whole record. */
+static gboolean
+infodb_slot_is(
+    guint	slot,
+    const char *key)
+{
+    infodb_record_t rec;
+    size_t hlen;
+
+    if (!infodb_get_record(slot, &rec) || !rec.in_use)
+	return FALSE;
+    rec.name[INFODB_NAME_SIZE-1] = '\0';
+    hlen = strlen(rec.name);
+    return strncmp(rec.name, key, hlen) == 0 && key[hlen] == '\n' &&
+	   strcmp(rec.name + hlen + 1, key + hlen + 1) == 0;
+}
+
+static void
+infodb_build_index(void)
+{
+    guint slot;
+    char name[INFODB_NAME_SIZE];
+    off_t name_offset = (off_t)G_STRUCT_OFFSET(infodb_record_t, name);
+
+    if (infodb_index)
+	g_hash_table_destroy(infodb_index);
+    infodb_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+					 g_free, NULL);
+    infodb_index_generation = infodb_generation();
+
+    for (slot = 0; slot < infodb_nslots; slot++) {
+	/* read just the name; infodb_find checks the whole record */
+	if (!infodb_read(INFODB_SLOT_OFFSET(slot) + name_offset,
+			 name, SIZEOF(name)) || name[0] == '\0')
+	    continue;
+	name[INFODB_NAME_SIZE-1] = '\0';
+	g_hash_table_replace(infodb_index,
+			     infodb_key(name, name + strlen(name) + 1),
+			     GUINT_TO_POINTER(slot + 1));
+    }
+
+    /* the journal may hold a slot that is not written yet */
+    {
+	infodb_record_t rec;
+
+	if (infodb_read(INFODB_JOURNAL_OFFSET, &rec, SIZEOF(rec)) &&
+	    rec.checksum == infodb_checksum(&rec) && rec.in_use &&
+	    rec.slot < infodb_nslots) {
+	    rec.name[INFODB_NAME_SIZE-1] = '\0';
+	    g_hash_table_replace(infodb_index,
+				 infodb_key(rec.name,
+					    rec.name + strlen(rec.name) + 1),
+				 GUINT_TO_POINTER(rec.slot + 1));
+	}
+    }
+}
+
+/* Find the slot for a host and disk, or return -1. */
+static int
+infodb_find(
+    const char *hostname,
+    const char *diskname)
+{
+    char *key = infodb_key(hostname, diskname);
+    gpointer value;
+    int tries;
+
+    for (tries = 0; tries < 2; tries++) {
+	if (infodb_index == NULL ||
+	    infodb_index_generation != infodb_generation()) {
+	    if (infodb_remap() != 0)
+		break;
+	    infodb_build_index();
+	}
+	value = g_hash_table_lookup(infodb_index, key);
+	if (value && infodb_slot_is(GPOINTER_TO_UINT(value) - 1, key)) {
+	    amfree(key);
+	    return (int)GPOINTER_TO_UINT(value) - 1;
+	}
+	/* the index is right unless a slot changed hands since it was
+	 * built; if one did, rebuild it and look again */
+	if (infodb_index_generation == infodb_generation())
+	    break;
+    }
+
+    amfree(key);
+    return -1;
+}
+
+static void
+infodb_to_info(
+    infodb_record_t *rec,
+    info_t *	info)
+{
+    int i;
+
+    info->command = rec->command;
+    info->last_level = rec->last_level;
+    info->consecutive_runs = rec->consecutive_runs;
+    for (i = 0; i < AVG_COUNT; i++) {
+	info->full.rate[i] = rec->full_rate[i];
+	info->full.comp[i] = rec->full_comp[i];
+	info->incr.rate[i] = rec->incr_rate[i];
+	info->incr.comp[i] = rec->incr_comp[i];
+    }
+    for (i = 0; i < INFODB_LEVELS; i++) {
+	infodb_stats_t *st = &rec->stats[i];
+	stats_t *sp;
+
+	if (st->level < 0 || st->level >= DUMP_LEVELS)
+	    continue;
+	sp = &info->inf[st->level];
+	sp->size = (off_t)st->size;
+	sp->csize = (off_t)st->csize;
+	sp->secs = (time_t)st->secs;
+	sp->date = (time_t)st->date;
+	sp->filenum = (off_t)st->filenum;
+	strncpy(sp->label, st->label, SIZEOF(sp->label)-1);
+	sp->label[SIZEOF(sp->label)-1] = '\0';
+    }
+    for (i = 0; i <= NB_HISTORY && rec->history[i].level > -1; i++) {
+	info->history[i].level = rec->history[i].level;
+	info->history[i].size = (off_t)rec->history[i].size;
+	info->history[i].csize = (off_t)rec->history[i].csize;
+	info->history[i].date = (time_t)rec->history[i].date;
+	info->history[i].secs = (time_t)rec->history[i].secs;
+    }
+}
+
+/* Fill in a record from an info_t; returns -1 if it does not fit. */
+static int
+info_to_infodb(
+    char *	hostname,
+    char *	diskname,
+    info_t *	info,
+    infodb_record_t *rec)
+{
+    size_t hlen = strlen(hostname), dlen = strlen(diskname);
+    int i, n;
+
+    memset(rec, 0, SIZEOF(*rec));
+    if (hlen + dlen + 2 > INFODB_NAME_SIZE) {
+	dbprintf(_("info database: %s:%s: name too long\n"), hostname, diskname);
+	return -1;
+    }
+    memcpy(rec->name, hostname, hlen);
+    memcpy(rec->name + hlen + 1, diskname, dlen);
+
+    rec->in_use = 1;
+    rec->command = info->command;
+    rec->last_level = info->last_level;
+    rec->consecutive_runs = info->consecutive_runs;
+    for (i = 0; i < AVG_COUNT; i++) {
+	rec->full_rate[i] = info->full.rate[i];
+	rec->full_comp[i] = info->full.comp[i];
+	rec->incr_rate[i] = info->incr.rate[i];
+	rec->incr_comp[i] = info->incr.comp[i];
+    }
+
+    for (i = 0; i < INFODB_LEVELS; i++)
+	rec->stats[i].level = -1;
+    for (i = 0, n = 0; i < DUMP_LEVELS; i++) {
+	stats_t *sp = &info->inf[i];
+	infodb_stats_t *st;
+
+	/* the same levels write_txinfofile writes */
+	if (sp->date < (time_t)0 && sp->label[0] == '\0')
+	    continue;
+	if (n == INFODB_LEVELS) {
+	    dbprintf(_("info database: %s:%s: more than %d dump levels\n"),
+		     hostname, diskname, INFODB_LEVELS);
+	    return -1;
+	}
+	st = &rec->stats[n++];
+	st->level = i;
+	st->size = (gint64)sp->size;
+	st->csize = (gint64)sp->csize;
+	st->secs = (gint64)sp->secs;
+	st->date = (gint64)sp->date;
+	st->filenum = (gint64)sp->filenum;
+	strncpy(st->label, sp->label, SIZEOF(st->label)-1);
+    }
+
+    for (i = 0; i <= NB_HISTORY; i++) {
+	rec->history[i].level = info->history[i].level;
+	if (info->history[i].level <= -1) {
+	    rec->history[i].level = -1;
+	    break;
+	}
+	rec->history[i].size = (gint64)info->history[i].size;
+	rec->history[i].csize = (gint64)info->history[i].csize;
+	rec->history[i].date = (gint64)info->history[i].date;
+	rec->history[i].secs = (gint64)info->history[i].secs;
+    }
+    for (; i <= NB_HISTORY; i++)
+	rec->history[i].level = -1;
+
+    return 0;
+}
+
+/* Write a record to a slot, by way of the journal; the file must be
+ * locked. */
+static int
+infodb_put_record(
+    guint		slot,
+    infodb_record_t *	rec)
+{
+    rec->slot = slot;
+    rec->checksum = infodb_checksum(rec);
+
+    if (!infodb_write(INFODB_JOURNAL_OFFSET, rec, SIZEOF(*rec)) ||
+	!infodb_write(INFODB_SLOT_OFFSET(slot), rec, SIZEOF(*rec))) {
+	dbprintf(_("cannot write info database %s: %s\n"),
+		 infodir, strerror(errno));
+	return -1;
+    }
+    return 0;
+}
+
+/* Tell other processes that a slot has changed hands.  The caller has
+ * already made the change to its own index, if it has one. */
+static int
+infodb_bump_generation(void)
+{
+    guint32 old = infodb_generation();
+    guint32 generation = old + 1;
+
+    if (!infodb_write((off_t)G_STRUCT_OFFSET(infodb_header_t, generation),
+		      &generation, SIZEOF(generation))) {
+	dbprintf(_("cannot write info database %s: %s\n"),
+		 infodir, strerror(errno));
+	return -1;
+    }
+    if (infodb_index && infodb_index_generation == old)
+	infodb_index_generation = generation;
+    return 0;
+}
+
+/* Record the header's free_slots and first_free; the file must be
+ * locked. */
+static int
+infodb_put_free(
+    infodb_header_t *hdr)
+{
+    guint32 counts[2];
+
+    counts[0] = hdr->free_slots;
+    counts[1] = hdr->first_free;
+    if (!infodb_write((off_t)G_STRUCT_OFFSET(infodb_header_t, free_slots),
+		      counts, SIZEOF(counts))) {
+	dbprintf(_("cannot write info database %s: %s\n"),
+		 infodir, strerror(errno));
+	return -1;
+    }
+    return 0;
+}
+
+/* Pick the slot for a new record: a deleted one if the header says there
+ * is one, or a new one at the end.  A slot with no good copy is reported
+ * and left alone, since it may still hold a record worth recovering.
+ * Updates hdr to match; the file must be locked. */
+static guint
+infodb_new_slot(
+    infodb_header_t *hdr)
+{
+    infodb_record_t *rec;
+    guint slot = infodb_nslots;
+
+    if (hdr->free_slots > 0) {
+	rec = alloc(SIZEOF(*rec));
+	for (slot = hdr->first_free; slot < infodb_nslots; slot++) {
+	    if (!infodb_get_record(slot, rec)) {
+		dbprintf(_("info database %s: slot %u is corrupt; not reusing it\n"),
+			 infodir, slot);
+		continue;
+	    }
+	    if (!rec->in_use)
+		break;
+	}
+	amfree(rec);
+    }
+
+    if (slot < infodb_nslots) {
+	hdr->free_slots--;
+    } else {
+	/* the count was off; there are no deleted slots after all */
+	hdr->free_slots = 0;
+    }
+    hdr->first_free = slot + 1;
+    return slot;
+}
+
+static void close_infodb(void);
+
+/* If the journal holds a good record that did not make it to its slot
+ * (a writer died between the two writes), write it there now, before
+ * the journal is reused and the only good copy is lost.  The file must
+ * be locked. */
+static int
+infodb_replay_journal(void)
+{
+    infodb_record_t *jrec, *srec;
+    struct stat st;
+    int rc = 0;
+
+    /* infodb_nslots may be stale; other writers append slots */
+    if (fstat(infodb_fd, &st) != 0) {
+	dbprintf(_("cannot stat info database %s: %s\n"),
+		 infodir, strerror(errno));
+	return -1;
+    }
+
+    jrec = alloc(SIZEOF(*jrec));
+    srec = alloc(SIZEOF(*srec));
+
+    /* a slot at the end of the file may be missing or cut short */
+    if (infodb_read(INFODB_JOURNAL_OFFSET, jrec, SIZEOF(*jrec)) &&
+	jrec->checksum == infodb_checksum(jrec) &&
+	INFODB_SLOT_OFFSET(jrec->slot) <= st.st_size &&
+	(INFODB_SLOT_OFFSET(jrec->slot + 1) > st.st_size ||
+	 !infodb_read(INFODB_SLOT_OFFSET(jrec->slot), srec, SIZEOF(*srec)) ||
+	 memcmp(jrec, srec, SIZEOF(*jrec)) != 0)) {
+	dbprintf(_("info database %s: restoring slot %u from the journal\n"),
+		 infodir, (unsigned)jrec->slot);
+	if (!infodb_write(INFODB_SLOT_OFFSET(jrec->slot), jrec, SIZEOF(*jrec))) {
+	    dbprintf(_("cannot write info database %s: %s\n"),
+		     infodir, strerror(errno));
+	    rc = -1;
+	} else {
+	    /* the slot may have changed hands, or been appended */
+	    if (infodb_index) {
+		g_hash_table_destroy(infodb_index);
+		infodb_index = NULL;
+	    }
+	    rc = infodb_bump_generation();
+	    if (rc == 0 && jrec->slot >= infodb_nslots)
+		rc = infodb_remap();
+	}
+    }
+
+    amfree(srec);
+    amfree(jrec);
+    return rc;
+}
+
+static int
+open_infodb(void)
+{
+    infodb_writable = TRUE;
+    infodb_fd = open(infodir, O_RDWR | O_CREAT, 0644);
+    if (infodb_fd < 0) {
+	infodb_writable = FALSE;
+	infodb_fd = open(infodir, O_RDONLY);
+    }
+    if (infodb_fd < 0) {
+	dbprintf(_("cannot open info database %s: %s\n"),
+		 infodir, strerror(errno));
+	return -1;
+    }
+    if (infodb_remap() != 0) {
+	aclose(infodb_fd);
+	return -1;
+    }
+    if (infodb_writable) {
+	int rc;
+
+	amflock(infodb_fd, "info");
+	rc = infodb_replay_journal();
+	amfunlock(infodb_fd, "info");
+	if (rc != 0) {
+	    close_infodb();
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+static void
+close_infodb(void)
+{
+#ifdef USE_MMAP_INFODB
+    if (infodb_map)
+	munmap(infodb_map, infodb_map_size);
+#endif
+    infodb_map = NULL;
+    infodb_map_size = 0;
+    if (infodb_index)
+	g_hash_table_destroy(infodb_index);
+    infodb_index = NULL;
+    aclose(infodb_fd);
+}
+
+static int
+get_infodb(
+    char *	hostname,
+    char *	diskname,
+    info_t *	info)
+{
+    infodb_record_t *rec;
+    int slot;
+    int rc = -1;
+
+    slot = infodb_find(hostname, diskname);
+    if (slot < 0)
+	return -1; /* record not found */
+
+    rec = alloc(SIZEOF(*rec));
+    if (infodb_get_record((guint)slot, rec) && rec->in_use) {
+	infodb_to_info(rec, info);
+	rc = 0;
+    }
+    amfree(rec);
+    return rc;
+}
+
+static int
+put_infodb(
+    char *	hostname,
+    char *	diskname,
+    info_t *	info)
+{
+    infodb_record_t *rec;
+    infodb_header_t hdr;
+    int slot;
+    int rc;
+
+    if (!infodb_writable)
+	return -1;
+
+    rec = alloc(SIZEOF(*rec));
+    if (info_to_infodb(hostname, diskname, info, rec) != 0) {
+	amfree(rec);
+	return -1;
+    }
+
+    amflock(infodb_fd, "info");
+
+    if (infodb_replay_journal() != 0) {
+	amfunlock(infodb_fd, "info");
+	amfree(rec);
+	return -1;
+    }
+
+    /* someone else may have added it since we looked */
+    slot = infodb_find(hostname, diskname);
+    if (slot >= 0) {
+	rc = infodb_put_record((guint)slot, rec);
+    } else if (!infodb_read(0, &hdr, SIZEOF(hdr))) {
+	dbprintf(_("cannot read info database %s: %s\n"),
+		 infodir, strerror(errno));
+	rc = -1;
+    } else {
+	guint32 free_slots = hdr.free_slots;
+
+	/* reuse a deleted slot, or add one at the end */
+	slot = (int)infodb_new_slot(&hdr);
+	rc = infodb_put_record((guint)slot, rec);
+	if (rc == 0 && slot == (int)infodb_nslots)
+	    infodb_nslots++;
+	if (rc == 0 && free_slots > 0)
+	    rc = infodb_put_free(&hdr);
+	if (rc == 0 && infodb_index) {
+	    g_hash_table_replace(infodb_index,
+				 infodb_key(hostname, diskname),
+				 GUINT_TO_POINTER(slot + 1));
+	}
+	rc = rc || infodb_bump_generation();
+    }
+
+    amfunlock(infodb_fd, "info");
+    amfree(rec);
+
+    return rc? -1 : 0;
+}
+
+static int
+del_infodb(
+    char *	hostname,
+    char *	diskname)
+{
+    infodb_record_t *rec;
+    infodb_header_t hdr;
+    int slot;
+    int rc;
+
+    if (!infodb_writable)
+	return -1;
+
+    amflock(infodb_fd, "info");
+
+    if (infodb_replay_journal() != 0) {
+	amfunlock(infodb_fd, "info");
+	return -1;
+    }
+
+    slot = infodb_find(hostname, diskname);
+    if (slot < 0) {
+	amfunlock(infodb_fd, "info");
+	return -1;
+    }
+
+    rec = alloc(SIZEOF(*rec));
+    memset(rec, 0, SIZEOF(*rec));
+    rc = infodb_put_record((guint)slot, rec);
+    if (rc == 0 && !infodb_read(0, &hdr, SIZEOF(hdr))) {
+	dbprintf(_("cannot read info database %s: %s\n"),
+		 infodir, strerror(errno));
+	rc = -1;
+    } else if (rc == 0) {
+	if (hdr.free_slots == 0 || (guint32)slot < hdr.first_free)
+	    hdr.first_free = (guint32)slot;
+	hdr.free_slots++;
+	rc = infodb_put_free(&hdr);
+    }
+    if (rc == 0 && infodb_index) {
+	char *key = infodb_key(hostname, diskname);
+
+	g_hash_table_remove(infodb_index, key);
+	amfree(key);
+    }
+    rc = rc || infodb_bump_generation();
+
+    amfunlock(infodb_fd, "info");
+    amfree(rec);
+
+    return rc? -1 : 0;
+}
+
 int
 open_infofile(
     char *	filename)
@@ -505,6 +1278,13 @@ open_infofile(
 
     infodir = stralloc(filename);
 
+    if (infofile_is_db(infodir)) {
+	if (open_infodb() != 0) {
+	    amfree(infodir);
+	    return -1;
+	}
+    }
+
     return 0; /* success! */
 }
 
@@ -513,6 +1293,8 @@ close_infofile(void)
 {
     assert(infodir != (char *)0);
 
+    if (infodb_fd >= 0)
+	close_infodb();
     amfree(infodir);
 }
 
@@ -609,7 +1391,9 @@ get_info(
 
     (void) zero_info(info);
 
-    {
+    if (infodb_fd >= 0) {
+	rc = get_infodb(hostname, diskname, info);
+    } else {
 	FILE *infof;
 
 	infof = open_txinfofile(hostname, diskname, "r");
@@ -637,6 +1421,9 @@ put_info(
     FILE *infof;
     int rc;
 
+    if (infodb_fd >= 0)
+	return put_infodb(hostname, diskname, info);
+
     infof = open_txinfofile(hostname, diskname, "w");
 
     if(infof == NULL) return -1;
@@ -654,6 +1441,8 @@ del_info(
     char *	hostname,
     char *	diskname)
 {
+    if (infodb_fd >= 0)
+	return del_infodb(hostname, diskname);
     return delete_txinfofile(hostname, diskname);
 }
 
@@ -81,6 +81,7 @@ typedef struct info_s {
 
 int open_infofile(char *infofile);
 void close_infofile(void);
+gboolean infofile_is_db(const char *infofile);
 
 char *get_dumpdate(info_t *info, int level);
 double perf_average(double *array, double def);
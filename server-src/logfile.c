@@ -200,7 +200,7 @@ log_end_multiline(void)
 }
 
 
-void
+char *
 log_rename(
     char *	datestamp)
 {
@@ -232,9 +232,10 @@ log_rename(
 	/*NOTREACHED*/
     }
 
-    amfree(fname);
     amfree(logfile);
     amfree(conf_logdir);
+
+    return fname;
 }
 
 
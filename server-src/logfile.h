@@ -74,7 +74,7 @@ char* log_genstring(logtype_t typ, char *pname, char * format, ...)
     		    G_GNUC_PRINTF(3, 4);
 void log_start_multiline(void);
 void log_end_multiline(void);
-void log_rename(char *datestamp);
+char *log_rename(char *datestamp);
 int get_logline(FILE *);
 
 #endif  /* ! LOGFILE_H */
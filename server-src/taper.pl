@@ -31,24 +31,24 @@ use constant START_TAPER => message("START-TAPER",
 );
 
 use constant PORT_WRITE => message("PORT-WRITE",
-    format => [ qw( handle hostname diskname level datestamp splitsize
+    format => [ qw( worker handle hostname diskname level datestamp splitsize
 		    split_diskbuffer fallback_splitsize data_path ) ],
 );
 
 use constant FILE_WRITE => message("FILE-WRITE",
-    format => [ qw( handle filename hostname diskname level datestamp splitsize ) ],
+    format => [ qw( worker handle filename hostname diskname level datestamp splitsize ) ],
 );
 
 use constant NEW_TAPE => message("NEW-TAPE",
     format => {
-	in => [ qw( ) ],
+	in => [ qw( handle ) ],
 	out => [ qw( handle label ) ],
     },
 );
 
 use constant NO_NEW_TAPE => message("NO-NEW-TAPE",
     format => {
-	in => [ qw( reason ) ],
+	in => [ qw( handle reason ) ],
 	out => [ qw( handle ) ],
     }
 );
@@ -72,6 +72,7 @@ use constant QUIT => message("QUIT",
 );
 
 use constant TAPER_OK => message("TAPER-OK",
+    format => [ qw( nworkers ) ],
 );
 
 use constant TAPE_ERROR => message("TAPE-ERROR",
@@ -109,23 +110,16 @@ use constant DUMPER_STATUS => message("DUMPER-STATUS",
 
 package main::Controller;
 
-use IO::Socket;
-use POSIX qw( :errno_h );
 use Amanda::Changer;
-use Amanda::Config qw( :getconf config_dir_relative );
-use Amanda::Header;
-use Amanda::Holding;
-use Amanda::MainLoop qw( :GIOCondition );
+use Amanda::Config qw( :getconf );
 use Amanda::MainLoop;
-use Amanda::Taper::Scan;
-use Amanda::Taper::Scribe;
 use Amanda::Logfile qw( :logtype_t log_add );
-use Amanda::Xfer;
-use Amanda::Util qw( quote_string );
-use Amanda::Tapelist;
-use File::Temp;
 
-use base qw( Amanda::Taper::Scribe::Feedback );
+# The controller owns the conversation with the driver and the changer.  The
+# actual writing is done by taper-parallel-write main::Worker objects, each
+# with its own scribe, so that several dumpfiles can be written to several
+# volumes at once.  The driver chooses the worker for each FILE-WRITE and
+# PORT-WRITE; later messages about that dumpfile are routed by handle.
 
 sub new {
     my $class = shift;
@@ -135,40 +129,26 @@ sub new {
 
 	# filled in at start
 	proto => undef,
-	scribe => undef,
-	listen_socket => undef,
-	listen_socket_src => undef,
+	changer => undef,
+	workers => [],
+	pending_labels => {},
 	tape_num => 0,
+	timestamp => undef,
 
-	# filled in when a write starts:
-	handle => undef,
-	header => undef,
-	nparts => -1,
-	last_partnum => -1,
-	doing_port_write => undef,
-	incoming_socket_cb => undef,
-	incoming_socket => undef,
-
-	# filled in when a new tape is started:
-	label => undef,
+	# worker writing each dumpfile, by handle
+	handles => {},
     }, $class;
     return $self;
 }
 
-# The feedback object mediates between messages from the driver and the ongoing
-# action with the taper.  This is made a little bit complicated because the
-# driver conversation is fairly contextual, with some responses answering
-# "questions" asked earlier.  This is modeled with the following taper
-# "states":
+# The controller has the following states:
 #
 # init:
 #   waiting for START-TAPER command
 # starting:
-#   warming up devices; TAPER-OK not sent yet
-# idle:
-#   not currently dumping anything
-# writing:
-#   in the middle of writing a file (self->{'handle'} set)
+#   workers are warming up devices; TAPER-OK not sent yet
+# running:
+#   TAPER-OK sent; each worker is idle or writing
 # error:
 #   a fatal error has occurred, so this object won't do anything
 
@@ -198,7 +178,7 @@ sub start {
 	debug => $Amanda::Config::debug_taper?'driver/taper':'',
     );
 
-    my $changer = Amanda::Changer->new();
+    my $changer = $self->{'changer'} = Amanda::Changer->new();
     if ($changer->isa("Amanda::Changer::Error")) {
 	# send a TAPE_ERROR right away
 	$self->{'proto'}->send(main::Protocol::TAPE_ERROR,
@@ -214,7 +194,304 @@ sub start {
 	return;
     }
 
-    my $taperscan = Amanda::Taper::Scan->new(changer => $changer);
+    my $nworkers = getconf($CNF_TAPER_PARALLEL_WRITE);
+    for my $i (0 .. $nworkers-1) {
+	my $worker = main::Worker->new(
+	    controller => $self,
+	    name => "worker$i");
+	$worker->start();
+	push @{$self->{'workers'}}, $worker;
+    }
+}
+
+sub quit {
+    my $self = shift;
+    my %params = @_;
+    my %subs;
+    my @errors;
+    my @workers = @{$self->{'workers'}};
+
+    $subs{'quit_worker'} = make_cb(quit_worker => sub {
+	my $worker = shift @workers;
+	return $subs{'stop_proto'}->() unless $worker;
+
+	$worker->quit(finished_cb => sub {
+	    my ($err) = @_;
+	    push @errors, $err if ($err);
+
+	    $subs{'quit_worker'}->();
+	});
+    });
+
+    $subs{'stop_proto'} = make_cb(stop_proto => sub {
+	$self->{'proto'}->stop(finished_cb => sub {
+	    my ($err) = @_;
+	    push @errors, $err if ($err);
+
+	    $subs{'done'}->();
+	});
+    });
+
+    $subs{'done'} = make_cb(done => sub {
+	if (@errors) {
+	    $params{'finished_cb'}->(join("; ", @errors));
+	} else {
+	    $params{'finished_cb'}->();
+	}
+    });
+
+    $subs{'quit_worker'}->();
+}
+
+# called by each worker when its initial scan is finished; once they all
+# are, tell the driver how many of them can write.  A worker that found no
+# volume (e.g., because a single-drive changer is already in use by another
+# worker) is shut down rather than failing the whole run.
+sub worker_started {
+    my $self = shift;
+    my ($worker, $error) = @_;
+
+    $worker->{'scan_error'} = $error;
+    return if grep { $_->{'state'} eq 'starting' } @{$self->{'workers'}};
+
+    my @ready = grep { !defined $_->{'scan_error'} } @{$self->{'workers'}};
+    my @failed = grep { defined $_->{'scan_error'} } @{$self->{'workers'}};
+
+    if (!@ready) {
+	$self->{'proto'}->send(main::Protocol::TAPE_ERROR,
+		handle => '99-9999', # fake handle
+		message => "$failed[0]->{scan_error}");
+	$self->{'state'} = "error";
+	# TODO: wait for message to be sent and then quit?
+	return;
+    }
+
+    for my $w (@failed) {
+	Amanda::Debug::warning("$w->{name}: $w->{scan_error}; not using it");
+	$w->quit(finished_cb => sub { });
+    }
+
+    # the driver numbers the workers that are left from zero
+    $self->{'workers'} = [ @ready ];
+    $self->{'state'} = "running";
+    $self->{'proto'}->send(main::Protocol::TAPER_OK,
+	nworkers => scalar @ready);
+}
+
+##
+# Driver commands
+
+sub msg_START_TAPER {
+    my $self = shift;
+    my ($msgtype, %params) = @_;
+
+    $self->_assert_in_state("init") or return;
+
+    $self->{'state'} = "starting";
+    $self->{'timestamp'} = $params{'timestamp'};
+    for my $worker (@{$self->{'workers'}}) {
+	$worker->start_scribe($params{'timestamp'});
+    }
+}
+
+sub msg_FILE_WRITE {
+    my $self = shift;
+    my ($msgtype, %params) = @_;
+
+    my $worker = $self->_start_write(%params) or return;
+    $worker->file_write($msgtype, %params);
+}
+
+sub msg_PORT_WRITE {
+    my $self = shift;
+    my ($msgtype, %params) = @_;
+
+    my $worker = $self->_start_write(%params) or return;
+    $worker->port_write($msgtype, %params);
+}
+
+sub msg_NEW_TAPE {
+    my $self = shift;
+    my ($msgtype, %params) = @_;
+
+    my $worker = $self->_handle_worker($params{'handle'}) or return;
+    $worker->volume_permission(undef);
+}
+
+sub msg_NO_NEW_TAPE {
+    my $self = shift;
+    my ($msgtype, %params) = @_;
+
+    my $worker = $self->_handle_worker($params{'handle'}) or return;
+
+    # log the error (note that the message is intentionally not quoted)
+    log_add($L_ERROR, "no-tape [$params{reason}]");
+
+    $worker->volume_permission($params{'reason'});
+}
+
+# DONE and FAILED from the driver answer a DUMPER-STATUS
+sub msg_DONE {
+    my $self = shift;
+    my ($msgtype, %params) = @_;
+
+    my $worker = $self->_handle_worker($params{'handle'}) or return;
+    $worker->dumper_status("DONE");
+}
+
+sub msg_FAILED {
+    my $self = shift;
+    my ($msgtype, %params) = @_;
+
+    my $worker = $self->_handle_worker($params{'handle'}) or return;
+    $worker->dumper_status("FAILED");
+}
+
+sub msg_QUIT {
+    my $self = shift;
+    my ($msgtype, %params) = @_;
+    my $read_cb;
+
+    # because the driver hangs up on us immediately after sending QUIT,
+    # and EOF also means QUIT, we tend to get this command repeatedly.
+    # So check to make sure this is only called once
+    return if $self->{'quitting'};
+    $self->{'quitting'} = 1;
+
+    my $finished_cb = make_cb(finished_cb => sub {
+	Amanda::MainLoop::quit();
+    });
+    $self->quit(finished_cb => $finished_cb);
+};
+
+##
+# Utilities
+
+sub _assert_in_state {
+    my $self = shift;
+    my ($state) = @_;
+    if ($self->{'state'} eq $state) {
+	return 1;
+    } else {
+	$self->{'proto'}->send(main::Protocol::BAD_COMMAND,
+	    message => "command not appropriate in state '$self->{state}'");
+	return 0;
+    }
+}
+
+sub _start_write {
+    my $self = shift;
+    my %params = @_;
+
+    $self->_assert_in_state("running") or return undef;
+
+    my $worker = $self->{'workers'}->[$params{'worker'}];
+    if (!defined $worker) {
+	$self->{'proto'}->send(main::Protocol::BAD_COMMAND,
+	    message => "no worker '$params{worker}'");
+	return undef;
+    }
+    $self->{'handles'}->{$params{'handle'}} = $worker;
+    return $worker;
+}
+
+sub _handle_worker {
+    my $self = shift;
+    my ($handle) = @_;
+
+    my $worker = $self->{'handles'}->{$handle};
+    if (!defined $worker) {
+	$self->{'proto'}->send(main::Protocol::BAD_COMMAND,
+	    message => "no dumpfile is being written for handle '$handle'");
+    }
+    return $worker;
+}
+
+# called by a worker when it has sent the final result for a handle
+sub write_done {
+    my $self = shift;
+    my ($handle) = @_;
+
+    delete $self->{'handles'}->{$handle};
+}
+
+
+package main::Worker;
+
+use IO::Socket;
+use POSIX qw( :errno_h );
+use Amanda::Config qw( :getconf config_dir_relative );
+use Amanda::Header;
+use Amanda::Holding;
+use Amanda::MainLoop qw( :GIOCondition );
+use Amanda::MainLoop;
+use Amanda::Taper::Scan;
+use Amanda::Taper::Scribe;
+use Amanda::Logfile qw( :logtype_t log_add );
+use Amanda::Xfer;
+use Amanda::Util qw( quote_string );
+use Amanda::Tapelist;
+use File::Temp;
+
+use base qw( Amanda::Taper::Scribe::Feedback );
+
+sub new {
+    my $class = shift;
+    my %params = @_;
+
+    my $self = bless {
+	state => "init",
+	controller => $params{'controller'},
+	proto => $params{'controller'}->{'proto'},
+	name => $params{'name'},
+
+	# filled in at start
+	scribe => undef,
+	listen_socket => undef,
+	listen_socket_src => undef,
+	scan_error => undef,
+
+	# filled in when a write starts:
+	handle => undef,
+	header => undef,
+	nparts => -1,
+	last_partnum => -1,
+	doing_port_write => undef,
+	incoming_socket_cb => undef,
+	incoming_socket => undef,
+
+	# filled in while waiting on the driver:
+	perm_cb => undef,
+	dumper_status_cb => undef,
+
+	# filled in when a new tape is started:
+	label => undef,
+    }, $class;
+    return $self;
+}
+
+# The worker mediates between the controller's messages from the driver and
+# the ongoing action with its scribe.  Its states are:
+#
+# init:
+#   waiting for START-TAPER command
+# starting:
+#   warming up the device; the controller has not heard back yet
+# idle:
+#   not currently dumping anything
+# writing:
+#   in the middle of writing a file (self->{'handle'} set)
+# error:
+#   the initial scan failed, so this worker won't do anything
+
+sub start {
+    my $self = shift;
+
+    # each worker needs its own taperscan, as a scan cannot be run twice at
+    # once; the labels they invent are shared so they never pick the same one
+    my $taperscan = Amanda::Taper::Scan->new(
+	changer => $self->{'controller'}->{'changer'},
+	pending_labels => $self->{'controller'}->{'pending_labels'});
     $self->{'scribe'} = Amanda::Taper::Scribe->new(
 	taperscan => $taperscan,
 	feedback => $self,
@@ -238,11 +515,23 @@ sub start {
     });
 }
 
+sub start_scribe {
+    my $self = shift;
+    my ($timestamp) = @_;
+
+    $self->{'state'} = "starting";
+    $self->{'scribe'}->start(dump_timestamp => $timestamp);
+}
+
 sub quit {
     my $self = shift;
     my %params = @_;
     my %subs;
-    my @errors = @_;
+    my @errors;
+
+    # a worker dropped at startup may be asked to quit again at QUIT time
+    return $params{'finished_cb'}->() if $self->{'quit'};
+    $self->{'quit'} = 1;
 
     $subs{'stop_socket'} = make_cb(stop_socket => sub {
 	$self->{'listen_socket_src'}->remove();
@@ -256,15 +545,6 @@ sub quit {
 	    my ($err) = @_;
 	    push @errors, $err if ($err);
 
-	    $subs{'stop_proto'}->();
-	});
-    });
-
-    $subs{'stop_proto'} = make_cb(stop_proto => sub {
-	$self->{'proto'}->stop(finished_cb => sub {
-	    my ($err) = @_;
-	    push @errors, $err if ($err);
-
 	    $subs{'done'}->();
 	});
     });
@@ -291,14 +571,11 @@ sub notif_scan_finished {
     # when starting up
     if ($self->{'state'} eq "starting") {
 	if ($params{'error'}) {
-	    $self->{'proto'}->send(main::Protocol::TAPE_ERROR,
-		    handle => '99-9999', # fake handle
-		    message => "$params{error}");
 	    $self->{'state'} = "error";
-	    # TODO: wait for message to be sent and then quit?
+	    $self->{'controller'}->worker_started($self, "$params{error}");
 	} else {
-	    $self->{'proto'}->send(main::Protocol::TAPER_OK);
 	    $self->{'state'} = "idle";
+	    $self->{'controller'}->worker_started($self, undef);
 	}
     }
 }
@@ -307,30 +584,28 @@ sub request_volume_permission {
     my $self = shift;
     my %params = @_;
 
-    # set up callbacks from when we hear back from the driver
-    my $new_tape_cb = make_cb(new_tape_cb => sub {
-	my ($msgtype, %msg_params) = @_;
-	$params{'perm_cb'}->(undef);
-    });
-    $self->{'proto'}->set_message_cb(main::Protocol::NEW_TAPE,
-	$new_tape_cb);
-
-    my $no_new_tape_cb = make_cb(no_new_tape_cb => sub {
-	my ($msgtype, %msg_params) = @_;
-
-	# log the error (note that the message is intentionally not quoted)
-	log_add($L_ERROR, "no-tape [$msg_params{reason}]");
-
-	$params{'perm_cb'}->($msg_params{'reason'});
-    });
-    $self->{'proto'}->set_message_cb(main::Protocol::NO_NEW_TAPE,
-	$no_new_tape_cb);
+    # the controller calls volume_permission when the driver answers
+    $self->{'perm_cb'} = $params{'perm_cb'};
 
     # and send the request to the driver
     $self->{'proto'}->send(main::Protocol::REQUEST_NEW_TAPE,
 	handle => $self->{'handle'});
 }
 
+sub volume_permission {
+    my $self = shift;
+    my ($reason) = @_;
+
+    my $perm_cb = $self->{'perm_cb'};
+    $self->{'perm_cb'} = undef;
+    if (!$perm_cb) {
+	$self->{'proto'}->send(main::Protocol::BAD_COMMAND,
+	    message => "$self->{name} did not ask for a new tape");
+	return;
+    }
+    $perm_cb->($reason);
+}
+
 sub notif_new_tape {
     my $self = shift;
     my %params = @_;
@@ -339,21 +614,22 @@ sub notif_new_tape {
     # (this will be a change to the protocol)
     if ($params{'volume_label'}) {
 	$self->{'label'} = $params{'volume_label'};
+	my $timestamp = $self->{'controller'}->{'timestamp'};
 
 	# register in the tapelist
 	my $tl_file = config_dir_relative(getconf($CNF_TAPELIST));
 	my $tl = Amanda::Tapelist::read_tapelist($tl_file);
 	my $tle = $tl->lookup_tapelabel($params{'volume_label'});
 	$tl->remove_tapelabel($params{'volume_label'});
-	$tl->add_tapelabel($self->{'timestamp'}, $params{'volume_label'},
+	$tl->add_tapelabel($timestamp, $params{'volume_label'},
 		$tle? $tle->{'comment'} : undef);
 	$tl->write($tl_file);
 
 	# add to the trace log
 	log_add($L_START, sprintf("datestamp %s label %s tape %s",
-		$self->{'timestamp'},
+		$timestamp,
 		quote_string($self->{'label'}),
-		++$self->{'tape_num'}));
+		++$self->{'controller'}->{'tape_num'}));
 
 	# and the amdump log
 	print STDERR "taper: wrote label `$self->{label}'\n";
@@ -415,21 +691,10 @@ sub notif_log_info {
 }
 
 ##
-# Driver commands
-
-sub msg_START_TAPER {
-    my $self = shift;
-    my ($msgtype, %params) = @_;
-
-    $self->_assert_in_state("init") or return;
-
-    $self->{'state'} = "starting";
-    $self->{'scribe'}->start(dump_timestamp => $params{'timestamp'});
-    $self->{'timestamp'} = $params{'timestamp'};
-}
+# Driver commands, passed on by the controller
 
 # defer both PORT_ and FILE_WRITE to a common method
-sub msg_FILE_WRITE {
+sub file_write {
     my $self = shift;
     my ($msgtype, %params) = @_;
 
@@ -446,7 +711,7 @@ sub msg_FILE_WRITE {
     $self->do_start_xfer($msgtype, $xfer_src, $hdr, %params);
 }
 
-sub msg_PORT_WRITE {
+sub port_write {
     my $self = shift;
     my ($msgtype, %params) = @_;
     my $read_cb;
@@ -536,22 +801,20 @@ sub msg_PORT_WRITE {
     }
 }
 
-sub msg_QUIT {
+# DONE or FAILED from the driver, in answer to a DUMPER-STATUS
+sub dumper_status {
     my $self = shift;
-    my ($msgtype, %params) = @_;
-    my $read_cb;
+    my ($status) = @_;
 
-    # because the driver hangs up on us immediately after sending QUIT,
-    # and EOF also means QUIT, we tend to get this command repeatedly.
-    # So check to make sure this is only called once
-    return if $self->{'quitting'};
-    $self->{'quitting'} = 1;
-
-    my $finished_cb = make_cb(finished_cb => sub {
-	Amanda::MainLoop::quit();
-    });
-    $self->quit(finished_cb => $finished_cb);
-};
+    my $dumper_status_cb = $self->{'dumper_status_cb'};
+    $self->{'dumper_status_cb'} = undef;
+    if (!$dumper_status_cb) {
+	$self->{'proto'}->send(main::Protocol::BAD_COMMAND,
+	    message => "$self->{name} did not ask for the dumper status");
+	return;
+    }
+    $dumper_status_cb->($status);
+}
 
 ##
 # Utilities
@@ -655,6 +918,16 @@ sub do_start_xfer {
 		$start_xfer_args{'split_method'} = 'none';
 	    }
 	}
+
+	# a slow device should not stall the client; spill to disk instead
+	my $spill_dir = getconf($CNF_TAPER_SPILL_DIR);
+	if ($spill_dir) {
+	    if (-d $spill_dir) {
+		$start_xfer_args{'spill_dirname'} = $spill_dir;
+	    } else {
+		Amanda::Debug::warning("taper-spill-dir '$spill_dir' not found or not a directory; not spilling");
+	    }
+	}
     }
 
     # implement the fallback to memory buffering if the disk buffer does
@@ -714,10 +987,10 @@ sub dump_cb {
     if ($params{'result'} eq "DONE"
 	    and $self->{'doing_port_write'}
 	    and !exists $params{'dumper_status'}) {
-	$self->{'proto'}->set_message_cb(main::Protocol::DONE,
-	    make_cb(sub { $self->dump_cb(%params, dumper_status => "DONE"); }));
-	$self->{'proto'}->set_message_cb(main::Protocol::FAILED,
-	    make_cb(sub { $self->dump_cb(%params, dumper_status => "FAILED"); }));
+	$self->{'dumper_status_cb'} = make_cb(dumper_status_cb => sub {
+	    my ($status) = @_;
+	    $self->dump_cb(%params, dumper_status => $status);
+	});
 	$self->{'proto'}->send(main::Protocol::DUMPER_STATUS,
 		handle => $self->{'handle'});
 	return;
@@ -800,6 +1073,7 @@ sub dump_cb {
     }
 
     # reset things to 'idle' (or 'error') before sending the message
+    $self->{'controller'}->write_done($self->{'handle'});
     $self->{'incoming_socket'} = undef;
     $self->{'handle'} = undef;
     $self->{'header'} = undef;
@@ -45,8 +45,7 @@ send_xfer_done(
 	    xmsg_new((XferElement *)self, XMSG_DONE, 0));
 }
 
-#define GLUE_BUFFER_SIZE 32768
-#define GLUE_RING_BUFFER_SIZE 32
+#define GLUE_SPLICE_SIZE 65536
 
 /*
  * Worker threads
@@ -76,11 +75,11 @@ call_and_write_thread(
 	if (full_write(fd, buf, len) < len) {
 	    xfer_element_handle_error(elt,
 		_("Error writing to fd %d: %s"), fd, strerror(errno));
-	    amfree(buf);
+	    xfer_release_buffer(elt->xfer, buf, len);
 	    break;
 	}
 
-	amfree(buf);
+	xfer_release_buffer(elt->xfer, buf, len);
     }
 
     if (elt->cancelled && elt->expect_eof)
@@ -96,25 +95,144 @@ call_and_write_thread(
     return NULL;
 }
 
-static gpointer
-read_and_write_thread(
-    gpointer data)
+#ifdef HAVE_SPLICE
+/* Move data from RFD to WFD with splice(2), so that it never passes through
+ * userspace.  Splice requires that one end of each call be a pipe; if neither
+ * RFD nor WFD is a pipe, the data is routed through a private pipe.
+ *
+ * Returns TRUE if the transfer is finished (at EOF, cancelled, or failed with
+ * an error that has already been reported), or FALSE if splice cannot be used
+ * with these file descriptors and the caller should finish the transfer by
+ * copying.  In the latter case, all data read from RFD has been written to
+ * WFD. */
+static gboolean
+splice_fds(
+    XferElementGlue *self,
+    int rfd,
+    int wfd)
 {
-    XferElement *elt = XFER_ELEMENT(data);
-    XferElementGlue *self = XFER_ELEMENT_GLUE(data);
-    int rfd = elt->upstream->output_fd;
-    int wfd = elt->downstream->input_fd;
+    XferElement *elt = XFER_ELEMENT(self);
+    int spipe[2] = { -1, -1 };
+    gboolean direct = TRUE;
+    gboolean finished = TRUE;
+
+    while (!elt->cancelled) {
+	ssize_t len;
+
+	if (direct) {
+	    len = splice(rfd, NULL, wfd, NULL, GLUE_SPLICE_SIZE,
+			 SPLICE_F_MOVE | SPLICE_F_MORE);
+	    if (len < 0 && errno == EINTR)
+		continue;
+
+	    /* EINVAL means neither fd is a pipe (or the kernel can't splice
+	     * them); ENOSYS means no splice at all.  Both are only possible
+	     * before any data has moved, since the fds do not change. */
+	    if (len < 0 && errno == EINVAL && self->bytes_spliced == 0) {
+		if (pipe(spipe) < 0) {
+		    spipe[0] = spipe[1] = -1;
+		    finished = FALSE;
+		    break;
+		}
+		direct = FALSE;
+		continue;
+	    }
+	    if (len < 0 && errno == ENOSYS && self->bytes_spliced == 0) {
+		finished = FALSE;
+		break;
+	    }
+	    if (len < 0) {
+		xfer_element_handle_error(elt,
+		    _("Error splicing from fd %d to fd %d: %s"), rfd, wfd, strerror(errno));
+		break;
+	    }
+	} else {
+	    ssize_t remaining;
+
+	    len = splice(rfd, NULL, spipe[1], NULL, GLUE_SPLICE_SIZE,
+			 SPLICE_F_MOVE | SPLICE_F_MORE);
+	    if (len < 0 && errno == EINTR)
+		continue;
+	    if (len < 0 && errno == EINVAL && self->bytes_spliced == 0) {
+		finished = FALSE;
+		break;
+	    }
+	    if (len < 0) {
+		xfer_element_handle_error(elt,
+		    _("Error reading from fd %d: %s"), rfd, strerror(errno));
+		break;
+	    }
+
+	    /* drain the private pipe into wfd */
+	    remaining = len;
+	    while (remaining > 0) {
+		ssize_t written = splice(spipe[0], NULL, wfd, NULL, remaining,
+					 SPLICE_F_MOVE | SPLICE_F_MORE);
+		if (written < 0 && errno == EINTR)
+		    continue;
+
+		if (written < 0 && errno == EINVAL) {
+		    /* wfd can't take spliced data (e.g., O_APPEND); copy what
+		     * is left in the pipe and let the caller carry on */
+		    char *buf = g_malloc(remaining);
+		    if (full_read(spipe[0], buf, remaining) < (size_t)remaining
+		     || full_write(wfd, buf, remaining) < (size_t)remaining) {
+			xfer_element_handle_error(elt,
+			    _("Could not write to fd %d: %s"), wfd, strerror(errno));
+		    } else {
+			finished = FALSE;
+		    }
+		    amfree(buf);
+		    goto done;
+		}
+		if (written <= 0) {
+		    xfer_element_handle_error(elt,
+			_("Could not write to fd %d: %s"), wfd, strerror(errno));
+		    goto done;
+		}
+
+		remaining -= written;
+		self->bytes_spliced += written;
+	    }
+	    if (len == 0)
+		break;
+	    continue;
+	}
+
+	if (len == 0) /* EOF */
+	    break;
+
+	self->bytes_spliced += len;
+    }
+
+done:
+    if (spipe[0] != -1) close(spipe[0]);
+    if (spipe[1] != -1) close(spipe[1]);
+
+    return finished;
+}
+#endif
+
+/* Copy data from RFD to WFD through a userspace buffer */
+static void
+copy_fds(
+    XferElementGlue *self,
+    int rfd,
+    int wfd)
+{
+    XferElement *elt = XFER_ELEMENT(self);
+    gsize bufsize;
 
     /* dynamically allocate a buffer, in case this thread has
      * a limited amount of stack allocated */
-    char *buf = g_malloc(GLUE_BUFFER_SIZE);
+    char *buf = xfer_get_buffer(elt->xfer, &bufsize);
 
     while (!elt->cancelled) {
 	size_t len;
 
 	/* read from upstream */
-	len = full_read(rfd, buf, GLUE_BUFFER_SIZE);
-	if (len < GLUE_BUFFER_SIZE) {
+	len = full_read(rfd, buf, bufsize);
+	if (len < bufsize) {
 	    if (errno) {
 		xfer_element_handle_error(elt,
 		    _("Error reading from fd %d: %s"), rfd, strerror(errno));
@@ -132,6 +250,29 @@ read_and_write_thread(
 	}
     }
 
+    xfer_release_buffer(elt->xfer, buf, bufsize);
+}
+
+static gpointer
+read_and_write_thread(
+    gpointer data)
+{
+    XferElement *elt = XFER_ELEMENT(data);
+    XferElementGlue *self = XFER_ELEMENT_GLUE(data);
+    int rfd = elt->upstream->output_fd;
+    int wfd = elt->downstream->input_fd;
+    gboolean finished = FALSE;
+
+#ifdef HAVE_SPLICE
+    finished = splice_fds(self, rfd, wfd);
+#endif
+    if (!finished)
+	copy_fds(self, rfd, wfd);
+
+    if (self->bytes_spliced)
+	g_debug("%s: spliced %ju bytes without copying",
+		xfer_element_repr(elt), (uintmax_t)self->bytes_spliced);
+
     if (elt->cancelled && elt->expect_eof)
 	xfer_element_drain_by_pulling(elt->upstream);
 
@@ -149,7 +290,6 @@ read_and_write_thread(
 
     send_xfer_done(self);
 
-    amfree(buf);
     return NULL;
 }
 
@@ -163,18 +303,20 @@ read_and_call_thread(
     int fd = *fdp;
 
     while (!elt->cancelled) {
-	char *buf = g_malloc(GLUE_BUFFER_SIZE);
+	gsize bufsize;
+	char *buf = xfer_get_buffer(elt->xfer, &bufsize);
 	size_t len;
 
 	/* read a buffer from upstream */
-	len = full_read(fd, buf, GLUE_BUFFER_SIZE);
-	if (len < GLUE_BUFFER_SIZE) {
+	len = full_read(fd, buf, bufsize);
+	if (len < bufsize) {
 	    if (errno) {
 		xfer_element_handle_error(elt,
 		    _("Error reading from fd %d: %s"), fd, strerror(errno));
+		xfer_release_buffer(elt->xfer, buf, bufsize);
 		break;
 	    } else if (len == 0) { /* we only count a zero-length read as EOF */
-		amfree(buf);
+		xfer_release_buffer(elt->xfer, buf, bufsize);
 		break;
 	    }
 	}
@@ -317,9 +459,9 @@ setup_impl(
 	    break;
 
 	case XFER_MECH_PULL_BUFFER:
-	    self->ring = g_malloc(sizeof(*self->ring) * GLUE_RING_BUFFER_SIZE);
-	    self->ring_used_sem = semaphore_new_with_value(0);
-	    self->ring_free_sem = semaphore_new_with_value(GLUE_RING_BUFFER_SIZE);
+	    /* the ring is allocated in start_impl, once every element has
+	     * had a chance to set the xfer's ring depth */
+	    self->need_ring = TRUE;
 	    break;
 
 	case XFER_MECH_NONE:
@@ -370,6 +512,13 @@ start_impl(
 {
     XferElementGlue *self = (XferElementGlue *)elt;
 
+    if (self->need_ring) {
+	self->ring_size = xfer_get_ring_depth(elt->xfer);
+	self->ring = g_malloc(sizeof(*self->ring) * self->ring_size);
+	self->ring_used_sem = semaphore_new_with_value(0);
+	self->ring_free_sem = semaphore_new_with_value(self->ring_size);
+    }
+
     if (self->threadfunc) {
 	self->thread = g_thread_create(self->threadfunc, (gpointer)self, FALSE, NULL);
     }
@@ -400,7 +549,7 @@ pull_buffer_impl(
 	/* get it */
 	buf = self->ring[self->ring_tail].buf;
 	*size = self->ring[self->ring_tail].size;
-	self->ring_tail = (self->ring_tail + 1) % GLUE_RING_BUFFER_SIZE;
+	self->ring_tail = (self->ring_tail + 1) % self->ring_size;
 
 	/* and mark this element as free to be overwritten */
 	semaphore_up(self->ring_free_sem);
@@ -409,7 +558,8 @@ pull_buffer_impl(
     } else {
 	int *fdp = (self->pipe[0] == -1)? &elt->upstream->output_fd : &self->pipe[0];
 	int fd = *fdp;
-	char *buf = g_malloc(GLUE_BUFFER_SIZE);
+	char *buf;
+	gsize bufsize;
 	ssize_t len;
 
 	if (elt->cancelled) {
@@ -424,14 +574,16 @@ pull_buffer_impl(
 	}
 
 	/* read from upstream */
-	len = full_read(fd, buf, GLUE_BUFFER_SIZE);
-	if (len < GLUE_BUFFER_SIZE) {
+	buf = xfer_get_buffer(elt->xfer, &bufsize);
+	len = full_read(fd, buf, bufsize);
+	if (len < (ssize_t)bufsize) {
 	    if (errno) {
 		xfer_element_handle_error(elt,
 		    _("Error reading from fd %d: %s"), fd, strerror(errno));
 
 		/* return an EOF */
-		amfree(buf);
+		xfer_release_buffer(elt->xfer, buf, bufsize);
+		buf = NULL;
 		len = 0;
 
 		/* and finish off the upstream */
@@ -442,7 +594,7 @@ pull_buffer_impl(
 		*fdp = -1;
 	    } else if (len == 0) {
 		/* EOF */
-		g_free(buf);
+		xfer_release_buffer(elt->xfer, buf, bufsize);
 		buf = NULL;
 		*size = 0;
 
@@ -468,7 +620,7 @@ push_buffer_impl(
     if (self->ring) {
 	/* just drop packets if the transfer has been cancelled */
 	if (elt->cancelled) {
-	    amfree(buf);
+	    xfer_release_buffer(elt->xfer, buf, len);
 	    return;
 	}
 
@@ -478,7 +630,7 @@ push_buffer_impl(
 	/* set it */
 	self->ring[self->ring_head].buf = buf;
 	self->ring[self->ring_head].size = len;
-	self->ring_head = (self->ring_head + 1) % GLUE_RING_BUFFER_SIZE;
+	self->ring_head = (self->ring_head + 1) % self->ring_size;
 
 	/* and mark this element as available for reading */
 	semaphore_up(self->ring_used_sem);
@@ -497,7 +649,7 @@ push_buffer_impl(
 		elt->expect_eof = TRUE;
 	    }
 
-	    amfree(buf);
+	    xfer_release_buffer(elt->xfer, buf, len);
 
 	    return;
 	}
@@ -509,7 +661,7 @@ push_buffer_impl(
 		    _("Error writing to fd %d: %s"), fd, strerror(errno));
 		/* nothing special to do to handle the cancellation */
 	    }
-	    amfree(buf);
+	    xfer_release_buffer(elt->xfer, buf, len);
 	} else {
 	    close(fd);
 	    *fdp = -1;
@@ -543,7 +695,7 @@ finalize_impl(
 	while (self->ring_used_sem->value) {
 	    if (self->ring[self->ring_tail].buf)
 		amfree(self->ring[self->ring_tail].buf);
-	    self->ring_tail = (self->ring_tail + 1) % GLUE_RING_BUFFER_SIZE;
+	    self->ring_tail = (self->ring_tail + 1) % self->ring_size;
 	}
 
 	amfree(self->ring);
@@ -50,13 +50,21 @@ typedef struct XferElementGlue {
      * providing.. */
     int pipe[2];
 
-    /* for push/pull, a ring buffer of ptr/size pairs */
+    /* for push/pull, a ring buffer of ptr/size pairs, with ring_size
+     * elements (taken from the xfer's ring depth) */
+    gboolean need_ring;
     struct { gpointer buf; size_t size; } *ring;
     semaphore_t *ring_used_sem, *ring_free_sem;
     gint ring_head, ring_tail;
+    guint ring_size;
 
     GThread *thread;
     GThreadFunc threadfunc;
+
+    /* bytes moved from fd to fd with splice(), without passing through
+     * userspace; only written by the glue thread, so read it after the
+     * transfer is done */
+    guint64 bytes_spliced;
 } XferElementGlue;
 
 /*
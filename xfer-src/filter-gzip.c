@@ -0,0 +1,438 @@
+/*
+ * Amanda, The Advanced Maryland Automatic Network Disk Archiver
+ * Copyright (c) 2008,2009 Zmanda, Inc.  All Rights Reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ *
+ * Contact information: Zmanda Inc., 465 S. Mathilda Ave., Suite 300
+ * Sunnyvale, CA 94085, USA, or: http://www.zmanda.com
+ */
+
+#include "amxfer.h"
+#include "amanda.h"
+
+#ifdef HAVE_ZLIB
+
+#include <zlib.h>
+
+/*
+ * The data is cut into blocks, and each block is compressed by one of a
+ * pool of worker threads into a complete gzip member.  A gzip file may
+ * hold any number of members, and gzip -d decompresses them one after
+ * another, so the concatenated output is an ordinary gzip stream and
+ * restores need nothing new.  Independent blocks cost a little
+ * compression ratio at the start of each block.
+ */
+
+#define GZIP_BLOCK_SIZE	(1024*1024)
+
+/*
+ * Class declaration
+ *
+ * This declaration is entirely private; nothing but xfer_filter_gzip() references
+ * it directly.
+ */
+
+GType xfer_filter_gzip_get_type(void);
+#define XFER_FILTER_GZIP_TYPE (xfer_filter_gzip_get_type())
+#define XFER_FILTER_GZIP(obj) G_TYPE_CHECK_INSTANCE_CAST((obj), xfer_filter_gzip_get_type(), XferFilterGzip)
+#define XFER_FILTER_GZIP_CONST(obj) G_TYPE_CHECK_INSTANCE_CAST((obj), xfer_filter_gzip_get_type(), XferFilterGzip const)
+#define XFER_FILTER_GZIP_CLASS(klass) G_TYPE_CHECK_CLASS_CAST((klass), xfer_filter_gzip_get_type(), XferFilterGzipClass)
+#define IS_XFER_FILTER_GZIP(obj) G_TYPE_CHECK_INSTANCE_TYPE((obj), xfer_filter_gzip_get_type ())
+#define XFER_FILTER_GZIP_GET_CLASS(obj) G_TYPE_INSTANCE_GET_CLASS((obj), xfer_filter_gzip_get_type(), XferFilterGzipClass)
+
+static GObjectClass *parent_class = NULL;
+
+/* A block of data on its way through a worker.  Data holds the input
+ * until done is set, and the compressed output after. */
+typedef struct gzip_block_s {
+    char *data;
+    size_t len;
+    gboolean done;
+    char *errmsg;		/* set instead of data if compression failed */
+} gzip_block_t;
+
+/* pushed onto the work queue to stop a worker */
+static gzip_block_t stop_block;
+
+/*
+ * Main object structure
+ */
+
+typedef struct XferFilterGzip {
+    XferElement __parent__;
+
+    int level;
+    int nthreads;
+
+    GThread **threads;
+    GAsyncQueue *work;
+
+    /* blocks handed to the workers, in stream order; the block at the
+     * head is the next to go downstream.  Done flags are protected by
+     * the mutex, and workers signal the cond when they set one. */
+    GQueue *blocks;
+    GMutex *mutex;
+    GCond *cond;
+
+    /* the block being filled */
+    char *cur;
+    size_t cur_len;
+    gboolean sent_block;
+} XferFilterGzip;
+
+/*
+ * Class definition
+ */
+
+typedef struct {
+    XferElementClass __parent__;
+} XferFilterGzipClass;
+
+
+/*
+ * Utilities
+ */
+
+static gpointer
+gzip_worker(
+    gpointer data)
+{
+    XferFilterGzip *self = (XferFilterGzip *)data;
+    gzip_block_t *block;
+    z_stream zs;
+    char *out;
+    size_t out_size;
+    const char *zmsg;
+    int zerr;
+
+    while ((block = g_async_queue_pop(self->work)) != &stop_block) {
+	memset(&zs, 0, SIZEOF(zs));
+
+	/* windowBits of 15+16 asks zlib for a gzip header and trailer */
+	zerr = deflateInit2(&zs, self->level, Z_DEFLATED, 15+16, 8,
+			    Z_DEFAULT_STRATEGY);
+	if (zerr == Z_OK) {
+	    out_size = deflateBound(&zs, (uLong)block->len);
+	    out = g_malloc(out_size);
+
+	    zs.next_in = (Bytef *)block->data;
+	    zs.avail_in = (uInt)block->len;
+	    zs.next_out = (Bytef *)out;
+	    zs.avail_out = (uInt)out_size;
+	    zerr = deflate(&zs, Z_FINISH);
+	    zmsg = zs.msg;
+	    deflateEnd(&zs);
+	} else {
+	    out = NULL;
+	    zmsg = zs.msg;
+	}
+
+	g_free(block->data);
+	if (zerr == Z_STREAM_END) {
+	    block->data = out;
+	    block->len = out_size - zs.avail_out;
+	} else {
+	    g_free(out);
+	    block->data = NULL;
+	    block->len = 0;
+	    block->errmsg = g_strdup_printf(_("compression failed: %s"),
+		zmsg? zmsg : _("zlib error"));
+	}
+
+	g_mutex_lock(self->mutex);
+	block->done = TRUE;
+	g_cond_broadcast(self->cond);
+	g_mutex_unlock(self->mutex);
+    }
+
+    return NULL;
+}
+
+static void
+start_workers(
+    XferFilterGzip *self)
+{
+    int i;
+
+    self->threads = g_new0(GThread *, self->nthreads);
+    for (i = 0; i < self->nthreads; i++) {
+	self->threads[i] = g_thread_create(gzip_worker, (gpointer)self, TRUE, NULL);
+    }
+}
+
+static void
+stop_workers(
+    XferFilterGzip *self)
+{
+    int i;
+
+    if (!self->threads)
+	return;
+
+    for (i = 0; i < self->nthreads; i++)
+	g_async_queue_push(self->work, &stop_block);
+    for (i = 0; i < self->nthreads; i++)
+	g_thread_join(self->threads[i]);
+    amfree(self->threads);
+}
+
+/* Send finished blocks downstream, in order, first waiting until no more than
+ * wait_for blocks are outstanding.  Returns FALSE if a block could not be
+ * compressed. */
+static gboolean
+send_blocks(
+    XferFilterGzip *self,
+    guint wait_for)
+{
+    XferElement *elt = XFER_ELEMENT(self);
+    gzip_block_t *block;
+
+    g_mutex_lock(self->mutex);
+    while ((block = g_queue_peek_head(self->blocks)) != NULL) {
+	if (!block->done) {
+	    if (self->blocks->length <= wait_for)
+		break;
+	    g_cond_wait(self->cond, self->mutex);
+	    continue;
+	}
+	g_queue_pop_head(self->blocks);
+	g_mutex_unlock(self->mutex);
+
+	if (block->errmsg) {
+	    if (!elt->cancelled)
+		xfer_element_handle_error(elt, "%s", block->errmsg);
+	    g_free(block->errmsg);
+	    g_free(block);
+	    return FALSE;
+	}
+
+	if (elt->cancelled)
+	    g_free(block->data);
+	else
+	    xfer_element_push_buffer(elt->downstream, block->data, block->len);
+	g_free(block);
+
+	g_mutex_lock(self->mutex);
+    }
+    g_mutex_unlock(self->mutex);
+
+    return TRUE;
+}
+
+/* Hand the block being filled to the workers. */
+static void
+queue_block(
+    XferFilterGzip *self)
+{
+    gzip_block_t *block = g_new0(gzip_block_t, 1);
+
+    block->data = self->cur;
+    block->len = self->cur_len;
+    self->cur = NULL;
+    self->cur_len = 0;
+    self->sent_block = TRUE;
+
+    g_mutex_lock(self->mutex);
+    g_queue_push_tail(self->blocks, block);
+    g_mutex_unlock(self->mutex);
+    g_async_queue_push(self->work, block);
+}
+
+/*
+ * Implementation
+ */
+
+static gboolean
+start_impl(
+    XferElement *elt)
+{
+    start_workers(XFER_FILTER_GZIP(elt));
+
+    return FALSE;
+}
+
+static void
+push_buffer_impl(
+    XferElement *elt,
+    gpointer buf,
+    size_t len)
+{
+    XferFilterGzip *self = (XferFilterGzip *)elt;
+    size_t off, n;
+
+    /* drop the buffer if we've been cancelled */
+    if (elt->cancelled) {
+	xfer_release_buffer(elt->xfer, buf, len);
+	if (!buf) {
+	    send_blocks(self, 0);
+	    xfer_element_push_buffer(elt->downstream, NULL, 0);
+	}
+	return;
+    }
+
+    if (buf) {
+	for (off = 0; off < len; off += n) {
+	    if (!self->cur)
+		self->cur = g_malloc(GZIP_BLOCK_SIZE);
+	    n = MIN(len - off, GZIP_BLOCK_SIZE - self->cur_len);
+	    memcpy(self->cur + self->cur_len, (char *)buf + off, n);
+	    self->cur_len += n;
+
+	    if (self->cur_len == GZIP_BLOCK_SIZE) {
+		queue_block(self);
+		/* keep every worker busy, with one block ready behind each,
+		 * but hold no more than that in memory */
+		if (!send_blocks(self, 2 * self->nthreads))
+		    break;
+	    }
+	}
+	xfer_release_buffer(elt->xfer, buf, len);
+	return;
+    }
+
+    /* EOF: compress what is left (an empty stream still needs a header),
+     * send everything, then pass the EOF along */
+    if (self->cur_len > 0 || !self->sent_block) {
+	if (!self->cur)
+	    self->cur = g_malloc(1);
+	queue_block(self);
+    }
+    send_blocks(self, 0);
+    xfer_element_push_buffer(elt->downstream, NULL, 0);
+}
+
+static void
+instance_init(
+    XferElement *elt)
+{
+    XferFilterGzip *self = (XferFilterGzip *)elt;
+
+    elt->can_generate_eof = TRUE;
+    self->work = g_async_queue_new();
+    self->blocks = g_queue_new();
+    self->mutex = g_mutex_new();
+    self->cond = g_cond_new();
+}
+
+static void
+finalize_impl(
+    GObject * obj_self)
+{
+    XferFilterGzip *self = XFER_FILTER_GZIP(obj_self);
+    gzip_block_t *block;
+
+    stop_workers(self);
+
+    while ((block = g_queue_pop_head(self->blocks)) != NULL) {
+	g_free(block->data);
+	g_free(block->errmsg);
+	g_free(block);
+    }
+    g_queue_free(self->blocks);
+    g_async_queue_unref(self->work);
+    g_mutex_free(self->mutex);
+    g_cond_free(self->cond);
+    g_free(self->cur);
+
+    /* chain up */
+    G_OBJECT_CLASS(parent_class)->finalize(obj_self);
+}
+
+static void
+class_init(
+    XferFilterGzipClass * selfc)
+{
+    XferElementClass *klass = XFER_ELEMENT_CLASS(selfc);
+    GObjectClass *goc = G_OBJECT_CLASS(selfc);
+    static xfer_element_mech_pair_t mech_pairs[] = {
+	{ XFER_MECH_PUSH_BUFFER, XFER_MECH_PUSH_BUFFER, 1, 0},
+	{ XFER_MECH_NONE, XFER_MECH_NONE, 0, 0},
+    };
+
+    klass->start = start_impl;
+    klass->push_buffer = push_buffer_impl;
+
+    klass->perl_class = "Amanda::Xfer::Filter::Gzip";
+    klass->mech_pairs = mech_pairs;
+
+    goc->finalize = finalize_impl;
+
+    parent_class = g_type_class_peek_parent(selfc);
+}
+
+GType
+xfer_filter_gzip_get_type (void)
+{
+    static GType type = 0;
+
+    if G_UNLIKELY(type == 0) {
+        static const GTypeInfo info = {
+            sizeof (XferFilterGzipClass),
+            (GBaseInitFunc) NULL,
+            (GBaseFinalizeFunc) NULL,
+            (GClassInitFunc) class_init,
+            (GClassFinalizeFunc) NULL,
+            NULL /* class_data */,
+            sizeof (XferFilterGzip),
+            0 /* n_preallocs */,
+            (GInstanceInitFunc) instance_init,
+            NULL
+        };
+
+        type = g_type_register_static (XFER_ELEMENT_TYPE, "XferFilterGzip", &info, 0);
+    }
+
+    return type;
+}
+
+#endif /* HAVE_ZLIB */
+
+/* create an element of this class; prototype is in xfer-element.h */
+XferElement *
+xfer_filter_gzip(
+    int level,
+    int nthreads)
+{
+#ifdef HAVE_ZLIB
+    XferFilterGzip *self = (XferFilterGzip *)g_object_new(XFER_FILTER_GZIP_TYPE, NULL);
+
+    if (level < 1 || level > 9)
+	level = Z_DEFAULT_COMPRESSION;
+    self->level = level;
+
+    if (nthreads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+	nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (nthreads <= 0)
+	    nthreads = 1;
+    }
+    self->nthreads = nthreads;
+
+    return XFER_ELEMENT(self);
+#else
+    /* without zlib, run the compression program instead */
+    gchar **argv = g_new0(gchar *, 3);
+
+    (void)nthreads;
+    argv[0] = g_strdup(COMPRESS_PATH);
+    if (level >= 9 && *COMPRESS_BEST_OPT)
+	argv[1] = g_strdup(COMPRESS_BEST_OPT);
+    else if (level < 9 && *COMPRESS_FAST_OPT)
+	argv[1] = g_strdup(COMPRESS_FAST_OPT);
+
+    return xfer_filter_process(argv, FALSE);
+#endif
+}
@@ -374,6 +374,20 @@ XferElement *xfer_filter_process(gchar **argv, gboolean need_root);
 XferElement *xfer_filter_xor(
     unsigned char xor_key);
 
+/* A transfer filter that compresses the data that passes through it into a
+ * gzip stream, spreading the work over several threads.  Without zlib, this
+ * returns a filter running the compression program instead.
+ *
+ * Implemented in filter-gzip.c
+ *
+ * @param level: compression level, 1 (fastest) to 9 (best)
+ * @param nthreads: number of compression threads, or 0 for one per CPU
+ * @return: new element
+ */
+XferElement *xfer_filter_gzip(
+    int level,
+    int nthreads);
+
 /* A transfer destination that consumes all bytes it is given, optionally
  * validating that they match those produced by source_random
  *
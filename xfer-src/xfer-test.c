@@ -27,6 +27,10 @@
 #include "event.h"
 #include "simpleprng.h"
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 /* Having tests repeat exactly is an advantage, so we use a hard-coded
  * random seed. */
 #define RANDOM_SEED 0xf00d
@@ -716,6 +720,8 @@ dest_push_push_buffer_impl(
     g_assert(self->bufpos + size <= TEST_XFER_SIZE);
     memcpy(self->buf + self->bufpos, buf, size);
     self->bufpos += size;
+
+    xfer_release_buffer(elt->xfer, buf, size);
 }
 
 static void
@@ -1001,20 +1007,110 @@ test_xfer_files_filter(void)
     return test_xfer_files(TRUE);
 }
 
+/****
+ * Compress random data with the gzip filter, and check that it inflates
+ * back to the same data
+ */
+
+#ifdef HAVE_ZLIB
+static int
+test_xfer_gzip(void)
+{
+    unsigned int i;
+    GSource *src;
+    guint64 length = 3*1024*1024 + 12345; /* a few blocks and a bit */
+    gpointer buf;
+    gsize size;
+    z_stream zs;
+    char out[65536];
+    simpleprng_state_t prng;
+    guint64 total = 0;
+    int zerr;
+    int success = 1;
+    XferElement *elements[] = {
+	xfer_source_random(length, RANDOM_SEED),
+	xfer_filter_gzip(1, 3),
+	xfer_dest_buffer(0),
+    };
+    XferElement *dest = elements[2];
+
+    Xfer *xfer = xfer_new(elements, sizeof(elements)/sizeof(*elements));
+    src = xfer_get_source(xfer);
+    g_source_set_callback(src, (GSourceFunc)test_xfer_generic_callback, NULL, NULL);
+    g_source_attach(src, NULL);
+    tu_dbg("Transfer: %s\n", xfer_repr(xfer));
+
+    /* unreference the elements */
+    for (i = 0; i < sizeof(elements)/sizeof(*elements); i++) {
+	g_object_unref(elements[i]);
+	g_assert(G_OBJECT(elements[i])->ref_count == 1);
+	elements[i] = NULL;
+    }
+
+    xfer_start(xfer);
+
+    g_main_loop_run(default_main_loop());
+    g_assert(xfer->status == XFER_DONE);
+
+    xfer_dest_buffer_get(dest, &buf, &size);
+    tu_dbg("compressed %ju bytes to %ju\n", (uintmax_t)length, (uintmax_t)size);
+
+    /* inflate each gzip member in turn (15+32 accepts a gzip header) */
+    simpleprng_seed(&prng, RANDOM_SEED);
+    memset(&zs, 0, sizeof(zs));
+    g_assert(inflateInit2(&zs, 15+32) == Z_OK);
+    zs.next_in = buf;
+    zs.avail_in = size;
+    do {
+	zs.next_out = (Bytef *)out;
+	zs.avail_out = sizeof(out);
+	zerr = inflate(&zs, Z_NO_FLUSH);
+	if (zerr != Z_OK && zerr != Z_STREAM_END) {
+	    g_fprintf(stderr, "inflate failed: %d\n", zerr);
+	    success = 0;
+	    break;
+	}
+	if (!simpleprng_verify_buffer(&prng, out, sizeof(out) - zs.avail_out)) {
+	    success = 0;
+	    break;
+	}
+	total += sizeof(out) - zs.avail_out;
+	if (zerr == Z_STREAM_END && zs.avail_in > 0)
+	    inflateReset(&zs);
+    } while (zerr == Z_OK || zs.avail_in > 0);
+    inflateEnd(&zs);
+
+    if (success && total != length) {
+	g_fprintf(stderr, "got %ju bytes back; expected %ju\n",
+		(uintmax_t)total, (uintmax_t)length);
+	success = 0;
+    }
+
+    xfer_unref(xfer);
+
+    return success;
+}
+#endif
+
 /*****
  * test each possible combination of source and destination mechansim
  */
 
-static int
-test_glue_combo(
+/* run a transfer from SOURCE to DEST, returning the (still referenced) Xfer */
+static Xfer *
+run_glue_xfer(
     XferElement *source,
-    XferElement *dest)
+    XferElement *dest,
+    gsize buffer_size,
+    guint ring_depth)
 {
     unsigned int i;
     GSource *src;
     XferElement *elements[] = { source, dest };
 
     Xfer *xfer = xfer_new(elements, sizeof(elements)/sizeof(*elements));
+    if (buffer_size || ring_depth)
+	xfer_set_buffer_size(xfer, buffer_size, ring_depth);
     src = xfer_get_source(xfer);
     g_source_set_callback(src, (GSourceFunc)test_xfer_generic_callback, NULL, NULL);
     g_source_attach(src, NULL);
@@ -1031,7 +1127,15 @@ test_glue_combo(
     g_main_loop_run(default_main_loop());
     g_assert(xfer->status == XFER_DONE);
 
-    xfer_unref(xfer);
+    return xfer;
+}
+
+static int
+test_glue_combo(
+    XferElement *source,
+    XferElement *dest)
+{
+    xfer_unref(run_glue_xfer(source, dest, 0, 0));
 
     return 1;
 }
@@ -1058,6 +1162,34 @@ make_test_glue(test_glue_PULL_WRITE, XFER_SOURCE_PULL_TYPE, XFER_DEST_WRITEFD_TY
 make_test_glue(test_glue_PULL_PUSH, XFER_SOURCE_PULL_TYPE, XFER_DEST_PUSH_TYPE)
 make_test_glue(test_glue_PULL_PULL, XFER_SOURCE_PULL_TYPE, XFER_DEST_PULL_TYPE)
 
+/*****
+ * test the buffer pool with small buffers and a shallow ring
+ */
+
+static int
+test_glue_buffer_pool(void)
+{
+    Xfer *xfer;
+
+    /* the glue reads block-sized buffers, and the destination hands them
+     * back, so all but the first few should be recycled */
+    xfer = run_glue_xfer((XferElement *)g_object_new(XFER_SOURCE_READFD_TYPE, NULL),
+			 (XferElement *)g_object_new(XFER_DEST_PUSH_TYPE, NULL),
+			 TEST_BLOCK_SIZE, 0);
+    g_assert(xfer->buffers_allocated > 0);
+    g_assert(xfer->buffers_reused > 0);
+    g_assert(xfer->buffers_allocated + xfer->buffers_reused > TEST_BLOCK_COUNT);
+    xfer_unref(xfer);
+
+    /* a two-element ring between a pusher and a puller */
+    xfer = run_glue_xfer((XferElement *)g_object_new(XFER_SOURCE_PUSH_TYPE, NULL),
+			 (XferElement *)g_object_new(XFER_DEST_PULL_TYPE, NULL),
+			 TEST_BLOCK_SIZE, 2);
+    xfer_unref(xfer);
+
+    return 1;
+}
+
 /*
  * Main driver
  */
@@ -1069,6 +1201,9 @@ main(int argc, char **argv)
 	TU_TEST(test_xfer_simple, 90),
 	TU_TEST(test_xfer_files_simple, 90),
 	TU_TEST(test_xfer_files_filter, 90),
+#ifdef HAVE_ZLIB
+	TU_TEST(test_xfer_gzip, 90),
+#endif
         TU_TEST(test_glue_READFD_READFD, 90),
         TU_TEST(test_glue_READFD_WRITE, 90),
         TU_TEST(test_glue_READFD_PUSH, 90),
@@ -1085,6 +1220,7 @@ main(int argc, char **argv)
         TU_TEST(test_glue_PULL_WRITE, 90),
         TU_TEST(test_glue_PULL_PUSH, 90),
         TU_TEST(test_glue_PULL_PULL, 90),
+        TU_TEST(test_glue_buffer_pool, 90),
 	TU_END()
     };
 
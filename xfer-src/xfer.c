@@ -36,6 +36,13 @@ typedef struct XMsgSource {
     Xfer *xfer;
 } XMsgSource;
 
+/* default buffer size, and the amount of data the ring buffers should be able
+ * to hold when their depth is chosen automatically */
+#define XFER_DEFAULT_BUFFER_SIZE 32768
+#define XFER_RING_MEMORY (4*1024*1024)
+#define XFER_MIN_RING_DEPTH 4
+#define XFER_MAX_RING_DEPTH 256
+
 /* forward prototypes */
 static void xfer_set_status(Xfer *xfer, xfer_status status);
 static XMsgSource *xmsgsource_new(Xfer *xfer);
@@ -59,6 +66,10 @@ xfer_new(
     xfer->refcount = 1;
     xfer->repr = NULL;
 
+    xfer->buffer_mutex = g_mutex_new();
+    xfer->buffer_size = XFER_DEFAULT_BUFFER_SIZE;
+    xfer->ring_depth = 0;
+
     /* Create our message source and corresponding queue */
     xfer->msg_source = xmsgsource_new(xfer);
     g_source_ref((GSource *)xfer->msg_source);
@@ -117,6 +128,10 @@ xfer_unref(
     g_mutex_free(xfer->status_mutex);
     g_cond_free(xfer->status_cond);
 
+    while (xfer->free_buffers)
+	g_free(g_trash_stack_pop(&xfer->free_buffers));
+    g_mutex_free(xfer->buffer_mutex);
+
     /* Free our references to the elements, and also set the 'xfer'
      * attribute of each to NULL, making them "unattached" (although 
      * subsequent reuse of elements is untested). */
@@ -170,6 +185,90 @@ xfer_repr(
     return xfer->repr;
 }
 
+void
+xfer_set_buffer_size(
+    Xfer *xfer,
+    gsize buffer_size,
+    guint ring_depth)
+{
+    g_assert(xfer->status == XFER_INIT || xfer->status == XFER_START);
+
+    /* the pool keeps its free list inside the buffers themselves */
+    if (buffer_size)
+	buffer_size = MAX(buffer_size, sizeof(GTrashStack));
+
+    g_mutex_lock(xfer->buffer_mutex);
+    if (buffer_size && buffer_size != xfer->buffer_size) {
+	/* pooled buffers may be too small now */
+	while (xfer->free_buffers)
+	    g_free(g_trash_stack_pop(&xfer->free_buffers));
+	xfer->n_free_buffers = 0;
+	xfer->buffer_size = buffer_size;
+    }
+    xfer->ring_depth = ring_depth;
+    g_mutex_unlock(xfer->buffer_mutex);
+}
+
+guint
+xfer_get_ring_depth(
+    Xfer *xfer)
+{
+    gsize depth;
+
+    if (xfer->ring_depth)
+	return xfer->ring_depth;
+
+    /* enough buffers to hold XFER_RING_MEMORY, within reason */
+    depth = XFER_RING_MEMORY / xfer->buffer_size;
+    return (guint)CLAMP(depth, XFER_MIN_RING_DEPTH, XFER_MAX_RING_DEPTH);
+}
+
+gpointer
+xfer_get_buffer(
+    Xfer *xfer,
+    gsize *size)
+{
+    gpointer buf;
+
+    g_mutex_lock(xfer->buffer_mutex);
+    *size = xfer->buffer_size;
+    if (xfer->free_buffers) {
+	buf = g_trash_stack_pop(&xfer->free_buffers);
+	xfer->n_free_buffers--;
+	xfer->buffers_reused++;
+	g_mutex_unlock(xfer->buffer_mutex);
+    } else {
+	xfer->buffers_allocated++;
+	g_mutex_unlock(xfer->buffer_mutex);
+	buf = g_malloc(*size);
+    }
+
+    return buf;
+}
+
+void
+xfer_release_buffer(
+    Xfer *xfer,
+    gpointer buf,
+    gsize len)
+{
+    if (!buf)
+	return;
+
+    /* a buffer holding at least buffer_size bytes is big enough to reuse, no
+     * matter who allocated it; keep no more than one ring's worth */
+    g_mutex_lock(xfer->buffer_mutex);
+    if (len >= xfer->buffer_size
+	    && xfer->n_free_buffers < xfer_get_ring_depth(xfer)) {
+	g_trash_stack_push(&xfer->free_buffers, buf);
+	xfer->n_free_buffers++;
+	buf = NULL;
+    }
+    g_mutex_unlock(xfer->buffer_mutex);
+
+    g_free(buf);
+}
+
 void
 xfer_start(
     Xfer *xfer)
@@ -541,6 +640,9 @@ xmsgsource_dispatch(
 		     * of this loop after delivering the message to the user */
 		    xfer_set_status(xfer, XFER_DONE);
 		    xfer_done = TRUE;
+		    g_debug("%s: %ju buffers allocated, %ju reused", xfer_repr(xfer),
+			    (uintmax_t)xfer->buffers_allocated,
+			    (uintmax_t)xfer->buffers_reused);
 		} else {
 		    /* eat this XMSG_DONE, since we expect more */
 		    deliver_to_caller = FALSE;
@@ -86,6 +86,21 @@ struct Xfer {
     /* Number of active elements remaining (a.k.a. the number of
      * XMSG_DONE messages to expect) */
     gint num_active_elements;
+
+    /* Pool of recycled data buffers, all at least buffer_size bytes, and the
+     * depth of the glue's ring buffers; see xfer_set_buffer_size.  Protected
+     * by buffer_mutex. */
+    GMutex *buffer_mutex;
+    GTrashStack *free_buffers;
+    guint n_free_buffers;
+    gsize buffer_size;
+    guint ring_depth;
+
+    /* Statistics for the buffer pool: the number of buffers allocated afresh,
+     * and the number handed out again from the pool.  These are logged when
+     * the transfer is done. */
+    guint64 buffers_allocated;
+    guint64 buffers_reused;
 };
 
 typedef struct Xfer Xfer;
@@ -149,6 +164,46 @@ void xfer_queue_message(Xfer *xfer, struct XMsg *msg);
  */
 char *xfer_repr(Xfer *xfer);
 
+/* Set the size of the data buffers allocated for this transfer, and the depth
+ * of the ring buffers between its elements.  This must be called before the
+ * transfer is started, or from an element's setup method; it is typically
+ * called by a destination element with the block size of its device.
+ *
+ * @param xfer: the Xfer object
+ * @param buffer_size: buffer size in bytes, or zero to leave it unchanged
+ * @param ring_depth: number of buffers in each ring, or zero to pick a depth
+ *     based on the buffer size
+ */
+void xfer_set_buffer_size(Xfer *xfer, gsize buffer_size, guint ring_depth);
+
+/* Get a data buffer from this transfer's buffer pool, allocating one if the
+ * pool is empty.  The buffer is an ordinary g_malloc'd buffer, so it may be
+ * freed with g_free, but it is better to hand it back with
+ * xfer_release_buffer.  This can be called in any thread.
+ *
+ * @param xfer: the Xfer object
+ * @param size: (output) the size of the buffer
+ * @returns: the buffer
+ */
+gpointer xfer_get_buffer(Xfer *xfer, gsize *size);
+
+/* Return a buffer to this transfer's buffer pool, or free it.  The buffer
+ * need not have come from xfer_get_buffer; any buffer holding LEN bytes of
+ * data will do.  This can be called in any thread.
+ *
+ * @param xfer: the Xfer object
+ * @param buf: the buffer (may be NULL)
+ * @param len: number of bytes of data that the buffer holds
+ */
+void xfer_release_buffer(Xfer *xfer, gpointer buf, gsize len);
+
+/* Get the depth of the ring buffers for this transfer.
+ *
+ * @param xfer: the Xfer object
+ * @returns: ring depth
+ */
+guint xfer_get_ring_depth(Xfer *xfer);
+
 /* Start a transfer.  This function will fail with an error message if it is
  * unable to set up the transfer (e.g., if the elements cannot be connected
  * correctly).